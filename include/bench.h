@@ -0,0 +1,2112 @@
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+#include <stdio.h>
+#include <algorithm>
+#include <vector>
+#include <mg.h>
+#include <volume.h>
+#include <probes.h>
+#include <shadow.h>
+#include <render.h>
+#include <frame.h>
+
+//////////////////////////////////////////////////////////////////////////////
+// CPU benchmarks, run with `main.exe -bench [max volume size]`
+
+struct bench_scene
+{
+	volume				Volume;
+	raymarch_params		Params;
+	grid_params			Grid;
+	m4					World,
+						InvWorld;
+};
+
+// One row of the probe error analysis, errors are absolute transmittance
+struct probe_error_stats
+{
+	v3i		Dims;
+	u32		ProbeCount;
+	f32		MemoryMB;
+	f64		BakeMs;
+	f32		Mean,
+			P50,
+			P90,
+			P99,
+			Max;
+};
+
+// Difference of an image against a reference, over every channel
+struct image_diff
+{
+	f32		RMSE,
+			PSNR,		// dB, against a peak of 1
+			MaxError,
+			OverThreshold;	// fraction of pixels with any channel further off than the threshold
+};
+
+void	InitBenchScene(bench_scene *Scene, u32 VolumeSize, v3i ProbeDims);
+void	RunBenchmarks(u32 MaxVolumeSize);
+void	DiffImages(image *Image, image *Reference, f32 Threshold, image_diff *Diff);
+void	PrintImageDiffHeader(void);
+void	PrintImageDiff(char const *Name, f64 Ms, image_diff *Diff);
+void	PrintCameraPathHeader(void);
+void	ReplayCameraPath(render_scene *Scene, camera_path *Path, char const *Name, u32 Width, u32 Height, f32 CoarseStep, u32 MaxFrames, image *Final);
+void	AnalyzeProbeGrid(volume *Volume, raymarch_params *Params, m4 &World, v3i Dims, std::vector<v3> &Points, std::vector<v4> &Reference, probe_error_stats *Stats);
+f32		Percentile(std::vector<f32> &Sorted, f32 P);
+void	GenerateAnalysisPoints(volume *Volume, raymarch_params *Params, m4 &World, u32 SampleCount, std::vector<v3> &Points, std::vector<v4> &Reference);
+void	RunProbeAnalysis(volume *Volume, raymarch_params *Params, m4 &World, u32 SampleCount, f32 TargetError, b32 Csv);
+void	RunPipelineTest(job_system *Jobs, u32 FrameCount);
+void	RunParamChannelTest(u32 ReaderCount, u32 PublishCount);
+
+#ifdef BENCH_IMPL
+
+// Keeps the optimizer from throwing away the work we're timing
+volatile f32	gBenchSink;
+
+void
+InitBenchScene(bench_scene *Scene,
+			   u32 VolumeSize,
+			   v3i ProbeDims)
+{
+	v3		Scale = v3(5.f, 5.f, 5.f);
+	f32		MinVal,
+			MaxVal;
+
+
+	GenerateNoiseVolume(&Scene->Volume, VolumeSize, VolumeSize, VolumeSize, &MinVal, &MaxVal);
+
+	Scene->Params = {};
+	Scene->Params.MinVal = MinVal;
+	Scene->Params.MaxVal = MaxVal;
+	Scene->Params.LightCount = 1;
+	Scene->Params.Lights[0] = PointLight(v3(7, 8, -2), v3(1, 1, 1), 1.0f);
+	Scene->Params.Absorption = 1.0f;
+	Scene->Params.DensityScale = 1.0f;
+	Scene->Params.LightingMode = LIGHTING_PROBES;
+	Scene->Params.Ambient = 0.1f;
+
+	Scene->World = Mat4Scale(Scale);
+	Scene->InvWorld = Mat4Inverse(Scene->World);
+
+	InitGridParams(&Scene->Grid, ProbeDims, v3(0, 0, 0), Scale, LAYOUT_LINEAR);
+}
+
+// ns per sample for fully random trilinear fetches
+f64
+BenchRandomSamples(volume *Volume,
+				   u32 Count)
+{
+	random_series	Series = RandomSeed(1234, 1);
+	f32				Sum = 0;
+	u64				Start,
+					End;
+
+
+	Start = ReadTimer();
+	for (u32 I = 0; I < Count; I++)
+	{
+		v3 Pos = v3(RandomUnilateral(&Series), RandomUnilateral(&Series), RandomUnilateral(&Series));
+
+		Sum += SampleVolume(Volume, Pos);
+	}
+	End = ReadTimer();
+
+	gBenchSink = Sum;
+
+	return (TimerSeconds(Start, End) * 1e9 / Count);
+}
+
+// ns per sample for light marches from random points, i.e. the access
+// pattern of the baker
+f64
+BenchRaySamples(bench_scene *Scene,
+				u32 RayCount)
+{
+	random_series	Series = RandomSeed(5678, 1);
+	f32				Sum = 0;
+	u64				Start,
+					End;
+
+
+	Start = ReadTimer();
+	for (u32 I = 0; I < RayCount; I++)
+	{
+		v3 Pos = Scene->Grid.GridMin + Hadamard(Scene->Grid.GridExtents,
+			v3(RandomUnilateral(&Series), RandomUnilateral(&Series), RandomUnilateral(&Series)));
+
+		Sum += Lightmarch(&Scene->Volume, &Scene->Grid, &Scene->Params, Scene->InvWorld, &Scene->Params.Lights[0], Pos);
+	}
+	End = ReadTimer();
+
+	gBenchSink = Sum;
+
+	return (TimerSeconds(Start, End) * 1e9 / (f64(RayCount) * LIGHTMARCH_STEPS));
+}
+
+// ms for a full CPU bake of the scene's probe grid
+f64
+BenchBake(bench_scene *Scene,
+		  std::vector<probe> &Probes)
+{
+	u64		Start,
+			End;
+
+
+	Probes.assign(ProbeStorageCount(&Scene->Grid), probe{});
+
+	Start = ReadTimer();
+	BakeProbes(Probes.data(), &Scene->Volume, &Scene->Grid, &Scene->Params, Scene->InvWorld);
+	End = ReadTimer();
+
+	return (TimerSeconds(Start, End) * 1e3);
+}
+
+// ns per probe lookup, marching coherent rays through the grid the way the
+// raymarch shader does
+f64
+BenchProbeLookups(probe *Probes,
+				  grid_params *Grid,
+				  u32 Filter,
+				  u32 RayCount,
+				  u32 StepCount)
+{
+	random_series	Series = RandomSeed(91011, 1);
+	f32				Sum = 0;
+	u64				Start,
+					End;
+
+
+	Start = ReadTimer();
+	for (u32 I = 0; I < RayCount; I++)
+	{
+		v3 Origin = Grid->GridMin + Hadamard(Grid->GridExtents,
+			v3(RandomUnilateral(&Series), RandomUnilateral(&Series), 0));
+		v3 Dir = Normalize(v3(RandomBilateral(&Series) * 0.5f, RandomBilateral(&Series) * 0.5f, 1));
+		f32 dt = Grid->GridExtents.z / StepCount;
+
+		for (u32 Step = 0; Step < StepCount; Step++)
+		{
+			Sum += SampleProbes(Probes, Grid, Origin + (Step * dt) * Dir, Filter).x;
+		}
+	}
+	End = ReadTimer();
+
+	gBenchSink = Sum;
+
+	return (TimerSeconds(Start, End) * 1e9 / (f64(RayCount) * StepCount));
+}
+
+void
+BenchLayouts(u32 MaxVolumeSize)
+{
+	bench_scene				Scene;
+	std::vector<probe>		Probes;
+
+
+	printf("\n== Volume layout (CPU sampler and baker, 32^3 probes) ==\n");
+	printf("%-8s %-12s %14s %14s %12s\n", "Volume", "Layout", "random ns", "ray ns", "bake ms");
+
+	for (u32 Size = 64; Size <= MaxVolumeSize; Size *= 2)
+	{
+		InitBenchScene(&Scene, Size, v3i(32, 32, 32));
+
+		for (u32 Layout = 0; Layout < LAYOUT_COUNT; Layout++)
+		{
+			SetVolumeLayout(&Scene.Volume, Layout);
+
+			f64 RandomNs = BenchRandomSamples(&Scene.Volume, 1 << 22);
+			f64 RayNs = BenchRaySamples(&Scene, 1 << 14);
+			f64 BakeMs = BenchBake(&Scene, Probes);
+
+			printf("%-8u %-12s %14.2f %14.2f %12.2f\n", Size, LayoutNames[Layout], RandomNs, RayNs, BakeMs);
+		}
+	}
+
+	printf("\n== Probe layout (CPU lookups along coherent rays) ==\n");
+	printf("%-8s %-12s %14s\n", "Probes", "Layout", "lookup ns");
+
+	for (s32 Dim = 32; Dim <= 128; Dim *= 2)
+	{
+		grid_params Grid;
+
+		InitGridParams(&Grid, v3i(Dim, Dim, Dim), v3(0, 0, 0), v3(5, 5, 5), LAYOUT_LINEAR);
+		Probes.assign(ProbeStorageCount(&Grid), probe{});
+
+		// Lookup cost doesn't depend on the values, so skip the bake and just
+		// fill in something smooth
+		for (s32 Z = 0; Z < Dim; Z++)
+		{
+			for (s32 Y = 0; Y < Dim; Y++)
+			{
+				for (s32 X = 0; X < Dim; X++)
+				{
+					probe *Probe = &Probes[GridCoordToProbeIndex(&Grid, v3i(X, Y, Z))];
+
+					Probe->Position = GridCoordToPosition(&Grid, v3i(X, Y, Z));
+					f32 T = f32(X + Y + Z) / (3 * Dim);
+
+					Probe->Transmittance = v4(T, T, T, T);
+				}
+			}
+		}
+
+		for (u32 Layout = 0; Layout < LAYOUT_COUNT; Layout++)
+		{
+			ConvertProbeLayout(Probes, &Grid, Layout);
+
+			f64 LookupNs = BenchProbeLookups(Probes.data(), &Grid, PROBE_FILTER_TRILINEAR, 1 << 14, 128);
+
+			printf("%-8d %-12s %14.2f\n", Dim, LayoutNames[Layout], LookupNs);
+		}
+	}
+}
+
+// One bake with every light marched together against one bake per light
+void
+BenchLights(void)
+{
+	bench_scene				Scene;
+	std::vector<probe>		Probes;
+	light					Lights[MAX_LIGHTS] =
+	{
+		PointLight(v3(7, 8, -2), v3(1, 1, 1), 1.0f),
+		PointLight(v3(-3, 6, 7), v3(1, 0.8f, 0.6f), 0.5f),
+		DirectionalLight(v3(1, 1, 1), v3(0.6f, 0.7f, 1), 0.3f),
+		PointLight(v3(2.5f, -4, 2.5f), v3(1, 1, 1), 0.2f),
+	};
+
+
+	printf("\n== Lights (CPU bake, 128^3 volume, 32^3 probes) ==\n");
+	printf("%-8s %14s %14s\n", "Lights", "separate ms", "together ms");
+
+	InitBenchScene(&Scene, 128, v3i(32, 32, 32));
+	memcpy(Scene.Params.Lights, Lights, sizeof(Lights));
+
+	for (u32 Count = 1; Count <= MAX_LIGHTS; Count++)
+	{
+		f64 SeparateMs = 0;
+
+		for (u32 L = 0; L < Count; L++)
+		{
+			raymarch_params Params = Scene.Params;
+
+			Scene.Params.LightCount = 1;
+			Scene.Params.Lights[0] = Lights[L];
+			SeparateMs += BenchBake(&Scene, Probes);
+			Scene.Params = Params;
+		}
+
+		Scene.Params.LightCount = Count;
+		f64 TogetherMs = BenchBake(&Scene, Probes);
+
+		printf("%-8u %14.2f %14.2f\n", Count, SeparateMs, TogetherMs);
+	}
+}
+
+// Lookup cost and interpolation error of each filter against the grid size.
+// The question is whether a cubic filter on a coarser grid can match
+// trilinear on a finer one for less bake time.
+void
+BenchFilters(void)
+{
+	static const s32		Resolutions[] = { 16, 24, 32, 48 };
+	bench_scene				Scene;
+	std::vector<v3>			Points;
+	std::vector<v4>			Reference;
+	std::vector<probe>		Probes;
+
+
+	printf("\n== Probe filters (128^3 volume, 4096 samples) ==\n");
+	printf("%-8s %-12s %12s %12s %12s %12s\n", "Probes", "Filter", "lookup ns", "bake ms", "mean", "p99");
+
+	InitBenchScene(&Scene, 128, v3i(32, 32, 32));
+	GenerateAnalysisPoints(&Scene.Volume, &Scene.Params, Scene.World, 4096, Points, Reference);
+
+	for (u32 R = 0; R < sizeof(Resolutions) / sizeof(Resolutions[0]); R++)
+	{
+		s32 Dim = Resolutions[R];
+
+		InitGridParams(&Scene.Grid, v3i(Dim, Dim, Dim), v3(0, 0, 0), v3(5, 5, 5), LAYOUT_LINEAR);
+		Probes.resize(ProbeStorageCount(&Scene.Grid));
+		BakeProbes(Probes.data(), &Scene.Volume, &Scene.Grid, &Scene.Params, Scene.InvWorld);
+
+		for (u32 Filter = 0; Filter < PROBE_FILTER_COUNT; Filter++)
+		{
+			probe_error_stats Stats;
+
+			Scene.Params.ProbeFilter = Filter;
+			AnalyzeProbeGrid(&Scene.Volume, &Scene.Params, Scene.World, Scene.Grid.GridDims, Points, Reference, &Stats);
+
+			f64 LookupNs = BenchProbeLookups(Probes.data(), &Scene.Grid, Filter, 1 << 12, 128);
+
+			printf("%-8d %-12s %12.2f %12.1f %12.5f %12.5f\n", Dim, ProbeFilterNames[Filter], LookupNs,
+				   Stats.BakeMs, Stats.Mean, Stats.P99);
+		}
+	}
+
+	Scene.Params.ProbeFilter = PROBE_FILTER_TRILINEAR;
+}
+
+// Mean and p99 of the worst light's error at each point
+void
+LookupErrorStats(std::vector<v4> &Lookups,
+				 std::vector<v4> &Reference,
+				 u32 LightCount,
+				 f32 *Mean,
+				 f32 *P99)
+{
+	std::vector<f32>	Errors(Lookups.size());
+	f64					ErrorSum = 0;
+
+
+	for (u32 I = 0; I < Lookups.size(); I++)
+	{
+		Errors[I] = 0;
+		for (u32 L = 0; L < LightCount; L++)
+		{
+			Errors[I] = _Max(Errors[I], Abs(Lookups[I].Elements[L] - Reference[I].Elements[L]));
+		}
+		ErrorSum += Errors[I];
+	}
+	std::sort(Errors.begin(), Errors.end());
+
+	*Mean = f32(ErrorSum / Lookups.size());
+	*P99 = Percentile(Errors, 0.99f);
+}
+
+// Probe grids against the shadow volume and deep shadow maps for the same
+// lights: build time, lookup cost along coherent rays and error against the
+// lightmarch
+void
+BenchShadowVolume(u32 MaxVolumeSize)
+{
+	static const s32		Resolutions[] = { 16, 32, 64 };
+	bench_scene				Scene;
+	std::vector<v3>			Points;
+	std::vector<v4>			Reference;
+	std::vector<probe>		Probes;
+	shadow_volume			Shadow;
+	deep_shadow_map			DeepShadow;
+	light_aligned_cache		AlignedCache = {};
+	std::vector<v4>			Lookups(4096);
+	f32						Mean,
+							P99;
+
+
+	printf("\n== Shadow volume and deep shadow map vs probes (4096 samples, point + directional light) ==\n");
+	printf("%-8s %-14s %12s %12s %12s %12s\n", "Volume", "Lighting", "build ms", "lookup ns", "mean", "p99");
+
+	for (u32 Size = 64; Size <= _Min(MaxVolumeSize, 256u); Size *= 2)
+	{
+		InitBenchScene(&Scene, Size, v3i(32, 32, 32));
+		Scene.Params.LightCount = 2;
+		Scene.Params.Lights[1] = DirectionalLight(v3(-1, 2, 0.5f), v3(1, 1, 1), 1.0f);
+		GenerateAnalysisPoints(&Scene.Volume, &Scene.Params, Scene.World, 4096, Points, Reference);
+
+		for (u32 R = 0; R < sizeof(Resolutions) / sizeof(Resolutions[0]); R++)
+		{
+			probe_error_stats	Stats;
+			s32					Dim = Resolutions[R];
+			char				Name[32];
+
+			InitGridParams(&Scene.Grid, v3i(Dim, Dim, Dim), v3(0, 0, 0), v3(5, 5, 5), LAYOUT_LINEAR);
+			AnalyzeProbeGrid(&Scene.Volume, &Scene.Params, Scene.World, Scene.Grid.GridDims, Points, Reference, &Stats);
+
+			Probes.resize(ProbeStorageCount(&Scene.Grid));
+			BakeProbes(Probes.data(), &Scene.Volume, &Scene.Grid, &Scene.Params, Scene.InvWorld);
+			f64 LookupNs = BenchProbeLookups(Probes.data(), &Scene.Grid, PROBE_FILTER_TRILINEAR, 1 << 12, 128);
+
+			snprintf(Name, sizeof(Name), "Probes %d^3", Dim);
+			printf("%-8u %-14s %12.1f %12.2f %12.5f %12.5f\n", Size, Name, Stats.BakeMs, LookupNs, Stats.Mean, Stats.P99);
+		}
+
+		u64 Start = ReadTimer();
+		BuildShadowVolume(&Shadow, &Scene.Volume, &Scene.Params, Scene.World);
+		f64 BuildMs = TimerSeconds(Start, ReadTimer()) * 1e3;
+
+		for (u32 I = 0; I < Points.size(); I++)
+		{
+			v4 TexPos = Scene.InvWorld * v4(Points[I].x, Points[I].y, Points[I].z, 1);
+
+			Lookups[I] = SampleShadowVolume(&Shadow, v3(TexPos.x, TexPos.y, TexPos.z));
+		}
+		LookupErrorStats(Lookups, Reference, Scene.Params.LightCount, &Mean, &P99);
+
+		// Same coherent rays as BenchProbeLookups(), in texture space
+		random_series Series = RandomSeed(91011, 1);
+		f32 Sum = 0;
+
+		Start = ReadTimer();
+		for (u32 I = 0; I < (1 << 12); I++)
+		{
+			v3 Origin = v3(RandomUnilateral(&Series), RandomUnilateral(&Series), 0);
+			v3 Dir = Normalize(v3(RandomBilateral(&Series) * 0.5f, RandomBilateral(&Series) * 0.5f, 1));
+
+			for (u32 Step = 0; Step < 128; Step++)
+			{
+				Sum += SampleShadowVolume(&Shadow, Origin + (Step / 128.0f) * Dir).x;
+			}
+		}
+		f64 LookupNs = TimerSeconds(Start, ReadTimer()) * 1e9 / (f64(1 << 12) * 128);
+		gBenchSink = Sum;
+
+		printf("%-8u %-14s %12.1f %12.2f %12.5f %12.5f\n", Size, "Shadow volume", BuildMs, LookupNs, Mean, P99);
+
+		// The deep shadow map's resolution is independent of the volume's.
+		// Each volume size is its own key for the light aligned cache.
+		for (u32 MapSize = 128; MapSize <= 256; MapSize *= 2)
+		{
+			char Name[32];
+
+			Start = ReadTimer();
+			b32 Built = BuildDeepShadowMap(&DeepShadow, &Scene.Volume, &Scene.Params, Scene.World, MapSize, &AlignedCache, Size);
+			BuildMs = TimerSeconds(Start, ReadTimer()) * 1e3;
+
+			// Same light directions, so the directional light skips the
+			// resample
+			Start = ReadTimer();
+			Built &= BuildDeepShadowMap(&DeepShadow, &Scene.Volume, &Scene.Params, Scene.World, MapSize, &AlignedCache, Size);
+			f64 CachedMs = TimerSeconds(Start, ReadTimer()) * 1e3;
+
+			if (!Built)
+			{
+				printf("Out of scratch memory building the %u^2 deep shadow map\n", MapSize);
+			}
+
+			for (u32 I = 0; I < Points.size(); I++)
+			{
+				Lookups[I] = SampleDeepShadowMap(&DeepShadow, &Scene.Params, Points[I]);
+			}
+			LookupErrorStats(Lookups, Reference, Scene.Params.LightCount, &Mean, &P99);
+
+			Series = RandomSeed(91011, 1);
+			Sum = 0;
+
+			Start = ReadTimer();
+			for (u32 I = 0; I < (1 << 12); I++)
+			{
+				v3 Origin = v3(RandomUnilateral(&Series), RandomUnilateral(&Series), 0);
+				v3 Dir = Normalize(v3(RandomBilateral(&Series) * 0.5f, RandomBilateral(&Series) * 0.5f, 1));
+
+				for (u32 Step = 0; Step < 128; Step++)
+				{
+					v3 TexPos = Origin + (Step / 128.0f) * Dir;
+					v4 Pos = Scene.World * v4(TexPos.x, TexPos.y, TexPos.z, 1);
+
+					Sum += SampleDeepShadowMap(&DeepShadow, &Scene.Params, v3(Pos.x, Pos.y, Pos.z)).x;
+				}
+			}
+			LookupNs = TimerSeconds(Start, ReadTimer()) * 1e9 / (f64(1 << 12) * 128);
+			gBenchSink = Sum;
+
+			snprintf(Name, sizeof(Name), "Deep map %u^2", MapSize);
+			printf("%-8u %-14s %12.1f %12.2f %12.5f %12.5f\n", Size, Name, BuildMs, LookupNs, Mean, P99);
+			printf("%-8s %-14s %12.1f\n", "", "  cached", CachedMs);
+		}
+	}
+}
+
+// Root mean square difference over every channel
+f32
+ImageRMSE(image *A,
+		  image *B)
+{
+	f64		Sum = 0;
+
+
+	for (u64 I = 0; I < A->Pixels.size(); I++)
+	{
+		for (u32 C = 0; C < 4; C++)
+		{
+			f64 Diff = A->Pixels[I].Elements[C] - B->Pixels[I].Elements[C];
+
+			Sum += Diff * Diff;
+		}
+	}
+
+	return (f32(sqrt(Sum / (A->Pixels.size() * 4))));
+}
+
+void
+DiffImages(image *Image,
+		   image *Reference,
+		   f32 Threshold,
+		   image_diff *Diff)
+{
+	f64		Sum = 0;
+	u64		Over = 0;
+
+
+	Diff->MaxError = 0;
+
+	for (u64 I = 0; I < Image->Pixels.size(); I++)
+	{
+		f32 PixelMax = 0;
+
+		for (u32 C = 0; C < 4; C++)
+		{
+			f32 Error = fabsf(Image->Pixels[I].Elements[C] - Reference->Pixels[I].Elements[C]);
+
+			Sum += f64(Error) * Error;
+			PixelMax = _Max(PixelMax, Error);
+		}
+
+		Diff->MaxError = _Max(Diff->MaxError, PixelMax);
+		Over += PixelMax > Threshold;
+	}
+
+	u64 Count = _Max(u64(Image->Pixels.size()), u64(1));
+
+	Diff->RMSE = f32(sqrt(Sum / (Count * 4)));
+	Diff->PSNR = Diff->RMSE > 0 ? -20.0f * log10f(Diff->RMSE) : INFINITY;
+	Diff->OverThreshold = f32(f64(Over) / Count);
+}
+
+void
+PrintImageDiffHeader(void)
+{
+	printf("%-16s %10s %10s %10s %10s %10s\n", "Image", "ms", "RMSE", "PSNR", "max", "% > 1/64");
+}
+
+void
+PrintImageDiff(char const *Name,
+			   f64 Ms,
+			   image_diff *Diff)
+{
+	printf("%-16s %10.1f %10.5f %10.2f %10.5f %10.2f\n", Name, Ms, Diff->RMSE, Diff->PSNR, Diff->MaxError,
+		   100.0f * Diff->OverThreshold);
+}
+
+// RenderVolumeTracked() one ray at a time through DeltaTrackRay(), the
+// reference its ray_batch packets are timed and checked against. Same
+// series, same draws, so the sums should match to the bit.
+void
+RenderVolumeTrackedSingle(image_accumulator *Accum,
+						  render_scene *Scene,
+						  majorant_grid *Majorants,
+						  m4 &View,
+						  m4 &Proj,
+						  u32 SamplesPerPixel)
+{
+	derived_params		Derived;
+
+
+	if (Accum->Sum.size() != u64(Accum->Width) * Accum->Height)
+	{
+		Accum->Sum.assign(u64(Accum->Width) * Accum->Height, v4(0, 0, 0, 0));
+		Accum->SampleCount = 0;
+	}
+
+	DeriveParams(&Derived, Scene->World, View, Proj, Scene->Volume, Scene->Params);
+
+	ParallelFor2D(Accum->Width, Accum->Height, RENDER_TILE, RENDER_TILE, [&](job_range Range)
+	{
+		for (u32 Y = u32(Range.Min.y); Y < u32(Range.Max.y); Y++)
+		{
+			for (u32 X = u32(Range.Min.x); X < u32(Range.Max.x); X++)
+			{
+				u64 Pixel = u64(Y) * Accum->Width + X;
+				random_series Series = RandomSeed(Accum->PassCount, Pixel);
+				v4 Sum = v4(0, 0, 0, 0);
+
+				for (u32 S = 0; S < SamplesPerPixel; S++)
+				{
+					f32 PixelX = X + RandomUnilateral(&Series);
+					f32 PixelY = Y + RandomUnilateral(&Series);
+					v3 Origin, Dir;
+					f32 tMin, tMax;
+
+					if (PixelRayBox(&Derived, PixelX, PixelY, Accum->Width, Accum->Height, &Origin, &Dir, &tMin, &tMax))
+					{
+						Sum += DeltaTrackRay(Scene, Majorants, Origin, Dir, tMin, tMax, &Series);
+					}
+				}
+
+				Accum->Sum[Pixel] += Sum;
+			}
+		}
+	});
+
+	Accum->SampleCount += SamplesPerPixel;
+	Accum->PassCount++;
+}
+
+// Fixed step marching against delta/ratio tracking, both against a long
+// tracked render. The march has no noise but is biased by its step, the
+// tracker's error is only noise.
+void
+BenchTracking(void)
+{
+	bench_scene				Scene;
+	render_scene			Render = {};
+	majorant_grid			Majorants;
+	image_accumulator		Accum = {};
+	image					Reference,
+							Image;
+	m4						View = Mat4LookAtLH(v3(3, 1.5f, -3.5f), v3(3, 1.5f, -3.5f) + v3(-0.5f, -0.25f, 0.8f), v3(0, 1, 0)),
+							Proj = Mat4PerspectiveLH(45.0f, 16.0f / 9.0f, 0.1f, 1000.0f);
+
+
+	printf("\n== Tracking vs marching (96x54, 64^3, reference 1024 spp tracked) ==\n");
+	printf("%-16s %12s %12s\n", "Renderer", "ms", "RMSE");
+
+	InitBenchScene(&Scene, 64, v3i(16, 16, 16));
+	Scene.Params.LightingMode = LIGHTING_MARCH;
+	Scene.Params.LightCount = 2;
+	Scene.Params.Lights[1] = DirectionalLight(v3(-1, 2, 0.5f), v3(0.5f, 0.5f, 1), 1.0f);
+
+	Render.Volume = &Scene.Volume;
+	Render.Grid = &Scene.Grid;
+	Render.Params = &Scene.Params;
+	Render.World = Scene.World;
+	Render.InvWorld = Scene.InvWorld;
+
+	BuildMajorantGrid(&Majorants, &Scene.Volume, Scene.Params.DensityScale);
+
+	Accum.Width = 96;
+	Accum.Height = 54;
+	RenderVolumeTracked(&Accum, &Render, &Majorants, View, Proj, 1024);
+	ResolveAccumulator(&Reference, &Accum);
+
+	Image.Width = 96;
+	Image.Height = 54;
+
+	u64 Start = ReadTimer();
+	RenderVolume(&Image, &Render, View, Proj);
+	f64 Ms = TimerSeconds(Start, ReadTimer()) * 1e3;
+
+	printf("%-16s %12.1f %12.5f\n", "March", Ms, ImageRMSE(&Image, &Reference));
+
+	// Progressive refinement: a 4 voxel step, jittered and averaged over
+	// frames, against the 1 voxel march above
+	Scene.Params.StepScale = 4.0f;
+
+	for (u32 Frames = 1; Frames <= 16; Frames *= 4)
+	{
+		image_accumulator	Progressive = {};
+		char				Name[32];
+
+		Progressive.Width = 96;
+		Progressive.Height = 54;
+
+		Start = ReadTimer();
+		for (u32 Frame = 0; Frame < Frames; Frame++)
+		{
+			RenderVolumeProgressive(&Progressive, &Render, View, Proj);
+		}
+		Ms = TimerSeconds(Start, ReadTimer()) * 1e3;
+
+		ResolveAccumulator(&Image, &Progressive);
+		snprintf(Name, sizeof(Name), "March 4x %u fr", Frames);
+		printf("%-16s %12.1f %12.5f\n", Name, Ms, ImageRMSE(&Image, &Reference));
+	}
+
+	Scene.Params.StepScale = 1.0f;
+
+	for (u32 Samples = 1; Samples <= 64; Samples *= 4)
+	{
+		char Name[32];
+
+		// Starts over, with noise independent of the reference's
+		Accum.Sum.clear();
+
+		Start = ReadTimer();
+		RenderVolumeTracked(&Accum, &Render, &Majorants, View, Proj, Samples);
+		Ms = TimerSeconds(Start, ReadTimer()) * 1e3;
+
+		ResolveAccumulator(&Image, &Accum);
+		snprintf(Name, sizeof(Name), "Tracked %u spp", Samples);
+		printf("%-16s %12.1f %12.5f\n", Name, Ms, ImageRMSE(&Image, &Reference));
+	}
+
+	// Four pixels per ray_batch against one ray at a time, on a bigger
+	// image so the timings aren't all overhead. Best of three, alternating,
+	// as the difference is about the size of the noise between runs.
+	image_accumulator	Single,
+						Packets;
+	f64					SingleMs = 1e30,
+						PacketMs = 1e30;
+
+	printf("\n%-16s %12s %12s\n", "Tracker 16 spp", "ms", "speedup");
+
+	for (u32 Run = 0; Run < 3; Run++)
+	{
+		Single = {};
+		Packets = {};
+		Single.Width = Packets.Width = 320;
+		Single.Height = Packets.Height = 180;
+
+		Start = ReadTimer();
+		RenderVolumeTrackedSingle(&Single, &Render, &Majorants, View, Proj, 16);
+		SingleMs = _Min(SingleMs, TimerSeconds(Start, ReadTimer()) * 1e3);
+
+		Start = ReadTimer();
+		RenderVolumeTracked(&Packets, &Render, &Majorants, View, Proj, 16);
+		PacketMs = _Min(PacketMs, TimerSeconds(Start, ReadTimer()) * 1e3);
+	}
+
+	printf("%-16s %12.1f %12s\n", "One ray", SingleMs, "");
+	printf("%-16s %12.1f %11.2fx\n", "ray_batch", PacketMs, SingleMs / PacketMs);
+
+	if (memcmp(Single.Sum.data(), Packets.Sum.data(), Single.Sum.size() * sizeof(v4)) != 0)
+	{
+		printf("ray_batch tracker doesn't match the one ray tracker\n");
+	}
+}
+
+void
+PrintCameraPathHeader(void)
+{
+	printf("%-10s %7s %10s %10s %10s %10s %10s %10s\n", "Path", "frames", "fine ms", "coarse ms",
+		   "raw RMSE", "temp RMSE", "raw last", "temp last");
+}
+
+// Plays Path back twice: a full rate march (StepScale 1, no jitter) as the
+// reference, and a jittered CoarseStep march through ResolveTemporal().
+// Prints one row with the per frame cost of both and the error of the
+// coarse march with and without the temporal pass, averaged over the path
+// and for its last frame. Final (optional) gets the last temporal frame.
+void
+ReplayCameraPath(render_scene *Scene,
+				 camera_path *Path,
+				 char const *Name,
+				 u32 Width,
+				 u32 Height,
+				 f32 CoarseStep,
+				 u32 MaxFrames,
+				 image *Final)
+{
+	raymarch_params		*Params = Scene->Params;
+	f32					StepScale = Params->StepScale;
+	temporal_history	History = {};
+	image				Reference,
+						Coarse,
+						Resolved;
+	std::vector<v4>		Positions;
+	m4					Proj = Mat4PerspectiveLH(45.0f, f32(Width) / f32(Height), 0.1f, 1000.0f);
+	f64					FineMs = 0,
+						CoarseMs = 0,
+						CoarseError = 0,
+						TemporalError = 0;
+	f32					LastCoarse = 0,
+						LastTemporal = 0;
+
+
+	Reference.Width = Coarse.Width = Width;
+	Reference.Height = Coarse.Height = Height;
+
+	for (u32 Frame = 0; Frame < Path->Keys.size(); Frame++)
+	{
+		camera_key *Key = &Path->Keys[Frame];
+		m4 View = Mat4LookAtLH(Key->Pos, Key->Pos + Key->Front, Key->Up);
+		m4 ViewProj = Proj * View;
+
+		Params->StepScale = 1.0f;
+		u64 Start = ReadTimer();
+		RenderVolume(&Reference, Scene, View, Proj);
+		FineMs += TimerSeconds(Start, ReadTimer()) * 1e3;
+
+		Params->StepScale = CoarseStep;
+		Start = ReadTimer();
+		RenderVolumeJittered(&Coarse, &Positions, Scene, View, Proj, Frame);
+		ResolveTemporal(&History, &Coarse, Positions, ViewProj, MaxFrames);
+		CoarseMs += TimerSeconds(Start, ReadTimer()) * 1e3;
+
+		Resolved.Width = Width;
+		Resolved.Height = Height;
+		Resolved.Pixels = History.Color;
+
+		LastCoarse = ImageRMSE(&Coarse, &Reference);
+		LastTemporal = ImageRMSE(&Resolved, &Reference);
+		CoarseError += LastCoarse;
+		TemporalError += LastTemporal;
+	}
+
+	Params->StepScale = StepScale;
+
+	if (Final)
+	{
+		*Final = Resolved;
+	}
+
+	f64 Frames = f64(_Max(u32(Path->Keys.size()), 1u));
+
+	printf("%-10s %7u %10.1f %10.1f %10.5f %10.5f %10.5f %10.5f\n", Name, u32(Path->Keys.size()),
+		   FineMs / Frames, CoarseMs / Frames, CoarseError / Frames, TemporalError / Frames, LastCoarse, LastTemporal);
+}
+
+// Temporal reprojection along a few synthetic camera paths, the same thing
+// `main.exe -render <out> -path <file>` does for one recorded in the viewer
+void
+BenchTemporal(void)
+{
+	bench_scene			Scene;
+	render_scene		Render = {};
+	camera_path			Orbit,
+						Dolly,
+						Still;
+	v3					Center = v3(2.5f, 2.5f, 2.5f);
+
+
+	printf("\n== Temporal reprojection (96x54, 32^3, 4 voxel steps vs 1, history <= 8 frames) ==\n");
+	PrintCameraPathHeader();
+
+	// A coarse volume, finer noise than the pixels is aliased in every frame
+	// and no reprojection can follow it
+	InitBenchScene(&Scene, 32, v3i(16, 16, 16));
+	Scene.Params.LightingMode = LIGHTING_MARCH;
+
+	Render.Volume = &Scene.Volume;
+	Render.Grid = &Scene.Grid;
+	Render.Params = &Scene.Params;
+	Render.World = Scene.World;
+	Render.InvWorld = Scene.InvWorld;
+
+	// Roughly what mouse look and WASD give at 60 fps
+	for (u32 Frame = 0; Frame < 16; Frame++)
+	{
+		f32 Angle = DegsToRads(-120.0f + 0.75f * Frame);
+		v3 Pos = Center + v3(8 * Cos(Angle), 1.5f, 8 * Sin(Angle));
+		v3 DollyPos = v3(3, 1.5f, -3.5f) + (0.02f * Frame) * v3(-0.5f, -0.25f, 0.8f);
+
+		Orbit.Keys.push_back({ Pos, Normalize(Center - Pos), v3(0, 1, 0) });
+		Dolly.Keys.push_back({ DollyPos, v3(-0.5f, -0.25f, 0.8f), v3(0, 1, 0) });
+		Still.Keys.push_back({ v3(3, 1.5f, -3.5f), v3(-0.5f, -0.25f, 0.8f), v3(0, 1, 0) });
+	}
+
+	ReplayCameraPath(&Render, &Still, "Still", 96, 54, 4.0f, 8, nullptr);
+	ReplayCameraPath(&Render, &Orbit, "Orbit", 96, 54, 4.0f, 8, nullptr);
+	ReplayCameraPath(&Render, &Dolly, "Dolly", 96, 54, 4.0f, 8, nullptr);
+}
+
+// Reduced resolution marching, upsampled by ray length and by plain
+// bilinear, against the full resolution march
+void
+BenchDownsample(void)
+{
+	bench_scene			Scene;
+	render_scene		Render = {};
+	image				Reference;
+	m4					View = Mat4LookAtLH(v3(3, 1.5f, -3.5f), v3(3, 1.5f, -3.5f) + v3(-0.5f, -0.25f, 0.8f), v3(0, 1, 0)),
+						Proj = Mat4PerspectiveLH(45.0f, 16.0f / 9.0f, 0.1f, 1000.0f);
+	image_diff			Diff;
+
+
+	printf("\n== Reduced resolution (192x108, 64^3, against full resolution) ==\n");
+	PrintImageDiffHeader();
+
+	InitBenchScene(&Scene, 64, v3i(16, 16, 16));
+	Scene.Params.LightingMode = LIGHTING_MARCH;
+
+	Render.Volume = &Scene.Volume;
+	Render.Grid = &Scene.Grid;
+	Render.Params = &Scene.Params;
+	Render.World = Scene.World;
+	Render.InvWorld = Scene.InvWorld;
+
+	Reference.Width = 192;
+	Reference.Height = 108;
+
+	u64 Start = ReadTimer();
+	RenderVolume(&Reference, &Render, View, Proj);
+	f64 Ms = TimerSeconds(Start, ReadTimer()) * 1e3;
+
+	DiffImages(&Reference, &Reference, 1.0f / 64, &Diff);
+	PrintImageDiff("Full", Ms, &Diff);
+
+	for (u32 Downsample = 2; Downsample <= 4; Downsample *= 2)
+	{
+		image					Low,
+								Image;
+		std::vector<f32>		FullLengths,
+								LowLengths;
+		char					Name[32];
+
+		Image.Width = Reference.Width;
+		Image.Height = Reference.Height;
+
+		Start = ReadTimer();
+		RenderVolumeScaled(&Image, &Render, View, Proj, Downsample);
+		Ms = TimerSeconds(Start, ReadTimer()) * 1e3;
+
+		DiffImages(&Image, &Reference, 1.0f / 64, &Diff);
+		snprintf(Name, sizeof(Name), "1/%u depth aware", Downsample);
+		PrintImageDiff(Name, Ms, &Diff);
+
+		// The same low resolution march with a flat guide
+		Low.Width = (Image.Width + Downsample - 1) / Downsample;
+		Low.Height = (Image.Height + Downsample - 1) / Downsample;
+		FullLengths.assign(u64(Image.Width) * Image.Height, 0.0f);
+		LowLengths.assign(u64(Low.Width) * Low.Height, 0.0f);
+
+		Start = ReadTimer();
+		RenderVolume(&Low, &Render, View, Proj);
+		UpsampleDepthAware(&Image, &Low, FullLengths, LowLengths, Downsample, UPSAMPLE_SIGMA);
+		Ms = TimerSeconds(Start, ReadTimer()) * 1e3;
+
+		DiffImages(&Image, &Reference, 1.0f / 64, &Diff);
+		snprintf(Name, sizeof(Name), "1/%u bilinear", Downsample);
+		PrintImageDiff(Name, Ms, &Diff);
+	}
+}
+
+// ns per element for the mg.h math: a plain scalar loop (what the types did
+// before MG_SIMD), the per element operators and the batch functions, with
+// the largest difference from the scalar loop
+void
+BenchMath(void)
+{
+	u32						Count = 1 << 12,
+							Repeats = 1024;
+	random_series			Series = RandomSeed(77, 1);
+	std::vector<v3>			Points(Count),
+							Reference(Count),
+							Result(Count);
+	std::vector<m4>			Mats(Count / 16);
+	std::vector<v3>			Origins(Count);
+	std::vector<f32>		tNears(Count),
+							tFars(Count);
+	m4						M = Mat4Translate(0.5f, -1.0f, 2.0f) * Mat4Rotate(0.7f, 0.2f, 1.0f, 0.3f) * Mat4Scale(1.5f),
+							Chain,
+							ReferenceChain;
+	u32						ChainLength = Count / 16;
+	u64						Start;
+	f64						Ns;
+	f32						MaxError;
+
+
+#ifdef MG_SIMD
+	printf("\n== Vector math (%u vectors, SIMD on) ==\n", Count);
+#else
+	printf("\n== Vector math (%u vectors, SIMD off) ==\n", Count);
+#endif
+	printf("%-24s %10s %12s\n", "Op", "ns/elem", "max error");
+
+	for (u32 I = 0; I < Count; I++)
+	{
+		Points[I] = v3(RandomBilateral(&Series), RandomBilateral(&Series), RandomBilateral(&Series));
+	}
+	for (u32 I = 0; I < ChainLength; I++)
+	{
+		Mats[I] = Mat4Rotate(RandomUnilateral(&Series) * 2.0f * PI, Points[I].x, Points[I].y, Points[I].z) * Mat4Scale(1.0f + RandomUnilateral(&Series));
+	}
+
+	// Transforms
+	Start = ReadTimer();
+	for (u32 R = 0; R < Repeats; R++)
+	{
+		for (u32 I = 0; I < Count; I++)
+		{
+			v3 P = Points[I];
+
+			Reference[I].x = P.x * M.Elements[0] + P.y * M.Elements[4] + P.z * M.Elements[8] + M.Elements[12];
+			Reference[I].y = P.x * M.Elements[1] + P.y * M.Elements[5] + P.z * M.Elements[9] + M.Elements[13];
+			Reference[I].z = P.x * M.Elements[2] + P.y * M.Elements[6] + P.z * M.Elements[10] + M.Elements[14];
+		}
+		gBenchSink = Reference[R].x;
+	}
+	Ns = TimerSeconds(Start, ReadTimer()) * 1e9 / (f64(Count) * Repeats);
+	printf("%-24s %10.2f %12s\n", "transform scalar", Ns, "-");
+
+	Start = ReadTimer();
+	for (u32 R = 0; R < Repeats; R++)
+	{
+		for (u32 I = 0; I < Count; I++)
+		{
+			v4 P = M * v4(Points[I].x, Points[I].y, Points[I].z, 1);
+
+			Result[I] = v3(P.x, P.y, P.z);
+		}
+		gBenchSink = Result[R].x;
+	}
+	Ns = TimerSeconds(Start, ReadTimer()) * 1e9 / (f64(Count) * Repeats);
+	MaxError = 0;
+	for (u32 I = 0; I < Count; I++)
+	{
+		MaxError = _Max(MaxError, Length(Result[I] - Reference[I]));
+	}
+	printf("%-24s %10.2f %12g\n", "transform m4 * v4", Ns, MaxError);
+
+	Start = ReadTimer();
+	for (u32 R = 0; R < Repeats; R++)
+	{
+		TransformPoints(M, Points.data(), Result.data(), Count);
+		gBenchSink = Result[R].x;
+	}
+	Ns = TimerSeconds(Start, ReadTimer()) * 1e9 / (f64(Count) * Repeats);
+	MaxError = 0;
+	for (u32 I = 0; I < Count; I++)
+	{
+		MaxError = _Max(MaxError, Length(Result[I] - Reference[I]));
+	}
+	printf("%-24s %10.2f %12g\n", "transform batch", Ns, MaxError);
+
+	// Normalizes
+	Start = ReadTimer();
+	for (u32 R = 0; R < Repeats; R++)
+	{
+		for (u32 I = 0; I < Count; I++)
+		{
+			v3 V = Points[I];
+			f32 Len = SquareRoot(V.x * V.x + V.y * V.y + V.z * V.z);
+
+			Reference[I] = v3(V.x / Len, V.y / Len, V.z / Len);
+		}
+		gBenchSink = Reference[R].x;
+	}
+	Ns = TimerSeconds(Start, ReadTimer()) * 1e9 / (f64(Count) * Repeats);
+	printf("%-24s %10.2f %12s\n", "normalize scalar", Ns, "-");
+
+	Start = ReadTimer();
+	for (u32 R = 0; R < Repeats; R++)
+	{
+		for (u32 I = 0; I < Count; I++)
+		{
+			Result[I] = Normalize(Points[I]);
+		}
+		gBenchSink = Result[R].x;
+	}
+	Ns = TimerSeconds(Start, ReadTimer()) * 1e9 / (f64(Count) * Repeats);
+	MaxError = 0;
+	for (u32 I = 0; I < Count; I++)
+	{
+		MaxError = _Max(MaxError, Length(Result[I] - Reference[I]));
+	}
+	printf("%-24s %10.2f %12g\n", "normalize Normalize()", Ns, MaxError);
+
+	Start = ReadTimer();
+	for (u32 R = 0; R < Repeats; R++)
+	{
+		NormalizeVectors(Points.data(), Result.data(), Count);
+		gBenchSink = Result[R].x;
+	}
+	Ns = TimerSeconds(Start, ReadTimer()) * 1e9 / (f64(Count) * Repeats);
+	MaxError = 0;
+	for (u32 I = 0; I < Count; I++)
+	{
+		MaxError = _Max(MaxError, Length(Result[I] - Reference[I]));
+	}
+	printf("%-24s %10.2f %12g\n", "normalize batch", Ns, MaxError);
+
+	// Box clips, IntersectBox() one ray at a time against ClipRayBatch().
+	// Reference holds the normalized directions from above. A lane that
+	// disagrees on the hit counts as an infinite error.
+	for (u32 I = 0; I < Count; I++)
+	{
+		Origins[I] = 3.0f * Points[I];
+	}
+
+	Start = ReadTimer();
+	for (u32 R = 0; R < Repeats; R++)
+	{
+		for (u32 I = 0; I < Count; I++)
+		{
+			f32 tNear, tFar;
+
+			IntersectBox(Origins[I], Reference[I], v3(-1, -1, -1), v3(1, 1, 1), &tNear, &tFar);
+			tNears[I] = _Max(tNear, 0.0f);
+			tFars[I] = tFar;
+		}
+		gBenchSink = tNears[R];
+	}
+	Ns = TimerSeconds(Start, ReadTimer()) * 1e9 / (f64(Count) * Repeats);
+	printf("%-24s %10.2f %12s\n", "box clip IntersectBox()", Ns, "-");
+
+	Start = ReadTimer();
+	for (u32 R = 0; R < Repeats; R++)
+	{
+		u32 Hits = 0;
+
+		for (u32 I = 0; I < Count; I += 4)
+		{
+			ray_batch Rays;
+
+			InitRayBatch(&Rays, &Origins[I], &Reference[I], _Min(Count - I, 4u));
+			Hits += B32x4Bits(ClipRayBatch(&Rays, v3(-1, -1, -1), v3(1, 1, 1)));
+		}
+		gBenchSink = f32(Hits);
+	}
+	Ns = TimerSeconds(Start, ReadTimer()) * 1e9 / (f64(Count) * Repeats);
+	MaxError = 0;
+	for (u32 I = 0; I < Count; I += 4)
+	{
+		ray_batch Rays;
+
+		InitRayBatch(&Rays, &Origins[I], &Reference[I], _Min(Count - I, 4u));
+
+		u32 Hit = B32x4Bits(ClipRayBatch(&Rays, v3(-1, -1, -1), v3(1, 1, 1)));
+
+		for (u32 Lane = 0; Lane < 4 && I + Lane < Count; Lane++)
+		{
+			b32 Expected = tNears[I + Lane] < tFars[I + Lane];
+
+			if (Expected != b32((Hit >> Lane) & 1))
+			{
+				MaxError = INFINITY;
+			}
+			else if (Expected)
+			{
+				MaxError = _Max(MaxError, Abs(F32x4Lane(Rays.tMin, Lane) - tNears[I + Lane]));
+				MaxError = _Max(MaxError, Abs(F32x4Lane(Rays.tMax, Lane) - tFars[I + Lane]));
+			}
+		}
+	}
+	printf("%-24s %10.2f %12g\n", "box clip ray_batch", Ns, MaxError);
+
+	// Matrix products, chained so each depends on the last
+	Start = ReadTimer();
+	for (u32 R = 0; R < Repeats; R++)
+	{
+		ReferenceChain = Mat4Identity();
+		for (u32 I = 0; I < ChainLength; I++)
+		{
+			m4 Product;
+
+			for (u32 Y = 0; Y < 4; Y++)
+			{
+				for (u32 X = 0; X < 4; X++)
+				{
+					f32 Sum = 0.0f;
+
+					for (u32 E = 0; E < 4; E++)
+					{
+						Sum += ReferenceChain.Elements[X + E * 4] * Mats[I].Elements[E + Y * 4];
+					}
+
+					Product.Elements[X + Y * 4] = Sum;
+				}
+			}
+
+			ReferenceChain = Product;
+		}
+		gBenchSink = ReferenceChain.Elements[0];
+	}
+	Ns = TimerSeconds(Start, ReadTimer()) * 1e9 / (f64(ChainLength) * Repeats);
+	printf("%-24s %10.2f %12s\n", "m4 * m4 scalar", Ns, "-");
+
+	Start = ReadTimer();
+	for (u32 R = 0; R < Repeats; R++)
+	{
+		Chain = Mat4Identity();
+		for (u32 I = 0; I < ChainLength; I++)
+		{
+			Chain = Chain * Mats[I];
+		}
+		gBenchSink = Chain.Elements[0];
+	}
+	Ns = TimerSeconds(Start, ReadTimer()) * 1e9 / (f64(ChainLength) * Repeats);
+	MaxError = 0;
+	for (u32 I = 0; I < 16; I++)
+	{
+		MaxError = _Max(MaxError, Abs(Chain.Elements[I] - ReferenceChain.Elements[I]));
+	}
+	printf("%-24s %10.2f %12g\n", "m4 * m4", Ns, MaxError);
+}
+
+// ns per exp/log for each tier, scalar and four wide, with the max error
+// over the range the kernels see (relative for exp, absolute for log). Then
+// the CPU march with an exp per step against one F32x4Exp() per four steps.
+void
+BenchExp(void)
+{
+	char const				*TierNames[] = { "fast", "medium", "exact" };
+	f64						ExpBounds[] = { 1.5e-4, 2.3e-7 },		// the table in mg.h
+							LogBounds[] = { 1.8e-4, 8.4e-7 };
+	u32						Count = 1 << 12,
+							Repeats = 1024;
+	std::vector<f32>		Inputs(Count),
+							Outputs(Count);
+	bench_scene				Scene;
+	render_scene			Render = {};
+	std::vector<probe>		Probes;
+	image					Images[2];
+	m4						View = Mat4LookAtLH(v3(3, 1.5f, -3.5f), v3(3, 1.5f, -3.5f) + v3(-0.5f, -0.25f, 0.8f), v3(0, 1, 0)),
+							Proj = Mat4PerspectiveLH(45.0f, 16.0f / 9.0f, 0.1f, 1000.0f);
+	image_diff				Diff;
+	char					Name[32];
+	u64						Start;
+	f64						Ns;
+	f64						MaxError;
+	b32						Over;
+
+
+	printf("\n== Exp and log (MG_EXP_TIER %s) ==\n", TierNames[MG_EXP_TIER]);
+	printf("%-24s %10s %12s %8s\n", "Op", "ns/elem", "max error", "bound");
+
+	for (u32 Op = 0; Op < 2; Op++)
+	{
+		// Optical depths for exp, 1 - U of the trackers for log
+		for (u32 I = 0; I < Count; I++)
+		{
+			Inputs[I] = Op == 0 ? -20.0f * (I + 0.5f) / Count : (I + 0.5f) / Count;
+		}
+
+		for (u32 Tier = EXP_TIER_FAST; Tier <= EXP_TIER_EXACT; Tier++)
+		{
+			for (u32 Wide = 0; Wide < 2; Wide++)
+			{
+				Start = ReadTimer();
+				for (u32 R = 0; R < Repeats; R++)
+				{
+					if (Wide)
+					{
+						for (u32 I = 0; I < Count; I += 4)
+						{
+							f32x4 X = F32x4Load(&Inputs[I]);
+
+							F32x4Store(&Outputs[I], Op == 0 ? F32x4Exp(X, Tier) : F32x4Log(X, Tier));
+						}
+					}
+					else
+					{
+						for (u32 I = 0; I < Count; I++)
+						{
+							Outputs[I] = Op == 0 ? ExpApprox(Inputs[I], Tier) : LogApprox(Inputs[I], Tier);
+						}
+					}
+					gBenchSink = Outputs[R];
+				}
+				Ns = TimerSeconds(Start, ReadTimer()) * 1e9 / (f64(Count) * Repeats);
+
+				MaxError = 0;
+				Over = false;
+				for (u32 I = 0; I < Count; I++)
+				{
+					f64 Exact = Op == 0 ? exp(f64(Inputs[I])) : log(f64(Inputs[I]));
+					f64 Error = Op == 0 ? fabs(Outputs[I] / Exact - 1) : fabs(Outputs[I] - Exact);
+
+					MaxError = _Max(MaxError, Error);
+
+					// Plus what mg.h says rounding adds, the log inputs run
+					// below 2^-8
+					if (Tier != EXP_TIER_EXACT)
+					{
+						f64 Bound = Op == 0 ? ExpBounds[Tier] + fabs(Inputs[I]) * 7.5e-8 :
+											  LogBounds[Tier] + ((Inputs[I] < 1.0f / 256) ? fabs(Exact) * 1e-7 : 0);
+
+						Over |= Error > Bound;
+					}
+				}
+
+				snprintf(Name, sizeof(Name), "%s %s%s", Op == 0 ? "exp" : "log", TierNames[Tier], Wide ? " x4" : "");
+				printf("%-24s %10.2f %12.3g %8s\n", Name, Ns, MaxError,
+					   (Tier == EXP_TIER_EXACT) ? "" : (Over ? "OVER" : "ok"));
+			}
+		}
+	}
+
+	// Probe lighting, a light march per sample would bury the exps
+	printf("\n== Transmittance per step and per segment (192x108, 64^3, probes) ==\n");
+	PrintImageDiffHeader();
+
+	InitBenchScene(&Scene, 64, v3i(16, 16, 16));
+	Probes.resize(ProbeStorageCount(&Scene.Grid));
+	BakeProbes(Probes.data(), &Scene.Volume, &Scene.Grid, &Scene.Params, Scene.InvWorld);
+
+	Render.Volume = &Scene.Volume;
+	Render.Grid = &Scene.Grid;
+	Render.Probes = Probes.data();
+	Render.Params = &Scene.Params;
+	Render.World = Scene.World;
+	Render.InvWorld = Scene.InvWorld;
+
+	for (u32 Mode = TRANSMITTANCE_STEP; Mode <= TRANSMITTANCE_SEGMENT; Mode++)
+	{
+		Render.TransmittanceMode = Mode;
+		Images[Mode].Width = 192;
+		Images[Mode].Height = 108;
+
+		Start = ReadTimer();
+		RenderVolume(&Images[Mode], &Render, View, Proj);
+		f64 Ms = TimerSeconds(Start, ReadTimer()) * 1e3;
+
+		DiffImages(&Images[Mode], &Images[TRANSMITTANCE_STEP], 1.0f / 64, &Diff);
+		PrintImageDiff(Mode == TRANSMITTANCE_STEP ? "per step" : "per segment", Ms, &Diff);
+	}
+}
+
+// Every worker runs it at once, so it can't share the volatile sink
+std::atomic<s32>	gJobSink;
+
+// An empty range, so only the split, push, steal and join are timed
+void
+BenchEmptyRange(void *Data,
+				job_range Range)
+{
+	(void)Data;
+	gJobSink.store(Range.Min.x, std::memory_order_relaxed);
+}
+
+// The CPU kernels at 1, 2, 4, ... threads up to one per logical processor,
+// with their own job systems, so it has to run outside of one
+void
+BenchJobs(void)
+{
+	bench_scene				Scene;
+	render_scene			Render = {};
+	std::vector<probe>		Probes;
+	shadow_volume			Shadows;
+	image					Image;
+	volume					Noise;
+	f64						Baseline[5] = {};
+	m4						View = Mat4LookAtLH(v3(3, 1.5f, -3.5f), v3(3, 1.5f, -3.5f) + v3(-0.5f, -0.25f, 0.8f), v3(0, 1, 0)),
+							Proj = Mat4PerspectiveLH(45.0f, 16.0f / 9.0f, 0.1f, 1000.0f);
+	u32						MaxThreads = _Max(u32(GetActiveProcessorCount(ALL_PROCESSOR_GROUPS)), 1u);
+
+
+	printf("\n== Job system scaling (ms, speedup over 1 thread) ==\n");
+	printf("%-8s %16s %16s %16s %16s %16s\n", "Threads", "ParallelFor us", "Noise 128^3", "Bake 32^3", "Shadow vol 64^3", "Render 320x180");
+
+	InitBenchScene(&Scene, 64, v3i(32, 32, 32));
+	Probes.resize(ProbeStorageCount(&Scene.Grid));
+
+	Render.Volume = &Scene.Volume;
+	Render.Grid = &Scene.Grid;
+	Render.Probes = Probes.data();
+	Render.Params = &Scene.Params;
+	Render.World = Scene.World;
+	Render.InvWorld = Scene.InvWorld;
+
+	Image.Width = 320;
+	Image.Height = 180;
+
+	for (u32 Threads = 1; ; Threads = _Min(2 * Threads, MaxThreads))
+	{
+		job_system	Jobs;
+		f64			Ms[5];
+		f32			MinVal,
+					MaxVal;
+		u64			Start;
+
+		InitJobSystem(&Jobs, Threads);
+
+		// 512 pieces each
+		Start = ReadTimer();
+		for (u32 I = 0; I < 256; I++)
+		{
+			ParallelFor(1 << 12, 8, BenchEmptyRange, nullptr);
+		}
+		Ms[0] = TimerSeconds(Start, ReadTimer()) * 1e6 / 256;
+
+		Start = ReadTimer();
+		GenerateNoiseVolume(&Noise, 128, 128, 128, &MinVal, &MaxVal);
+		Ms[1] = TimerSeconds(Start, ReadTimer()) * 1e3;
+
+		Start = ReadTimer();
+		BakeProbes(Probes.data(), &Scene.Volume, &Scene.Grid, &Scene.Params, Scene.InvWorld);
+		Ms[2] = TimerSeconds(Start, ReadTimer()) * 1e3;
+
+		Start = ReadTimer();
+		BuildShadowVolume(&Shadows, &Scene.Volume, &Scene.Params, Scene.World);
+		Ms[3] = TimerSeconds(Start, ReadTimer()) * 1e3;
+
+		Start = ReadTimer();
+		RenderVolume(&Image, &Render, View, Proj);
+		Ms[4] = TimerSeconds(Start, ReadTimer()) * 1e3;
+
+		ShutdownJobSystem(&Jobs);
+
+		printf("%-8u", Threads);
+		for (u32 I = 0; I < 5; I++)
+		{
+			char Cell[32];
+
+			if (Threads == 1)
+			{
+				Baseline[I] = Ms[I];
+			}
+			if (I == 0)
+			{
+				snprintf(Cell, sizeof(Cell), "%.1f", Ms[I]);
+			}
+			else
+			{
+				snprintf(Cell, sizeof(Cell), "%.1f (%.1fx)", Ms[I], Baseline[I] / Ms[I]);
+			}
+			printf(" %16s", Cell);
+		}
+		printf("\n");
+
+		if (Threads == MaxThreads)
+		{
+			break;
+		}
+	}
+}
+
+// Mean and worst of Rounds timings
+void
+PrintAllocRow(char const *Name,
+			  f64 *Ms,
+			  u32 Rounds)
+{
+	f64		Sum = 0,
+			Worst = 0;
+
+
+	for (u32 I = 0; I < Rounds; I++)
+	{
+		Sum += Ms[I];
+		Worst = _Max(Worst, Ms[I]);
+	}
+
+	printf("%-26s %10.3f %10.3f\n", Name, Sum / Rounds, Worst);
+}
+
+// NOTE(matthew): The allocation pattern the CPU kernels have, per tile
+// temporaries of a 1080p frame, from the heap and from the threads' scratch
+// arenas. Each round is timed on its own, the worst is what a frame would
+// see.
+
+#define BENCH_ALLOC_ROUNDS		64
+
+void
+BenchAllocators(void)
+{
+	u32						Width = 1920,
+							Height = 1080;
+	f64						Ms[BENCH_ALLOC_ROUNDS];
+	u64						Start;
+
+
+	printf("\n== Allocators (ms per round) ==\n");
+	printf("%-26s %10s %10s\n", "", "mean", "worst");
+
+	// Per tile scratch, a tile of colours and a row of steps, touched so
+	// neither is free
+	for (u32 Round = 0; Round < BENCH_ALLOC_ROUNDS; Round++)
+	{
+		Start = ReadTimer();
+		ParallelFor2D(Width, Height, RENDER_TILE, RENDER_TILE, [&](job_range Range)
+		{
+			std::vector<v4> Tile(RENDER_TILE * RENDER_TILE);
+			std::vector<f32> Steps(256);
+
+			Tile[Range.Min.x % Tile.size()] = v4(1, 1, 1, 1);
+			Steps[Range.Min.y % Steps.size()] = Tile[0].x;
+			gBenchSink = Steps[0];
+		});
+		Ms[Round] = TimerSeconds(Start, ReadTimer()) * 1e3;
+	}
+	PrintAllocRow("Tile scratch, heap", Ms, BENCH_ALLOC_ROUNDS);
+
+	for (u32 Round = 0; Round < BENCH_ALLOC_ROUNDS; Round++)
+	{
+		Start = ReadTimer();
+		ParallelFor2D(Width, Height, RENDER_TILE, RENDER_TILE, [&](job_range Range)
+		{
+			arena_frame Frame = ArenaPushFrame(ScratchArena());
+			v4 *Tile = ArenaAllocArray<v4>(Frame.Arena, RENDER_TILE * RENDER_TILE);
+			f32 *Steps = ArenaAllocArray<f32>(Frame.Arena, 256);
+
+			if (!Tile || !Steps)
+			{
+				ArenaPopFrame(Frame);
+				return;
+			}
+
+			memset(Tile, 0, RENDER_TILE * RENDER_TILE * sizeof(v4));
+			memset(Steps, 0, 256 * sizeof(f32));
+			Tile[Range.Min.x % (RENDER_TILE * RENDER_TILE)] = v4(1, 1, 1, 1);
+			Steps[Range.Min.y % 256] = Tile[0].x;
+			gBenchSink = Steps[0];
+			ArenaPopFrame(Frame);
+		});
+		Ms[Round] = TimerSeconds(Start, ReadTimer()) * 1e3;
+	}
+	PrintAllocRow("Tile scratch, arena", Ms, BENCH_ALLOC_ROUNDS);
+
+	printf("Scratch arena (this thread): %llu KB committed, %llu KB peak, %llu allocs, %llu failed\n",
+		   ScratchArena()->Committed / 1024, ScratchArena()->Peak / 1024, ScratchArena()->AllocCount,
+		   ScratchArena()->FailCount);
+}
+
+// NOTE(matthew): What the TLB costs random sampling. Reading its miss
+// counters takes a driver, so the same random fetches run against the
+// volume on normal pages and on large pages instead, the difference is the
+// page walks. Past a couple of thousand 4 KB pages the volume is out of the
+// TLB's reach and it starts to show.
+void
+BenchPages(u32 MaxVolumeSize)
+{
+	u32		Flags = gPageFlags;
+
+
+	printf("\n== Volume pages (random trilinear fetches, ns) ==\n");
+	if (!gPageStats.LargePageSize)
+	{
+		printf("No large pages, they need the \"Lock pages in memory\" privilege\n");
+	}
+	printf("%-8s %10s %12s %12s %12s %12s %9s\n", "Volume", "MB", "4 KB pages", "large pages", "normal", "large", "speedup");
+
+	for (u32 Size = 64; Size <= MaxVolumeSize; Size *= 2)
+	{
+		u64		Bytes = u64(Size) * Size * Size * sizeof(f32);
+		f64		Ns[2] = {};
+		b32		Large = FALSE;
+
+		for (u32 Pass = 0; Pass < 2; Pass++)
+		{
+			volume	Volume;
+			f32		MinVal,
+					MaxVal;
+			u32		LargeAllocs = gPageStats.LargeAllocs;
+
+			if (Pass == 1 && !gPageStats.LargePageSize)
+			{
+				break;
+			}
+
+			gPageFlags = (Pass == 1) ? (Flags | PAGES_LARGE) : (Flags & ~PAGES_LARGE);
+			GenerateNoiseVolume(&Volume, Size, Size, Size, &MinVal, &MaxVal);
+			Ns[Pass] = BenchRandomSamples(&Volume, 1 << 22);
+			Large = (Pass == 1) && gPageStats.LargeAllocs != LargeAllocs;
+		}
+
+		if (Large)
+		{
+			printf("%-8u %10.1f %12llu %12llu %12.2f %12.2f %8.2fx\n", Size, Bytes / 1048576.0, (Bytes + 4095) / 4096,
+				   (Bytes + gPageStats.LargePageSize - 1) / gPageStats.LargePageSize, Ns[0], Ns[1], Ns[0] / Ns[1]);
+		}
+		else
+		{
+			printf("%-8u %10.1f %12llu %12s %12.2f %12s %9s\n", Size, Bytes / 1048576.0, (Bytes + 4095) / 4096,
+				   "-", Ns[0], "-", "-");
+		}
+	}
+
+	gPageFlags = Flags;
+}
+
+void
+RunBenchmarks(u32 MaxVolumeSize)
+{
+	job_system	Jobs;
+
+
+	// Scaling first, it brings up its own job systems. Everything after runs
+	// on all the cores.
+	BenchJobs();
+	InitJobSystem(&Jobs, 0);
+
+	BenchMath();
+	BenchExp();
+	BenchLayouts(MaxVolumeSize);
+	BenchPages(MaxVolumeSize);
+	BenchLights();
+	BenchFilters();
+	BenchShadowVolume(MaxVolumeSize);
+	BenchTracking();
+	BenchTemporal();
+	BenchDownsample();
+	BenchAllocators();
+
+	ShutdownJobSystem(&Jobs);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Probe error analysis, run with `main.exe -analyze`
+
+// NOTE(matthew): The reference is LightmarchAll() at each sample point
+// against the volume's full bounds, i.e. what the probes would give with
+// infinite resolution. Both use LIGHTMARCH_STEPS, so the error is only the
+// interpolation between probes, not the march itself. With several lights
+// the error at a point is the worst of them. Lookups use Params->ProbeFilter.
+
+// Error percentile, Sorted must be ascending. 0 if it's empty.
+f32
+Percentile(std::vector<f32> &Sorted,
+		   f32 P)
+{
+	if (Sorted.empty())
+	{
+		return (0);
+	}
+
+	u64 Index = u64(P * (Sorted.size() - 1) + 0.5f);
+
+	return (Sorted[Index]);
+}
+
+// Random points in the volume's bounds and the reference transmittance at
+// each
+void
+GenerateAnalysisPoints(volume *Volume,
+					   raymarch_params *Params,
+					   m4 &World,
+					   u32 SampleCount,
+					   std::vector<v3> &Points,
+					   std::vector<v4> &Reference)
+{
+	random_series			Series = RandomSeed(4242, 1);
+	grid_params				Bounds;
+	m4						InvWorld = Mat4Inverse(World);
+	v4						WorldMax = World * v4(1, 1, 1, 1);
+
+
+	InitGridParams(&Bounds, v3i(2, 2, 2), v3(0, 0, 0), v3(WorldMax.x, WorldMax.y, WorldMax.z), LAYOUT_LINEAR);
+
+	Points.resize(SampleCount);
+	Reference.resize(SampleCount);
+
+	for (u32 I = 0; I < SampleCount; I++)
+	{
+		Points[I] = Bounds.GridMin + Hadamard(Bounds.GridExtents,
+			v3(RandomUnilateral(&Series), RandomUnilateral(&Series), RandomUnilateral(&Series)));
+		Reference[I] = LightmarchAll(Volume, &Bounds, Params, InvWorld, Points[I]);
+	}
+}
+
+void
+AnalyzeProbeGrid(volume *Volume,
+				 raymarch_params *Params,
+				 m4 &World,
+				 v3i Dims,
+				 std::vector<v3> &Points,
+				 std::vector<v4> &Reference,
+				 probe_error_stats *Stats)
+{
+	grid_params				Grid;
+	std::vector<probe>		Probes;
+	std::vector<f32>		Errors(Points.size());
+	m4						InvWorld = Mat4Inverse(World);
+	v4						WorldMax = World * v4(1, 1, 1, 1);
+	f64						ErrorSum = 0;
+	u64						Start,
+							End;
+
+
+	InitGridParams(&Grid, Dims, v3(0, 0, 0), v3(WorldMax.x, WorldMax.y, WorldMax.z), LAYOUT_LINEAR);
+	Probes.resize(ProbeStorageCount(&Grid));
+
+	Start = ReadTimer();
+	BakeProbes(Probes.data(), Volume, &Grid, Params, InvWorld);
+	End = ReadTimer();
+
+	*Stats = {};
+	Stats->Dims = Dims;
+	Stats->ProbeCount = Grid.ProbeCount;
+	Stats->MemoryMB = f32(f64(Probes.size()) * sizeof(probe) / (1024.0 * 1024.0));
+	Stats->BakeMs = TimerSeconds(Start, End) * 1e3;
+
+	// Nothing to measure the error at
+	if (Points.empty())
+	{
+		return;
+	}
+
+	for (u32 I = 0; I < Points.size(); I++)
+	{
+		v4 Lookup = SampleProbes(Probes.data(), &Grid, Points[I], Params->ProbeFilter);
+
+		// Worst light at each point
+		Errors[I] = 0;
+		for (u32 L = 0; L < _Min(Params->LightCount, u32(MAX_LIGHTS)); L++)
+		{
+			Errors[I] = _Max(Errors[I], Abs(Lookup.Elements[L] - Reference[I].Elements[L]));
+		}
+		ErrorSum += Errors[I];
+	}
+
+	std::sort(Errors.begin(), Errors.end());
+
+	Stats->Mean = f32(ErrorSum / Points.size());
+	Stats->P50 = Percentile(Errors, 0.5f);
+	Stats->P90 = Percentile(Errors, 0.9f);
+	Stats->P99 = Percentile(Errors, 0.99f);
+	Stats->Max = Errors.back();
+}
+
+// Sweeps the probe resolution from 8 to 128 along the longest axis (the
+// other axes follow the volume's aspect) and prints the error percentiles
+// with the CPU bake time and buffer size. With TargetError > 0 it also
+// reports the cheapest grid whose p99 error is under it.
+void
+RunProbeAnalysis(volume *Volume,
+				 raymarch_params *Params,
+				 m4 &World,
+				 u32 SampleCount,
+				 f32 TargetError,
+				 b32 Csv)
+{
+	static const s32		Resolutions[] = { 8, 12, 16, 24, 32, 48, 64, 96, 128 };
+	u32						ResolutionCount = sizeof(Resolutions) / sizeof(Resolutions[0]);
+
+	std::vector<v3>			Points;
+	std::vector<v4>			Reference;
+	std::vector<probe_error_stats>	Rows;
+	u32						MaxDim = _Max(_Max(Volume->Width, Volume->Height), Volume->Depth);
+	u32						VolumeDims[3] = { Volume->Width, Volume->Height, Volume->Depth };
+
+
+	GenerateAnalysisPoints(Volume, Params, World, SampleCount, Points, Reference);
+
+	if (Csv)
+	{
+		printf("dims_x,dims_y,dims_z,probes,memory_mb,bake_ms,mean,p50,p90,p99,max\n");
+	}
+	else
+	{
+		printf("\n== Probe interpolation error (%u samples, %ux%ux%u volume, %s) ==\n", SampleCount,
+			   Volume->Width, Volume->Height, Volume->Depth, ProbeFilterNames[Params->ProbeFilter]);
+		printf("%-14s %10s %10s %10s %10s %10s %10s %10s %10s\n", "Grid", "probes", "MB", "bake ms",
+			   "mean", "p50", "p90", "p99", "max");
+	}
+
+	for (u32 R = 0; R < ResolutionCount; R++)
+	{
+		probe_error_stats	Stats;
+		s32					Dims[3];
+
+		for (u32 I = 0; I < 3; I++)
+		{
+			Dims[I] = _Max(2, s32(Round(f32(Resolutions[R]) * VolumeDims[I] / MaxDim)));
+		}
+
+		AnalyzeProbeGrid(Volume, Params, World, v3i(Dims[0], Dims[1], Dims[2]), Points, Reference, &Stats);
+		Rows.push_back(Stats);
+
+		if (Csv)
+		{
+			printf("%d,%d,%d,%u,%.3f,%.2f,%.6f,%.6f,%.6f,%.6f,%.6f\n", Dims[0], Dims[1], Dims[2],
+				   Stats.ProbeCount, Stats.MemoryMB, Stats.BakeMs, Stats.Mean, Stats.P50, Stats.P90, Stats.P99, Stats.Max);
+		}
+		else
+		{
+			char Grid[32];
+
+			snprintf(Grid, sizeof(Grid), "%dx%dx%d", Dims[0], Dims[1], Dims[2]);
+			printf("%-14s %10u %10.2f %10.1f %10.5f %10.5f %10.5f %10.5f %10.5f\n", Grid, Stats.ProbeCount,
+				   Stats.MemoryMB, Stats.BakeMs, Stats.Mean, Stats.P50, Stats.P90, Stats.P99, Stats.Max);
+		}
+	}
+
+	if (TargetError > 0 && !Csv)
+	{
+		// Resolutions are ascending, so the first one under the bar is the cheapest
+		for (u32 I = 0; I < Rows.size(); I++)
+		{
+			if (Rows[I].P99 <= TargetError)
+			{
+				printf("\nCheapest grid with p99 <= %g: %dx%dx%d (%.2f MB)\n", TargetError,
+					   Rows[I].Dims.x, Rows[I].Dims.y, Rows[I].Dims.z, Rows[I].MemoryMB);
+				return;
+			}
+		}
+
+		printf("\nNo grid up to %d^3 has p99 <= %g\n", Resolutions[ResolutionCount - 1], TargetError);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Frame pipeline test, run with `main.exe -pipeline [frames]`
+
+// NOTE(matthew): Drives the frame pipeline with a CPU render stage, so it
+// runs without a device. The UI stage spins for PIPELINE_TEST_UI_MS in place
+// of input and ImGui, then fills in the input from its frame number. The
+// render stage rebuilds what it should have got from the number and renders
+// the volume with it. A mismatch (a torn input), a skipped or repeated
+// input, a params version that didn't move with the input, or an output
+// older than the last one is an error. The same frames run on one thread
+// first to compare against.
+
+#define PIPELINE_TEST_UI_MS		4.0
+#define PIPELINE_TEST_WIDTH		128
+#define PIPELINE_TEST_HEIGHT	72
+
+struct pipeline_test
+{
+	bench_scene		Scene;
+	render_scene	Render;
+	image			Image;
+	u64				Expected;		// next input number
+	u32				Errors;
+};
+
+void
+FillPipelineTestInput(pipeline_test *Test,
+					  model_params *Model,
+					  raymarch_params *Params,
+					  u64 Number)
+{
+	f32		Angle = f32(Number) * 0.05f;
+	v3		Eye = v3(2.5f, 1.5f, 2.5f) + 4.0f * v3(Cos(Angle), 0.25f, Sin(Angle));
+
+
+	Model->World = Test->Scene.World;
+	Model->View = Mat4LookAtLH(Eye, v3(2.5f, 2.5f, 2.5f), v3(0, 1, 0));
+	Model->Proj = Mat4PerspectiveLH(45.0f, f32(PIPELINE_TEST_WIDTH) / f32(PIPELINE_TEST_HEIGHT), 0.1f, 1000.0f);
+
+	*Params = Test->Scene.Params;
+	Params->FrameIndex = u32(Number);
+	Params->Lights[0].Intensity = 1.0f + 0.5f * Sin(Angle);
+}
+
+void
+RunPipelineTestUi(pipeline_test *Test,
+				  model_params *Model,
+				  raymarch_params *Params,
+				  u64 Number)
+{
+	u64		Start = ReadTimer();
+
+
+	while (TimerSeconds(Start, ReadTimer()) * 1e3 < PIPELINE_TEST_UI_MS)
+	{
+	}
+
+	FillPipelineTestInput(Test, Model, Params, Number);
+}
+
+// Every input changes the params, so the version is one ahead of the number
+void
+RunPipelineTestRender(pipeline_test *Test,
+					  u64 Number,
+					  model_params *Model,
+					  raymarch_params *Params,
+					  u32 Version)
+{
+	model_params		ExpectedModel;
+	raymarch_params		ExpectedParams;
+
+
+	FillPipelineTestInput(Test, &ExpectedModel, &ExpectedParams, Number);
+
+	if (Number != Test->Expected || Version != Number + 1 ||
+		!ParamsEqual(&ExpectedModel, Model) || !ParamsEqual(&ExpectedParams, Params))
+	{
+		Test->Errors++;
+	}
+	Test->Expected = Number + 1;
+
+	Test->Render.Params = Params;
+	RenderVolume(&Test->Image, &Test->Render, Model->View, Model->Proj);
+	gBenchSink = Test->Image.Pixels[0].x;
+}
+
+void
+RunPipelineTest(job_system *Jobs,
+				u32 FrameCount)
+{
+	pipeline_test			Test;
+	std::vector<probe>		Probes;
+	frame_pipeline			Pipeline;
+	model_params			Model;
+	raymarch_params			Params;
+	u64						LastOutput = 0,
+							MaxLead = 0,
+							Start;
+	f64						SerialMs,
+							PipelinedMs;
+	u32						OutputErrors = 0;
+
+
+	InitBenchScene(&Test.Scene, 32, v3i(16, 16, 16));
+	Probes.resize(ProbeStorageCount(&Test.Scene.Grid));
+	BakeProbes(Probes.data(), &Test.Scene.Volume, &Test.Scene.Grid, &Test.Scene.Params, Test.Scene.InvWorld);
+
+	Test.Render = {};
+	Test.Render.Volume = &Test.Scene.Volume;
+	Test.Render.Grid = &Test.Scene.Grid;
+	Test.Render.Probes = Probes.data();
+	Test.Render.World = Test.Scene.World;
+	Test.Render.InvWorld = Test.Scene.InvWorld;
+	Test.Image.Width = PIPELINE_TEST_WIDTH;
+	Test.Image.Height = PIPELINE_TEST_HEIGHT;
+
+	printf("\n== Frame pipeline, %u frames, %ux%u CPU render, %.1f ms UI ==\n", FrameCount,
+		   PIPELINE_TEST_WIDTH, PIPELINE_TEST_HEIGHT, PIPELINE_TEST_UI_MS);
+
+	// Both stages on this thread
+	Test.Expected = 0;
+	Test.Errors = 0;
+	Start = ReadTimer();
+	for (u64 Number = 0; Number < FrameCount; Number++)
+	{
+		RunPipelineTestUi(&Test, &Model, &Params, Number);
+		RunPipelineTestRender(&Test, Number, &Model, &Params, u32(Number + 1));
+	}
+	SerialMs = TimerSeconds(Start, ReadTimer()) * 1e3 / FrameCount;
+
+	// The render stage on its own thread, the outputs checked as they come
+	// back
+	auto Render = [&](frame_input *Input, frame_output *)
+	{
+		model_params		InputModel;
+		raymarch_params		InputParams;
+		u32					Version = ReadParamChannel(&Pipeline.Params, &InputParams);
+
+
+		ReadParamChannel(&Pipeline.Model, &InputModel);
+		EndFrameLatch(&Pipeline);
+		RunPipelineTestRender(&Test, Input->Number, &InputModel, &InputParams, Version);
+	};
+
+	Test.Expected = 0;
+	Start = ReadTimer();
+	StartFramePipeline(&Pipeline, Jobs, Render);
+	for (u64 Number = 0; Number < FrameCount; Number++)
+	{
+		frame_input *Input = BeginFrameInput(&Pipeline);
+		b32 Fresh;
+
+		RunPipelineTestUi(&Test, &Model, &Params, Input->Number);
+		PublishParamChannel(&Pipeline.Model, &Model);
+		PublishParamChannel(&Pipeline.Params, &Params);
+		PublishFrameInput(&Pipeline);
+
+		frame_output *Output = LatestFrameOutput(&Pipeline, &Fresh);
+
+		if (Fresh)
+		{
+			if (Output->Number < LastOutput)
+			{
+				OutputErrors++;
+			}
+			LastOutput = Output->Number;
+			MaxLead = _Max(MaxLead, Input->Number - Output->Number);
+		}
+	}
+
+	// Once the last input is latched the render stage finishes it before it
+	// stops
+	BeginFrameInput(&Pipeline);
+	StopFramePipeline(&Pipeline);
+	PipelinedMs = TimerSeconds(Start, ReadTimer()) * 1e3 / FrameCount;
+
+	printf("%-12s %10s %10s\n", "", "ms/frame", "speedup");
+	printf("%-12s %10.2f %10s\n", "Serial", SerialMs, "");
+	printf("%-12s %10.2f %9.2fx\n", "Pipelined", PipelinedMs, SerialMs / PipelinedMs);
+	printf("Rendered %llu of %u inputs, UI up to %llu ahead, %u errors\n", Test.Expected, FrameCount,
+		   MaxLead, Test.Errors + OutputErrors);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Param channel stress test, run with `main.exe -params [publishes]`
+
+// NOTE(matthew): One writer publishes raymarch_params built from a counter
+// as fast as it can, each one twice, and ReaderCount threads read them back
+// as fast as they can. The second publish of a value has to keep its
+// version. A read has to be a whole value, the one its version was
+// published with, and a reader's versions can't go backwards. Worth running
+// under a race detector as well as on its own.
+
+#define PARAM_TEST_MAX_READERS	8
+
+struct param_channel_test
+{
+	param_channel<raymarch_params>		Channel;
+	std::atomic<b32>					Running;
+	std::atomic<u32>					Errors;
+	std::atomic<u64>					Reads;
+};
+
+// Every field from Number, so a torn read mixes two numbers
+void
+FillParamChannelTestInput(raymarch_params *Params,
+						  u32 Number)
+{
+	f32		Value = f32(Number & 0xFFFF);
+
+
+	*Params = {};
+	Params->ScreenWidth = Number;
+	Params->ScreenHeight = ~Number;
+	Params->MinVal = Value;
+	Params->MaxVal = -Value;
+	Params->Absorption = Value + 1;
+	Params->DensityScale = Value + 2;
+	Params->Ambient = Value + 3;
+	Params->LightCount = Number % MAX_LIGHTS;
+	Params->FrameIndex = Number;
+	Params->StepScale = Value + 4;
+
+	for (u32 L = 0; L < MAX_LIGHTS; L++)
+	{
+		Params->Lights[L] = PointLight(v3(Value, f32(L), -Value), v3(1, 1, 1), Value + L);
+	}
+}
+
+DWORD WINAPI
+ParamChannelTestReader(LPVOID Param)
+{
+	param_channel_test		*Test = (param_channel_test *)Param;
+	raymarch_params			Params,
+							Expected;
+	u32						LastVersion = 0;
+	u64						Reads = 0;
+
+
+	while (Test->Running.load(std::memory_order_acquire))
+	{
+		u32 Version = ReadParamChannel(&Test->Channel, &Params);
+
+		FillParamChannelTestInput(&Expected, Params.FrameIndex);
+		if (!ParamsEqual(&Params, &Expected) || Version != Params.FrameIndex || Version < LastVersion)
+		{
+			Test->Errors++;
+		}
+		LastVersion = Version;
+		Reads++;
+	}
+
+	Test->Reads += Reads;
+
+	return (0);
+}
+
+void
+RunParamChannelTest(u32 ReaderCount,
+					u32 PublishCount)
+{
+	param_channel_test		Test;
+	HANDLE					Readers[PARAM_TEST_MAX_READERS];
+	raymarch_params			Params;
+	u64						Start;
+	f64						Ms;
+
+
+	ReaderCount = _Min(_Max(ReaderCount, 1u), u32(PARAM_TEST_MAX_READERS));
+
+	printf("\n== Param channel, %u publishes, %u readers ==\n", PublishCount, ReaderCount);
+
+	FillParamChannelTestInput(&Params, 0);
+	InitParamChannel(&Test.Channel, &Params);
+	Test.Running.store(TRUE);
+	Test.Errors.store(0);
+	Test.Reads.store(0);
+
+	for (u32 I = 0; I < ReaderCount; I++)
+	{
+		Readers[I] = CreateThread(NULL, 0, ParamChannelTestReader, &Test, 0, NULL);
+	}
+
+	Start = ReadTimer();
+	for (u32 Number = 1; Number <= PublishCount; Number++)
+	{
+		FillParamChannelTestInput(&Params, Number);
+
+		if (PublishParamChannel(&Test.Channel, &Params) != Number ||
+			PublishParamChannel(&Test.Channel, &Params) != Number)
+		{
+			Test.Errors++;
+		}
+	}
+	Ms = TimerSeconds(Start, ReadTimer()) * 1e3;
+
+	Test.Running.store(FALSE, std::memory_order_release);
+	WaitForMultipleObjects(ReaderCount, Readers, TRUE, INFINITE);
+	for (u32 I = 0; I < ReaderCount; I++)
+	{
+		CloseHandle(Readers[I]);
+	}
+
+	printf("%.1f ns per publish, %llu reads, version %u, %u errors\n", Ms * 1e6 / (2.0 * PublishCount),
+		   Test.Reads.load(), ParamChannelVersion(&Test.Channel), Test.Errors.load());
+}
+
+#endif // BENCH_IMPL
+
+#endif // __BENCH_H__
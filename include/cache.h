@@ -0,0 +1,585 @@
+#ifndef __CACHE_H__
+#define __CACHE_H__
+
+#include <stdio.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include <mg.h>
+#include <volume.h>
+#include <probes.h>
+
+//////////////////////////////////////////////////////////////////////////////
+// Probe bake cache
+
+// NOTE(matthew): Baked probes are stored on disk keyed by a hash of everything
+// the bake reads: the volume contents, the lighting params and grid_params.
+// Files hold the probes in grid order (not storage order) with the positions
+// stripped, since both are rebuilt from grid_params on load. The payload can
+// optionally be compressed, see EncodeProbeFloats(). The directory is kept
+// under MaxBytes by deleting the least recently used files, a cache hit
+// touches the file's write time so that's what the LRU order goes by.
+
+#define BAKE_CACHE_MAGIC		0x45424f52		// 'ROBE'
+#define BAKE_CACHE_VERSION		3
+
+// Floats per probe in the file, i.e. everything from Transmittance on
+#define PROBE_PAYLOAD_OFFSET	offsetof(probe, Transmittance)
+#define PROBE_PAYLOAD_FLOATS	((sizeof(probe) - PROBE_PAYLOAD_OFFSET) / sizeof(f32))
+
+struct bake_cache
+{
+	std::string		Directory;
+	u64				MaxBytes;
+	b32				Compress;
+	u32				Hits,
+					Misses;
+};
+
+struct bake_cache_header
+{
+	u32				Magic;
+	u32				Version;
+	u64				Key;
+	grid_params		Grid;
+	u32				FloatsPerProbe;
+	u32				Compressed;
+	u32				PayloadBytes;
+	u32				_Pad0;
+};
+
+u64		HashBytes(void const *Data, u64 Size, u64 Hash);
+u64		HashVolume(volume *Volume);
+u64		ProbeBakeKey(u64 VolumeHash, raymarch_params *Params, grid_params *Grid);
+
+void	InitBakeCache(bake_cache *Cache, char const *Directory, u64 MaxBytes, b32 Compress);
+b32		LoadCachedProbes(bake_cache *Cache, u64 Key, grid_params *Grid, probe *Probes);
+void	StoreCachedProbes(bake_cache *Cache, u64 Key, grid_params *Grid, probe *Probes);
+void	EvictBakeCache(bake_cache *Cache);
+
+#ifdef CACHE_IMPL
+
+#include <algorithm>
+#include <windows.h>
+
+#define HASH_SEED		0xcbf29ce484222325ull
+#define HASH_PRIME		0x100000001b3ull
+
+// FNV-1a over 8 byte words with a final mix, the volume is tens of MB so
+// going a byte at a time is noticeably slow
+u64
+HashBytes(void const *Data,
+		  u64 Size,
+		  u64 Hash)
+{
+	u8 const	*Bytes = (u8 const *)Data;
+	u64			Word;
+
+
+	for (; Size >= 8; Size -= 8, Bytes += 8)
+	{
+		memcpy(&Word, Bytes, 8);
+		Hash = (Hash ^ Word) * HASH_PRIME;
+	}
+
+	for (; Size > 0; Size--, Bytes++)
+	{
+		Hash = (Hash ^ *Bytes) * HASH_PRIME;
+	}
+
+	Hash ^= Hash >> 33;
+	Hash *= 0xff51afd7ed558ccdull;
+	Hash ^= Hash >> 33;
+
+	return (Hash);
+}
+
+// Hashes the voxels in grid order so the key doesn't change with the layout
+u64
+HashVolume(volume *Volume)
+{
+	u32		Dims[3] = { Volume->Width, Volume->Height, Volume->Depth };
+	u64		Hash = HashBytes(Dims, sizeof(Dims), HASH_SEED);
+
+
+	if (Volume->Layout == LAYOUT_LINEAR)
+	{
+		return (HashBytes(Volume->Data.data(), u64(Volume->Width) * Volume->Height * Volume->Depth * sizeof(f32), Hash));
+	}
+
+	std::vector<f32>	Row(Volume->Width);
+
+	for (u32 Z = 0; Z < Volume->Depth; Z++)
+	{
+		for (u32 Y = 0; Y < Volume->Height; Y++)
+		{
+			for (u32 X = 0; X < Volume->Width; X++)
+			{
+				Row[X] = Volume->Data[Volume->OffsetX[X] + Volume->OffsetY[Y] + Volume->OffsetZ[Z]];
+			}
+
+			Hash = HashBytes(Row.data(), Row.size() * sizeof(f32), Hash);
+		}
+	}
+
+	return (Hash);
+}
+
+// Only the params the bake reads go into the key, so moving the camera or
+// changing Ambient/LightingMode doesn't miss
+u64
+ProbeBakeKey(u64 VolumeHash,
+			 raymarch_params *Params,
+			 grid_params *Grid)
+{
+	grid_params		KeyGrid = *Grid;
+	u64				Hash = VolumeHash;
+
+
+	// Probes are stored in grid order, so every layout shares an entry
+	KeyGrid.ProbeLayout = 0;
+
+	Hash = HashBytes(&Params->LightCount, sizeof(Params->LightCount), Hash);
+	Hash = HashBytes(Params->Lights, _Min(Params->LightCount, u32(MAX_LIGHTS)) * sizeof(light), Hash);
+	Hash = HashBytes(&Params->Absorption, sizeof(Params->Absorption), Hash);
+	Hash = HashBytes(&Params->DensityScale, sizeof(Params->DensityScale), Hash);
+	Hash = HashBytes(&KeyGrid, sizeof(KeyGrid), Hash);
+
+	return (Hash);
+}
+
+void
+InitBakeCache(bake_cache *Cache,
+			  char const *Directory,
+			  u64 MaxBytes,
+			  b32 Compress)
+{
+	Cache->Directory = Directory;
+	Cache->MaxBytes = MaxBytes;
+	Cache->Compress = Compress;
+	Cache->Hits = 0;
+	Cache->Misses = 0;
+
+	CreateDirectoryA(Directory, NULL);
+}
+
+std::string
+BakeCachePath(bake_cache *Cache,
+			  u64 Key)
+{
+	char	Name[32];
+
+
+	snprintf(Name, sizeof(Name), "%016llx.probes", Key);
+
+	return (Cache->Directory + "/" + Name);
+}
+
+// NOTE(matthew): Transmittance is smooth across the grid and saturates to 1
+// in empty space, so neighbouring floats share most of their bits. Each
+// float is XORed with the previous one, the results are split into four byte
+// planes (the high planes end up mostly zero) and each plane is run-length
+// encoded. Control byte C < 128 is a literal run of C + 1 bytes, otherwise
+// the next byte repeats C - 125 times.
+void
+EncodeByteRuns(u8 *Src,
+			   u32 Count,
+			   std::vector<u8> &Dst)
+{
+	u32		I = 0;
+
+
+	while (I < Count)
+	{
+		u32 Run = 1;
+
+		while (I + Run < Count && Run < 130 && Src[I + Run] == Src[I])
+		{
+			Run++;
+		}
+
+		if (Run >= 3)
+		{
+			Dst.push_back(u8(Run + 125));
+			Dst.push_back(Src[I]);
+			I += Run;
+		}
+		else
+		{
+			u32 Start = I;
+
+			// Extend the literal until the next run worth encoding
+			while (I < Count && I - Start < 128)
+			{
+				if (I + 2 < Count && Src[I] == Src[I + 1] && Src[I] == Src[I + 2])
+				{
+					break;
+				}
+				I++;
+			}
+
+			Dst.push_back(u8(I - Start - 1));
+			Dst.insert(Dst.end(), Src + Start, Src + I);
+		}
+	}
+}
+
+b32
+DecodeByteRuns(u8 *Src,
+			   u32 SrcSize,
+			   u8 *Dst,
+			   u32 Count,
+			   u32 *Consumed)
+{
+	u32		In = 0,
+			Out = 0;
+
+
+	while (Out < Count)
+	{
+		if (In >= SrcSize)
+		{
+			return (FALSE);
+		}
+
+		u32 Control = Src[In++];
+
+		if (Control < 128)
+		{
+			u32 Length = Control + 1;
+
+			if (In + Length > SrcSize || Out + Length > Count)
+			{
+				return (FALSE);
+			}
+
+			memcpy(Dst + Out, Src + In, Length);
+			In += Length;
+			Out += Length;
+		}
+		else
+		{
+			u32 Length = Control - 125;
+
+			if (In >= SrcSize || Out + Length > Count)
+			{
+				return (FALSE);
+			}
+
+			memset(Dst + Out, Src[In++], Length);
+			Out += Length;
+		}
+	}
+
+	*Consumed = In;
+
+	return (TRUE);
+}
+
+void
+EncodeProbeFloats(f32 *Floats,
+				  u32 Count,
+				  std::vector<u8> &Dst)
+{
+	std::vector<u8>		Planes(u64(Count) * 4);
+	u32					Prev = 0;
+
+
+	for (u32 I = 0; I < Count; I++)
+	{
+		u32 Bits;
+
+		memcpy(&Bits, &Floats[I], sizeof(Bits));
+
+		u32 Delta = Bits ^ Prev;
+
+		Prev = Bits;
+		for (u32 Plane = 0; Plane < 4; Plane++)
+		{
+			Planes[u64(Plane) * Count + I] = u8(Delta >> (24 - 8 * Plane));
+		}
+	}
+
+	for (u32 Plane = 0; Plane < 4; Plane++)
+	{
+		EncodeByteRuns(&Planes[u64(Plane) * Count], Count, Dst);
+	}
+}
+
+b32
+DecodeProbeFloats(u8 *Src,
+				  u32 SrcSize,
+				  f32 *Floats,
+				  u32 Count)
+{
+	std::vector<u8>		Planes(u64(Count) * 4);
+	u32					Prev = 0;
+
+
+	for (u32 Plane = 0; Plane < 4; Plane++)
+	{
+		u32 Consumed;
+
+		if (!DecodeByteRuns(Src, SrcSize, &Planes[u64(Plane) * Count], Count, &Consumed))
+		{
+			return (FALSE);
+		}
+
+		Src += Consumed;
+		SrcSize -= Consumed;
+	}
+
+	for (u32 I = 0; I < Count; I++)
+	{
+		u32 Delta = 0;
+
+		for (u32 Plane = 0; Plane < 4; Plane++)
+		{
+			Delta |= u32(Planes[u64(Plane) * Count + I]) << (24 - 8 * Plane);
+		}
+
+		Prev ^= Delta;
+		memcpy(&Floats[I], &Prev, sizeof(Prev));
+	}
+
+	return (TRUE);
+}
+
+// Marks the file as just used for the LRU
+void
+TouchCacheFile(std::string const &Path)
+{
+	HANDLE		File = CreateFileA(Path.c_str(), FILE_WRITE_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+								   OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	FILETIME	Now;
+
+
+	if (File == INVALID_HANDLE_VALUE)
+	{
+		return;
+	}
+
+	GetSystemTimeAsFileTime(&Now);
+	SetFileTime(File, NULL, NULL, &Now);
+	CloseHandle(File);
+}
+
+// Fills Probes (in Grid's storage layout) from the cache, returns FALSE on a
+// miss or if the file doesn't match
+b32
+LoadCachedProbes(bake_cache *Cache,
+				 u64 Key,
+				 grid_params *Grid,
+				 probe *Probes)
+{
+	std::string				Path = BakeCachePath(Cache, Key);
+	FILE					*File = fopen(Path.c_str(), "rb");
+	bake_cache_header		Header;
+	std::vector<u8>			Payload;
+	std::vector<f32>		Floats(u64(Grid->ProbeCount) * PROBE_PAYLOAD_FLOATS);
+	b32						Valid;
+
+
+	if (!File)
+	{
+		Cache->Misses++;
+		return (FALSE);
+	}
+
+	// The layout only changes where the probes go, not their values, so it's
+	// left out of the comparison
+	grid_params Expected = *Grid;
+	Expected.ProbeLayout = 0;
+
+	Valid = fread(&Header, sizeof(Header), 1, File) == 1 &&
+			Header.Magic == BAKE_CACHE_MAGIC &&
+			Header.Version == BAKE_CACHE_VERSION &&
+			Header.Key == Key &&
+			Header.FloatsPerProbe == PROBE_PAYLOAD_FLOATS &&
+			memcmp(&Header.Grid, &Expected, sizeof(Expected)) == 0;
+
+	if (Valid)
+	{
+		Payload.resize(Header.PayloadBytes);
+		Valid = fread(Payload.data(), 1, Payload.size(), File) == Payload.size();
+	}
+	fclose(File);
+
+	if (Valid)
+	{
+		if (Header.Compressed)
+		{
+			Valid = DecodeProbeFloats(Payload.data(), u32(Payload.size()), Floats.data(), u32(Floats.size()));
+		}
+		else
+		{
+			Valid = Payload.size() == Floats.size() * sizeof(f32);
+			if (Valid)
+			{
+				memcpy(Floats.data(), Payload.data(), Payload.size());
+			}
+		}
+	}
+
+	if (!Valid)
+	{
+		Cache->Misses++;
+		return (FALSE);
+	}
+
+	f32 *Src = Floats.data();
+
+	for (s32 Z = 0; Z < Grid->GridDims.z; Z++)
+	{
+		for (s32 Y = 0; Y < Grid->GridDims.y; Y++)
+		{
+			for (s32 X = 0; X < Grid->GridDims.x; X++)
+			{
+				v3i Coord = v3i(X, Y, Z);
+				probe *Probe = &Probes[GridCoordToProbeIndex(Grid, Coord)];
+
+				Probe->Position = GridCoordToPosition(Grid, Coord);
+				memcpy((u8 *)Probe + PROBE_PAYLOAD_OFFSET, Src, PROBE_PAYLOAD_FLOATS * sizeof(f32));
+				Src += PROBE_PAYLOAD_FLOATS;
+			}
+		}
+	}
+
+	TouchCacheFile(Path);
+	Cache->Hits++;
+
+	return (TRUE);
+}
+
+// Probes are in Grid's storage layout
+void
+StoreCachedProbes(bake_cache *Cache,
+				  u64 Key,
+				  grid_params *Grid,
+				  probe *Probes)
+{
+	std::string				Path = BakeCachePath(Cache, Key);
+	std::string				TempPath = Path + ".tmp";
+	bake_cache_header		Header = {};
+	std::vector<f32>		Floats;
+	std::vector<u8>			Payload;
+	FILE					*File;
+
+
+	Floats.reserve(u64(Grid->ProbeCount) * PROBE_PAYLOAD_FLOATS);
+
+	for (s32 Z = 0; Z < Grid->GridDims.z; Z++)
+	{
+		for (s32 Y = 0; Y < Grid->GridDims.y; Y++)
+		{
+			for (s32 X = 0; X < Grid->GridDims.x; X++)
+			{
+				probe *Probe = &Probes[GridCoordToProbeIndex(Grid, v3i(X, Y, Z))];
+				f32 *ProbePayload = (f32 *)((u8 *)Probe + PROBE_PAYLOAD_OFFSET);
+
+				Floats.insert(Floats.end(), ProbePayload, ProbePayload + PROBE_PAYLOAD_FLOATS);
+			}
+		}
+	}
+
+	if (Cache->Compress)
+	{
+		EncodeProbeFloats(Floats.data(), u32(Floats.size()), Payload);
+	}
+	else
+	{
+		Payload.resize(Floats.size() * sizeof(f32));
+		memcpy(Payload.data(), Floats.data(), Payload.size());
+	}
+
+	Header.Magic = BAKE_CACHE_MAGIC;
+	Header.Version = BAKE_CACHE_VERSION;
+	Header.Key = Key;
+	Header.Grid = *Grid;
+	Header.Grid.ProbeLayout = 0;
+	Header.FloatsPerProbe = PROBE_PAYLOAD_FLOATS;
+	Header.Compressed = Cache->Compress;
+	Header.PayloadBytes = u32(Payload.size());
+
+	// Written to a temp file and renamed so other processes sharing the
+	// directory never see a partial file
+	File = fopen(TempPath.c_str(), "wb");
+	if (!File)
+	{
+		return;
+	}
+
+	b32 Written = fwrite(&Header, sizeof(Header), 1, File) == 1 &&
+				  fwrite(Payload.data(), 1, Payload.size(), File) == Payload.size();
+
+	fclose(File);
+
+	if (!Written || !MoveFileExA(TempPath.c_str(), Path.c_str(), MOVEFILE_REPLACE_EXISTING))
+	{
+		DeleteFileA(TempPath.c_str());
+		return;
+	}
+
+	EvictBakeCache(Cache);
+}
+
+struct bake_cache_entry
+{
+	std::string		Path;
+	u64				Size;
+	u64				LastUsed;
+};
+
+// Deletes the least recently used files until the directory fits in MaxBytes
+void
+EvictBakeCache(bake_cache *Cache)
+{
+	std::string						Pattern = Cache->Directory + "/*.probes";
+	std::vector<bake_cache_entry>	Entries;
+	WIN32_FIND_DATAA				FindData;
+	HANDLE							Find;
+	u64								TotalBytes = 0;
+
+
+	Find = FindFirstFileA(Pattern.c_str(), &FindData);
+	if (Find == INVALID_HANDLE_VALUE)
+	{
+		return;
+	}
+
+	do
+	{
+		bake_cache_entry Entry;
+
+		Entry.Path = Cache->Directory + "/" + FindData.cFileName;
+		Entry.Size = (u64(FindData.nFileSizeHigh) << 32) | FindData.nFileSizeLow;
+		Entry.LastUsed = (u64(FindData.ftLastWriteTime.dwHighDateTime) << 32) | FindData.ftLastWriteTime.dwLowDateTime;
+
+		TotalBytes += Entry.Size;
+		Entries.push_back(Entry);
+	} while (FindNextFileA(Find, &FindData));
+
+	FindClose(Find);
+
+	if (TotalBytes <= Cache->MaxBytes)
+	{
+		return;
+	}
+
+	std::sort(Entries.begin(), Entries.end(), [](bake_cache_entry const &A, bake_cache_entry const &B)
+	{
+		return (A.LastUsed < B.LastUsed);
+	});
+
+	for (u32 I = 0; I < Entries.size() && TotalBytes > Cache->MaxBytes; I++)
+	{
+		if (DeleteFileA(Entries[I].Path.c_str()))
+		{
+			TotalBytes -= Entries[I].Size;
+		}
+	}
+}
+
+#endif // CACHE_IMPL
+
+#endif // __CACHE_H__
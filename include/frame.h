@@ -0,0 +1,286 @@
+#ifndef __FRAME_H__
+#define __FRAME_H__
+
+#include <atomic>
+#include <vector>
+#include <mg.h>
+#include <volume.h>
+#include <probes.h>
+#include <scatter.h>
+
+//////////////////////////////////////////////////////////////////////////////
+// Frame pipeline
+
+// NOTE(matthew): The viewer's frame runs as two stages on two threads. The
+// UI stage, on the main thread, polls input, builds the ImGui frame and
+// fills in a frame_input with everything the frame is drawn from. The render
+// stage, on a thread of its own, takes the latest frame_input, runs the
+// bakes, submits the draws and presents. So while the render stage submits
+// frame N, and waits on Present() for it, the UI stage is building N + 1.
+//
+// Inputs go over a triple_buffer, so neither stage waits to hand one over.
+// The camera and the raymarch params go over param_channels instead, which
+// any thread can read and whose versions tell the render stage's caches
+// whether they changed. The render stage reads them while it latches the
+// input, which makes them the ones published with it.
+// The UI stage is held to one frame ahead: BeginFrameInput() waits until the
+// render stage has latched the previous input, i.e. is done with anything
+// the UI stage owns (ImGui's textures, the draw lists' texture references),
+// see EndFrameLatch(). What the UI shows about the render side, the grid
+// size or the cache hits, comes back in a frame_output a frame or two late.
+//
+// One-shot requests, loading a volume or refitting the grid, are serial
+// numbers the render stage compares against the last one it handled, so
+// they survive an input it never saw.
+//
+// The render thread takes over worker 0 of the job system for as long as
+// it runs, the bakes it kicks off are the ones that need it.
+
+struct ImDrawList;
+
+// Everything the viewer's widgets change that the render stage reads. Types
+// are whatever ImGui edits in place.
+struct frame_ui
+{
+	bool					ShowProbes,
+							Accumulate,
+							Temporal,
+							UseBakeCache,
+							Interacting;		// an item is active, the slow bakes wait for it to end
+	s32						AccumMaxFrames,
+							TemporalFrames,
+							ProbeLayout;
+	u32						RefitSerial,		// bumped to refit the probe grid
+							VolumeSerial;		// bumped to load VolumeFile
+	char					VolumeFile[MAX_PATH];
+	probe_budget			ProbeBudget;
+	scatter_bake_params		ScatterBake;
+};
+
+struct frame_input
+{
+	u64							Number;
+	u64							Published;		// ReadTimer()
+	frame_ui					Ui;
+
+	// ImGui's draw data, the lists are clones the slot owns
+	std::vector<ImDrawList *>	Overlay;
+	v2							OverlayPos,
+								OverlaySize,
+								OverlayScale;
+};
+
+struct frame_output
+{
+	u64				Number;				// of the input it was rendered from
+	f64				LatchMs,
+					RenderMs;
+	u32				AccumFrames;
+	grid_params		Grid;
+	probe_fit		Fit;
+	u32				CacheHits,
+					CacheMisses;
+	v3i				ScatterDims;
+};
+
+typedef void frame_render_func(void *Data, frame_input *Input, frame_output *Output);
+
+struct frame_pipeline
+{
+	triple_buffer<frame_input>		Inputs;
+	triple_buffer<frame_output>		Outputs;
+	param_channel<model_params>		Model;
+	param_channel<raymarch_params>	Params;
+	frame_render_func				*Render;
+	void							*Data;
+	job_system						*Jobs;
+	HANDLE							Thread,
+									Ready,			// released per published input
+									Latched;		// released per latched input
+	std::atomic<b32>				Running;
+	b32								Latching;		// render thread only
+	u64								LatchStart,		// render thread only
+									LatchEnd;
+	u64								InputCount;		// UI thread only
+};
+
+void			StartFramePipeline(frame_pipeline *Pipeline, job_system *Jobs, frame_render_func *Render, void *Data);
+void			StopFramePipeline(frame_pipeline *Pipeline);
+frame_input		*BeginFrameInput(frame_pipeline *Pipeline);
+void			PublishFrameInput(frame_pipeline *Pipeline);
+void			EndFrameLatch(frame_pipeline *Pipeline);
+frame_output	*LatestFrameOutput(frame_pipeline *Pipeline, b32 *Fresh);
+
+// The same with anything callable as Render(Input, Output), usually a
+// lambda. Unlike ParallelFor()'s it has to outlive the pipeline.
+template <typename func>
+void
+FrameRenderThunk(void *Data,
+				 frame_input *Input,
+				 frame_output *Output)
+{
+	(*(func *)Data)(Input, Output);
+}
+
+template <typename func>
+void
+StartFramePipeline(frame_pipeline *Pipeline,
+				   job_system *Jobs,
+				   func const &Render)
+{
+	StartFramePipeline(Pipeline, Jobs, FrameRenderThunk<func>, (void *)&Render);
+}
+
+#ifdef FRAME_IMPL
+
+DWORD WINAPI
+FrameRenderThread(LPVOID Param)
+{
+	frame_pipeline		*Pipeline = (frame_pipeline *)Param;
+
+
+	if (Pipeline->Jobs)
+	{
+		EnterJobSystem(Pipeline->Jobs);
+	}
+
+	for (;;)
+	{
+		WaitForSingleObject(Pipeline->Ready, INFINITE);
+		if (!Pipeline->Running.load(std::memory_order_acquire))
+		{
+			break;
+		}
+
+		// Every release of Ready comes with a fresh input, the UI stage can't
+		// get any further ahead
+		frame_input *Input = ReadTripleBuffer(&Pipeline->Inputs, (b32 *)NULL);
+		frame_output *Output = TripleBufferBack(&Pipeline->Outputs);
+
+		Pipeline->Latching = TRUE;
+		Pipeline->LatchStart = ReadTimer();
+		Pipeline->Render(Pipeline->Data, Input, Output);
+		EndFrameLatch(Pipeline);
+
+		Output->Number = Input->Number;
+		Output->LatchMs = TimerSeconds(Pipeline->LatchStart, Pipeline->LatchEnd) * 1e3;
+		Output->RenderMs = TimerSeconds(Pipeline->LatchStart, ReadTimer()) * 1e3;
+		PublishTripleBuffer(&Pipeline->Outputs);
+	}
+
+	if (Pipeline->Jobs)
+	{
+		LeaveJobSystem();
+	}
+
+	// The render func's kernels take their scratch from this thread too
+	ReleaseScratchArena();
+
+	return (0);
+}
+
+// Starts the render stage. Jobs, if there is one, is handed from the calling
+// thread to the render thread until StopFramePipeline().
+void
+StartFramePipeline(frame_pipeline *Pipeline,
+				   job_system *Jobs,
+				   frame_render_func *Render,
+				   void *Data)
+{
+	model_params		Model = {};
+	raymarch_params		Params = {};
+
+
+	InitTripleBuffer(&Pipeline->Inputs);
+	InitTripleBuffer(&Pipeline->Outputs);
+	InitParamChannel(&Pipeline->Model, &Model);
+	InitParamChannel(&Pipeline->Params, &Params);
+
+	Pipeline->Render = Render;
+	Pipeline->Data = Data;
+	Pipeline->Jobs = Jobs;
+	Pipeline->Ready = CreateSemaphoreA(NULL, 0, 0x7FFFFFFF, NULL);
+	Pipeline->Latched = CreateSemaphoreA(NULL, 1, 1, NULL);
+	Pipeline->Running.store(TRUE);
+	Pipeline->Latching = FALSE;
+	Pipeline->InputCount = 0;
+
+	if (Jobs)
+	{
+		LeaveJobSystem();
+	}
+
+	Pipeline->Thread = CreateThread(NULL, 0, FrameRenderThread, Pipeline, 0, NULL);
+}
+
+// Drops an input that hasn't been rendered yet, the one being rendered is
+// finished. Jobs comes back to the calling thread.
+void
+StopFramePipeline(frame_pipeline *Pipeline)
+{
+	Pipeline->Running.store(FALSE, std::memory_order_release);
+	ReleaseSemaphore(Pipeline->Ready, 1, NULL);
+	WaitForSingleObject(Pipeline->Thread, INFINITE);
+
+	CloseHandle(Pipeline->Thread);
+	CloseHandle(Pipeline->Ready);
+	CloseHandle(Pipeline->Latched);
+
+	if (Pipeline->Jobs)
+	{
+		EnterJobSystem(Pipeline->Jobs);
+	}
+}
+
+// UI thread. Waits until the render stage has latched the last input, then
+// returns the slot to fill in. It holds whatever was put in it two inputs
+// ago, so anything it owns can be reused.
+frame_input *
+BeginFrameInput(frame_pipeline *Pipeline)
+{
+	frame_input		*Input;
+
+
+	WaitForSingleObject(Pipeline->Latched, INFINITE);
+
+	Input = TripleBufferBack(&Pipeline->Inputs);
+	Input->Number = Pipeline->InputCount++;
+
+	return (Input);
+}
+
+// UI thread, after the input's Model and Params are published
+void
+PublishFrameInput(frame_pipeline *Pipeline)
+{
+	TripleBufferBack(&Pipeline->Inputs)->Published = ReadTimer();
+	PublishTripleBuffer(&Pipeline->Inputs);
+	ReleaseSemaphore(Pipeline->Ready, 1, NULL);
+}
+
+// Render thread. Lets the UI stage start on the next input, the render func
+// calls it once it's done with anything the UI stage owns. Otherwise it's
+// called when the render func returns.
+void
+EndFrameLatch(frame_pipeline *Pipeline)
+{
+	if (Pipeline->Latching)
+	{
+		Pipeline->Latching = FALSE;
+		Pipeline->LatchEnd = ReadTimer();
+		ReleaseSemaphore(Pipeline->Latched, 1, NULL);
+	}
+}
+
+// UI thread, the last frame_output the render stage finished. All zero
+// before the first.
+frame_output *
+LatestFrameOutput(frame_pipeline *Pipeline,
+				  b32 *Fresh)
+{
+	return (ReadTripleBuffer(&Pipeline->Outputs, Fresh));
+}
+
+#endif // FRAME_IMPL
+
+#endif // __FRAME_H__
@@ -6,6 +6,7 @@
 //****************************************************************************
 
 #include <stdint.h>
+#include <float.h>
 
 // Signed
 typedef char                s8;
@@ -69,1092 +70,1417 @@ typedef s32                 b32;
 #define INV_PI              (1.0f / PI)
 
 ////////////////////////////////////////
-// V2
+// SIMD
 ////////////////////////////////////////
 
-union v2
-{
-    struct { f32 x, y; };
-    struct { f32 r, g; };
-    struct { f32 u, v; };
-    f32 Elements[2];
+// NOTE(matthew): Four wide float ops for v4, m4 and the wide types further
+// down. SSE2 is always there on x64 and NEON on ARM64 (32-bit ARM has no
+// vector divide or square root, so it stays scalar), so these switch on by
+// themselves; define MG_NO_SIMD to get the scalar paths back. MG_SIMD says
+// whether there's hardware behind f32x4, the functions work either way.
+// Everything loads and stores unaligned, so the types keep their layout.
+// Only adds, subtracts, multiplies, divides and square roots, in the same
+// order as the scalar code, so both paths agree to the bit (bar the sign of
+// a zero).
+//
+// b32x4 is a per lane mask from the compares, all ones or all zeros, for
+// F32x4Select() and masking off finished lanes.
+
+#if !defined(MG_NO_SIMD) && !defined(MG_USE_SSE) && !defined(MG_USE_NEON)
+    #if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+        #define MG_USE_SSE
+    #elif defined(__aarch64__) || defined(_M_ARM64)
+        #define MG_USE_NEON
+    #endif
+#endif
 
+#if defined(MG_USE_SSE)
+    #include <emmintrin.h>
 
-    v2(void);
-    v2(f32 x, f32 y);
+    #define MG_SIMD
+    typedef __m128          f32x4;
+    typedef __m128          b32x4;
+#elif defined(MG_USE_NEON)
+    #include <arm_neon.h>
 
+    #define MG_SIMD
+    typedef float32x4_t     f32x4;
+    typedef uint32x4_t      b32x4;
+#else
+    struct f32x4 { f32 E[4]; };
+    struct b32x4 { u32 E[4]; };
+#endif
 
-    v2      operator-(void);
-    f32     &operator[](const u32 Component);
 
-    v2      &operator+=(const v2 &V);
-    v2      &operator-=(const v2 &V);
-    v2      &operator*=(const f32 T);
-    v2      &operator/=(const f32 T);
-};
+inline f32x4
+F32x4Load(f32 const *P)
+{
+#if defined(MG_USE_SSE)
+    return (_mm_loadu_ps(P));
+#elif defined(MG_USE_NEON)
+    return (vld1q_f32(P));
+#else
+    f32x4 Result;
 
-v2      operator+(const v2 &U, const v2 &V);
-v2      operator-(const v2 &U, const v2 &V);
-v2      operator*(const f32 T, const v2 &U);
-v2      operator/(const v2 &U, const f32 T);
-f32     Dot(const v2 &U, const v2 &V);
-f32     Length(const v2 &V);
-f32     LengthSquared(const v2 &V);
-v2      Normalize(const v2 &V);
-v2      Hadamard(const v2 &U, const v2 &V);
+    for (u32 I = 0; I < 4; I++)
+    {
+        Result.E[I] = P[I];
+    }
 
-#ifdef MG_IMPL
+    return (Result);
+#endif
+}
 
-v2::v2(void)
+inline void
+F32x4Store(f32 *P,
+           f32x4 A)
 {
-    this->x = 0;
-    this->y = 0;
+#if defined(MG_USE_SSE)
+    _mm_storeu_ps(P, A);
+#elif defined(MG_USE_NEON)
+    vst1q_f32(P, A);
+#else
+    for (u32 I = 0; I < 4; I++)
+    {
+        P[I] = A.E[I];
+    }
+#endif
 }
 
-v2::v2(f32 x,
-       f32 y)
+inline f32x4
+F32x4Set1(f32 A)
 {
-    this->x = x;
-    this->y = y;
+#if defined(MG_USE_SSE)
+    return (_mm_set1_ps(A));
+#elif defined(MG_USE_NEON)
+    return (vdupq_n_f32(A));
+#else
+    f32x4 Result = {{ A, A, A, A }};
+
+    return (Result);
+#endif
 }
 
-v2
-v2::operator-(void)
+inline f32x4
+F32x4Set(f32 A,
+         f32 B,
+         f32 C,
+         f32 D)
 {
-    this->x *= -1;
-    this->y *= -1;
+#if defined(MG_USE_SSE)
+    return (_mm_setr_ps(A, B, C, D));
+#elif defined(MG_USE_NEON)
+    f32 Lanes[4] = { A, B, C, D };
 
-    return (*this);
+    return (vld1q_f32(Lanes));
+#else
+    f32x4 Result = {{ A, B, C, D }};
+
+    return (Result);
+#endif
 }
 
-f32 &
-v2::operator[](const u32 Component)
+inline f32x4
+F32x4Add(f32x4 A,
+         f32x4 B)
 {
-    return (this->Elements[Component]);
+#if defined(MG_USE_SSE)
+    return (_mm_add_ps(A, B));
+#elif defined(MG_USE_NEON)
+    return (vaddq_f32(A, B));
+#else
+    f32x4 Result;
+
+    for (u32 I = 0; I < 4; I++)
+    {
+        Result.E[I] = A.E[I] + B.E[I];
+    }
+
+    return (Result);
+#endif
 }
 
-v2 &
-v2::operator+=(const v2 &V)
+inline f32x4
+F32x4Sub(f32x4 A,
+         f32x4 B)
 {
-    this->x += V.x;
-    this->y += V.y;
+#if defined(MG_USE_SSE)
+    return (_mm_sub_ps(A, B));
+#elif defined(MG_USE_NEON)
+    return (vsubq_f32(A, B));
+#else
+    f32x4 Result;
 
-    return (*this);
+    for (u32 I = 0; I < 4; I++)
+    {
+        Result.E[I] = A.E[I] - B.E[I];
+    }
+
+    return (Result);
+#endif
 }
 
-v2 &
-v2::operator-=(const v2 &V)
+inline f32x4
+F32x4Mul(f32x4 A,
+         f32x4 B)
 {
-    this->x -= V.x;
-    this->y -= V.y;
+#if defined(MG_USE_SSE)
+    return (_mm_mul_ps(A, B));
+#elif defined(MG_USE_NEON)
+    return (vmulq_f32(A, B));
+#else
+    f32x4 Result;
 
-    return (*this);
+    for (u32 I = 0; I < 4; I++)
+    {
+        Result.E[I] = A.E[I] * B.E[I];
+    }
+
+    return (Result);
+#endif
 }
 
-v2 &
-v2::operator*=(const f32 T)
+inline f32x4
+F32x4Div(f32x4 A,
+         f32x4 B)
 {
-    this->x *= T;
-    this->y *= T;
+#if defined(MG_USE_SSE)
+    return (_mm_div_ps(A, B));
+#elif defined(MG_USE_NEON)
+    return (vdivq_f32(A, B));
+#else
+    f32x4 Result;
 
-    return (*this);
+    for (u32 I = 0; I < 4; I++)
+    {
+        Result.E[I] = A.E[I] / B.E[I];
+    }
+
+    return (Result);
+#endif
 }
 
-v2 &
-v2::operator/=(const f32 T)
+// Like _Min()/_Max(), B where either is NaN
+inline f32x4
+F32x4Min(f32x4 A,
+         f32x4 B)
 {
-    this->x /= T;
-    this->y /= T;
+#if defined(MG_USE_SSE)
+    return (_mm_min_ps(A, B));
+#elif defined(MG_USE_NEON)
+    return (vbslq_f32(vcltq_f32(A, B), A, B));
+#else
+    f32x4 Result;
 
-    return (*this);
+    for (u32 I = 0; I < 4; I++)
+    {
+        Result.E[I] = _Min(A.E[I], B.E[I]);
+    }
+
+    return (Result);
+#endif
 }
 
-v2
-operator+(const v2 &U,
-          const v2 &V)
+inline f32x4
+F32x4Max(f32x4 A,
+         f32x4 B)
 {
-    v2 Result;
+#if defined(MG_USE_SSE)
+    return (_mm_max_ps(A, B));
+#elif defined(MG_USE_NEON)
+    return (vbslq_f32(vcgtq_f32(A, B), A, B));
+#else
+    f32x4 Result;
 
-    Result.x = U.x + V.x;
-    Result.y = U.y + V.y;
+    for (u32 I = 0; I < 4; I++)
+    {
+        Result.E[I] = _Max(A.E[I], B.E[I]);
+    }
 
     return (Result);
+#endif
 }
 
-v2
-operator-(const v2 &U,
-          const v2 &V)
+inline f32x4
+F32x4Sqrt(f32x4 A)
 {
-    v2 Result;
+#if defined(MG_USE_SSE)
+    return (_mm_sqrt_ps(A));
+#elif defined(MG_USE_NEON)
+    return (vsqrtq_f32(A));
+#else
+    f32x4 Result;
 
-    Result.x = U.x - V.x;
-    Result.y = U.y - V.y;
+    for (u32 I = 0; I < 4; I++)
+    {
+        Result.E[I] = SquareRoot(A.E[I]);
+    }
 
     return (Result);
+#endif
 }
 
-v2
-operator*(const f32 T,
-          const v2 &V)
+inline b32x4
+F32x4Less(f32x4 A,
+          f32x4 B)
 {
-    v2 Result;
+#if defined(MG_USE_SSE)
+    return (_mm_cmplt_ps(A, B));
+#elif defined(MG_USE_NEON)
+    return (vcltq_f32(A, B));
+#else
+    b32x4 Result;
 
-    Result.x = T * V.x;
-    Result.y = T * V.y;
+    for (u32 I = 0; I < 4; I++)
+    {
+        Result.E[I] = A.E[I] < B.E[I] ? 0xFFFFFFFF : 0;
+    }
 
-    return Result;
+    return (Result);
+#endif
 }
 
-v2
-operator/(const v2 &V,
-          const f32 T)
+inline b32x4
+F32x4LessEqual(f32x4 A,
+               f32x4 B)
 {
-    v2 Result;
+#if defined(MG_USE_SSE)
+    return (_mm_cmple_ps(A, B));
+#elif defined(MG_USE_NEON)
+    return (vcleq_f32(A, B));
+#else
+    b32x4 Result;
 
-    Result.x = V.x / T;
-    Result.y = V.y / T;
+    for (u32 I = 0; I < 4; I++)
+    {
+        Result.E[I] = A.E[I] <= B.E[I] ? 0xFFFFFFFF : 0;
+    }
 
-    return Result;
+    return (Result);
+#endif
 }
 
-f32
-Dot(const v2 &U,
-    const v2 &V)
+inline b32x4
+F32x4Greater(f32x4 A,
+             f32x4 B)
 {
-    return (U.x * V.x) + (U.y * V.y);
+#if defined(MG_USE_SSE)
+    return (_mm_cmpgt_ps(A, B));
+#elif defined(MG_USE_NEON)
+    return (vcgtq_f32(A, B));
+#else
+    b32x4 Result;
+
+    for (u32 I = 0; I < 4; I++)
+    {
+        Result.E[I] = A.E[I] > B.E[I] ? 0xFFFFFFFF : 0;
+    }
+
+    return (Result);
+#endif
 }
 
-f32
-Length(const v2 &V)
+inline b32x4
+F32x4GreaterEqual(f32x4 A,
+                  f32x4 B)
 {
-    return SquareRoot(Dot(V, V));
+#if defined(MG_USE_SSE)
+    return (_mm_cmpge_ps(A, B));
+#elif defined(MG_USE_NEON)
+    return (vcgeq_f32(A, B));
+#else
+    b32x4 Result;
+
+    for (u32 I = 0; I < 4; I++)
+    {
+        Result.E[I] = A.E[I] >= B.E[I] ? 0xFFFFFFFF : 0;
+    }
+
+    return (Result);
+#endif
 }
 
-f32
-LengthSquared(const v2 &V)
+inline b32x4
+F32x4Equal(f32x4 A,
+           f32x4 B)
 {
-    return Dot(V, V);
+#if defined(MG_USE_SSE)
+    return (_mm_cmpeq_ps(A, B));
+#elif defined(MG_USE_NEON)
+    return (vceqq_f32(A, B));
+#else
+    b32x4 Result;
+
+    for (u32 I = 0; I < 4; I++)
+    {
+        Result.E[I] = A.E[I] == B.E[I] ? 0xFFFFFFFF : 0;
+    }
+
+    return (Result);
+#endif
 }
 
-v2
-Normalize(const v2 &V)
+// Mask ? A : B per lane
+inline f32x4
+F32x4Select(b32x4 Mask,
+            f32x4 A,
+            f32x4 B)
 {
-    return V / Length(V);
+#if defined(MG_USE_SSE)
+    return (_mm_or_ps(_mm_and_ps(Mask, A), _mm_andnot_ps(Mask, B)));
+#elif defined(MG_USE_NEON)
+    return (vbslq_f32(Mask, A, B));
+#else
+    f32x4 Result;
+
+    for (u32 I = 0; I < 4; I++)
+    {
+        Result.E[I] = Mask.E[I] ? A.E[I] : B.E[I];
+    }
+
+    return (Result);
+#endif
 }
 
-v2      
-Hadamard(const v2 &U, 
-         const v2 &V)
+inline b32x4
+B32x4And(b32x4 A,
+         b32x4 B)
 {
-    v2 Result;
+#if defined(MG_USE_SSE)
+    return (_mm_and_ps(A, B));
+#elif defined(MG_USE_NEON)
+    return (vandq_u32(A, B));
+#else
+    b32x4 Result;
 
-    Result.x = U.x * V.x;
-    Result.y = U.y * V.y;
+    for (u32 I = 0; I < 4; I++)
+    {
+        Result.E[I] = A.E[I] & B.E[I];
+    }
 
     return (Result);
+#endif
 }
 
-#endif // MG_IMPL
+inline b32x4
+B32x4Or(b32x4 A,
+        b32x4 B)
+{
+#if defined(MG_USE_SSE)
+    return (_mm_or_ps(A, B));
+#elif defined(MG_USE_NEON)
+    return (vorrq_u32(A, B));
+#else
+    b32x4 Result;
 
-////////////////////////////////////////
-// V2i
-////////////////////////////////////////
+    for (u32 I = 0; I < 4; I++)
+    {
+        Result.E[I] = A.E[I] | B.E[I];
+    }
 
-union v2i
+    return (Result);
+#endif
+}
+
+// A and not B
+inline b32x4
+B32x4AndNot(b32x4 A,
+            b32x4 B)
 {
-    struct { s32 x, y; };
-    struct { s32 r, g; };
-    struct { s32 u, v; };
-    s32 Elements[2];
+#if defined(MG_USE_SSE)
+    return (_mm_andnot_ps(B, A));
+#elif defined(MG_USE_NEON)
+    return (vbicq_u32(A, B));
+#else
+    b32x4 Result;
 
+    for (u32 I = 0; I < 4; I++)
+    {
+        Result.E[I] = A.E[I] & ~B.E[I];
+    }
 
-    v2i(void);
-    v2i(s32 x, s32 y);
+    return (Result);
+#endif
+}
 
+// One bit per lane, lane 0 in bit 0
+inline u32
+B32x4Bits(b32x4 Mask)
+{
+#if defined(MG_USE_SSE)
+    return (u32(_mm_movemask_ps(Mask)));
+#elif defined(MG_USE_NEON)
+    u32 LaneBits[4] = { 1, 2, 4, 8 };
 
-    v2i     operator-(void);
-    s32     &operator[](const u32 Component);
+    return (vaddvq_u32(vandq_u32(Mask, vld1q_u32(LaneBits))));
+#else
+    return ((Mask.E[0] & 1) | (Mask.E[1] & 2) | (Mask.E[2] & 4) | (Mask.E[3] & 8));
+#endif
+}
 
-    v2i         &operator+=(const v2i &V);
-    v2i         &operator-=(const v2i &V);
-    v2i         &operator*=(const s32 T);
-};
+// The mask B32x4Bits() came from
+inline b32x4
+B32x4FromBits(u32 Bits)
+{
+#if defined(MG_USE_SSE)
+    __m128i LaneBits = _mm_setr_epi32(1, 2, 4, 8);
 
-v2i     operator+(const v2i &U, const v2i &V);
-v2i     operator-(const v2i &U, const v2i &V);
-v2i     operator*(const s32 T, const v2i &U);
-v2i     operator/(const v2i &U, const s32 T);
-s32     Dot(const v2i &U, const v2i &V);
-v2i     Hadamard(const v2i &U, const v2i &V);
+    return (_mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32(s32(Bits)), LaneBits), LaneBits)));
+#elif defined(MG_USE_NEON)
+    u32 LaneBits[4] = { 1, 2, 4, 8 };
 
-#ifdef MG_IMPL
+    return (vtstq_u32(vdupq_n_u32(Bits), vld1q_u32(LaneBits)));
+#else
+    b32x4 Result;
 
-v2i::v2i(void)
-{
-    this->x = 0;
-    this->y = 0;
+    for (u32 I = 0; I < 4; I++)
+    {
+        Result.E[I] = ((Bits >> I) & 1) ? 0xFFFFFFFF : 0;
+    }
+
+    return (Result);
+#endif
 }
 
-v2i::v2i(s32 x,
-       s32 y)
+inline b32
+B32x4Any(b32x4 Mask)
 {
-    this->x = x;
-    this->y = y;
+    return (B32x4Bits(Mask) != 0);
 }
 
-v2i
-v2i::operator-(void)
+inline b32
+B32x4All(b32x4 Mask)
 {
-    this->x *= -1;
-    this->y *= -1;
+    return (B32x4Bits(Mask) == 0xF);
+}
 
-    return (*this);
+// Four packed xyz triples (12 floats) to one register per component, and
+// back
+inline void
+F32x4Load3(f32 const *P,
+           f32x4 *X,
+           f32x4 *Y,
+           f32x4 *Z)
+{
+#if defined(MG_USE_SSE)
+    __m128  A = _mm_loadu_ps(P),                                // x0 y0 z0 x1
+            B = _mm_loadu_ps(P + 4),                            // y1 z1 x2 y2
+            C = _mm_loadu_ps(P + 8),                            // z2 x3 y3 z3
+            T = _mm_shuffle_ps(B, C, _MM_SHUFFLE(2, 1, 3, 2)),  // x2 y2 x3 y3
+            U = _mm_shuffle_ps(A, B, _MM_SHUFFLE(1, 0, 2, 1));  // y0 z0 y1 z1
+
+    *X = _mm_shuffle_ps(A, T, _MM_SHUFFLE(2, 0, 3, 0));
+    *Y = _mm_shuffle_ps(U, T, _MM_SHUFFLE(3, 1, 2, 0));
+    *Z = _mm_shuffle_ps(U, C, _MM_SHUFFLE(3, 0, 3, 1));
+#elif defined(MG_USE_NEON)
+    float32x4x3_t V = vld3q_f32(P);
+
+    *X = V.val[0];
+    *Y = V.val[1];
+    *Z = V.val[2];
+#else
+    for (u32 I = 0; I < 4; I++)
+    {
+        X->E[I] = P[3 * I];
+        Y->E[I] = P[3 * I + 1];
+        Z->E[I] = P[3 * I + 2];
+    }
+#endif
 }
 
-s32 &
-v2i::operator[](const u32 Component)
-{
-    return (this->Elements[Component]);
+inline void
+F32x4Store3(f32 *P,
+            f32x4 X,
+            f32x4 Y,
+            f32x4 Z)
+{
+#if defined(MG_USE_SSE)
+    __m128  XY01 = _mm_unpacklo_ps(X, Y),                           // x0 y0 x1 y1
+            XY23 = _mm_unpackhi_ps(X, Y),                           // x2 y2 x3 y3
+            W = _mm_shuffle_ps(Z, XY01, _MM_SHUFFLE(2, 2, 0, 0)),   // z0 z0 x1 x1
+            V = _mm_shuffle_ps(XY01, Z, _MM_SHUFFLE(1, 1, 3, 3)),   // y1 y1 z1 z1
+            S = _mm_shuffle_ps(Z, XY23, _MM_SHUFFLE(2, 2, 2, 2)),   // z2 z2 x3 x3
+            R = _mm_shuffle_ps(XY23, Z, _MM_SHUFFLE(3, 3, 3, 3));   // y3 y3 z3 z3
+
+    _mm_storeu_ps(P, _mm_shuffle_ps(XY01, W, _MM_SHUFFLE(2, 0, 1, 0)));
+    _mm_storeu_ps(P + 4, _mm_shuffle_ps(V, XY23, _MM_SHUFFLE(1, 0, 2, 0)));
+    _mm_storeu_ps(P + 8, _mm_shuffle_ps(S, R, _MM_SHUFFLE(2, 0, 2, 0)));
+#elif defined(MG_USE_NEON)
+    float32x4x3_t V;
+
+    V.val[0] = X;
+    V.val[1] = Y;
+    V.val[2] = Z;
+    vst3q_f32(P, V);
+#else
+    for (u32 I = 0; I < 4; I++)
+    {
+        P[3 * I] = X.E[I];
+        P[3 * I + 1] = Y.E[I];
+        P[3 * I + 2] = Z.E[I];
+    }
+#endif
 }
 
-v2i &
-v2i::operator+=(const v2i &V)
+// Round to the nearest whole number, ties to even. |A| < 2^31.
+inline f32x4
+F32x4Round(f32x4 A)
 {
-    this->x += V.x;
-    this->y += V.y;
+#if defined(MG_USE_SSE)
+    return (_mm_cvtepi32_ps(_mm_cvtps_epi32(A)));
+#elif defined(MG_USE_NEON)
+    return (vrndnq_f32(A));
+#else
+    f32x4 Result;
 
-    return (*this);
+    for (u32 I = 0; I < 4; I++)
+    {
+        Result.E[I] = std::nearbyint(A.E[I]);
+    }
+
+    return (Result);
+#endif
 }
 
-v2i &
-v2i::operator-=(const v2i &V)
+// floorf() per lane, |A| < 2^31
+inline f32x4
+F32x4Floor(f32x4 A)
 {
-    this->x -= V.x;
-    this->y -= V.y;
+#if defined(MG_USE_SSE)
+    f32x4 Rounded = F32x4Round(A);
 
-    return (*this);
-}
+    return (F32x4Sub(Rounded, _mm_and_ps(F32x4Greater(Rounded, A), _mm_set1_ps(1.0f))));
+#elif defined(MG_USE_NEON)
+    return (vrndmq_f32(A));
+#else
+    f32x4 Result;
 
-v2i &
-v2i::operator*=(const s32 T)
-{
-    this->x *= T;
-    this->y *= T;
+    for (u32 I = 0; I < 4; I++)
+    {
+        Result.E[I] = floorf(A.E[I]);
+    }
 
-    return (*this);
+    return (Result);
+#endif
 }
 
-v2i
-operator+(const v2i &U,
-          const v2i &V)
+// 2^N for whole N in [-126, 127], built straight from the exponent bits
+inline f32x4
+F32x4Pow2(f32x4 N)
 {
-    v2i Result;
+#if defined(MG_USE_SSE)
+    return (_mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(_mm_cvtps_epi32(N), _mm_set1_epi32(127)), 23)));
+#elif defined(MG_USE_NEON)
+    return (vreinterpretq_f32_s32(vshlq_n_s32(vaddq_s32(vcvtnq_s32_f32(N), vdupq_n_s32(127)), 23)));
+#else
+    f32x4 Result;
 
-    Result.x = U.x + V.x;
-    Result.y = U.y + V.y;
+    for (u32 I = 0; I < 4; I++)
+    {
+        union { u32 U; f32 F; } Bits;
+
+        Bits.U = u32(s32(N.E[I]) + 127) << 23;
+        Result.E[I] = Bits.F;
+    }
 
     return (Result);
+#endif
 }
 
-v2i
-operator-(const v2i &U,
-          const v2i &V)
+// Splits positive normal floats into a mantissa in [1, 2) and the exponent
+inline f32x4
+F32x4Mantissa(f32x4 A,
+              f32x4 *Exponent)
 {
-    v2i Result;
+#if defined(MG_USE_SSE)
+    __m128i Bits = _mm_castps_si128(A);
 
-    Result.x = U.x - V.x;
-    Result.y = U.y - V.y;
+    *Exponent = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(Bits, 23), _mm_set1_epi32(127)));
+
+    return (_mm_castsi128_ps(_mm_or_si128(_mm_and_si128(Bits, _mm_set1_epi32(0x007FFFFF)), _mm_set1_epi32(0x3F800000))));
+#elif defined(MG_USE_NEON)
+    uint32x4_t Bits = vreinterpretq_u32_f32(A);
+
+    *Exponent = vcvtq_f32_s32(vsubq_s32(vreinterpretq_s32_u32(vshrq_n_u32(Bits, 23)), vdupq_n_s32(127)));
+
+    return (vreinterpretq_f32_u32(vorrq_u32(vandq_u32(Bits, vdupq_n_u32(0x007FFFFF)), vdupq_n_u32(0x3F800000))));
+#else
+    f32x4 Result;
+
+    for (u32 I = 0; I < 4; I++)
+    {
+        union { u32 U; f32 F; } Bits;
+
+        Bits.F = A.E[I];
+        Exponent->E[I] = f32(s32(Bits.U >> 23) - 127);
+        Bits.U = (Bits.U & 0x007FFFFF) | 0x3F800000;
+        Result.E[I] = Bits.F;
+    }
 
     return (Result);
+#endif
 }
 
-v2i
-operator*(const s32 T,
-          const v2i &V)
-{
-    v2i Result;
+////////////////////////////////////////
+// Transcendentals
+////////////////////////////////////////
 
-    Result.x = T * V.x;
-    Result.y = T * V.y;
+// NOTE(matthew): Polynomial exp and log for the CPU kernels, where expf()
+// is a good part of a march step. Exp2 rounds X to the nearest whole N,
+// evaluates 2^(X - N) on [-1/2, 1/2] with a minimax polynomial and puts N
+// straight into the exponent bits. Log2 splits off the exponent and
+// evaluates log2(m) for m in [sqrt(1/2), sqrt(2)). Max errors, measured
+// against doubles:
+//
+//   Tier               exp2 (relative)     log2, log (absolute)
+//   EXP_TIER_FAST      1.5e-4              1.8e-4
+//   EXP_TIER_MEDIUM    2.3e-7              8.4e-7
+//   EXP_TIER_EXACT     exp2f(), expf()     log2f(), logf()
+//
+// Exp() multiplies by log2(e) first, and rounding that product adds up to
+// |X| * 7.5e-8 of relative error. The log errors hold for X in [2^-8, 2^8],
+// most of the medium tier's is rounding the result near |log2| = 8; further
+// out that rounding adds up to |log(X)| * 1e-7. BenchExp() checks all of
+// these. Exp2 clamps
+// X to [-126, 126], so it never returns 0 or infinity. Log2 only takes
+// positive normal floats.
+//
+// The tier is an argument so the benchmarks can compare them. The kernels
+// go through FastExp()/FastLog() and F32x4Exp()/F32x4Log() with
+// MG_EXP_TIER, EXP_TIER_MEDIUM unless it's defined before including this.
+
+#define EXP_TIER_FAST       0
+#define EXP_TIER_MEDIUM     1
+#define EXP_TIER_EXACT      2
+
+#ifndef MG_EXP_TIER
+    #define MG_EXP_TIER     EXP_TIER_MEDIUM
+#endif
 
-    return Result;
-}
+#define LOG2_E              1.44269504f
+#define LN_2                0.693147181f
+#define ROUND_MAGIC         12582912.0f     // 1.5 * 2^23, X + this - this rounds X to a whole number
+#define ROUND_MAGIC_BITS    0x4B400000
 
-v2i
-operator/(const v2i &V,
-          const s32 T)
+// The polynomials are minimax fits, 2^F - 1 for F in [-1/2, 1/2] and
+// log2(1 + T) / T for T in [sqrt(1/2) - 1, sqrt(2) - 1]. The scalar and four
+// wide versions do the same operations in the same order, so they agree to
+// the bit.
+
+inline f32
+Exp2Approx(f32 X,
+           u32 Tier)
 {
-    v2i Result;
+    union { u32 U; f32 F; }     Round,
+                                Scale;
+    f32                         F,
+                                P;
 
-    Result.x = V.x / T;
-    Result.y = V.y / T;
 
-    return Result;
-}
+    if (Tier == EXP_TIER_EXACT)
+    {
+        return (exp2f(X));
+    }
 
-s32
-Dot(const v2i &U,
-    const v2i &V)
-{
-    return (U.x * V.x) + (U.y * V.y);
-}
+    X = _Min(_Max(X, -126.0f), 126.0f);
 
-v2i         
-Hadamard(const v2i &U, 
-         const v2i &V)
-{
-    v2i Result;
+    // Ties to even, the whole number ends up in the low mantissa bits
+    Round.F = X + ROUND_MAGIC;
+    F = X - (Round.F - ROUND_MAGIC);
 
-    Result.x = U.x * V.x;
-    Result.y = U.y * V.y;
+    if (Tier == EXP_TIER_FAST)
+    {
+        P = ((0.0559771195f * F + 0.242225511f) * F + 0.693112498f) * F + 1.0f;
+    }
+    else
+    {
+        P = ((((0.00134072555f * F + 0.0096718753f) * F + 0.0555030837f) * F + 0.240222346f) * F + 0.693147215f) * F + 1.0f;
+    }
 
-    return (Result);
+    Scale.U = (Round.U - ROUND_MAGIC_BITS + 127) << 23;
+
+    return (P * Scale.F);
 }
 
-#endif // MG_IMPL
+inline f32
+ExpApprox(f32 X,
+          u32 Tier)
+{
+    if (Tier == EXP_TIER_EXACT)
+    {
+        return (expf(X));
+    }
 
-////////////////////////////////////////
-// V2u
-////////////////////////////////////////
+    return (Exp2Approx(X * LOG2_E, Tier));
+}
 
-union v2u
+inline f32
+Log2Approx(f32 X,
+           u32 Tier)
 {
-    struct { u32 x, y; };
-    struct { u32 r, g; };
-    struct { u32 u, v; };
-    u32 Elements[2];
+    union { u32 U; f32 F; }     Bits;
+    f32                         Exponent,
+                                T,
+                                P;
 
 
-    v2u(void);
-    v2u(u32 x, u32 y);
+    if (Tier == EXP_TIER_EXACT)
+    {
+        return (log2f(X));
+    }
 
+    Bits.F = X;
+    Exponent = f32(s32(Bits.U >> 23) - 127);
+    Bits.U = (Bits.U & 0x007FFFFF) | 0x3F800000;
 
-    u32     &operator[](const u32 Component);
+    // [sqrt(2), 2) down to [sqrt(1/2), 1)
+    if (Bits.F > 1.41421356f)
+    {
+        Bits.F *= 0.5f;
+        Exponent += 1.0f;
+    }
 
-    v2u         &operator+=(const v2u &V);
-    v2u         &operator-=(const v2u &V);
-    v2u         &operator*=(const u32 T);
-};
+    T = Bits.F - 1.0f;
 
-v2u     operator+(const v2u &U, const v2u &V);
-v2u     operator-(const v2u &U, const v2u &V);
-v2u     operator*(const u32 T, const v2u &U);
-v2u     operator/(const v2u &U, const u32 T);
-u32     Dot(const v2u &U, const v2u &V);
-v2u     Hadamard(const v2u &U, const v2u &V);
+    if (Tier == EXP_TIER_FAST)
+    {
+        P = ((-0.327767208f * T + 0.511272069f) * T - 0.724297245f) * T + 1.44227045f;
+    }
+    else
+    {
+        P = (((((0.171622388f * T - 0.269319416f) * T + 0.295699806f) * T - 0.359371734f) * T + 0.480626758f) * T - 0.721363574f) * T + 1.44269645f;
+    }
 
-#ifdef MG_IMPL
+    return (Exponent + T * P);
+}
 
-v2u::v2u(void)
+inline f32
+LogApprox(f32 X,
+          u32 Tier)
 {
-    this->x = 0;
-    this->y = 0;
+    if (Tier == EXP_TIER_EXACT)
+    {
+        return (logf(X));
+    }
+
+    return (Log2Approx(X, Tier) * LN_2);
 }
 
-v2u::v2u(u32 x,
-       u32 y)
+inline f32
+FastExp(f32 X)
 {
-    this->x = x;
-    this->y = y;
+    return (ExpApprox(X, MG_EXP_TIER));
 }
 
-u32 &
-v2u::operator[](const u32 Component)
+inline f32
+FastLog(f32 X)
 {
-    return (this->Elements[Component]);
+    return (LogApprox(X, MG_EXP_TIER));
 }
 
-v2u &
-v2u::operator+=(const v2u &V)
+// A * B + C
+inline f32x4
+F32x4MulAdd(f32x4 A,
+            f32x4 B,
+            f32 C)
 {
-    this->x += V.x;
-    this->y += V.y;
-
-    return (*this);
+    return (F32x4Add(F32x4Mul(A, B), F32x4Set1(C)));
 }
 
-v2u &
-v2u::operator-=(const v2u &V)
+inline f32x4
+F32x4Exp2(f32x4 X,
+          u32 Tier)
 {
-    this->x -= V.x;
-    this->y -= V.y;
+    f32x4   N,
+            F,
+            P;
 
-    return (*this);
-}
 
-v2u &
-v2u::operator*=(const u32 T)
-{
-    this->x *= T;
-    this->y *= T;
+    if (Tier == EXP_TIER_EXACT)
+    {
+        f32 Lanes[4];
 
-    return (*this);
-}
+        F32x4Store(Lanes, X);
 
-v2u
-operator+(const v2u &U,
-          const v2u &V)
-{
-    v2u Result;
+        return (F32x4Set(exp2f(Lanes[0]), exp2f(Lanes[1]), exp2f(Lanes[2]), exp2f(Lanes[3])));
+    }
 
-    Result.x = U.x + V.x;
-    Result.y = U.y + V.y;
+    X = F32x4Min(F32x4Max(X, F32x4Set1(-126.0f)), F32x4Set1(126.0f));
+    N = F32x4Round(X);
+    F = F32x4Sub(X, N);
 
-    return (Result);
+    if (Tier == EXP_TIER_FAST)
+    {
+        P = F32x4MulAdd(F32x4MulAdd(F32x4MulAdd(F32x4Set1(0.0559771195f), F, 0.242225511f), F, 0.693112498f), F, 1.0f);
+    }
+    else
+    {
+        P = F32x4MulAdd(F32x4Set1(0.00134072555f), F, 0.0096718753f);
+        P = F32x4MulAdd(F32x4MulAdd(F32x4MulAdd(P, F, 0.0555030837f), F, 0.240222346f), F, 0.693147215f);
+        P = F32x4MulAdd(P, F, 1.0f);
+    }
+
+    return (F32x4Mul(P, F32x4Pow2(N)));
 }
 
-v2u
-operator-(const v2u &U,
-          const v2u &V)
+inline f32x4
+F32x4Exp(f32x4 X,
+         u32 Tier)
 {
-    v2u Result;
+    if (Tier == EXP_TIER_EXACT)
+    {
+        f32 Lanes[4];
 
-    Result.x = U.x - V.x;
-    Result.y = U.y - V.y;
+        F32x4Store(Lanes, X);
 
-    return (Result);
+        return (F32x4Set(expf(Lanes[0]), expf(Lanes[1]), expf(Lanes[2]), expf(Lanes[3])));
+    }
+
+    return (F32x4Exp2(F32x4Mul(X, F32x4Set1(LOG2_E)), Tier));
 }
 
-v2u
-operator*(const u32 T,
-          const v2u &V)
+inline f32x4
+F32x4Log2(f32x4 X,
+          u32 Tier)
 {
-    v2u Result;
+    f32x4   M,
+            Exponent,
+            T,
+            P;
+    b32x4   Big;
 
-    Result.x = T * V.x;
-    Result.y = T * V.y;
 
-    return Result;
-}
+    if (Tier == EXP_TIER_EXACT)
+    {
+        f32 Lanes[4];
 
-v2u
-operator/(const v2u &V,
-          const u32 T)
-{
-    v2u Result;
+        F32x4Store(Lanes, X);
 
-    Result.x = V.x / T;
-    Result.y = V.y / T;
+        return (F32x4Set(log2f(Lanes[0]), log2f(Lanes[1]), log2f(Lanes[2]), log2f(Lanes[3])));
+    }
 
-    return Result;
-}
+    M = F32x4Mantissa(X, &Exponent);
+    Big = F32x4Greater(M, F32x4Set1(1.41421356f));
+    M = F32x4Select(Big, F32x4Mul(M, F32x4Set1(0.5f)), M);
+    Exponent = F32x4Select(Big, F32x4Add(Exponent, F32x4Set1(1.0f)), Exponent);
+    T = F32x4Sub(M, F32x4Set1(1.0f));
 
-u32
-Dot(const v2u &U,
-    const v2u &V)
-{
-    return (U.x * V.x) + (U.y * V.y);
+    if (Tier == EXP_TIER_FAST)
+    {
+        P = F32x4MulAdd(F32x4MulAdd(F32x4MulAdd(F32x4Set1(-0.327767208f), T, 0.511272069f), T, -0.724297245f), T, 1.44227045f);
+    }
+    else
+    {
+        P = F32x4MulAdd(F32x4MulAdd(F32x4Set1(0.171622388f), T, -0.269319416f), T, 0.295699806f);
+        P = F32x4MulAdd(F32x4MulAdd(F32x4MulAdd(P, T, -0.359371734f), T, 0.480626758f), T, -0.721363574f);
+        P = F32x4MulAdd(P, T, 1.44269645f);
+    }
+
+    return (F32x4Add(Exponent, F32x4Mul(T, P)));
 }
 
-v2u         
-Hadamard(const v2u &U, 
-         const v2u &V)
+inline f32x4
+F32x4Log(f32x4 X,
+         u32 Tier)
 {
-    v2u Result;
+    if (Tier == EXP_TIER_EXACT)
+    {
+        f32 Lanes[4];
 
-    Result.x = U.x * V.x;
-    Result.y = U.y * V.y;
+        F32x4Store(Lanes, X);
 
-    return (Result);
-}
+        return (F32x4Set(logf(Lanes[0]), logf(Lanes[1]), logf(Lanes[2]), logf(Lanes[3])));
+    }
 
-#endif // MG_IMPL
+    return (F32x4Mul(F32x4Log2(X, Tier), F32x4Set1(LN_2)));
+}
 
 ////////////////////////////////////////
-// V3
+// V2
 ////////////////////////////////////////
 
-union v3
+union v2
 {
-    struct { f32 x, y, z; };
-    struct { f32 r, g, b; };
-    struct { f32 u, v, w; };
-    f32 Elements[3];
+    struct { f32 x, y; };
+    struct { f32 r, g; };
+    struct { f32 u, v; };
+    f32 Elements[2];
 
 
-    v3(void);
-    v3(f32 x, f32 y, f32 z);
+    v2(void);
+    v2(f32 x, f32 y);
 
 
-    v3      operator-(void);
+    v2      operator-(void);
     f32     &operator[](const u32 Component);
 
-    v3      &operator+=(const v3 &V);
-    v3      &operator-=(const v3 &V);
-    v3      &operator*=(const f32 T);
-    v3      &operator/=(const f32 T);
+    v2      &operator+=(const v2 &V);
+    v2      &operator-=(const v2 &V);
+    v2      &operator*=(const f32 T);
+    v2      &operator/=(const f32 T);
 };
 
-v3      operator+(const v3 &U, const v3 &V);
-v3      operator-(const v3 &U, const v3 &V);
-v3      operator*(const f32 T, const v3 &U);
-v3      operator/(const v3 &U, const f32 T);
-f32     Dot(const v3 &U, const v3 &V);
-v3      Cross(const v3 &U, const v3 &V);
-f32     Length(const v3 &V);
-f32     LengthSquared(const v3 &V);
-v3      Normalize(const v3 &V);
-v3      Hadamard(const v3 &U, const v3 &V);
-v3      MinV3(const v3 &U, const v3 &V);
-v3      MaxV3(const v3 &U, const v3 &V);
+v2      operator+(const v2 &U, const v2 &V);
+v2      operator-(const v2 &U, const v2 &V);
+v2      operator*(const f32 T, const v2 &U);
+v2      operator/(const v2 &U, const f32 T);
+f32     Dot(const v2 &U, const v2 &V);
+f32     Length(const v2 &V);
+f32     LengthSquared(const v2 &V);
+v2      Normalize(const v2 &V);
+v2      Hadamard(const v2 &U, const v2 &V);
 
 #ifdef MG_IMPL
 
-v3::v3(void)
+v2::v2(void)
 {
     this->x = 0;
     this->y = 0;
-    this->z = 0;
 }
 
-v3::v3(f32 x,
-       f32 y,
-       f32 z)
+v2::v2(f32 x,
+       f32 y)
 {
     this->x = x;
     this->y = y;
-    this->z = z;
 }
 
-v3
-v3::operator-(void)
+v2
+v2::operator-(void)
 {
     this->x *= -1;
     this->y *= -1;
-    this->z *= -1;
 
     return (*this);
 }
 
 f32 &
-v3::operator[](const u32 Component)
+v2::operator[](const u32 Component)
 {
     return (this->Elements[Component]);
 }
 
-v3 &
-v3::operator+=(const v3 &V)
+v2 &
+v2::operator+=(const v2 &V)
 {
     this->x += V.x;
     this->y += V.y;
-    this->z += V.z;
 
     return (*this);
 }
 
-v3 &
-v3::operator-=(const v3 &V)
+v2 &
+v2::operator-=(const v2 &V)
 {
     this->x -= V.x;
     this->y -= V.y;
-    this->z -= V.z;
 
     return (*this);
 }
 
-v3 &
-v3::operator*=(const f32 T)
+v2 &
+v2::operator*=(const f32 T)
 {
     this->x *= T;
     this->y *= T;
-    this->z *= T;
 
     return (*this);
 }
 
-v3 &
-v3::operator/=(const f32 T)
+v2 &
+v2::operator/=(const f32 T)
 {
     this->x /= T;
     this->y /= T;
-    this->z /= T;
 
     return (*this);
 }
 
-v3
-operator+(const v3 &U,
-          const v3 &V)
+v2
+operator+(const v2 &U,
+          const v2 &V)
 {
-    v3 Result;
+    v2 Result;
 
     Result.x = U.x + V.x;
     Result.y = U.y + V.y;
-    Result.z = U.z + V.z;
 
     return (Result);
 }
 
-v3
-operator-(const v3 &U,
-          const v3 &V)
+v2
+operator-(const v2 &U,
+          const v2 &V)
 {
-    v3 Result;
+    v2 Result;
 
     Result.x = U.x - V.x;
     Result.y = U.y - V.y;
-    Result.z = U.z - V.z;
 
     return (Result);
 }
 
-v3
+v2
 operator*(const f32 T,
-          const v3 &V)
+          const v2 &V)
 {
-    v3 Result;
+    v2 Result;
 
     Result.x = T * V.x;
     Result.y = T * V.y;
-    Result.z = T * V.z;
 
     return Result;
 }
 
-v3
-operator/(const v3 &V,
+v2
+operator/(const v2 &V,
           const f32 T)
 {
-    v3 Result;
+    v2 Result;
 
     Result.x = V.x / T;
     Result.y = V.y / T;
-    Result.z = V.z / T;
 
     return Result;
 }
 
 f32
-Dot(const v3 &U,
-    const v3 &V)
-{
-    return (U.x * V.x) + (U.y * V.y) + (U.z * V.z);
-}
-
-v3
-Cross(const v3 &U,
-      const v3 &V)
+Dot(const v2 &U,
+    const v2 &V)
 {
-    v3 Result;
-
-    Result.x = U.y * V.z - U.z * V.y;
-    Result.y = U.z * V.x - U.x * V.z;
-    Result.z = U.x * V.y - U.y * V.x;
-
-    return Result;
+    return (U.x * V.x) + (U.y * V.y);
 }
 
 f32
-Length(const v3 &V)
+Length(const v2 &V)
 {
     return SquareRoot(Dot(V, V));
 }
 
 f32
-LengthSquared(const v3 &V)
+LengthSquared(const v2 &V)
 {
     return Dot(V, V);
 }
 
-v3
-Normalize(const v3 &V)
+v2
+Normalize(const v2 &V)
 {
     return V / Length(V);
 }
 
-v3      
-Hadamard(const v3 &U, 
-         const v3 &V)
+v2      
+Hadamard(const v2 &U, 
+         const v2 &V)
 {
-    v3 Result;
+    v2 Result;
 
     Result.x = U.x * V.x;
     Result.y = U.y * V.y;
-    Result.z = U.z * V.z;
 
     return (Result);
 }
 
-v3      
-MinV3(const v3 &U, 
-      const v3 &V)
-{
-    v3 Result;
-
-    Result.x = _Min(U.x, V.x);
-    Result.y = _Min(U.y, V.y);
-    Result.z = _Min(U.z, V.z);
-
-    return Result;
-}
-
-v3      
-MaxV3(const v3 &U, 
-      const v3 &V)
-{
-    v3 Result;
-
-    Result.x = _Max(U.x, V.x);
-    Result.y = _Max(U.y, V.y);
-    Result.z = _Max(U.z, V.z);
-
-    return Result;
-}
-
 #endif // MG_IMPL
 
 ////////////////////////////////////////
-// V3i
+// V2i
 ////////////////////////////////////////
 
-union v3i
+union v2i
 {
-    struct { s32 x, y, z; };
-    struct { s32 r, g, b; };
-    struct { s32 u, v, w; };
-    s32 Elements[3];
+    struct { s32 x, y; };
+    struct { s32 r, g; };
+    struct { s32 u, v; };
+    s32 Elements[2];
 
 
-    v3i(void);
-    v3i(s32 x, s32 y, s32 z);
+    v2i(void);
+    v2i(s32 x, s32 y);
 
 
-    v3i     operator-(void);
+    v2i     operator-(void);
     s32     &operator[](const u32 Component);
 
-    v3i     &operator+=(const v3i &V);
-    v3i     &operator-=(const v3i &V);
+    v2i         &operator+=(const v2i &V);
+    v2i         &operator-=(const v2i &V);
+    v2i         &operator*=(const s32 T);
 };
 
-v3i     operator+(const v3i &U, const v3i &V);
-v3i     operator-(const v3i &U, const v3i &V);
-v3i     operator*(const s32 T, const v3i &U);
-s32     Dot(const v3i &U, const v3i &V);
-v3i     Hadamard(const v3i &U, const v3i &V);
+v2i     operator+(const v2i &U, const v2i &V);
+v2i     operator-(const v2i &U, const v2i &V);
+v2i     operator*(const s32 T, const v2i &U);
+v2i     operator/(const v2i &U, const s32 T);
+s32     Dot(const v2i &U, const v2i &V);
+v2i     Hadamard(const v2i &U, const v2i &V);
 
 #ifdef MG_IMPL
 
-v3i::v3i(void)
+v2i::v2i(void)
 {
     this->x = 0;
     this->y = 0;
-    this->z = 0;
 }
 
-v3i::v3i(s32 x,
-         s32 y, 
-         s32 z)
+v2i::v2i(s32 x,
+       s32 y)
 {
     this->x = x;
     this->y = y;
-    this->z = z;
 }
 
-v3i     
-v3i::operator-(void)
+v2i
+v2i::operator-(void)
 {
     this->x *= -1;
     this->y *= -1;
-    this->z *= -1;
 
     return (*this);
 }
 
 s32 &
-v3i::operator[](const u32 Component)
+v2i::operator[](const u32 Component)
 {
     return (this->Elements[Component]);
 }
 
-v3i &
-v3i::operator+=(const v3i &V)
+v2i &
+v2i::operator+=(const v2i &V)
 {
     this->x += V.x;
     this->y += V.y;
-    this->z += V.z;
 
     return (*this);
 }
 
-v3i &
-v3i::operator-=(const v3i &V)
+v2i &
+v2i::operator-=(const v2i &V)
 {
     this->x -= V.x;
     this->y -= V.y;
-    this->z -= V.z;
 
     return (*this);
 }
 
-v3i     
-operator+(const v3i &U, 
-          const v3i &V)
+v2i &
+v2i::operator*=(const s32 T)
 {
-    v3i     Result;
-
-    Result.x = U.x + V.x;
-    Result.y = U.y + V.y;
-    Result.z = U.z + V.z;
+    this->x *= T;
+    this->y *= T;
+
+    return (*this);
+}
+
+v2i
+operator+(const v2i &U,
+          const v2i &V)
+{
+    v2i Result;
+
+    Result.x = U.x + V.x;
+    Result.y = U.y + V.y;
 
     return (Result);
 }
 
-v3i     
-operator-(const v3i &U, 
-          const v3i &V)
+v2i
+operator-(const v2i &U,
+          const v2i &V)
 {
-    v3i     Result;
+    v2i Result;
 
     Result.x = U.x - V.x;
     Result.y = U.y - V.y;
-    Result.z = U.z - V.z;
 
     return (Result);
 }
 
-v3i     
-operator*(const s32 T, 
-          const v3i &U)
+v2i
+operator*(const s32 T,
+          const v2i &V)
 {
-    v3i     Result;
+    v2i Result;
 
-    Result.x = T * U.x;
-    Result.y = T * U.y;
-    Result.z = T * U.z;
+    Result.x = T * V.x;
+    Result.y = T * V.y;
 
-    return (Result);
+    return Result;
 }
 
-s32     
-Dot(const v3i &U, 
-    const v3i &V)
+v2i
+operator/(const v2i &V,
+          const s32 T)
 {
-    return (U.x * V.x) + (U.y * V.y) + (U.z * V.z);
+    v2i Result;
+
+    Result.x = V.x / T;
+    Result.y = V.y / T;
+
+    return Result;
 }
 
-v3i     
-Hadamard(const v3i &U, 
-         const v3i &V)
+s32
+Dot(const v2i &U,
+    const v2i &V)
 {
-    v3i     Result;
+    return (U.x * V.x) + (U.y * V.y);
+}
+
+v2i         
+Hadamard(const v2i &U, 
+         const v2i &V)
+{
+    v2i Result;
 
     Result.x = U.x * V.x;
     Result.y = U.y * V.y;
-    Result.z = U.z * V.z;
 
     return (Result);
 }
 
-#endif MG_IMPL
+#endif // MG_IMPL
 
 ////////////////////////////////////////
-// V4
+// V2u
 ////////////////////////////////////////
 
-union v4
+union v2u
 {
-    struct { f32 x, y, z, w; };
-    struct { f32 r, g, b, a; };
-    f32 Elements[4];
+    struct { u32 x, y; };
+    struct { u32 r, g; };
+    struct { u32 u, v; };
+    u32 Elements[2];
 
 
-    v4(void);
-    v4(f32 x, f32 y, f32 z, f32 w);
+    v2u(void);
+    v2u(u32 x, u32 y);
 
 
-    v4      operator-(void);
-    f32     &operator[](const u32 Component);
+    u32     &operator[](const u32 Component);
 
-    v4      &operator+=(const v4 &V);
-    v4      &operator-=(const v4 &V);
-    v4      &operator*=(const f32 T);
-    v4      &operator/=(const f32 T);
+    v2u         &operator+=(const v2u &V);
+    v2u         &operator-=(const v2u &V);
+    v2u         &operator*=(const u32 T);
 };
 
-v4      operator+(const v4 &U, const v4 &V);
-v4      operator-(const v4 &U, const v4 &V);
-v4      operator*(const f32 T, const v4 &U);
-v4      operator/(const v4 &U, const f32 T);
-f32     Dot(const v4 &U, const v4 &V);
-f32     Length(const v4 &V);
-f32     LengthSquared(const v4 &V);
-v4      Normalize(const v4 &V);
-v4      Hadamard(const v4 &U, const v4 &V);
+v2u     operator+(const v2u &U, const v2u &V);
+v2u     operator-(const v2u &U, const v2u &V);
+v2u     operator*(const u32 T, const v2u &U);
+v2u     operator/(const v2u &U, const u32 T);
+u32     Dot(const v2u &U, const v2u &V);
+v2u     Hadamard(const v2u &U, const v2u &V);
 
 #ifdef MG_IMPL
 
-v4::v4(void)
+v2u::v2u(void)
 {
     this->x = 0;
     this->y = 0;
-    this->z = 0;
-    this->w = 0;
 }
 
-v4::v4(f32 x,
-       f32 y,
-       f32 z,
-       f32 w)
+v2u::v2u(u32 x,
+       u32 y)
 {
     this->x = x;
     this->y = y;
-    this->z = z;
-    this->w = w;
-}
-
-v4
-v4::operator-(void)
-{
-    this->x *= -1;
-    this->y *= -1;
-    this->z *= -1;
-    this->w *= -1;
-
-    return (*this);
 }
 
-f32 &
-v4::operator[](const u32 Component)
+u32 &
+v2u::operator[](const u32 Component)
 {
     return (this->Elements[Component]);
 }
 
-v4 &
-v4::operator+=(const v4 &V)
+v2u &
+v2u::operator+=(const v2u &V)
 {
     this->x += V.x;
     this->y += V.y;
-    this->z += V.z;
-    this->w += V.w;
 
     return (*this);
 }
 
-v4 &
-v4::operator-=(const v4 &V)
+v2u &
+v2u::operator-=(const v2u &V)
 {
     this->x -= V.x;
     this->y -= V.y;
-    this->z -= V.z;
-    this->w -= V.w;
 
     return (*this);
 }
 
-v4 &
-v4::operator*=(const f32 T)
+v2u &
+v2u::operator*=(const u32 T)
 {
     this->x *= T;
     this->y *= T;
-    this->z *= T;
-    this->w *= T;
-
-    return (*this);
-}
-
-v4 &
-v4::operator/=(const f32 T)
-{
-    this->x /= T;
-    this->y /= T;
-    this->z /= T;
-    this->w /= T;
 
     return (*this);
 }
 
-v4
-operator+(const v4 &U,
-          const v4 &V)
+v2u
+operator+(const v2u &U,
+          const v2u &V)
 {
-    v4 Result;
+    v2u Result;
 
     Result.x = U.x + V.x;
     Result.y = U.y + V.y;
-    Result.z = U.z + V.z;
-    Result.w = U.w + V.w;
 
     return (Result);
 }
 
-v4
-operator-(const v4 &U,
-          const v4 &V)
+v2u
+operator-(const v2u &U,
+          const v2u &V)
 {
-    v4 Result;
+    v2u Result;
 
     Result.x = U.x - V.x;
     Result.y = U.y - V.y;
-    Result.z = U.z - V.z;
-    Result.w = U.w - V.w;
 
     return (Result);
 }
 
-v4
-operator*(const f32 T,
-          const v4 &V)
+v2u
+operator*(const u32 T,
+          const v2u &V)
 {
-    v4 Result;
+    v2u Result;
 
     Result.x = T * V.x;
     Result.y = T * V.y;
-    Result.z = T * V.z;
-    Result.w = T * V.w;
 
     return Result;
 }
 
-v4
-operator/(const v4 &V,
-          const f32 T)
+v2u
+operator/(const v2u &V,
+          const u32 T)
 {
-    v4 Result;
+    v2u Result;
 
     Result.x = V.x / T;
     Result.y = V.y / T;
-    Result.z = V.z / T;
-    Result.w = V.w / T;
 
     return Result;
 }
 
-f32
-Dot(const v4 &U,
-    const v4 &V)
-{
-    return (U.x * V.x) + (U.y * V.y) + (U.z * V.z) + (U.w * V.w);
-}
-
-f32
-Length(const v4 &V)
-{
-    return SquareRoot(Dot(V, V));
-}
-
-f32
-LengthSquared(const v4 &V)
-{
-    return Dot(V, V);
-}
-
-v4
-Normalize(const v4 &V)
+u32
+Dot(const v2u &U,
+    const v2u &V)
 {
-    return V / Length(V);
+    return (U.x * V.x) + (U.y * V.y);
 }
 
-
-v4      
-Hadamard(const v4 &U, 
-         const v4 &V)
+v2u         
+Hadamard(const v2u &U, 
+         const v2u &V)
 {
-    v4 Result;
+    v2u Result;
 
     Result.x = U.x * V.x;
     Result.y = U.y * V.y;
-    Result.z = U.z * V.z;
-    Result.w = U.w * V.w;
 
     return (Result);
 }
@@ -1162,1713 +1488,4342 @@ Hadamard(const v4 &U,
 #endif // MG_IMPL
 
 ////////////////////////////////////////
-// M4
+// V3
 ////////////////////////////////////////
 
-union m4
+union v3
 {
-    struct { v4 Cols[4]; };
-    f32 Elements[16];
+    struct { f32 x, y, z; };
+    struct { f32 r, g, b; };
+    struct { f32 u, v, w; };
+    f32 Elements[3];
 
 
-    m4(void);
-    m4(v4 Col0, v4 Col1, v4 Col2, v4 Col3);
-};
+    v3(void);
+    v3(f32 x, f32 y, f32 z);
 
-m4      Mat4Identity(void);
-m4      Mat4Translate(f32 X, f32 Y, f32 Z);
-m4      Mat4Translate(v3 &V);
-m4      Mat4Rotate(f32 Angle, f32 X, f32 Y, f32 Z);
-m4      Mat4Rotate(f32 Angle, v3 &V);
-m4      Mat4PerspectiveRH(f32 FOV, f32 AspectRatio, f32 Near, f32 Far);
-m4      Mat4PerspectiveLH(f32 FOV, f32 AspectRatio, f32 Near, f32 Far);
-m4      Mat4LookAtRH(v3 Eye, v3 Center, v3 Up);
-m4      Mat4LookAtLH(v3 Eye, v3 Center, v3 Up);
-m4      Mat4Scale(f32 Scale);
-m4      Mat4Scale(v3 &Scale);
-m4      operator*(m4 M1, m4 M2);
-v4      operator*(m4 M, v4 V);
+
+    v3      operator-(void);
+    f32     &operator[](const u32 Component);
+
+    v3      &operator+=(const v3 &V);
+    v3      &operator-=(const v3 &V);
+    v3      &operator*=(const f32 T);
+    v3      &operator/=(const f32 T);
+};
+
+v3      operator+(const v3 &U, const v3 &V);
+v3      operator-(const v3 &U, const v3 &V);
+v3      operator*(const f32 T, const v3 &U);
+v3      operator/(const v3 &U, const f32 T);
+f32     Dot(const v3 &U, const v3 &V);
+v3      Cross(const v3 &U, const v3 &V);
+f32     Length(const v3 &V);
+f32     LengthSquared(const v3 &V);
+v3      Normalize(const v3 &V);
+v3      Hadamard(const v3 &U, const v3 &V);
+v3      MinV3(const v3 &U, const v3 &V);
+v3      MaxV3(const v3 &U, const v3 &V);
 
 #ifdef MG_IMPL
 
-m4::m4(void)
+v3::v3(void)
 {
-    for (u32 I = 0; I < 16; I += 4)
-    {
-        this->Elements[I] = 0;
-        this->Elements[I + 1] = 0;
-        this->Elements[I + 2] = 0;
-        this->Elements[I + 3] = 0;
-    }
+    this->x = 0;
+    this->y = 0;
+    this->z = 0;
 }
 
-m4::m4(v4 Col0,
-       v4 Col1,
-       v4 Col2,
-       v4 Col3)
+v3::v3(f32 x,
+       f32 y,
+       f32 z)
 {
-    this->Cols[0] = Col0;
-    this->Cols[1] = Col1;
-    this->Cols[2] = Col2;
-    this->Cols[3] = Col3;
+    this->x = x;
+    this->y = y;
+    this->z = z;
 }
 
-m4
-Mat4Identity(void)
+v3
+v3::operator-(void)
 {
-    m4      Mat;
-
-
-    Mat.Cols[0].x = 1;
-    Mat.Cols[1].y = 1;
-    Mat.Cols[2].z = 1;
-    Mat.Cols[3].w = 1;
+    this->x *= -1;
+    this->y *= -1;
+    this->z *= -1;
 
-    return (Mat);
+    return (*this);
 }
 
-m4
-Mat4Translate(f32 x, f32 y, f32 z)
+f32 &
+v3::operator[](const u32 Component)
 {
-    m4      Mat;
-
+    return (this->Elements[Component]);
+}
 
-    Mat = Mat4Identity();
-    Mat.Cols[3].x = x;
-    Mat.Cols[3].y = y;
-    Mat.Cols[3].z = z;
+v3 &
+v3::operator+=(const v3 &V)
+{
+    this->x += V.x;
+    this->y += V.y;
+    this->z += V.z;
 
-    return (Mat);
+    return (*this);
 }
 
-m4
-Mat4Translate(v3 &V)
+v3 &
+v3::operator-=(const v3 &V)
 {
-    m4      Mat;
+    this->x -= V.x;
+    this->y -= V.y;
+    this->z -= V.z;
 
+    return (*this);
+}
 
-    Mat = Mat4Identity();
-    Mat.Cols[3].x = V.x;
-    Mat.Cols[3].y = V.y;
-    Mat.Cols[3].z = V.z;
+v3 &
+v3::operator*=(const f32 T)
+{
+    this->x *= T;
+    this->y *= T;
+    this->z *= T;
 
-    return (Mat);
+    return (*this);
 }
 
-m4
-Mat4Rotate(f32 Angle,
-           f32 x,
-           f32 y,
-           f32 z)
+v3 &
+v3::operator/=(const f32 T)
 {
-    m4      Mat;
-    f32     C,
-            S,
-            C1;
-    v3      Axis;
+    this->x /= T;
+    this->y /= T;
+    this->z /= T;
 
+    return (*this);
+}
 
-    C = Cos(DegsToRads(Angle));
-    S = Sin(DegsToRads(Angle));
-    C1 = 1.0f - C;
-    Axis = Normalize(v3(x, y, z));
+v3
+operator+(const v3 &U,
+          const v3 &V)
+{
+    v3 Result;
 
-    Mat.Cols[0].x = (C1 * Axis.x * Axis.x) + C;
-    Mat.Cols[0].y = (C1 * Axis.x * Axis.y) + S * Axis.z;
-    Mat.Cols[0].z = (C1 * Axis.x * Axis.z) - S * Axis.y;
+    Result.x = U.x + V.x;
+    Result.y = U.y + V.y;
+    Result.z = U.z + V.z;
 
-    Mat.Cols[1].x = (C1 * Axis.x * Axis.y) - S * Axis.z;
-    Mat.Cols[1].y = (C1 * Axis.y * Axis.y) + C;
-    Mat.Cols[1].z = (C1 * Axis.y * Axis.z) + S * Axis.x;
+    return (Result);
+}
 
-    Mat.Cols[2].x = (C1 * Axis.x * Axis.z) + S * Axis.y;
-    Mat.Cols[2].y = (C1 * Axis.y * Axis.z) - S * Axis.x;
-    Mat.Cols[2].z = (C1 * Axis.z * Axis.z) + C;
+v3
+operator-(const v3 &U,
+          const v3 &V)
+{
+    v3 Result;
 
-    Mat.Cols[3].w = 1.0f;
+    Result.x = U.x - V.x;
+    Result.y = U.y - V.y;
+    Result.z = U.z - V.z;
 
-    return (Mat);
+    return (Result);
 }
 
-m4
-Mat4Rotate(f32 Angle,
-           v3 Axis)
+v3
+operator*(const f32 T,
+          const v3 &V)
 {
-    m4      Mat;
-    f32     C,
-            S,
-            C1;
-    v3      Vec;
-
-
-    C = Cos(DegsToRads(Angle));
-    S = Sin(DegsToRads(Angle));
-    C1 = 1.0f - C;
-    Vec = Normalize(Axis);
+    v3 Result;
 
-    Mat.Cols[0].x = (C1 * Vec.x * Vec.x) + C;
-    Mat.Cols[0].y = (C1 * Vec.x * Vec.y) + S * Vec.z;
-    Mat.Cols[0].z = (C1 * Vec.x * Vec.z) - S * Vec.y;
+    Result.x = T * V.x;
+    Result.y = T * V.y;
+    Result.z = T * V.z;
 
-    Mat.Cols[1].x = (C1 * Vec.x * Vec.y) - S * Vec.z;
-    Mat.Cols[1].y = (C1 * Vec.y * Vec.y) + C;
-    Mat.Cols[1].z = (C1 * Vec.y * Vec.z) + S * Vec.x;
+    return Result;
+}
 
-    Mat.Cols[2].x = (C1 * Vec.x * Vec.z) + S * Vec.y;
-    Mat.Cols[2].y = (C1 * Vec.y * Vec.z) - S * Vec.x;
-    Mat.Cols[2].z = (C1 * Vec.z * Vec.z) + C;
+v3
+operator/(const v3 &V,
+          const f32 T)
+{
+    v3 Result;
 
-    Mat.Cols[3].w = 1.0f;
+    Result.x = V.x / T;
+    Result.y = V.y / T;
+    Result.z = V.z / T;
 
-    return (Mat);
+    return Result;
 }
 
-m4
-Mat4PerspectiveRH(f32 FOV,
-                  f32 AspectRatio,
-                  f32 Near,
-                  f32 Far)
+f32
+Dot(const v3 &U,
+    const v3 &V)
 {
-    m4      Mat;
-    f32     t,
-            Delta;
-
+    return (U.x * V.x) + (U.y * V.y) + (U.z * V.z);
+}
 
-    t = Tan(DegsToRads(FOV) * 0.5f);
-    Delta = Far - Near;
+v3
+Cross(const v3 &U,
+      const v3 &V)
+{
+    v3 Result;
 
-    Mat.Cols[0].x = 1 / (AspectRatio * t);
-    Mat.Cols[1].y = 1 / t;
-    Mat.Cols[2].z = -1 * ((Far + Near) / Delta);
-    Mat.Cols[2].w = -1.0f;
-    Mat.Cols[3].z = ((-2.0f * Far * Near) / Delta);
+    Result.x = U.y * V.z - U.z * V.y;
+    Result.y = U.z * V.x - U.x * V.z;
+    Result.z = U.x * V.y - U.y * V.x;
 
-    return (Mat);
+    return Result;
 }
 
-m4
-Mat4PerspectiveLH(f32 FOV,
-                  f32 AspectRatio,
-                  f32 Near,
-                  f32 Far)
+f32
+Length(const v3 &V)
 {
-    m4      Mat;
-    f32     t;
-    f32     Range;
-
+    return SquareRoot(Dot(V, V));
+}
 
-    t = Tan(DegsToRads(FOV) * 0.5f);
-    Range = Far / (Far - Near);
-
-    Mat.Cols[0].x = 1 / (AspectRatio * t);
-    Mat.Cols[1].y = 1 / t;
-    Mat.Cols[2].z = Range;
-    Mat.Cols[2].w = 1.0f;
-    Mat.Cols[3].z = -Range * Near;
+f32
+LengthSquared(const v3 &V)
+{
+    return Dot(V, V);
+}
 
-    return (Mat);
+v3
+Normalize(const v3 &V)
+{
+    return V / Length(V);
 }
 
-m4
-Mat4LookAtRH(v3 Eye,
-             v3 Center,
-             v3 Up)
+v3      
+Hadamard(const v3 &U, 
+         const v3 &V)
 {
-    m4      Mat;
-    v3      F,
-            S,
-            U;
+    v3 Result;
 
+    Result.x = U.x * V.x;
+    Result.y = U.y * V.y;
+    Result.z = U.z * V.z;
 
-    F = Normalize(Center - Eye);
-    S = Normalize(Cross(F, Up));
-    U = Cross(S, F);
+    return (Result);
+}
 
-    Mat.Cols[0].x = S.x;
-    Mat.Cols[0].y = U.x;
-    Mat.Cols[0].z = -F.x;
+v3      
+MinV3(const v3 &U, 
+      const v3 &V)
+{
+    v3 Result;
 
-    Mat.Cols[1].x = S.y;
-    Mat.Cols[1].y = U.y;
-    Mat.Cols[1].z = -F.y;
+    Result.x = _Min(U.x, V.x);
+    Result.y = _Min(U.y, V.y);
+    Result.z = _Min(U.z, V.z);
 
-    Mat.Cols[2].x = S.z;
-    Mat.Cols[2].y = U.z;
-    Mat.Cols[2].z = -F.z;
+    return Result;
+}
 
-    Mat.Cols[3].x = -Dot(S, Eye);
-    Mat.Cols[3].y = -Dot(U, Eye);
-    Mat.Cols[3].z = -Dot(F, Eye);
+v3      
+MaxV3(const v3 &U, 
+      const v3 &V)
+{
+    v3 Result;
 
-    Mat.Cols[3].w = 1.0f;
+    Result.x = _Max(U.x, V.x);
+    Result.y = _Max(U.y, V.y);
+    Result.z = _Max(U.z, V.z);
 
-    return (Mat);
+    return Result;
 }
 
-m4
-Mat4LookAtLH(v3 Eye,
-             v3 Center,
-             v3 Up)
+#endif // MG_IMPL
+
+////////////////////////////////////////
+// V3i
+////////////////////////////////////////
+
+union v3i
 {
-    m4      Mat;
-    v3      F,
-            S,
-            U;
+    struct { s32 x, y, z; };
+    struct { s32 r, g, b; };
+    struct { s32 u, v, w; };
+    s32 Elements[3];
 
 
-    F = Normalize(Center - Eye);
-    S = Normalize(Cross(Up, F));
-    U = Cross(F, S);
+    v3i(void);
+    v3i(s32 x, s32 y, s32 z);
 
-    Mat.Cols[0].x = S.x;
-    Mat.Cols[0].y = U.x;
-    Mat.Cols[0].z = F.x;
 
-    Mat.Cols[1].x = S.y;
-    Mat.Cols[1].y = U.y;
-    Mat.Cols[1].z = F.y;
+    v3i     operator-(void);
+    s32     &operator[](const u32 Component);
 
-    Mat.Cols[2].x = S.z;
-    Mat.Cols[2].y = U.z;
-    Mat.Cols[2].z = F.z;
+    v3i     &operator+=(const v3i &V);
+    v3i     &operator-=(const v3i &V);
+};
 
-    Mat.Cols[3].x = -Dot(S, Eye);
-    Mat.Cols[3].y = -Dot(U, Eye);
-    Mat.Cols[3].z = -Dot(F, Eye);
+v3i     operator+(const v3i &U, const v3i &V);
+v3i     operator-(const v3i &U, const v3i &V);
+v3i     operator*(const s32 T, const v3i &U);
+s32     Dot(const v3i &U, const v3i &V);
+v3i     Hadamard(const v3i &U, const v3i &V);
 
-    Mat.Cols[3].w = 1.0f;
+#ifdef MG_IMPL
 
-    return (Mat);
+v3i::v3i(void)
+{
+    this->x = 0;
+    this->y = 0;
+    this->z = 0;
 }
 
-m4
-Mat4Scale(f32 Scale)
+v3i::v3i(s32 x,
+         s32 y, 
+         s32 z)
 {
-    m4       Mat;
-
+    this->x = x;
+    this->y = y;
+    this->z = z;
+}
 
-    Mat.Cols[0].x = Scale;
-    Mat.Cols[1].y = Scale;
-    Mat.Cols[2].z = Scale;
-    Mat.Cols[3].w = 1.0f;
+v3i     
+v3i::operator-(void)
+{
+    this->x *= -1;
+    this->y *= -1;
+    this->z *= -1;
 
-    return (Mat);
+    return (*this);
 }
 
-m4
-Mat4Scale(v3 &Scale)
+s32 &
+v3i::operator[](const u32 Component)
 {
-    m4       Mat;
-
+    return (this->Elements[Component]);
+}
 
-    Mat.Cols[0].x = Scale.x;
-    Mat.Cols[1].y = Scale.y;
-    Mat.Cols[2].z = Scale.z;
-    Mat.Cols[3].w = 1.0f;
+v3i &
+v3i::operator+=(const v3i &V)
+{
+    this->x += V.x;
+    this->y += V.y;
+    this->z += V.z;
 
-    return (Mat);
+    return (*this);
 }
 
-m4
-operator*(m4 M1,
-          m4 M2)
+v3i &
+v3i::operator-=(const v3i &V)
 {
-    m4 Mat;
+    this->x -= V.x;
+    this->y -= V.y;
+    this->z -= V.z;
 
-    for (u32 Y = 0; Y < 4; Y++)
-    {
-        for (u32 X = 0; X < 4; X++)
-        {
-            f32 Sum = 0.0f;
+    return (*this);
+}
 
-            for (u32 E = 0; E < 4; E++)
-            {
-                Sum += M1.Elements[X + E * 4] * M2.Elements[E + Y * 4];
-            }
+v3i     
+operator+(const v3i &U, 
+          const v3i &V)
+{
+    v3i     Result;
 
-            Mat.Elements[X + Y * 4] = Sum;
-        }
-    }
+    Result.x = U.x + V.x;
+    Result.y = U.y + V.y;
+    Result.z = U.z + V.z;
 
-    return (Mat);
+    return (Result);
 }
 
-v4      
-operator*(m4 M,
-          v4 V)
+v3i     
+operator-(const v3i &U, 
+          const v3i &V)
 {
-    v4 Result;
+    v3i     Result;
 
-    Result = V.x * M.Cols[0] +
-             V.y * M.Cols[1] +
-             V.z * M.Cols[2] +
-             V.w * M.Cols[3];
+    Result.x = U.x - V.x;
+    Result.y = U.y - V.y;
+    Result.z = U.z - V.z;
 
-    return Result;
+    return (Result);
 }
 
-#endif // MG_IMPL
-
+v3i     
+operator*(const s32 T, 
+          const v3i &U)
+{
+    v3i     Result;
 
+    Result.x = T * U.x;
+    Result.y = T * U.y;
+    Result.z = T * U.z;
 
+    return (Result);
+}
 
+s32     
+Dot(const v3i &U, 
+    const v3i &V)
+{
+    return (U.x * V.x) + (U.y * V.y) + (U.z * V.z);
+}
 
-//****************************************************************************
-//*** Windows.h **************************************************************
-//****************************************************************************
+v3i     
+Hadamard(const v3i &U, 
+         const v3i &V)
+{
+    v3i     Result;
 
-#ifndef MG_USE_WINDOWS_H
+    Result.x = U.x * V.x;
+    Result.y = U.y * V.y;
+    Result.z = U.z * V.z;
 
-// NOTE(matthew): This is the include guard that windows.h defines.
-#define _WINDOWS_
+    return (Result);
+}
 
-// NOTE(matthew): This is in the include guard that winapifamily.h defines,
-// which gets included at the top of windows.h BEFORE it's include guard.
-#define _INC_WINAPIFAMILY
+#endif MG_IMPL
 
-// TODO: add ASYNC I/O support
+////////////////////////////////////////
+// V4
+////////////////////////////////////////
 
-//////////////////////////////////////////////////////////////////////////////
-// #define
+union v4
+{
+    struct { f32 x, y, z, w; };
+    struct { f32 r, g, b, a; };
+    f32 Elements[4];
 
-#ifdef __cplusplus
-extern "C" {
-#endif  // __cplusplus
 
-#ifndef NULL
-#define NULL    0
-#endif // NULL
-#define TRUE    1
-#define FALSE   0
-#define MAX_PATH    260
+    v4(void);
+    v4(f32 x, f32 y, f32 z, f32 w);
 
-#define DECLSPEC_IMPORT     __declspec(dllimport)
-#define DECLSPEC_NORETURN   __declspec(noreturn)
-#define WINBASEAPI          DECLSPEC_IMPORT
-#define WINUSERAPI          DECLSPEC_IMPORT
-#define WINABLEAPI          DECLSPEC_IMPORT
-#define WINGDIAPI           DECLSPEC_IMPORT
-#define CALLBACK            __stdcall
-#define WINAPI              __stdcall
-#define WINAPIV             __cdecl
-#define APIENTRY            WINAPI
-#define APIPRIVATE          __stdcall
-#define PASCAL              __stdcall
-#define CONST               const
-#define UNALIGNED           __unaligned
-#define UNALIGNED64         __unaligned
 
-#ifndef _VCRTIMP
-    #if defined _CRTIMP && !defined _VCRT_DEFINED_CRTIMP
-        #define _VCRTIMP _CRTIMP
-    #elif defined _VCRT_BUILD && defined CRTDLL
-        #define _VCRTIMP __declspec(dllexport)
-    #elif defined _CORECRT_BUILD
-        #define _VCRTIMP
-    #elif defined _DLL
-        #define _VCRTIMP __declspec(dllimport)
-    #else
-        #define _VCRTIMP
-    #endif
-#endif
+    v4      operator-(void);
+    f32     &operator[](const u32 Component);
 
-#define GENERIC_READ    (0x80000000L)
-#define GENERIC_WRITE   (0x40000000L)
-#define GENERIC_EXECUTE (0x20000000L)
-#define GENERIC_ALL     (0x10000000L)
+    v4      &operator+=(const v4 &V);
+    v4      &operator-=(const v4 &V);
+    v4      &operator*=(const f32 T);
+    v4      &operator/=(const f32 T);
+};
 
-#define FILE_ATTRIBUTE_NORMAL   0x00000080
+v4      operator+(const v4 &U, const v4 &V);
+v4      operator-(const v4 &U, const v4 &V);
+v4      operator*(const f32 T, const v4 &U);
+v4      operator/(const v4 &U, const f32 T);
+f32     Dot(const v4 &U, const v4 &V);
+f32     Length(const v4 &V);
+f32     LengthSquared(const v4 &V);
+v4      Normalize(const v4 &V);
+v4      Hadamard(const v4 &U, const v4 &V);
 
-#define PAGE_NOACCESS               0x01
-#define PAGE_READONLY               0x02
-#define PAGE_READWRITE              0x04
-#define PAGE_WRITECOPY              0x08
-#define PAGE_EXECUTE                0x10
-#define PAGE_EXECUTE_READ           0x20
-#define PAGE_EXECUTE_READWRITE      0x40
-#define PAGE_EXECUTE_WRITECOPY      0x80
-#define MEM_COMMIT                  0x1000
-#define MEM_RESERVE                 0x2000
-#define MEM_DECOMMIT                0x4000
-#define MEM_RELEASE                 0x8000
-#define MEM_FREE                    0x10000
-#define MEM_PRIVATE                 0x20000
-#define MEM_MAPPED                  0x40000
-#define MEM_RESET                   0x80000
+#ifdef MG_IMPL
 
-#define SECTION_QUERY                0x0001
-#define SECTION_MAP_WRITE            0x0002
-#define SECTION_MAP_READ             0x0004
-#define SECTION_MAP_EXECUTE          0x0008
-#define SECTION_EXTEND_SIZE          0x0010
-#define SECTION_MAP_EXECUTE_EXPLICIT 0x0020
-#define STANDARD_RIGHTS_REQUIRED         (0x000F0000L)
+v4::v4(void)
+{
+    this->x = 0;
+    this->y = 0;
+    this->z = 0;
+    this->w = 0;
+}
 
-#define SECTION_ALL_ACCESS (STANDARD_RIGHTS_REQUIRED|SECTION_QUERY|\
-                        SECTION_MAP_WRITE |      \
-                        SECTION_MAP_READ |       \
-                        SECTION_MAP_EXECUTE |    \
-                        SECTION_EXTEND_SIZE)
+v4::v4(f32 x,
+       f32 y,
+       f32 z,
+       f32 w)
+{
+    this->x = x;
+    this->y = y;
+    this->z = z;
+    this->w = w;
+}
 
-#define FILE_MAP_WRITE      SECTION_MAP_WRITE
-#define FILE_MAP_READ       SECTION_MAP_READ
-#define FILE_MAP_ALL_ACCESS SECTION_ALL_ACCESS
+v4
+v4::operator-(void)
+{
+    this->x *= -1;
+    this->y *= -1;
+    this->z *= -1;
+    this->w *= -1;
 
-#define DECLARE_HANDLE(name) struct name##__{int unused;}; typedef struct name##__ *name
+    return (*this);
+}
 
-//////////////////////////////////////////////////////////////////////////////
-// Types
+f32 &
+v4::operator[](const u32 Component)
+{
+    return (this->Elements[Component]);
+}
 
-#ifndef VOID
-#define VOID void
-#endif // VOID
+v4 &
+v4::operator+=(const v4 &V)
+{
+#ifdef MG_SIMD
+    F32x4Store(this->Elements, F32x4Add(F32x4Load(this->Elements), F32x4Load(V.Elements)));
+#else
+    this->x += V.x;
+    this->y += V.y;
+    this->z += V.z;
+    this->w += V.w;
+#endif
 
-typedef void            *HANDLE;
-typedef long            HRESULT;
-typedef char            CHAR;
-typedef short           SHORT, *PSHORT, *LPSHORT;
-typedef int             INT, *PINT, *LPINT;
-typedef int             BOOL, *PBOOL, *LPBOOL;
-typedef unsigned char   BYTE, *PBYTE, *LPBYTE;
-typedef unsigned short  WORD, *PWORD, *LPWORD;
-typedef unsigned long   DWORD, *PDWORD, *LPDWORD;
-typedef float           FLOAT, *PFLOAT, *LPFLOAT;
-typedef void            *PVOID, *LPVOID;
-typedef long            LONG, *PLONG, *LPLONG;
-typedef CONST void      *PCVOID, *LPCVOID;
-typedef unsigned int    UINT, *PUINT, *LPUINT;
+    return (*this);
+}
 
-typedef CHAR                    *PCHAR, *LPCH, *PCH;
-typedef CONST CHAR              *LPCCH, *PCCH;
-typedef CHAR                    *NPSTR, *LPSTR, *PSTR;
-typedef PSTR                    *PZPSTR;
-typedef CONST PSTR              *PCZPSTR;
-typedef CONST CHAR              *LPCSTR, *PCSTR;
-typedef PCSTR                   *PZPCSTR;
-typedef CONST PCSTR             *PCZPCSTR;
-typedef CHAR                    *PZZSTR;
-typedef CONST CHAR              *PCZZSTR;
-typedef CHAR                    *PNZCH;
-typedef CONST CHAR              *PCNZCH;
+v4 &
+v4::operator-=(const v4 &V)
+{
+#ifdef MG_SIMD
+    F32x4Store(this->Elements, F32x4Sub(F32x4Load(this->Elements), F32x4Load(V.Elements)));
+#else
+    this->x -= V.x;
+    this->y -= V.y;
+    this->z -= V.z;
+    this->w -= V.w;
+#endif
 
-typedef unsigned short          WCHAR;
-typedef WCHAR                   *PWCHAR, *LPWCH, *PWCH;
-typedef CONST WCHAR             *LPCWCH, *PCWCH;
-typedef WCHAR                   *NWPSTR, *LPWSTR, *PWSTR;
-typedef PWSTR                   *PZPWSTR;
-typedef CONST PWSTR             *PCZPWSTR;
-typedef WCHAR UNALIGNED         *LPUWSTR, *PUWSTR;
-typedef CONST WCHAR             *LPCWSTR, *PCWSTR;
-typedef PCWSTR                  *PZPCWSTR;
-typedef CONST PCWSTR            *PCZPCWSTR;
-typedef CONST WCHAR UNALIGNED   *LPCUWSTR, *PCUWSTR;
-typedef WCHAR                   *PZZWSTR;
-typedef CONST WCHAR             *PCZZWSTR;
-typedef WCHAR UNALIGNED         *PUZZWSTR;
-typedef CONST WCHAR UNALIGNED   *PCUZZWSTR;
-typedef WCHAR                   *PNZWCH;
-typedef CONST WCHAR             *PCNZWCH;
-typedef WCHAR UNALIGNED         *PUNZWCH;
-typedef CONST WCHAR UNALIGNED   *PCUNZWCH;
+    return (*this);
+}
 
-typedef __int64                 INT_PTR, *PINT_PTR, LONG_PTR, *PLONG_PTR, LONGLONG;
-typedef unsigned __int64        UINT_PTR, *PUINT_PTR, ULONG_PTR, *PULONG_PTR, ULONGLONG;
-typedef UINT_PTR                WPARAM;
-typedef LONG_PTR                LPARAM, LRESULT, SSIZE_T, *PSSIZE_T;
-typedef ULONG_PTR               SIZE_T, *PSIZE_T, DWORD_PTR, *PDWORD_PTR;
+v4 &
+v4::operator*=(const f32 T)
+{
+#ifdef MG_SIMD
+    F32x4Store(this->Elements, F32x4Mul(F32x4Load(this->Elements), F32x4Set1(T)));
+#else
+    this->x *= T;
+    this->y *= T;
+    this->z *= T;
+    this->w *= T;
+#endif
 
-typedef WORD                    ATOM;
-typedef DWORD                   COLORREF, *LPCOLORREF;
+    return (*this);
+}
 
-#define MAKEWORD(a, b)      ((WORD)(((BYTE)(((DWORD_PTR)(a)) & 0xff)) | ((WORD)((BYTE)(((DWORD_PTR)(b)) & 0xff))) << 8))
-#define MAKELONG(a, b)      ((LONG)(((WORD)(((DWORD_PTR)(a)) & 0xffff)) | ((DWORD)((WORD)(((DWORD_PTR)(b)) & 0xffff))) << 16))
-#define LOWORD(l)           ((WORD)(((DWORD_PTR)(l)) & 0xffff))
-#define HIWORD(l)           ((WORD)((((DWORD_PTR)(l)) >> 16) & 0xffff))
-#define LOBYTE(w)           ((BYTE)(((DWORD_PTR)(w)) & 0xff))
-#define HIBYTE(w)           ((BYTE)((((DWORD_PTR)(w)) >> 8) & 0xff))
+v4 &
+v4::operator/=(const f32 T)
+{
+#ifdef MG_SIMD
+    F32x4Store(this->Elements, F32x4Div(F32x4Load(this->Elements), F32x4Set1(T)));
+#else
+    this->x /= T;
+    this->y /= T;
+    this->z /= T;
+    this->w /= T;
+#endif
 
-typedef INT_PTR (WINAPI *FARPROC)();
-typedef INT_PTR (WINAPI *NEARPROC)();
-typedef INT_PTR (WINAPI *PROC)();
+    return (*this);
+}
 
-typedef union _LARGE_INTEGER {
-    struct {
-        DWORD LowPart;
-        LONG HighPart;
-    } DUMMYSTRUCTNAME;
-    struct {
-        DWORD LowPart;
-        LONG HighPart;
-    } u;
-    LONGLONG QuadPart;
-} LARGE_INTEGER, *PLARGE_INTEGER, *LPLARGE_INTEGER;
+v4
+operator+(const v4 &U,
+          const v4 &V)
+{
+    v4 Result;
 
-typedef struct _LUID {
-    DWORD LowPart;
-    LONG HighPart;
-} LUID, *PLUID;
+#ifdef MG_SIMD
+    F32x4Store(Result.Elements, F32x4Add(F32x4Load(U.Elements), F32x4Load(V.Elements)));
+#else
+    Result.x = U.x + V.x;
+    Result.y = U.y + V.y;
+    Result.z = U.z + V.z;
+    Result.w = U.w + V.w;
+#endif
 
-#define _DWORDLONG_
-typedef ULONGLONG  DWORDLONG;
-typedef DWORDLONG *PDWORDLONG;
+    return (Result);
+}
 
-DECLARE_HANDLE(HWND);
-DECLARE_HANDLE(HHOOK);
-DECLARE_HANDLE(HACCEL);
-DECLARE_HANDLE(HBITMAP);
-DECLARE_HANDLE(HBRUSH);
-DECLARE_HANDLE(HDC);
-DECLARE_HANDLE(HGLRC);
-DECLARE_HANDLE(HDESK);
-DECLARE_HANDLE(HENHMETAFILE);
-DECLARE_HANDLE(HFONT);
-DECLARE_HANDLE(HICON);
-DECLARE_HANDLE(HMENU);
-DECLARE_HANDLE(HPALETTE);
-DECLARE_HANDLE(HPEN);
-DECLARE_HANDLE(HKEY);
-DECLARE_HANDLE(HMETAFILE);
-DECLARE_HANDLE(HINSTANCE);
-DECLARE_HANDLE(HRGN);
-DECLARE_HANDLE(HRSRC);
-DECLARE_HANDLE(HSPRITE);
-DECLARE_HANDLE(HLSURF);
-DECLARE_HANDLE(HSTR);
-DECLARE_HANDLE(HTASK);
-DECLARE_HANDLE(HWINSTA);
-DECLARE_HANDLE(HKL);
+v4
+operator-(const v4 &U,
+          const v4 &V)
+{
+    v4 Result;
 
-typedef HANDLE      GDIOBJ;
-typedef HKEY        *PHKEY;
-typedef HINSTANCE   HMODULE;      /* HMODULEs can be used in place of HINSTANCEs */
-typedef HICON       HCURSOR;      /* HICONs & HCURSORs are polymorphic */
-typedef INT         HFILE;
-#define HFILE_ERROR ((HFILE)-1)
+#ifdef MG_SIMD
+    F32x4Store(Result.Elements, F32x4Sub(F32x4Load(U.Elements), F32x4Load(V.Elements)));
+#else
+    Result.x = U.x - V.x;
+    Result.y = U.y - V.y;
+    Result.z = U.z - V.z;
+    Result.w = U.w - V.w;
+#endif
 
-//////////////////////////////////////////////////////////////////////////////
-// GENERAL
-//////////////////////////////////////////////////////////////////////////////
+    return (Result);
+}
 
-typedef struct _SECURITY_ATTRIBUTES {
-    DWORD nLength;
-    LPVOID lpSecurityDescriptor;
-    BOOL bInheritHandle;
-} SECURITY_ATTRIBUTES, *PSECURITY_ATTRIBUTES, *LPSECURITY_ATTRIBUTES;
-typedef struct _SYSTEMTIME {
-    WORD wYear;
-    WORD wMonth;
-    WORD wDayOfWeek;
-    WORD wDay;
-    WORD wHour;
-    WORD wMinute;
-    WORD wSecond;
-    WORD wMilliseconds;
-} SYSTEMTIME, *PSYSTEMTIME, *LPSYSTEMTIME;
-typedef struct _FILETIME {
-    DWORD dwLowDateTime;
-    DWORD dwHighDateTime;
-} FILETIME, *PFILETIME, *LPFILETIME;
-typedef struct _WIN32_FIND_DATAA {
-    DWORD dwFileAttributes;
-    FILETIME ftCreationTime;
-    FILETIME ftLastAccessTime;
-    FILETIME ftLastWriteTime;
-    DWORD nFileSizeHigh;
-    DWORD nFileSizeLow;
-    DWORD dwReserved0;
-    DWORD dwReserved1;
-    CHAR   cFileName[ MAX_PATH ];
-    CHAR   cAlternateFileName[ 14 ];
-} WIN32_FIND_DATAA, *PWIN32_FIND_DATAA, *LPWIN32_FIND_DATAA;
-typedef struct _WIN32_FIND_DATAW {
-    DWORD dwFileAttributes;
-    FILETIME ftCreationTime;
-    FILETIME ftLastAccessTime;
-    FILETIME ftLastWriteTime;
-    DWORD nFileSizeHigh;
-    DWORD nFileSizeLow;
-    DWORD dwReserved0;
-    DWORD dwReserved1;
-    WCHAR  cFileName[ MAX_PATH ];
-    WCHAR  cAlternateFileName[ 14 ];
-} WIN32_FIND_DATAW, *PWIN32_FIND_DATAW, *LPWIN32_FIND_DATAW;
-typedef struct _OVERLAPPED {
-    ULONG_PTR Internal;
-    ULONG_PTR InternalHigh;
-    union {
-        struct {
-            DWORD Offset;
-            DWORD OffsetHigh;
-        } DUMMYSTRUCTNAME;
-        PVOID Pointer;
-    } DUMMYUNIONNAME;
+v4
+operator*(const f32 T,
+          const v4 &V)
+{
+    v4 Result;
 
-    HANDLE  hEvent;
-} OVERLAPPED, *LPOVERLAPPED;
-typedef struct _OVERLAPPED_ENTRY {
-    ULONG_PTR lpCompletionKey;
-    LPOVERLAPPED lpOverlapped;
-    ULONG_PTR Internal;
-    DWORD dwNumberOfBytesTransferred;
-} OVERLAPPED_ENTRY, *LPOVERLAPPED_ENTRY;
+#ifdef MG_SIMD
+    F32x4Store(Result.Elements, F32x4Mul(F32x4Set1(T), F32x4Load(V.Elements)));
+#else
+    Result.x = T * V.x;
+    Result.y = T * V.y;
+    Result.z = T * V.z;
+    Result.w = T * V.w;
+#endif
 
-typedef VOID (WINAPI *LPOVERLAPPED_COMPLETION_ROUTINE)(DWORD dwErrorCode, DWORD dwNumberOfBytesTransfered, LPOVERLAPPED lpOverlapped);
+    return Result;
+}
 
-//////////////////////////////////////////////////////////////////////////////
-// vcruntime_string.h
-//////////////////////////////////////////////////////////////////////////////
+v4
+operator/(const v4 &V,
+          const f32 T)
+{
+    v4 Result;
 
-#include <string.h>
+#ifdef MG_SIMD
+    F32x4Store(Result.Elements, F32x4Div(F32x4Load(V.Elements), F32x4Set1(T)));
+#else
+    Result.x = V.x / T;
+    Result.y = V.y / T;
+    Result.z = V.z / T;
+    Result.w = V.w / T;
+#endif
 
-/* int __cdecl                 memcmp(void* const _Buf1, void const* _Buf2, size_t _Size); */
-/* void* __cdecl               memcpy(void* _Dst, void const* _Src, size_t _Size); */
-/* void* __cdecl               memset(void* _Dst, int _Val,size_t _Size); */
-/* _VCRTIMP void* __cdecl      memmove(void* _Dst, void const* _Src, size_t _Size); */
-/* size_t __cdecl              strlen(char const* _Str); */
+    return Result;
+}
 
-//////////////////////////////////////////////////////////////////////////////
-// winnt.h
-//////////////////////////////////////////////////////////////////////////////
+f32
+Dot(const v4 &U,
+    const v4 &V)
+{
+    return (U.x * V.x) + (U.y * V.y) + (U.z * V.z) + (U.w * V.w);
+}
 
-#define RtlEqualMemory(Destination,Source,Length) (!memcmp((Destination),(Source),(Length)))
-#define RtlMoveMemory(Destination,Source,Length) memmove((Destination),(Source),(Length))
-#define RtlCopyMemory(Destination,Source,Length) memcpy((Destination),(Source),(Length))
-#define RtlFillMemory(Destination,Length,Fill) memset((Destination),(Fill),(Length))
-#define RtlZeroMemory(Destination,Length) memset((Destination),0,(Length))
+f32
+Length(const v4 &V)
+{
+    return SquareRoot(Dot(V, V));
+}
 
-#define MoveMemory RtlMoveMemory
-#define CopyMemory RtlCopyMemory
-#define FillMemory RtlFillMemory
-#define ZeroMemory RtlZeroMemory
+f32
+LengthSquared(const v4 &V)
+{
+    return Dot(V, V);
+}
 
-//////////////////////////////////////////////////////////////////////////////
-// handleapi.h
-//////////////////////////////////////////////////////////////////////////////
+v4
+Normalize(const v4 &V)
+{
+    return V / Length(V);
+}
 
-#define INVALID_HANDLE_VALUE    ((HANDLE)(LONG_PTR)-1)
 
-WINBASEAPI BOOL WINAPI  CloseHandle(HANDLE hObject);
+v4      
+Hadamard(const v4 &U, 
+         const v4 &V)
+{
+    v4 Result;
 
-//////////////////////////////////////////////////////////////////////////////
-// fileapi.h
-//////////////////////////////////////////////////////////////////////////////
+#ifdef MG_SIMD
+    F32x4Store(Result.Elements, F32x4Mul(F32x4Load(U.Elements), F32x4Load(V.Elements)));
+#else
+    Result.x = U.x * V.x;
+    Result.y = U.y * V.y;
+    Result.z = U.z * V.z;
+    Result.w = U.w * V.w;
+#endif
 
-#define CREATE_NEW                  1
-#define CREATE_ALWAYS               2
-#define OPEN_EXISTING               3
-#define OPEN_ALWAYS                 4
-#define TRUNCATE_EXISTING           5
-#define INVALID_FILE_SIZE           ((DWORD)0xFFFFFFFF)
-#define INVALID_SET_FILE_POINTER    ((DWORD)-1)
-#define INVALID_FILE_ATTRIBUTES     ((DWORD)-1)
+    return (Result);
+}
 
-WINBASEAPI LONG WINAPI      CompareFileTime(CONST FILETIME * lpFileTime1, CONST FILETIME * lpFileTime2);
-WINBASEAPI BOOL WINAPI      CreateDirectoryA(LPCSTR lpPathName, LPSECURITY_ATTRIBUTES lpSecurityAttributes);
-WINBASEAPI BOOL WINAPI      CreateDirectoryW(LPCWSTR lpPathName, LPSECURITY_ATTRIBUTES lpSecurityAttributes);
-WINBASEAPI HANDLE WINAPI    CreateFileA(LPCSTR lpFileName, DWORD dwDesiredAccess, DWORD dwShareMode, LPSECURITY_ATTRIBUTES lpSecurityAttributes, DWORD dwCreationDisposition, DWORD dwFlagsAndAttributes, HANDLE hTemplateFile);
-WINBASEAPI HANDLE WINAPI    CreateFileW(LPCWSTR lpFileName, DWORD dwDesiredAccess, DWORD dwShareMode, LPSECURITY_ATTRIBUTES lpSecurityAttributes, DWORD dwCreationDisposition, DWORD dwFlagsAndAttributes, HANDLE hTemplateFile);
-WINBASEAPI BOOL WINAPI      DeleteFileA(LPCSTR lpFileName);
-WINBASEAPI BOOL WINAPI      DeleteFileW(LPCWSTR lpFileName);
-WINBASEAPI HANDLE WINAPI    FindFirstFileA(LPCSTR lpFileName, LPWIN32_FIND_DATAA lpFindFileData);
-WINBASEAPI HANDLE WINAPI    FindFirstFileW(LPCWSTR lpFileName, LPWIN32_FIND_DATAA lpFindFileData);
-WINBASEAPI DWORD WINAPI     GetFileSize(HANDLE hFile, LPDWORD lpFileSizeHigh);
-WINBASEAPI BOOL WINAPI      GetFileSizeEx(HANDLE hFile, PLARGE_INTEGER lpFileSize);
-WINBASEAPI BOOL WINAPI      ReadFile(HANDLE hFile, LPVOID lpBuffer, DWORD nNumberOfBytesToRead, LPDWORD lpNumberOfBytesRead, LPOVERLAPPED lpOverlapped);
-WINBASEAPI BOOL WINAPI      ReadFileEx(HANDLE hFile, LPVOID lpBuffer, DWORD nNumberOfBytesToRead, LPOVERLAPPED lpOverlapped, LPOVERLAPPED_COMPLETION_ROUTINE lpCompletionRoutine);
-WINBASEAPI BOOL WINAPI      WriteFile(HANDLE hFile, LPCVOID lpBuffer, DWORD nNumberOfBytesToWrite, LPDWORD lpNumberOfBytesWritten, LPOVERLAPPED lpOverlapped);
-WINBASEAPI BOOL WINAPI      WriteFileEx(HANDLE hFile, LPCVOID lpBuffer, DWORD nNumberOfBytesToWrite, LPOVERLAPPED lpOverlapped, LPOVERLAPPED_COMPLETION_ROUTINE lpCompletionRoutine);
-WINBASEAPI DWORD WINAPI     SetFilePointer(HANDLE hFile, LONG lDistanceToMove, PLONG lpDistanceToMoveHigh, DWORD dwMoveMethod);
-WINBASEAPI BOOL WINAPI      SetFilePointerEx(HANDLE hFile, LARGE_INTEGER liDistanceToMove, PLARGE_INTEGER lpNewFilePointer, DWORD dwMoveMethod);
-WINBASEAPI BOOL WINAPI      LockFile(HANDLE hFile, DWORD dwFileOffsetLow, DWORD dwFileOffsetHigh, DWORD nNumberOfBytesToLockLow, DWORD nNumberOfBytesToLockHigh);
-WINBASEAPI BOOL WINAPI      LockFileEx(HANDLE hFile, DWORD dwFlags, DWORD dwReserved, DWORD nNumberOfBytesToLockLow, DWORD nNumberOfBytesToLockHigh, LPOVERLAPPED lpOverlapped);
-WINBASEAPI BOOL WINAPI      UnlockFile(HANDLE hFile, DWORD dwFileOffsetLow, DWORD dwFileOffsetHigh, DWORD nNumberOfBytesToUnlockLow, DWORD nNumberOfBytesToUnlockHigh);
-WINBASEAPI BOOL WINAPI      UnlockFileEx(HANDLE hFile, DWORD dwReserved, DWORD nNumberOfBytesToUnlockLow, DWORD nNumberOfBytesToUnlockHigh, LPOVERLAPPED lpOverlapped);
-WINBASEAPI BOOL WINAPI      RemoveDirectoryA(LPCSTR lpPathName);
-WINBASEAPI BOOL WINAPI      RemoveDirectoryW(LPCWSTR lpPathName);
+#endif // MG_IMPL
 
-#ifdef UNICODE
-    #define CreateDirectory     CreateDirectoryW
-    #define CreateFile          CreateFileW
-    #define DeleteFile          DeleteFileW
-    #define FindFirstFile       FindFirstFileW
-    #define RemoveDirectory     RemoveDirectoryW
+////////////////////////////////////////
+// M4
+////////////////////////////////////////
+
+union m4
+{
+    struct { v4 Cols[4]; };
+    f32 Elements[16];
+
+
+    m4(void);
+    m4(v4 Col0, v4 Col1, v4 Col2, v4 Col3);
+};
+
+m4      Mat4Identity(void);
+m4      Mat4Translate(f32 X, f32 Y, f32 Z);
+m4      Mat4Translate(v3 &V);
+m4      Mat4Rotate(f32 Angle, f32 X, f32 Y, f32 Z);
+m4      Mat4Rotate(f32 Angle, v3 &V);
+m4      Mat4PerspectiveRH(f32 FOV, f32 AspectRatio, f32 Near, f32 Far);
+m4      Mat4PerspectiveLH(f32 FOV, f32 AspectRatio, f32 Near, f32 Far);
+m4      Mat4LookAtRH(v3 Eye, v3 Center, v3 Up);
+m4      Mat4LookAtLH(v3 Eye, v3 Center, v3 Up);
+m4      Mat4Scale(f32 Scale);
+m4      Mat4Scale(v3 &Scale);
+m4      Mat4Inverse(m4 M);
+m4      operator*(m4 M1, m4 M2);
+v4      operator*(m4 M, v4 V);
+
+#ifdef MG_IMPL
+
+m4::m4(void)
+{
+    for (u32 I = 0; I < 16; I += 4)
+    {
+        this->Elements[I] = 0;
+        this->Elements[I + 1] = 0;
+        this->Elements[I + 2] = 0;
+        this->Elements[I + 3] = 0;
+    }
+}
+
+m4::m4(v4 Col0,
+       v4 Col1,
+       v4 Col2,
+       v4 Col3)
+{
+    this->Cols[0] = Col0;
+    this->Cols[1] = Col1;
+    this->Cols[2] = Col2;
+    this->Cols[3] = Col3;
+}
+
+m4
+Mat4Identity(void)
+{
+    m4      Mat;
+
+
+    Mat.Cols[0].x = 1;
+    Mat.Cols[1].y = 1;
+    Mat.Cols[2].z = 1;
+    Mat.Cols[3].w = 1;
+
+    return (Mat);
+}
+
+m4
+Mat4Translate(f32 x, f32 y, f32 z)
+{
+    m4      Mat;
+
+
+    Mat = Mat4Identity();
+    Mat.Cols[3].x = x;
+    Mat.Cols[3].y = y;
+    Mat.Cols[3].z = z;
+
+    return (Mat);
+}
+
+m4
+Mat4Translate(v3 &V)
+{
+    m4      Mat;
+
+
+    Mat = Mat4Identity();
+    Mat.Cols[3].x = V.x;
+    Mat.Cols[3].y = V.y;
+    Mat.Cols[3].z = V.z;
+
+    return (Mat);
+}
+
+m4
+Mat4Rotate(f32 Angle,
+           f32 x,
+           f32 y,
+           f32 z)
+{
+    m4      Mat;
+    f32     C,
+            S,
+            C1;
+    v3      Axis;
+
+
+    C = Cos(DegsToRads(Angle));
+    S = Sin(DegsToRads(Angle));
+    C1 = 1.0f - C;
+    Axis = Normalize(v3(x, y, z));
+
+    Mat.Cols[0].x = (C1 * Axis.x * Axis.x) + C;
+    Mat.Cols[0].y = (C1 * Axis.x * Axis.y) + S * Axis.z;
+    Mat.Cols[0].z = (C1 * Axis.x * Axis.z) - S * Axis.y;
+
+    Mat.Cols[1].x = (C1 * Axis.x * Axis.y) - S * Axis.z;
+    Mat.Cols[1].y = (C1 * Axis.y * Axis.y) + C;
+    Mat.Cols[1].z = (C1 * Axis.y * Axis.z) + S * Axis.x;
+
+    Mat.Cols[2].x = (C1 * Axis.x * Axis.z) + S * Axis.y;
+    Mat.Cols[2].y = (C1 * Axis.y * Axis.z) - S * Axis.x;
+    Mat.Cols[2].z = (C1 * Axis.z * Axis.z) + C;
+
+    Mat.Cols[3].w = 1.0f;
+
+    return (Mat);
+}
+
+m4
+Mat4Rotate(f32 Angle,
+           v3 Axis)
+{
+    m4      Mat;
+    f32     C,
+            S,
+            C1;
+    v3      Vec;
+
+
+    C = Cos(DegsToRads(Angle));
+    S = Sin(DegsToRads(Angle));
+    C1 = 1.0f - C;
+    Vec = Normalize(Axis);
+
+    Mat.Cols[0].x = (C1 * Vec.x * Vec.x) + C;
+    Mat.Cols[0].y = (C1 * Vec.x * Vec.y) + S * Vec.z;
+    Mat.Cols[0].z = (C1 * Vec.x * Vec.z) - S * Vec.y;
+
+    Mat.Cols[1].x = (C1 * Vec.x * Vec.y) - S * Vec.z;
+    Mat.Cols[1].y = (C1 * Vec.y * Vec.y) + C;
+    Mat.Cols[1].z = (C1 * Vec.y * Vec.z) + S * Vec.x;
+
+    Mat.Cols[2].x = (C1 * Vec.x * Vec.z) + S * Vec.y;
+    Mat.Cols[2].y = (C1 * Vec.y * Vec.z) - S * Vec.x;
+    Mat.Cols[2].z = (C1 * Vec.z * Vec.z) + C;
+
+    Mat.Cols[3].w = 1.0f;
+
+    return (Mat);
+}
+
+m4
+Mat4PerspectiveRH(f32 FOV,
+                  f32 AspectRatio,
+                  f32 Near,
+                  f32 Far)
+{
+    m4      Mat;
+    f32     t,
+            Delta;
+
+
+    t = Tan(DegsToRads(FOV) * 0.5f);
+    Delta = Far - Near;
+
+    Mat.Cols[0].x = 1 / (AspectRatio * t);
+    Mat.Cols[1].y = 1 / t;
+    Mat.Cols[2].z = -1 * ((Far + Near) / Delta);
+    Mat.Cols[2].w = -1.0f;
+    Mat.Cols[3].z = ((-2.0f * Far * Near) / Delta);
+
+    return (Mat);
+}
+
+m4
+Mat4PerspectiveLH(f32 FOV,
+                  f32 AspectRatio,
+                  f32 Near,
+                  f32 Far)
+{
+    m4      Mat;
+    f32     t;
+    f32     Range;
+
+
+    t = Tan(DegsToRads(FOV) * 0.5f);
+    Range = Far / (Far - Near);
+
+    Mat.Cols[0].x = 1 / (AspectRatio * t);
+    Mat.Cols[1].y = 1 / t;
+    Mat.Cols[2].z = Range;
+    Mat.Cols[2].w = 1.0f;
+    Mat.Cols[3].z = -Range * Near;
+
+    return (Mat);
+}
+
+m4
+Mat4LookAtRH(v3 Eye,
+             v3 Center,
+             v3 Up)
+{
+    m4      Mat;
+    v3      F,
+            S,
+            U;
+
+
+    F = Normalize(Center - Eye);
+    S = Normalize(Cross(F, Up));
+    U = Cross(S, F);
+
+    Mat.Cols[0].x = S.x;
+    Mat.Cols[0].y = U.x;
+    Mat.Cols[0].z = -F.x;
+
+    Mat.Cols[1].x = S.y;
+    Mat.Cols[1].y = U.y;
+    Mat.Cols[1].z = -F.y;
+
+    Mat.Cols[2].x = S.z;
+    Mat.Cols[2].y = U.z;
+    Mat.Cols[2].z = -F.z;
+
+    Mat.Cols[3].x = -Dot(S, Eye);
+    Mat.Cols[3].y = -Dot(U, Eye);
+    Mat.Cols[3].z = -Dot(F, Eye);
+
+    Mat.Cols[3].w = 1.0f;
+
+    return (Mat);
+}
+
+m4
+Mat4LookAtLH(v3 Eye,
+             v3 Center,
+             v3 Up)
+{
+    m4      Mat;
+    v3      F,
+            S,
+            U;
+
+
+    F = Normalize(Center - Eye);
+    S = Normalize(Cross(Up, F));
+    U = Cross(F, S);
+
+    Mat.Cols[0].x = S.x;
+    Mat.Cols[0].y = U.x;
+    Mat.Cols[0].z = F.x;
+
+    Mat.Cols[1].x = S.y;
+    Mat.Cols[1].y = U.y;
+    Mat.Cols[1].z = F.y;
+
+    Mat.Cols[2].x = S.z;
+    Mat.Cols[2].y = U.z;
+    Mat.Cols[2].z = F.z;
+
+    Mat.Cols[3].x = -Dot(S, Eye);
+    Mat.Cols[3].y = -Dot(U, Eye);
+    Mat.Cols[3].z = -Dot(F, Eye);
+
+    Mat.Cols[3].w = 1.0f;
+
+    return (Mat);
+}
+
+m4
+Mat4Scale(f32 Scale)
+{
+    m4       Mat;
+
+
+    Mat.Cols[0].x = Scale;
+    Mat.Cols[1].y = Scale;
+    Mat.Cols[2].z = Scale;
+    Mat.Cols[3].w = 1.0f;
+
+    return (Mat);
+}
+
+m4
+Mat4Scale(v3 &Scale)
+{
+    m4       Mat;
+
+
+    Mat.Cols[0].x = Scale.x;
+    Mat.Cols[1].y = Scale.y;
+    Mat.Cols[2].z = Scale.z;
+    Mat.Cols[3].w = 1.0f;
+
+    return (Mat);
+}
+
+m4
+Mat4Inverse(m4 M)
+{
+    m4      Mat;
+    f32     *m = M.Elements,
+            *Inv = Mat.Elements;
+    f32     Det;
+
+
+    Inv[0] = m[5] * m[10] * m[15] - m[5] * m[11] * m[14] - m[9] * m[6] * m[15] + m[9] * m[7] * m[14] + m[13] * m[6] * m[11] - m[13] * m[7] * m[10];
+    Inv[4] = -m[4] * m[10] * m[15] + m[4] * m[11] * m[14] + m[8] * m[6] * m[15] - m[8] * m[7] * m[14] - m[12] * m[6] * m[11] + m[12] * m[7] * m[10];
+    Inv[8] = m[4] * m[9] * m[15] - m[4] * m[11] * m[13] - m[8] * m[5] * m[15] + m[8] * m[7] * m[13] + m[12] * m[5] * m[11] - m[12] * m[7] * m[9];
+    Inv[12] = -m[4] * m[9] * m[14] + m[4] * m[10] * m[13] + m[8] * m[5] * m[14] - m[8] * m[6] * m[13] - m[12] * m[5] * m[10] + m[12] * m[6] * m[9];
+    Inv[1] = -m[1] * m[10] * m[15] + m[1] * m[11] * m[14] + m[9] * m[2] * m[15] - m[9] * m[3] * m[14] - m[13] * m[2] * m[11] + m[13] * m[3] * m[10];
+    Inv[5] = m[0] * m[10] * m[15] - m[0] * m[11] * m[14] - m[8] * m[2] * m[15] + m[8] * m[3] * m[14] + m[12] * m[2] * m[11] - m[12] * m[3] * m[10];
+    Inv[9] = -m[0] * m[9] * m[15] + m[0] * m[11] * m[13] + m[8] * m[1] * m[15] - m[8] * m[3] * m[13] - m[12] * m[1] * m[11] + m[12] * m[3] * m[9];
+    Inv[13] = m[0] * m[9] * m[14] - m[0] * m[10] * m[13] - m[8] * m[1] * m[14] + m[8] * m[2] * m[13] + m[12] * m[1] * m[10] - m[12] * m[2] * m[9];
+    Inv[2] = m[1] * m[6] * m[15] - m[1] * m[7] * m[14] - m[5] * m[2] * m[15] + m[5] * m[3] * m[14] + m[13] * m[2] * m[7] - m[13] * m[3] * m[6];
+    Inv[6] = -m[0] * m[6] * m[15] + m[0] * m[7] * m[14] + m[4] * m[2] * m[15] - m[4] * m[3] * m[14] - m[12] * m[2] * m[7] + m[12] * m[3] * m[6];
+    Inv[10] = m[0] * m[5] * m[15] - m[0] * m[7] * m[13] - m[4] * m[1] * m[15] + m[4] * m[3] * m[13] + m[12] * m[1] * m[7] - m[12] * m[3] * m[5];
+    Inv[14] = -m[0] * m[5] * m[14] + m[0] * m[6] * m[13] + m[4] * m[1] * m[14] - m[4] * m[2] * m[13] - m[12] * m[1] * m[6] + m[12] * m[2] * m[5];
+    Inv[3] = -m[1] * m[6] * m[11] + m[1] * m[7] * m[10] + m[5] * m[2] * m[11] - m[5] * m[3] * m[10] - m[9] * m[2] * m[7] + m[9] * m[3] * m[6];
+    Inv[7] = m[0] * m[6] * m[11] - m[0] * m[7] * m[10] - m[4] * m[2] * m[11] + m[4] * m[3] * m[10] + m[8] * m[2] * m[7] - m[8] * m[3] * m[6];
+    Inv[11] = -m[0] * m[5] * m[11] + m[0] * m[7] * m[9] + m[4] * m[1] * m[11] - m[4] * m[3] * m[9] - m[8] * m[1] * m[7] + m[8] * m[3] * m[5];
+    Inv[15] = m[0] * m[5] * m[10] - m[0] * m[6] * m[9] - m[4] * m[1] * m[10] + m[4] * m[2] * m[9] + m[8] * m[1] * m[6] - m[8] * m[2] * m[5];
+
+    Det = m[0] * Inv[0] + m[1] * Inv[4] + m[2] * Inv[8] + m[3] * Inv[12];
+    if (Det != 0)
+    {
+        Det = 1.0f / Det;
+    }
+
+    for (u32 I = 0; I < 16; I++)
+    {
+        Inv[I] *= Det;
+    }
+
+    return (Mat);
+}
+
+m4
+operator*(m4 M1,
+          m4 M2)
+{
+    m4 Mat;
+
+#ifdef MG_SIMD
+    // Column Y is M1 * M2.Cols[Y], the sums go in the same order as below
+    f32x4   C0 = F32x4Load(M1.Cols[0].Elements),
+            C1 = F32x4Load(M1.Cols[1].Elements),
+            C2 = F32x4Load(M1.Cols[2].Elements),
+            C3 = F32x4Load(M1.Cols[3].Elements);
+
+    for (u32 Y = 0; Y < 4; Y++)
+    {
+        f32     *E = M2.Cols[Y].Elements;
+        f32x4   Sum = F32x4Mul(C0, F32x4Set1(E[0]));
+
+        Sum = F32x4Add(Sum, F32x4Mul(C1, F32x4Set1(E[1])));
+        Sum = F32x4Add(Sum, F32x4Mul(C2, F32x4Set1(E[2])));
+        Sum = F32x4Add(Sum, F32x4Mul(C3, F32x4Set1(E[3])));
+        F32x4Store(Mat.Cols[Y].Elements, Sum);
+    }
+#else
+    for (u32 Y = 0; Y < 4; Y++)
+    {
+        for (u32 X = 0; X < 4; X++)
+        {
+            f32 Sum = 0.0f;
+
+            for (u32 E = 0; E < 4; E++)
+            {
+                Sum += M1.Elements[X + E * 4] * M2.Elements[E + Y * 4];
+            }
+
+            Mat.Elements[X + Y * 4] = Sum;
+        }
+    }
+#endif
+
+    return (Mat);
+}
+
+v4      
+operator*(m4 M,
+          v4 V)
+{
+    v4 Result;
+
+#ifdef MG_SIMD
+    f32x4 Sum = F32x4Mul(F32x4Set1(V.x), F32x4Load(M.Cols[0].Elements));
+
+    Sum = F32x4Add(Sum, F32x4Mul(F32x4Set1(V.y), F32x4Load(M.Cols[1].Elements)));
+    Sum = F32x4Add(Sum, F32x4Mul(F32x4Set1(V.z), F32x4Load(M.Cols[2].Elements)));
+    Sum = F32x4Add(Sum, F32x4Mul(F32x4Set1(V.w), F32x4Load(M.Cols[3].Elements)));
+    F32x4Store(Result.Elements, Sum);
+#else
+    Result = V.x * M.Cols[0] +
+             V.y * M.Cols[1] +
+             V.z * M.Cols[2] +
+             V.w * M.Cols[3];
+#endif
+
+    return Result;
+}
+
+#endif // MG_IMPL
+
+////////////////////////////////////////
+// Wide
+////////////////////////////////////////
+
+// NOTE(matthew): Structure of arrays versions of the types above, one f32x4
+// per component, so four of them go through each op. This is what the
+// packet kernels share instead of writing their own intrinsics. The small
+// ops are inline like the f32x4 ones, they'd cost more as calls than they
+// do. V3x4Load()/V3x4Store() convert four consecutive (AoS) v3s.
+
+union v3x4
+{
+    struct { f32x4 x, y, z; };
+    f32x4 Elements[3];
+};
+
+// NOTE(matthew): Four rays for the packet kernels. Origin and Dir are the
+// ray, tMin/tMax the interval left to march, Transmittance and Energy what
+// it's gathered so far. Lanes that miss or finish are cleared from Active
+// rather than compacted, kernels stop once nothing is.
+
+struct ray_batch
+{
+    v3x4    Origin,
+            Dir;
+    f32x4   tMin,
+            tMax,
+            Transmittance;
+    v3x4    Energy;
+    b32x4   Active;
+};
+
+void    InitRayBatch(ray_batch *Rays, v3 const *Origins, v3 const *Dirs, u32 Count);
+b32x4   ClipRayBatch(ray_batch *Rays, v3 BoxMin, v3 BoxMax);
+
+inline f32
+F32x4Lane(f32x4 A,
+          u32 Lane)
+{
+    f32 Lanes[4];
+
+    F32x4Store(Lanes, A);
+
+    return (Lanes[Lane]);
+}
+
+inline v3x4
+V3x4(f32x4 X,
+     f32x4 Y,
+     f32x4 Z)
+{
+    v3x4 Result;
+
+    Result.x = X;
+    Result.y = Y;
+    Result.z = Z;
+
+    return (Result);
+}
+
+inline v3x4
+V3x4Set1(v3 V)
+{
+    return (V3x4(F32x4Set1(V.x), F32x4Set1(V.y), F32x4Set1(V.z)));
+}
+
+inline v3x4
+V3x4Load(v3 const *P)
+{
+    v3x4 Result;
+
+    F32x4Load3(P->Elements, &Result.x, &Result.y, &Result.z);
+
+    return (Result);
+}
+
+inline void
+V3x4Store(v3 *P,
+          v3x4 V)
+{
+    F32x4Store3(P->Elements, V.x, V.y, V.z);
+}
+
+inline v3
+V3x4Lane(v3x4 V,
+         u32 Lane)
+{
+    return (v3(F32x4Lane(V.x, Lane), F32x4Lane(V.y, Lane), F32x4Lane(V.z, Lane)));
+}
+
+inline v3x4
+operator+(const v3x4 &U,
+          const v3x4 &V)
+{
+    return (V3x4(F32x4Add(U.x, V.x), F32x4Add(U.y, V.y), F32x4Add(U.z, V.z)));
+}
+
+inline v3x4
+operator-(const v3x4 &U,
+          const v3x4 &V)
+{
+    return (V3x4(F32x4Sub(U.x, V.x), F32x4Sub(U.y, V.y), F32x4Sub(U.z, V.z)));
+}
+
+inline v3x4
+operator*(f32x4 T,
+          const v3x4 &V)
+{
+    return (V3x4(F32x4Mul(T, V.x), F32x4Mul(T, V.y), F32x4Mul(T, V.z)));
+}
+
+inline v3x4
+Hadamard(const v3x4 &U,
+         const v3x4 &V)
+{
+    return (V3x4(F32x4Mul(U.x, V.x), F32x4Mul(U.y, V.y), F32x4Mul(U.z, V.z)));
+}
+
+inline f32x4
+Dot(const v3x4 &U,
+    const v3x4 &V)
+{
+    return (F32x4Add(F32x4Add(F32x4Mul(U.x, V.x), F32x4Mul(U.y, V.y)), F32x4Mul(U.z, V.z)));
+}
+
+inline f32x4
+Length(const v3x4 &V)
+{
+    return (F32x4Sqrt(Dot(V, V)));
+}
+
+inline v3x4
+Normalize(const v3x4 &V)
+{
+    f32x4 Len = Length(V);
+
+    return (V3x4(F32x4Div(V.x, Len), F32x4Div(V.y, Len), F32x4Div(V.z, Len)));
+}
+
+// Mask ? U : V per lane
+inline v3x4
+V3x4Select(b32x4 Mask,
+           const v3x4 &U,
+           const v3x4 &V)
+{
+    return (V3x4(F32x4Select(Mask, U.x, V.x), F32x4Select(Mask, U.y, V.y), F32x4Select(Mask, U.z, V.z)));
+}
+
+// M * v4(P, 1) without the w, in the same order as there
+inline v3x4
+TransformPoint(const m4 &M,
+               const v3x4 &P)
+{
+    v3x4 Result;
+
+    for (u32 I = 0; I < 3; I++)
+    {
+        f32x4 Sum = F32x4Mul(P.x, F32x4Set1(M.Cols[0].Elements[I]));
+
+        Sum = F32x4Add(Sum, F32x4Mul(P.y, F32x4Set1(M.Cols[1].Elements[I])));
+        Sum = F32x4Add(Sum, F32x4Mul(P.z, F32x4Set1(M.Cols[2].Elements[I])));
+        Result.Elements[I] = F32x4Add(Sum, F32x4Set1(M.Cols[3].Elements[I]));
+    }
+
+    return (Result);
+}
+
+#ifdef MG_IMPL
+
+// Count (up to 4) rays from the arrays, the lanes past it start inactive.
+// The interval is [0, F32_MAX) until something clips it.
+void
+InitRayBatch(ray_batch *Rays,
+             v3 const *Origins,
+             v3 const *Dirs,
+             u32 Count)
+{
+    v3      O[4],
+            D[4];
+
+
+    for (u32 I = 0; I < 4; I++)
+    {
+        O[I] = (I < Count) ? Origins[I] : v3(0, 0, 0);
+        D[I] = (I < Count) ? Dirs[I] : v3(0, 0, 1);
+    }
+
+    Rays->Origin = V3x4Load(O);
+    Rays->Dir = V3x4Load(D);
+    Rays->tMin = F32x4Set1(0);
+    Rays->tMax = F32x4Set1(F32_MAX);
+    Rays->Transmittance = F32x4Set1(1);
+    Rays->Energy = V3x4Set1(v3(0, 0, 0));
+    Rays->Active = F32x4Less(F32x4Set(0, 1, 2, 3), F32x4Set1(f32(Count)));
+}
+
+// IntersectBox() in probes.h for four rays at once, narrowed into each
+// ray's interval. Clears the lanes that miss from Active and returns it.
+b32x4
+ClipRayBatch(ray_batch *Rays,
+             v3 BoxMin,
+             v3 BoxMax)
+{
+    f32x4   Zero = F32x4Set1(0),
+            One = F32x4Set1(1),
+            Far = F32x4Set1(F32_MAX),
+            NegFar = F32x4Set1(-F32_MAX),
+            tNear = Rays->tMin,
+            tFar = Rays->tMax;
+
+
+    for (u32 I = 0; I < 3; I++)
+    {
+        f32x4 Origin = Rays->Origin.Elements[I];
+        f32x4 Dir = Rays->Dir.Elements[I];
+        f32x4 Min = F32x4Set1(BoxMin.Elements[I]);
+        f32x4 Max = F32x4Set1(BoxMax.Elements[I]);
+
+        // Same as there, a ray parallel to a slab is inside it for all t or
+        // never, the divide by zero in those lanes is thrown away
+        b32x4 Parallel = F32x4Equal(Dir, Zero);
+        b32x4 Inside = B32x4And(F32x4GreaterEqual(Origin, Min), F32x4LessEqual(Origin, Max));
+
+        f32x4 InvR = F32x4Div(One, Dir);
+        f32x4 tBot = F32x4Mul(InvR, F32x4Sub(Min, Origin));
+        f32x4 tTop = F32x4Mul(InvR, F32x4Sub(Max, Origin));
+
+        f32x4 tMin = F32x4Select(Parallel, F32x4Select(Inside, NegFar, Far), F32x4Min(tTop, tBot));
+        f32x4 tMax = F32x4Select(Parallel, F32x4Select(Inside, Far, NegFar), F32x4Max(tTop, tBot));
+
+        tNear = F32x4Max(tNear, tMin);
+        tFar = F32x4Min(tFar, tMax);
+    }
+
+    Rays->tMin = tNear;
+    Rays->tMax = tFar;
+    Rays->Active = B32x4And(Rays->Active, F32x4Less(tNear, tFar));
+
+    return (Rays->Active);
+}
+
+#endif // MG_IMPL
+
+////////////////////////////////////////
+// Batches
+////////////////////////////////////////
+
+// NOTE(matthew): Whole arrays at once. With MG_SIMD these work on four
+// vectors at a time, one register per component, which is where the SIMD
+// really pays off: a single v3 op is all shuffles and one lane of work.
+// Result can be the same array as the input.
+
+void    TransformPoints(const m4 &M, v3 const *Points, v3 *Result, u32 Count);
+void    NormalizeVectors(v3 const *Vectors, v3 *Result, u32 Count);
+void    ExpArray(f32 *Values, u32 Count, u32 Tier);
+
+#ifdef MG_IMPL
+
+// M * v4(P, 1), without the w
+void
+TransformPoints(const m4 &M,
+                v3 const *Points,
+                v3 *Result,
+                u32 Count)
+{
+    u32     I = 0;
+
+
+#ifdef MG_SIMD
+    f32x4   Mx[4],
+            My[4],
+            Mz[4];
+
+    for (u32 C = 0; C < 4; C++)
+    {
+        Mx[C] = F32x4Set1(M.Cols[C].x);
+        My[C] = F32x4Set1(M.Cols[C].y);
+        Mz[C] = F32x4Set1(M.Cols[C].z);
+    }
+
+    for (; I + 4 <= Count; I += 4)
+    {
+        v3x4 P = V3x4Load(&Points[I]);
+        v3x4 R;
+
+        R.x = F32x4Add(F32x4Add(F32x4Add(F32x4Mul(P.x, Mx[0]), F32x4Mul(P.y, Mx[1])), F32x4Mul(P.z, Mx[2])), Mx[3]);
+        R.y = F32x4Add(F32x4Add(F32x4Add(F32x4Mul(P.x, My[0]), F32x4Mul(P.y, My[1])), F32x4Mul(P.z, My[2])), My[3]);
+        R.z = F32x4Add(F32x4Add(F32x4Add(F32x4Mul(P.x, Mz[0]), F32x4Mul(P.y, Mz[1])), F32x4Mul(P.z, Mz[2])), Mz[3]);
+
+        V3x4Store(&Result[I], R);
+    }
+#endif
+
+    for (; I < Count; I++)
+    {
+        v3 P = Points[I];
+
+        Result[I].x = P.x * M.Cols[0].x + P.y * M.Cols[1].x + P.z * M.Cols[2].x + M.Cols[3].x;
+        Result[I].y = P.x * M.Cols[0].y + P.y * M.Cols[1].y + P.z * M.Cols[2].y + M.Cols[3].y;
+        Result[I].z = P.x * M.Cols[0].z + P.y * M.Cols[1].z + P.z * M.Cols[2].z + M.Cols[3].z;
+    }
+}
+
+// Normalize() over an array, a zero vector gives NaNs same as there
+void
+NormalizeVectors(v3 const *Vectors,
+                 v3 *Result,
+                 u32 Count)
+{
+    u32     I = 0;
+
+
+#ifdef MG_SIMD
+    for (; I + 4 <= Count; I += 4)
+    {
+        V3x4Store(&Result[I], Normalize(V3x4Load(&Vectors[I])));
+    }
+#endif
+
+    for (; I < Count; I++)
+    {
+        Result[I] = Normalize(Vectors[I]);
+    }
+}
+
+// ExpApprox() in place
+void
+ExpArray(f32 *Values,
+         u32 Count,
+         u32 Tier)
+{
+    u32     I = 0;
+
+
+#ifdef MG_SIMD
+    for (; I + 4 <= Count; I += 4)
+    {
+        F32x4Store(&Values[I], F32x4Exp(F32x4Load(&Values[I]), Tier));
+    }
+#endif
+
+    for (; I < Count; I++)
+    {
+        Values[I] = ExpApprox(Values[I], Tier);
+    }
+}
+
+#endif // MG_IMPL
+
+////////////////////////////////////////
+// Bits
+////////////////////////////////////////
+
+// NOTE(matthew): Morton (Z-order) codes for 3D grids, 10 bits per axis, so
+// they cover up to 1024^3. With BMI2 the (de)interleave is a single
+// pdep/pext per axis, otherwise we fall back to the usual magic-bits shifts.
+// pdep/pext are microcoded on AMD before Zen 3, so only enable MG_USE_BMI2
+// when building for a target where they're fast.
+
+#if !defined(MG_USE_BMI2) && (defined(__BMI2__) || defined(__AVX2__))
+    #define MG_USE_BMI2
+#endif
+
+#ifdef MG_USE_BMI2
+    #include <immintrin.h>
+#endif
+
+#define MORTON_MASK_X       0x09249249
+#define MORTON_MASK_Y       0x12492492
+#define MORTON_MASK_Z       0x24924924
+
+u32     NextPow2(u32 X);
+u32     MortonPart1By2(u32 X);
+u32     MortonCompact1By2(u32 X);
+u32     MortonEncode3(u32 X, u32 Y, u32 Z);
+void    MortonDecode3(u32 Code, u32 *X, u32 *Y, u32 *Z);
+
+#ifdef MG_IMPL
+
+u32
+NextPow2(u32 X)
+{
+    if (X == 0)
+    {
+        return (1);
+    }
+
+    X--;
+    X |= X >> 1;
+    X |= X >> 2;
+    X |= X >> 4;
+    X |= X >> 8;
+    X |= X >> 16;
+
+    return (X + 1);
+}
+
+u32
+MortonPart1By2(u32 X)
+{
+    X &= 0x000003ff;
+    X = (X ^ (X << 16)) & 0xff0000ff;
+    X = (X ^ (X <<  8)) & 0x0300f00f;
+    X = (X ^ (X <<  4)) & 0x030c30c3;
+    X = (X ^ (X <<  2)) & 0x09249249;
+
+    return (X);
+}
+
+u32
+MortonCompact1By2(u32 X)
+{
+    X &= 0x09249249;
+    X = (X ^ (X >>  2)) & 0x030c30c3;
+    X = (X ^ (X >>  4)) & 0x0300f00f;
+    X = (X ^ (X >>  8)) & 0xff0000ff;
+    X = (X ^ (X >> 16)) & 0x000003ff;
+
+    return (X);
+}
+
+u32
+MortonEncode3(u32 X,
+              u32 Y,
+              u32 Z)
+{
+#ifdef MG_USE_BMI2
+    return (_pdep_u32(X, MORTON_MASK_X) | _pdep_u32(Y, MORTON_MASK_Y) | _pdep_u32(Z, MORTON_MASK_Z));
+#else
+    return (MortonPart1By2(X) | (MortonPart1By2(Y) << 1) | (MortonPart1By2(Z) << 2));
+#endif
+}
+
+void
+MortonDecode3(u32 Code,
+              u32 *X,
+              u32 *Y,
+              u32 *Z)
+{
+#ifdef MG_USE_BMI2
+    *X = _pext_u32(Code, MORTON_MASK_X);
+    *Y = _pext_u32(Code, MORTON_MASK_Y);
+    *Z = _pext_u32(Code, MORTON_MASK_Z);
+#else
+    *X = MortonCompact1By2(Code);
+    *Y = MortonCompact1By2(Code >> 1);
+    *Z = MortonCompact1By2(Code >> 2);
+#endif
+}
+
+#endif // MG_IMPL
+
+////////////////////////////////////////
+// Random
+////////////////////////////////////////
+
+// PCG32 (pcg-random.org), small and good enough for sampling
+struct random_series
+{
+    u64     State;
+    u64     Inc;
+};
+
+random_series   RandomSeed(u64 Seed, u64 Stream);
+u32             RandomNextU32(random_series *Series);
+f32             RandomUnilateral(random_series *Series);
+f32             RandomBilateral(random_series *Series);
+
+#ifdef MG_IMPL
+
+random_series
+RandomSeed(u64 Seed,
+           u64 Stream)
+{
+    random_series   Series;
+
+
+    Series.State = 0;
+    Series.Inc = (Stream << 1) | 1;
+    RandomNextU32(&Series);
+    Series.State += Seed;
+    RandomNextU32(&Series);
+
+    return (Series);
+}
+
+u32
+RandomNextU32(random_series *Series)
+{
+    u64     Old = Series->State;
+    u32     XorShifted,
+            Rot;
+
+
+    Series->State = Old * 6364136223846793005ULL + Series->Inc;
+    XorShifted = u32(((Old >> 18) ^ Old) >> 27);
+    Rot = u32(Old >> 59);
+
+    return ((XorShifted >> Rot) | (XorShifted << ((~Rot + 1) & 31)));
+}
+
+// [0, 1)
+f32
+RandomUnilateral(random_series *Series)
+{
+    return (f32(RandomNextU32(Series) >> 8) * (1.0f / 16777216.0f));
+}
+
+// [-1, 1)
+f32
+RandomBilateral(random_series *Series)
+{
+    return (2.0f * RandomUnilateral(Series) - 1.0f);
+}
+
+#endif // MG_IMPL
+
+
+
+
+
+
+//****************************************************************************
+//*** Windows.h **************************************************************
+//****************************************************************************
+
+#ifndef MG_USE_WINDOWS_H
+
+// NOTE(matthew): This is the include guard that windows.h defines.
+#define _WINDOWS_
+
+// NOTE(matthew): This is in the include guard that winapifamily.h defines,
+// which gets included at the top of windows.h BEFORE it's include guard.
+#define _INC_WINAPIFAMILY
+
+// TODO: add ASYNC I/O support
+
+//////////////////////////////////////////////////////////////////////////////
+// #define
+
+#ifdef __cplusplus
+extern "C" {
+#endif  // __cplusplus
+
+#ifndef NULL
+#define NULL    0
+#endif // NULL
+#define TRUE    1
+#define FALSE   0
+#define MAX_PATH    260
+
+#define DECLSPEC_IMPORT     __declspec(dllimport)
+#define DECLSPEC_NORETURN   __declspec(noreturn)
+#define WINBASEAPI          DECLSPEC_IMPORT
+#define WINADVAPI           DECLSPEC_IMPORT
+#define WINUSERAPI          DECLSPEC_IMPORT
+#define WINABLEAPI          DECLSPEC_IMPORT
+#define WINGDIAPI           DECLSPEC_IMPORT
+#define CALLBACK            __stdcall
+#define WINAPI              __stdcall
+#define WINAPIV             __cdecl
+#define APIENTRY            WINAPI
+#define APIPRIVATE          __stdcall
+#define PASCAL              __stdcall
+#define CONST               const
+#define UNALIGNED           __unaligned
+#define UNALIGNED64         __unaligned
+
+#ifndef _VCRTIMP
+    #if defined _CRTIMP && !defined _VCRT_DEFINED_CRTIMP
+        #define _VCRTIMP _CRTIMP
+    #elif defined _VCRT_BUILD && defined CRTDLL
+        #define _VCRTIMP __declspec(dllexport)
+    #elif defined _CORECRT_BUILD
+        #define _VCRTIMP
+    #elif defined _DLL
+        #define _VCRTIMP __declspec(dllimport)
+    #else
+        #define _VCRTIMP
+    #endif
+#endif
+
+#define GENERIC_READ    (0x80000000L)
+#define GENERIC_WRITE   (0x40000000L)
+#define GENERIC_EXECUTE (0x20000000L)
+#define GENERIC_ALL     (0x10000000L)
+
+#define FILE_ATTRIBUTE_NORMAL   0x00000080
+
+#define PAGE_NOACCESS               0x01
+#define PAGE_READONLY               0x02
+#define PAGE_READWRITE              0x04
+#define PAGE_WRITECOPY              0x08
+#define PAGE_EXECUTE                0x10
+#define PAGE_EXECUTE_READ           0x20
+#define PAGE_EXECUTE_READWRITE      0x40
+#define PAGE_EXECUTE_WRITECOPY      0x80
+#define MEM_COMMIT                  0x1000
+#define MEM_RESERVE                 0x2000
+#define MEM_DECOMMIT                0x4000
+#define MEM_RELEASE                 0x8000
+#define MEM_FREE                    0x10000
+#define MEM_PRIVATE                 0x20000
+#define MEM_MAPPED                  0x40000
+#define MEM_RESET                   0x80000
+#define MEM_LARGE_PAGES             0x20000000
+
+#define SECTION_QUERY                0x0001
+#define SECTION_MAP_WRITE            0x0002
+#define SECTION_MAP_READ             0x0004
+#define SECTION_MAP_EXECUTE          0x0008
+#define SECTION_EXTEND_SIZE          0x0010
+#define SECTION_MAP_EXECUTE_EXPLICIT 0x0020
+#define STANDARD_RIGHTS_REQUIRED         (0x000F0000L)
+
+#define SECTION_ALL_ACCESS (STANDARD_RIGHTS_REQUIRED|SECTION_QUERY|\
+                        SECTION_MAP_WRITE |      \
+                        SECTION_MAP_READ |       \
+                        SECTION_MAP_EXECUTE |    \
+                        SECTION_EXTEND_SIZE)
+
+#define FILE_MAP_WRITE      SECTION_MAP_WRITE
+#define FILE_MAP_READ       SECTION_MAP_READ
+#define FILE_MAP_ALL_ACCESS SECTION_ALL_ACCESS
+
+#define DECLARE_HANDLE(name) struct name##__{int unused;}; typedef struct name##__ *name
+
+//////////////////////////////////////////////////////////////////////////////
+// Types
+
+#ifndef VOID
+#define VOID void
+#endif // VOID
+
+typedef void            *HANDLE;
+typedef long            HRESULT;
+typedef char            CHAR;
+typedef short           SHORT, *PSHORT, *LPSHORT;
+typedef int             INT, *PINT, *LPINT;
+typedef int             BOOL, *PBOOL, *LPBOOL;
+typedef unsigned char   BYTE, *PBYTE, *LPBYTE;
+typedef unsigned short  WORD, *PWORD, *LPWORD;
+typedef unsigned long   DWORD, *PDWORD, *LPDWORD;
+typedef float           FLOAT, *PFLOAT, *LPFLOAT;
+typedef void            *PVOID, *LPVOID;
+typedef long            LONG, *PLONG, *LPLONG;
+typedef unsigned long   ULONG, *PULONG;
+typedef CONST void      *PCVOID, *LPCVOID;
+typedef unsigned int    UINT, *PUINT, *LPUINT;
+
+typedef CHAR                    *PCHAR, *LPCH, *PCH;
+typedef CONST CHAR              *LPCCH, *PCCH;
+typedef CHAR                    *NPSTR, *LPSTR, *PSTR;
+typedef PSTR                    *PZPSTR;
+typedef CONST PSTR              *PCZPSTR;
+typedef CONST CHAR              *LPCSTR, *PCSTR;
+typedef PCSTR                   *PZPCSTR;
+typedef CONST PCSTR             *PCZPCSTR;
+typedef CHAR                    *PZZSTR;
+typedef CONST CHAR              *PCZZSTR;
+typedef CHAR                    *PNZCH;
+typedef CONST CHAR              *PCNZCH;
+
+typedef unsigned short          WCHAR;
+typedef WCHAR                   *PWCHAR, *LPWCH, *PWCH;
+typedef CONST WCHAR             *LPCWCH, *PCWCH;
+typedef WCHAR                   *NWPSTR, *LPWSTR, *PWSTR;
+typedef PWSTR                   *PZPWSTR;
+typedef CONST PWSTR             *PCZPWSTR;
+typedef WCHAR UNALIGNED         *LPUWSTR, *PUWSTR;
+typedef CONST WCHAR             *LPCWSTR, *PCWSTR;
+typedef PCWSTR                  *PZPCWSTR;
+typedef CONST PCWSTR            *PCZPCWSTR;
+typedef CONST WCHAR UNALIGNED   *LPCUWSTR, *PCUWSTR;
+typedef WCHAR                   *PZZWSTR;
+typedef CONST WCHAR             *PCZZWSTR;
+typedef WCHAR UNALIGNED         *PUZZWSTR;
+typedef CONST WCHAR UNALIGNED   *PCUZZWSTR;
+typedef WCHAR                   *PNZWCH;
+typedef CONST WCHAR             *PCNZWCH;
+typedef WCHAR UNALIGNED         *PUNZWCH;
+typedef CONST WCHAR UNALIGNED   *PCUNZWCH;
+
+typedef __int64                 INT_PTR, *PINT_PTR, LONG_PTR, *PLONG_PTR, LONGLONG;
+typedef unsigned __int64        UINT_PTR, *PUINT_PTR, ULONG_PTR, *PULONG_PTR, ULONGLONG;
+typedef UINT_PTR                WPARAM;
+typedef LONG_PTR                LPARAM, LRESULT, SSIZE_T, *PSSIZE_T;
+typedef ULONG_PTR               SIZE_T, *PSIZE_T, DWORD_PTR, *PDWORD_PTR;
+
+typedef WORD                    ATOM;
+typedef DWORD                   COLORREF, *LPCOLORREF;
+
+#define MAKEWORD(a, b)      ((WORD)(((BYTE)(((DWORD_PTR)(a)) & 0xff)) | ((WORD)((BYTE)(((DWORD_PTR)(b)) & 0xff))) << 8))
+#define MAKELONG(a, b)      ((LONG)(((WORD)(((DWORD_PTR)(a)) & 0xffff)) | ((DWORD)((WORD)(((DWORD_PTR)(b)) & 0xffff))) << 16))
+#define LOWORD(l)           ((WORD)(((DWORD_PTR)(l)) & 0xffff))
+#define HIWORD(l)           ((WORD)((((DWORD_PTR)(l)) >> 16) & 0xffff))
+#define LOBYTE(w)           ((BYTE)(((DWORD_PTR)(w)) & 0xff))
+#define HIBYTE(w)           ((BYTE)((((DWORD_PTR)(w)) >> 8) & 0xff))
+
+typedef INT_PTR (WINAPI *FARPROC)();
+typedef INT_PTR (WINAPI *NEARPROC)();
+typedef INT_PTR (WINAPI *PROC)();
+
+typedef union _LARGE_INTEGER {
+    struct {
+        DWORD LowPart;
+        LONG HighPart;
+    } DUMMYSTRUCTNAME;
+    struct {
+        DWORD LowPart;
+        LONG HighPart;
+    } u;
+    LONGLONG QuadPart;
+} LARGE_INTEGER, *PLARGE_INTEGER, *LPLARGE_INTEGER;
+
+typedef struct _LUID {
+    DWORD LowPart;
+    LONG HighPart;
+} LUID, *PLUID;
+
+typedef struct _LUID_AND_ATTRIBUTES {
+    LUID Luid;
+    DWORD Attributes;
+} LUID_AND_ATTRIBUTES, *PLUID_AND_ATTRIBUTES;
+
+typedef struct _TOKEN_PRIVILEGES {
+    DWORD PrivilegeCount;
+    LUID_AND_ATTRIBUTES Privileges[1];
+} TOKEN_PRIVILEGES, *PTOKEN_PRIVILEGES;
+
+#define _DWORDLONG_
+typedef ULONGLONG  DWORDLONG;
+typedef DWORDLONG *PDWORDLONG;
+
+DECLARE_HANDLE(HWND);
+DECLARE_HANDLE(HHOOK);
+DECLARE_HANDLE(HACCEL);
+DECLARE_HANDLE(HBITMAP);
+DECLARE_HANDLE(HBRUSH);
+DECLARE_HANDLE(HDC);
+DECLARE_HANDLE(HGLRC);
+DECLARE_HANDLE(HDESK);
+DECLARE_HANDLE(HENHMETAFILE);
+DECLARE_HANDLE(HFONT);
+DECLARE_HANDLE(HICON);
+DECLARE_HANDLE(HMENU);
+DECLARE_HANDLE(HPALETTE);
+DECLARE_HANDLE(HPEN);
+DECLARE_HANDLE(HKEY);
+DECLARE_HANDLE(HMETAFILE);
+DECLARE_HANDLE(HINSTANCE);
+DECLARE_HANDLE(HRGN);
+DECLARE_HANDLE(HRSRC);
+DECLARE_HANDLE(HSPRITE);
+DECLARE_HANDLE(HLSURF);
+DECLARE_HANDLE(HSTR);
+DECLARE_HANDLE(HTASK);
+DECLARE_HANDLE(HWINSTA);
+DECLARE_HANDLE(HKL);
+
+typedef HANDLE      GDIOBJ;
+typedef HKEY        *PHKEY;
+typedef HINSTANCE   HMODULE;      /* HMODULEs can be used in place of HINSTANCEs */
+typedef HICON       HCURSOR;      /* HICONs & HCURSORs are polymorphic */
+typedef INT         HFILE;
+#define HFILE_ERROR ((HFILE)-1)
+
+//////////////////////////////////////////////////////////////////////////////
+// GENERAL
+//////////////////////////////////////////////////////////////////////////////
+
+typedef struct _SECURITY_ATTRIBUTES {
+    DWORD nLength;
+    LPVOID lpSecurityDescriptor;
+    BOOL bInheritHandle;
+} SECURITY_ATTRIBUTES, *PSECURITY_ATTRIBUTES, *LPSECURITY_ATTRIBUTES;
+typedef struct _SYSTEMTIME {
+    WORD wYear;
+    WORD wMonth;
+    WORD wDayOfWeek;
+    WORD wDay;
+    WORD wHour;
+    WORD wMinute;
+    WORD wSecond;
+    WORD wMilliseconds;
+} SYSTEMTIME, *PSYSTEMTIME, *LPSYSTEMTIME;
+typedef struct _FILETIME {
+    DWORD dwLowDateTime;
+    DWORD dwHighDateTime;
+} FILETIME, *PFILETIME, *LPFILETIME;
+typedef struct _WIN32_FIND_DATAA {
+    DWORD dwFileAttributes;
+    FILETIME ftCreationTime;
+    FILETIME ftLastAccessTime;
+    FILETIME ftLastWriteTime;
+    DWORD nFileSizeHigh;
+    DWORD nFileSizeLow;
+    DWORD dwReserved0;
+    DWORD dwReserved1;
+    CHAR   cFileName[ MAX_PATH ];
+    CHAR   cAlternateFileName[ 14 ];
+} WIN32_FIND_DATAA, *PWIN32_FIND_DATAA, *LPWIN32_FIND_DATAA;
+typedef struct _WIN32_FIND_DATAW {
+    DWORD dwFileAttributes;
+    FILETIME ftCreationTime;
+    FILETIME ftLastAccessTime;
+    FILETIME ftLastWriteTime;
+    DWORD nFileSizeHigh;
+    DWORD nFileSizeLow;
+    DWORD dwReserved0;
+    DWORD dwReserved1;
+    WCHAR  cFileName[ MAX_PATH ];
+    WCHAR  cAlternateFileName[ 14 ];
+} WIN32_FIND_DATAW, *PWIN32_FIND_DATAW, *LPWIN32_FIND_DATAW;
+typedef struct _OVERLAPPED {
+    ULONG_PTR Internal;
+    ULONG_PTR InternalHigh;
+    union {
+        struct {
+            DWORD Offset;
+            DWORD OffsetHigh;
+        } DUMMYSTRUCTNAME;
+        PVOID Pointer;
+    } DUMMYUNIONNAME;
+
+    HANDLE  hEvent;
+} OVERLAPPED, *LPOVERLAPPED;
+typedef struct _OVERLAPPED_ENTRY {
+    ULONG_PTR lpCompletionKey;
+    LPOVERLAPPED lpOverlapped;
+    ULONG_PTR Internal;
+    DWORD dwNumberOfBytesTransferred;
+} OVERLAPPED_ENTRY, *LPOVERLAPPED_ENTRY;
+
+typedef VOID (WINAPI *LPOVERLAPPED_COMPLETION_ROUTINE)(DWORD dwErrorCode, DWORD dwNumberOfBytesTransfered, LPOVERLAPPED lpOverlapped);
+
+//////////////////////////////////////////////////////////////////////////////
+// vcruntime_string.h
+//////////////////////////////////////////////////////////////////////////////
+
+#include <string.h>
+
+/* int __cdecl                 memcmp(void* const _Buf1, void const* _Buf2, size_t _Size); */
+/* void* __cdecl               memcpy(void* _Dst, void const* _Src, size_t _Size); */
+/* void* __cdecl               memset(void* _Dst, int _Val,size_t _Size); */
+/* _VCRTIMP void* __cdecl      memmove(void* _Dst, void const* _Src, size_t _Size); */
+/* size_t __cdecl              strlen(char const* _Str); */
+
+//////////////////////////////////////////////////////////////////////////////
+// winnt.h
+//////////////////////////////////////////////////////////////////////////////
+
+#define RtlEqualMemory(Destination,Source,Length) (!memcmp((Destination),(Source),(Length)))
+#define RtlMoveMemory(Destination,Source,Length) memmove((Destination),(Source),(Length))
+#define RtlCopyMemory(Destination,Source,Length) memcpy((Destination),(Source),(Length))
+#define RtlFillMemory(Destination,Length,Fill) memset((Destination),(Fill),(Length))
+#define RtlZeroMemory(Destination,Length) memset((Destination),0,(Length))
+
+#define MoveMemory RtlMoveMemory
+#define CopyMemory RtlCopyMemory
+#define FillMemory RtlFillMemory
+#define ZeroMemory RtlZeroMemory
+
+//////////////////////////////////////////////////////////////////////////////
+// handleapi.h
+//////////////////////////////////////////////////////////////////////////////
+
+#define INVALID_HANDLE_VALUE    ((HANDLE)(LONG_PTR)-1)
+
+WINBASEAPI BOOL WINAPI  CloseHandle(HANDLE hObject);
+
+//////////////////////////////////////////////////////////////////////////////
+// fileapi.h
+//////////////////////////////////////////////////////////////////////////////
+
+#define CREATE_NEW                  1
+#define CREATE_ALWAYS               2
+#define OPEN_EXISTING               3
+#define OPEN_ALWAYS                 4
+#define TRUNCATE_EXISTING           5
+#define INVALID_FILE_SIZE           ((DWORD)0xFFFFFFFF)
+#define INVALID_SET_FILE_POINTER    ((DWORD)-1)
+#define INVALID_FILE_ATTRIBUTES     ((DWORD)-1)
+
+WINBASEAPI LONG WINAPI      CompareFileTime(CONST FILETIME * lpFileTime1, CONST FILETIME * lpFileTime2);
+WINBASEAPI BOOL WINAPI      CreateDirectoryA(LPCSTR lpPathName, LPSECURITY_ATTRIBUTES lpSecurityAttributes);
+WINBASEAPI BOOL WINAPI      CreateDirectoryW(LPCWSTR lpPathName, LPSECURITY_ATTRIBUTES lpSecurityAttributes);
+WINBASEAPI HANDLE WINAPI    CreateFileA(LPCSTR lpFileName, DWORD dwDesiredAccess, DWORD dwShareMode, LPSECURITY_ATTRIBUTES lpSecurityAttributes, DWORD dwCreationDisposition, DWORD dwFlagsAndAttributes, HANDLE hTemplateFile);
+WINBASEAPI HANDLE WINAPI    CreateFileW(LPCWSTR lpFileName, DWORD dwDesiredAccess, DWORD dwShareMode, LPSECURITY_ATTRIBUTES lpSecurityAttributes, DWORD dwCreationDisposition, DWORD dwFlagsAndAttributes, HANDLE hTemplateFile);
+WINBASEAPI BOOL WINAPI      DeleteFileA(LPCSTR lpFileName);
+WINBASEAPI BOOL WINAPI      DeleteFileW(LPCWSTR lpFileName);
+WINBASEAPI HANDLE WINAPI    FindFirstFileA(LPCSTR lpFileName, LPWIN32_FIND_DATAA lpFindFileData);
+WINBASEAPI HANDLE WINAPI    FindFirstFileW(LPCWSTR lpFileName, LPWIN32_FIND_DATAA lpFindFileData);
+WINBASEAPI DWORD WINAPI     GetFileSize(HANDLE hFile, LPDWORD lpFileSizeHigh);
+WINBASEAPI BOOL WINAPI      GetFileSizeEx(HANDLE hFile, PLARGE_INTEGER lpFileSize);
+WINBASEAPI BOOL WINAPI      ReadFile(HANDLE hFile, LPVOID lpBuffer, DWORD nNumberOfBytesToRead, LPDWORD lpNumberOfBytesRead, LPOVERLAPPED lpOverlapped);
+WINBASEAPI BOOL WINAPI      ReadFileEx(HANDLE hFile, LPVOID lpBuffer, DWORD nNumberOfBytesToRead, LPOVERLAPPED lpOverlapped, LPOVERLAPPED_COMPLETION_ROUTINE lpCompletionRoutine);
+WINBASEAPI BOOL WINAPI      WriteFile(HANDLE hFile, LPCVOID lpBuffer, DWORD nNumberOfBytesToWrite, LPDWORD lpNumberOfBytesWritten, LPOVERLAPPED lpOverlapped);
+WINBASEAPI BOOL WINAPI      WriteFileEx(HANDLE hFile, LPCVOID lpBuffer, DWORD nNumberOfBytesToWrite, LPOVERLAPPED lpOverlapped, LPOVERLAPPED_COMPLETION_ROUTINE lpCompletionRoutine);
+WINBASEAPI DWORD WINAPI     SetFilePointer(HANDLE hFile, LONG lDistanceToMove, PLONG lpDistanceToMoveHigh, DWORD dwMoveMethod);
+WINBASEAPI BOOL WINAPI      SetFilePointerEx(HANDLE hFile, LARGE_INTEGER liDistanceToMove, PLARGE_INTEGER lpNewFilePointer, DWORD dwMoveMethod);
+WINBASEAPI BOOL WINAPI      LockFile(HANDLE hFile, DWORD dwFileOffsetLow, DWORD dwFileOffsetHigh, DWORD nNumberOfBytesToLockLow, DWORD nNumberOfBytesToLockHigh);
+WINBASEAPI BOOL WINAPI      LockFileEx(HANDLE hFile, DWORD dwFlags, DWORD dwReserved, DWORD nNumberOfBytesToLockLow, DWORD nNumberOfBytesToLockHigh, LPOVERLAPPED lpOverlapped);
+WINBASEAPI BOOL WINAPI      UnlockFile(HANDLE hFile, DWORD dwFileOffsetLow, DWORD dwFileOffsetHigh, DWORD nNumberOfBytesToUnlockLow, DWORD nNumberOfBytesToUnlockHigh);
+WINBASEAPI BOOL WINAPI      UnlockFileEx(HANDLE hFile, DWORD dwReserved, DWORD nNumberOfBytesToUnlockLow, DWORD nNumberOfBytesToUnlockHigh, LPOVERLAPPED lpOverlapped);
+WINBASEAPI BOOL WINAPI      RemoveDirectoryA(LPCSTR lpPathName);
+WINBASEAPI BOOL WINAPI      RemoveDirectoryW(LPCWSTR lpPathName);
+
+#ifdef UNICODE
+    #define CreateDirectory     CreateDirectoryW
+    #define CreateFile          CreateFileW
+    #define DeleteFile          DeleteFileW
+    #define FindFirstFile       FindFirstFileW
+    #define RemoveDirectory     RemoveDirectoryW
+#else
+    #define CreateDirectory     CreateDirectoryA
+    #define CreateFile          CreateFileA
+    #define DeleteFile          DeleteFileA
+    #define FindFirstFile       FindFirstFileA
+    #define RemoveDirectory     RemoveDirectoryA
+#endif // UNICODE
+
+//////////////////////////////////////////////////////////////////////////////
+// heapapi.h
+//////////////////////////////////////////////////////////////////////////////
+
+WINBASEAPI HANDLE WINAPI    HeapCreate(DWORD flOptions, SIZE_T dwInitialSize, SIZE_T dwMaximumSize);
+WINBASEAPI BOOL WINAPI      HeapDestroy(HANDLE hHeap);
+WINBASEAPI LPVOID WINAPI    HeapAlloc(HANDLE hHeap, DWORD dwFlags, SIZE_T dwBytes);
+WINBASEAPI LPVOID WINAPI    HeapReAlloc(HANDLE hHeap, DWORD dwFlags, LPVOID lpMem, SIZE_T dwBytes);
+WINBASEAPI BOOL WINAPI      HeapFree(HANDLE hHeap, DWORD dwFlags, LPVOID lpMem);
+WINBASEAPI HANDLE WINAPI    GetProcessHeap(VOID);
+WINBASEAPI SIZE_T WINAPI    HeapCompact(HANDLE hHeap, DWORD dwFlags);
+WINBASEAPI SIZE_T WINAPI    HeapSize(HANDLE hHeap, DWORD dwFlags, LPCVOID lpMem);
+
+//////////////////////////////////////////////////////////////////////////////
+// WinUser.h
+//////////////////////////////////////////////////////////////////////////////
+
+#define CS_VREDRAW          0x0001
+#define CS_HREDRAW          0x0002
+#define CS_OWNDC            0x0020
+#define CW_USEDEFAULT       ((int)0x80000000)
+
+#define WS_OVERLAPPED       0x00000000L
+#define WS_POPUP            0x80000000L
+#define WS_CHILD            0x40000000L
+#define WS_MINIMIZE         0x20000000L
+#define WS_VISIBLE          0x10000000L
+#define WS_DISABLED         0x08000000L
+#define WS_CLIPSIBLINGS     0x04000000L
+#define WS_CLIPCHILDREN     0x02000000L
+#define WS_MAXIMIZE         0x01000000L
+#define WS_CAPTION          0x00C00000L     /* WS_BORDER | WS_DLGFRAME  */
+#define WS_BORDER           0x00800000L
+#define WS_DLGFRAME         0x00400000L
+#define WS_VSCROLL          0x00200000L
+#define WS_HSCROLL          0x00100000L
+#define WS_SYSMENU          0x00080000L
+#define WS_THICKFRAME       0x00040000L
+#define WS_GROUP            0x00020000L
+#define WS_TABSTOP          0x00010000L
+#define WS_MINIMIZEBOX      0x00020000L
+#define WS_MAXIMIZEBOX      0x00010000L
+#define WS_TILED            WS_OVERLAPPED
+#define WS_ICONIC           WS_MINIMIZE
+#define WS_SIZEBOX          WS_THICKFRAME
+#define WS_TILEDWINDOW      WS_OVERLAPPEDWINDOW
+#define WS_OVERLAPPEDWINDOW (WS_OVERLAPPED     | \
+                             WS_CAPTION        | \
+                             WS_SYSMENU        | \
+                             WS_THICKFRAME     | \
+                             WS_MINIMIZEBOX    | \
+                             WS_MAXIMIZEBOX)
+#define WS_POPUPWINDOW      (WS_POPUP          | \
+                             WS_BORDER         | \
+                             WS_SYSMENU)
+#define WS_CHILDWINDOW      (WS_CHILD)
+
+#define WM_NULL             0x0000
+#define WM_CREATE           0x0001
+#define WM_DESTROY          0x0002
+#define WM_MOVE             0x0003
+#define WM_SIZE             0x0005
+#define WM_QUIT             0x0012
+#define WM_CLOSE            0x0010
+#define WM_PAINT            0x000F
+#define WM_KEYDOWN          0x0100
+#define WM_KEYUP            0x0101
+
+#define VK_ESCAPE           0x1B
+
+#define MB_OK                       0x00000000L
+#define MB_OKCANCEL                 0x00000001L
+#define MB_ABORTRETRYIGNORE         0x00000002L
+#define MB_YESNOCANCEL              0x00000003L
+#define MB_YESNO                    0x00000004L
+#define MB_RETRYCANCEL              0x00000005L
+#define MB_ICONHAND                 0x00000010L
+#define MB_ICONQUESTION             0x00000020L
+#define MB_ICONEXCLAMATION          0x00000030L
+#define MB_ICONASTERISK             0x00000040L
+#define MB_ICONERROR                MB_ICONHAND
+
+#define SW_HIDE             0
+#define SW_SHOWNORMAL       1
+#define SW_NORMAL           1
+#define SW_SHOWMINIMIZED    2
+#define SW_SHOWMAXIMIZED    3
+#define SW_MAXIMIZE         3
+#define SW_SHOWNOACTIVATE   4
+#define SW_SHOW             5
+#define SW_MINIMIZE         6
+#define SW_SHOWMINNOACTIVE  7
+#define SW_SHOWNA           8
+#define SW_RESTORE          9
+#define SW_SHOWDEFAULT      10
+#define SW_FORCEMINIMIZE    11
+#define SW_MAX              11
+
+#define PM_NOREMOVE         0x0000
+#define PM_REMOVE           0x0001
+#define PM_NOYIELD          0x0002
+
+#define GWLP_WNDPROC        (-4)
+#define GWLP_HINSTANCE      (-6)
+#define GWLP_HWNDPARENT     (-8)
+#define GWLP_USERDATA       (-21)
+#define GWLP_ID             (-12)
+
+
+typedef LRESULT (CALLBACK *WNDPROC)(HWND, UINT, WPARAM, LPARAM);
+
+typedef struct tagPOINT
+{
+    LONG  x;
+    LONG  y;
+} POINT, *PPOINT, *NPPOINT, *LPPOINT;
+typedef struct tagWNDCLASSA {
+    UINT        style;
+    WNDPROC     lpfnWndProc;
+    int         cbClsExtra;
+    int         cbWndExtra;
+    HINSTANCE   hInstance;
+    HICON       hIcon;
+    HCURSOR     hCursor;
+    HBRUSH      hbrBackground;
+    LPCSTR      lpszMenuName;
+    LPCSTR      lpszClassName;
+} WNDCLASSA, *PWNDCLASSA, *NPWNDCLASSA, *LPWNDCLASSA;
+typedef struct tagWNDCLASSW {
+    UINT        style;
+    WNDPROC     lpfnWndProc;
+    int         cbClsExtra;
+    int         cbWndExtra;
+    HINSTANCE   hInstance;
+    HICON       hIcon;
+    HCURSOR     hCursor;
+    HBRUSH      hbrBackground;
+    LPCWSTR     lpszMenuName;
+    LPCWSTR     lpszClassName;
+} WNDCLASSW, *PWNDCLASSW, *NPWNDCLASSW, *LPWNDCLASSW;
+typedef struct tagWNDCLASSEXA {
+    UINT        cbSize;
+    /* Win 3.x */
+    UINT        style;
+    WNDPROC     lpfnWndProc;
+    int         cbClsExtra;
+    int         cbWndExtra;
+    HINSTANCE   hInstance;
+    HICON       hIcon;
+    HCURSOR     hCursor;
+    HBRUSH      hbrBackground;
+    LPCSTR      lpszMenuName;
+    LPCSTR      lpszClassName;
+    /* Win 4.0 */
+    HICON       hIconSm;
+} WNDCLASSEXA, *PWNDCLASSEXA, *NPWNDCLASSEXA, *LPWNDCLASSEXA;
+typedef struct tagWNDCLASSEXW {
+    UINT        cbSize;
+    /* Win 3.x */
+    UINT        style;
+    WNDPROC     lpfnWndProc;
+    int         cbClsExtra;
+    int         cbWndExtra;
+    HINSTANCE   hInstance;
+    HICON       hIcon;
+    HCURSOR     hCursor;
+    HBRUSH      hbrBackground;
+    LPCWSTR     lpszMenuName;
+    LPCWSTR     lpszClassName;
+    /* Win 4.0 */
+    HICON       hIconSm;
+} WNDCLASSEXW, *PWNDCLASSEXW, *NPWNDCLASSEXW, *LPWNDCLASSEXW;
+typedef struct tagMSG {
+    HWND        hwnd;
+    UINT        message;
+    WPARAM      wParam;
+    LPARAM      lParam;
+    DWORD       time;
+    POINT       pt;
+} MSG, *PMSG, *NPMSG, *LPMSG;
+typedef struct tagRECT
+{
+    LONG    left;
+    LONG    top;
+    LONG    right;
+    LONG    bottom;
+} RECT, *PRECT, *NPRECT, *LPRECT;
+typedef struct tagPAINTSTRUCT {
+    HDC         hdc;
+    BOOL        fErase;
+    RECT        rcPaint;
+    BOOL        fRestore;
+    BOOL        fIncUpdate;
+    BYTE        rgbReserved[32];
+} PAINTSTRUCT, *PPAINTSTRUCT, *NPPAINTSTRUCT, *LPPAINTSTRUCT;
+
+// Class
+WINUSERAPI ATOM WINAPI      RegisterClassA(CONST WNDCLASSA *lpWndClass);
+WINUSERAPI ATOM WINAPI      RegisterClassW(CONST WNDCLASSW *lpWndClass);
+WINUSERAPI ATOM WINAPI      RegisterClassExA(CONST WNDCLASSEXA *);
+WINUSERAPI ATOM WINAPI      RegisterClassExW(CONST WNDCLASSEXW *);
+// Window
+WINUSERAPI HWND WINAPI      CreateWindowExA(DWORD dwExStyle, LPCSTR lpClassName, LPCSTR lpWindowName, DWORD dwStyle, int X, int Y, int nWidth, int nHeight, HWND hWndParent, HMENU hMenu, HINSTANCE hInstance, LPVOID lpParam);
+WINUSERAPI HWND WINAPI      CreateWindowExW(DWORD dwExStyle, LPCWSTR lpClassName, LPCWSTR lpWindowName, DWORD dwStyle, int X, int Y, int nWidth, int nHeight, HWND hWndParent, HMENU hMenu, HINSTANCE hInstance, LPVOID lpParam);
+WINUSERAPI BOOL WINAPI      DestroyWindow(HWND hWnd);
+WINUSERAPI BOOL WINAPI      ShowWindow(HWND hWnd, int nCmdShow);
+WINUSERAPI BOOL WINAPI      UpdateWindow(HWND hWnd);
+WINUSERAPI BOOL WINAPI      GetClientRect(HWND hWnd, LPRECT lpRect);
+WINUSERAPI BOOL WINAPI      GetWindowRect( HWND hWnd, LPRECT lpRect);
+WINUSERAPI BOOL WINAPI      AdjustWindowRect(LPRECT lpRect, DWORD dwStyle, BOOL bMenu);
+WINUSERAPI BOOL WINAPI      AdjustWindowRectEx(LPRECT lpRect, DWORD dwStyle, BOOL bMenu, DWORD dwExStyle);
+WINUSERAPI int WINAPI       MessageBoxA(HWND hWnd, LPCSTR lpText, LPCSTR lpCaption, UINT uType);
+WINUSERAPI int WINAPI       MessageBoxW(HWND hWnd, LPCWSTR lpText, LPCWSTR lpCaption, UINT uType);
+WINUSERAPI BOOL WINAPI      SetWindowTextA(HWND hWnd, LPCSTR lpString);
+WINUSERAPI BOOL WINAPI      SetWindowTextW(HWND hWnd, LPCWSTR lpString);
+WINUSERAPI LONG_PTR WINAPI  SetWindowLongPtrA(HWND hWnd, int nIndex, LONG_PTR dwNewLong);
+WINUSERAPI LONG_PTR WINAPI  SetWindowLongPtrW(HWND hWnd, int nIndex, LONG_PTR dwNewLong);
+WINUSERAPI LONG_PTR WINAPI	GetWindowLongPtrA(HWND hWnd, int nIndex);
+WINUSERAPI LONG_PTR WINAPI	GetWindowLongPtrW(HWND hWnd, int nIndex);
+
+// Message
+WINUSERAPI BOOL WINAPI      PeekMessageA(LPMSG lpMsg, HWND hWnd, UINT wMsgFilterMin, UINT wMsgFilterMax, UINT wRemoveMsg);
+WINUSERAPI BOOL WINAPI      PeekMessageW(LPMSG lpMsg, HWND hWnd, UINT wMsgFilterMin, UINT wMsgFilterMax, UINT wRemoveMsg);
+WINUSERAPI BOOL WINAPI      TranslateMessage(CONST MSG *lpMsg);
+WINUSERAPI LRESULT WINAPI   DispatchMessageA(CONST MSG *lpMsg);
+WINUSERAPI LRESULT WINAPI   DispatchMessageW(CONST MSG *lpMsg);
+WINUSERAPI BOOL WINAPI      GetMessageA(LPMSG lpMsg, HWND hWnd, UINT wMsgFilterMin, UINT wMsgFilterMax);
+WINUSERAPI BOOL WINAPI      GetMessageW(LPMSG lpMsg, HWND hWnd, UINT wMsgFilterMin, UINT wMsgFilterMax);
+WINUSERAPI LRESULT WINAPI   DefWindowProcA(HWND hWnd, UINT Msg, WPARAM wParam, LPARAM lParam);
+WINUSERAPI LRESULT WINAPI   DefWindowProcW(HWND hWnd, UINT Msg, WPARAM wParam, LPARAM lParam);
+WINUSERAPI VOID WINAPI      PostQuitMessage(int nExitCode);
+WINUSERAPI BOOL WINAPI      PostMessageA(HWND hWnd, UINT Msg, WPARAM wParam, LPARAM lParam);
+WINUSERAPI BOOL WINAPI      PostMessageW(HWND hWnd, UINT Msg, WPARAM wParam, LPARAM lParam);
+// DC / Paint
+
+WINUSERAPI HDC WINAPI       GetDC(HWND hWnd);
+WINUSERAPI HDC WINAPI       GetWindowDC(HWND hWnd);
+WINUSERAPI int WINAPI       ReleaseDC(HWND hWnd, HDC hDC);
+WINUSERAPI HDC WINAPI       BeginPaint(HWND hWnd, LPPAINTSTRUCT lpPaint);
+WINUSERAPI BOOL WINAPI      EndPaint(HWND hWnd, CONST PAINTSTRUCT *lpPaint);
+
+#ifdef UNICODE
+    typedef WNDCLASSW           WNDCLASS;
+    typedef PWNDCLASSW          PWNDCLASS;
+    typedef NPWNDCLASSW         NPWNDCLASS;
+    typedef LPWNDCLASSW         LPWNDCLASS;
+    typedef WNDCLASSEXW         WNDCLASSEX;
+    typedef PWNDCLASSEXW        PWNDCLASSEX;
+    typedef NPWNDCLASSEXW       NPWNDCLASSEX;
+    typedef LPWNDCLASSEXW       LPWNDCLASSEX;
+    #define RegisterClass       RegisterClassW
+    #define RegisterClassEx     RegisterClassExW
+    #define CreateWindowEx      CreateWindowExW
+    #define PeekMessage         PeekMessageW
+    #define MessageBox          MessageBoxW
+    #define DispatchMessage     DispatchMessageW
+    #define GetMessage          GetMessageExW
+    #define DefWindowProc       DefWindowProcW
+    #define PostMessage         PostMessageW
+    #define SetWindowText       SetWindowTextW
+    #define SetWindowLongPtr    SetWindowLongPtrW
+    #define GetWindowLongPtr    GetWindowLongPtrW
+#else
+    typedef WNDCLASSA           WNDCLASS;
+    typedef PWNDCLASSA          PWNDCLASS;
+    typedef NPWNDCLASSA         NPWNDCLASS;
+    typedef LPWNDCLASSA         LPWNDCLASS;
+    typedef WNDCLASSEXA         WNDCLASSEX;
+    typedef PWNDCLASSEXA        PWNDCLASSEX;
+    typedef NPWNDCLASSEXA       NPWNDCLASSEX;
+    typedef LPWNDCLASSEXA       LPWNDCLASSEX;
+    #define RegisterClass       RegisterClassA
+    #define RegisterClassEx     RegisterClassExA
+    #define CreateWindowEx      CreateWindowExA
+    #define PeekMessage         PeekMessageA
+    #define MessageBox          MessageBoxA
+    #define DispatchMessage     DispatchMessageA
+    #define GetMessage          GetMessageExA
+    #define DefWindowProc       DefWindowProcA
+    #define PostMessage         PostMessageA
+    #define SetWindowText       SetWindowTextA
+    #define SetWindowLongPtr    SetWindowLongPtrA
+    #define GetWindowLongPtr    GetWindowLongPtrA
+#endif // UNICODE
+
+/////////////////////////////////////////////////////////////////////////////
+// wingdi.h
+//////////////////////////////////////////////////////////////////////////////
+
+#define BI_RGB        0L
+#define BI_RLE8       1L
+#define BI_RLE4       2L
+#define BI_BITFIELDS  3L
+#define BI_JPEG       4L
+#define BI_PNG        5L
+#define DIB_RGB_COLORS      0 /* color table in RGBs */
+#define SRCCOPY             (DWORD)0x00CC0020 /* dest = source                   */
+#define SRCPAINT            (DWORD)0x00EE0086 /* dest = source OR dest           */
+#define SRCAND              (DWORD)0x008800C6 /* dest = source AND dest          */
+#define SRCINVERT           (DWORD)0x00660046 /* dest = source XOR dest          */
+#define SRCERASE            (DWORD)0x00440328 /* dest = source AND (NOT dest )   */
+#define NOTSRCCOPY          (DWORD)0x00330008 /* dest = (NOT source)             */
+#define NOTSRCERASE         (DWORD)0x001100A6 /* dest = (NOT src) AND (NOT dest) */
+#define MERGECOPY           (DWORD)0x00C000CA /* dest = (source AND pattern)     */
+#define MERGEPAINT          (DWORD)0x00BB0226 /* dest = (NOT source) OR dest     */
+#define PATCOPY             (DWORD)0x00F00021 /* dest = pattern                  */
+#define PATPAINT            (DWORD)0x00FB0A09 /* dest = DPSnoo                   */
+#define PATINVERT           (DWORD)0x005A0049 /* dest = pattern XOR dest         */
+#define DSTINVERT           (DWORD)0x00550009 /* dest = (NOT dest)               */
+#define BLACKNESS           (DWORD)0x00000042 /* dest = BLACK                    */
+#define WHITENESS           (DWORD)0x00FF0062 /* dest = WHITE                    */
+
+typedef struct tagBITMAPCOREHEADER {
+        DWORD   bcSize;                 /* used to get to color table */
+        WORD    bcWidth;
+        WORD    bcHeight;
+        WORD    bcPlanes;
+        WORD    bcBitCount;
+} BITMAPCOREHEADER, *LPBITMAPCOREHEADER, *PBITMAPCOREHEADER;
+typedef struct tagBITMAPINFOHEADER{
+        DWORD      biSize;
+        LONG       biWidth;
+        LONG       biHeight;
+        WORD       biPlanes;
+        WORD       biBitCount;
+        DWORD      biCompression;
+        DWORD      biSizeImage;
+        LONG       biXPelsPerMeter;
+        LONG       biYPelsPerMeter;
+        DWORD      biClrUsed;
+        DWORD      biClrImportant;
+} BITMAPINFOHEADER, *LPBITMAPINFOHEADER, *PBITMAPINFOHEADER;
+typedef struct tagRGBQUAD {
+        BYTE    rgbBlue;
+        BYTE    rgbGreen;
+        BYTE    rgbRed;
+        BYTE    rgbReserved;
+} RGBQUAD;
+typedef struct tagBITMAPINFO {
+    BITMAPINFOHEADER    bmiHeader;
+    RGBQUAD             bmiColors[1];
+} BITMAPINFO, *LPBITMAPINFO, *PBITMAPINFO;
+
+WINGDIAPI int WINAPI    StretchDIBits(HDC hdc, int xDest, int yDest, int DestWidth, int DestHeight, int xSrc, int ySrc, int SrcWidth, int SrcHeight, CONST VOID *lpBits, CONST BITMAPINFO *lpbmi, UINT iUsage, DWORD rop);
+
+//////////////////////////////////////////////////////////////////////////////
+// memoryapi.h
+//////////////////////////////////////////////////////////////////////////////
+
+typedef struct _MEMORY_BASIC_INFORMATION {
+    PVOID BaseAddress;
+    PVOID AllocationBase;
+    DWORD AllocationProtect;
+    SIZE_T RegionSize;
+    DWORD State;
+    DWORD Protect;
+    DWORD Type;
+} MEMORY_BASIC_INFORMATION, *PMEMORY_BASIC_INFORMATION;
+
+// Virtual
+WINBASEAPI LPVOID WINAPI    VirtualAlloc(LPVOID lpAddress, SIZE_T dwSize, DWORD flAllocationType, DWORD flProtect);
+WINBASEAPI BOOL WINAPI      VirtualFree(LPVOID lpAddress, SIZE_T dwSize, DWORD dwFreeType);
+WINBASEAPI BOOL WINAPI      VirtualProtect(LPVOID lpAddress, SIZE_T dwSize, DWORD flNewProtect, PDWORD lpflOldProtect);
+WINBASEAPI SIZE_T WINAPI    VirtualQuery(LPCVOID lpAddress, PMEMORY_BASIC_INFORMATION lpBuffer, SIZE_T dwLength);
+WINBASEAPI LPVOID WINAPI    VirtualAllocEx(HANDLE hProcess, LPVOID lpAddress, SIZE_T dwSize, DWORD flAllocationType, DWORD flProtect);
+WINBASEAPI BOOL WINAPI      VirtualFreeEx(HANDLE hProcess, LPVOID lpAddress, SIZE_T dwSize, DWORD dwFreeType);
+WINBASEAPI BOOL WINAPI      VirtualProtectEx(HANDLE hProcess, LPVOID lpAddress, SIZE_T dwSize, DWORD flNewProtect, PDWORD lpflOldProtect);
+WINBASEAPI SIZE_T WINAPI    VirtualQueryEx(HANDLE hProcess, LPCVOID lpAddress, PMEMORY_BASIC_INFORMATION lpBuffer, SIZE_T dwLength);
+WINBASEAPI BOOL WINAPI      VirtualLock(LPVOID lpAddress, SIZE_T dwSize);
+WINBASEAPI BOOL WINAPI      VirtualUnlock(LPVOID lpAddress, SIZE_T dwSize);
+// Large pages and NUMA
+WINBASEAPI SIZE_T WINAPI    GetLargePageMinimum(VOID);
+WINBASEAPI BOOL WINAPI      GetNumaHighestNodeNumber(PULONG HighestNodeNumber);
+WINBASEAPI LPVOID WINAPI    VirtualAllocExNuma(HANDLE hProcess, LPVOID lpAddress, SIZE_T dwSize, DWORD flAllocationType, DWORD flProtect, DWORD nndPreferred);
+// Filemap
+WINBASEAPI HANDLE WINAPI    CreateFileMappingW(HANDLE hFile, LPSECURITY_ATTRIBUTES lpFileMappingAttributes, DWORD flProtect, DWORD dwMaximumSizeHigh, DWORD dwMaximumSizeLow, LPCWSTR lpName);
+WINBASEAPI LPVOID WINAPI    MapViewOfFile(HANDLE hFileMappingObject, DWORD dwDesiredAccess, DWORD dwFileOffsetHigh, DWORD dwFileOffsetLow, SIZE_T dwNumberOfBytesToMap);
+WINBASEAPI LPVOID WINAPI    MapViewOfFileEx(HANDLE hFileMappingObject, DWORD dwDesiredAccess, DWORD dwFileOffsetHigh, DWORD dwFileOffsetLow, SIZE_T dwNumberOfBytesToMap, LPVOID lpBaseAddress);
+WINBASEAPI BOOL WINAPI      FlushViewOfFile(LPCVOID lpBaseAddress, SIZE_T dwNumberOfBytesToFlush);
+WINBASEAPI BOOL WINAPI      UnmapViewOfFile(LPCVOID lpBaseAddress);
+// Memory
+WINBASEAPI BOOL WINAPI      ReadProcessMemory(HANDLE hProcess, LPCVOID lpBaseAddress, LPVOID lpBuffer, SIZE_T nSize, SIZE_T *lpNumberOfBytesRead);
+WINBASEAPI BOOL WINAPI      WriteProcessMemory(HANDLE hProcess, LPVOID lpBaseAddress, LPCVOID lpBuffer, SIZE_T nSize, SIZE_T *lpNumberOfBytesWritten);
+
+//////////////////////////////////////////////////////////////////////////////
+// processthreadsapi.h
+//////////////////////////////////////////////////////////////////////////////
+
+typedef DWORD (WINAPI *PTHREAD_START_ROUTINE)(LPVOID lpThreadParameter);
+typedef PTHREAD_START_ROUTINE LPTHREAD_START_ROUTINE;
+
+typedef struct _PROCESS_INFORMATION {
+    HANDLE hProcess;
+    HANDLE hThread;
+    DWORD dwProcessId;
+    DWORD dwThreadId;
+} PROCESS_INFORMATION, *PPROCESS_INFORMATION, *LPPROCESS_INFORMATION;
+typedef struct _STARTUPINFOA {
+    DWORD   cb;
+    LPSTR   lpReserved;
+    LPSTR   lpDesktop;
+    LPSTR   lpTitle;
+    DWORD   dwX;
+    DWORD   dwY;
+    DWORD   dwXSize;
+    DWORD   dwYSize;
+    DWORD   dwXCountChars;
+    DWORD   dwYCountChars;
+    DWORD   dwFillAttribute;
+    DWORD   dwFlags;
+    WORD    wShowWindow;
+    WORD    cbReserved2;
+    LPBYTE  lpReserved2;
+    HANDLE  hStdInput;
+    HANDLE  hStdOutput;
+    HANDLE  hStdError;
+} STARTUPINFOA, *LPSTARTUPINFOA;
+typedef struct _STARTUPINFOW {
+    DWORD   cb;
+    LPWSTR  lpReserved;
+    LPWSTR  lpDesktop;
+    LPWSTR  lpTitle;
+    DWORD   dwX;
+    DWORD   dwY;
+    DWORD   dwXSize;
+    DWORD   dwYSize;
+    DWORD   dwXCountChars;
+    DWORD   dwYCountChars;
+    DWORD   dwFillAttribute;
+    DWORD   dwFlags;
+    WORD    wShowWindow;
+    WORD    cbReserved2;
+    LPBYTE  lpReserved2;
+    HANDLE  hStdInput;
+    HANDLE  hStdOutput;
+    HANDLE  hStdError;
+} STARTUPINFOW, *LPSTARTUPINFOW;
+typedef struct _PROC_THREAD_ATTRIBUTE_LIST *PPROC_THREAD_ATTRIBUTE_LIST, *LPPROC_THREAD_ATTRIBUTE_LIST;
+typedef ULONG_PTR KAFFINITY;
+typedef struct _GROUP_AFFINITY {
+    KAFFINITY Mask;
+    WORD Group;
+    WORD Reserved[3];
+} GROUP_AFFINITY, *PGROUP_AFFINITY;
+
+#define CREATE_SUSPENDED        0x00000004
+#define ALL_PROCESSOR_GROUPS    0xffff
+
+// Processes
+WINBASEAPI HANDLE WINAPI                    GetCurrentProcess(VOID);
+WINBASEAPI DWORD WINAPI                     GetCurrentProcessId(VOID);
+WINBASEAPI DECLSPEC_NORETURN VOID WINAPI    ExitProcess(UINT uExitCode);
+WINBASEAPI BOOL WINAPI                      TerminateProcess(HANDLE hProcess, UINT uExitCode);
+WINBASEAPI BOOL WINAPI                      GetExitCodeProcess(HANDLE hProcess, LPDWORD lpExitCode);
+WINBASEAPI BOOL WINAPI                      CreateProcessA(LPCSTR lpApplicationName, LPSTR lpCommandLine, LPSECURITY_ATTRIBUTES lpProcessAttributes, LPSECURITY_ATTRIBUTES lpThreadAttributes, BOOL bInheritHandles, DWORD dwCreationFlags, LPVOID lpEnvironment, LPCSTR lpCurrentDirectory, LPSTARTUPINFOA lpStartupInfo, LPPROCESS_INFORMATION lpProcessInformation);
+WINBASEAPI BOOL WINAPI                      CreateProcessW(LPCWSTR lpApplicationName, LPWSTR lpCommandLine, LPSECURITY_ATTRIBUTES lpProcessAttributes, LPSECURITY_ATTRIBUTES lpThreadAttributes, BOOL bInheritHandles, DWORD dwCreationFlags, LPVOID lpEnvironment, LPCWSTR lpCurrentDirectory, LPSTARTUPINFOW lpStartupInfo, LPPROCESS_INFORMATION lpProcessInformation);
+WINBASEAPI DWORD WINAPI                     GetProcessId(HANDLE Process);
+// TLS
+WINBASEAPI DWORD WINAPI                     TlsAlloc(VOID);
+WINBASEAPI LPVOID WINAPI                    TlsGetValue(DWORD dwTlsIndex);
+WINBASEAPI BOOL WINAPI                      TlsSetValue(DWORD dwTlsIndex, LPVOID lpTlsValue);
+WINBASEAPI BOOL WINAPI                      TlsFree(DWORD dwTlsIndex);
+// Threads
+WINBASEAPI HANDLE WINAPI                    CreateThread(LPSECURITY_ATTRIBUTES lpThreadAttributes, SIZE_T dwStackSize, LPTHREAD_START_ROUTINE lpStartAddress, LPVOID lpParameter, DWORD dwCreationFlags, LPDWORD lpThreadId);
+WINBASEAPI HANDLE WINAPI                    CreateRemoteThread(HANDLE hProcess, LPSECURITY_ATTRIBUTES lpThreadAttributes, SIZE_T dwStackSize, LPTHREAD_START_ROUTINE lpStartAddress, LPVOID lpParameter, DWORD dwCreationFlags, LPDWORD lpThreadId);
+WINBASEAPI HANDLE WINAPI                    OpenThread(DWORD dwDesiredAccess, BOOL bInheritHandle, DWORD dwThreadId);
+WINBASEAPI DECLSPEC_NORETURN VOID WINAPI    ExitThread(DWORD dwExitCode);
+WINBASEAPI BOOL WINAPI                      TerminateThread(HANDLE hThread, DWORD dwExitCode);
+WINBASEAPI BOOL WINAPI                      GetExitCodeThread(HANDLE hThread, LPDWORD lpExitCode);
+WINBASEAPI DWORD WINAPI                     SuspendThread(HANDLE hThread);
+WINBASEAPI DWORD WINAPI                     ResumeThread(HANDLE hThread);
+WINBASEAPI DWORD WINAPI                     GetThreadId(HANDLE Thread);
+WINBASEAPI HANDLE WINAPI                    CreateRemoteThreadEx(HANDLE hProcess, LPSECURITY_ATTRIBUTES lpThreadAttributes, SIZE_T dwStackSize, LPTHREAD_START_ROUTINE lpStartAddress, LPVOID lpParameter, DWORD dwCreationFlags, LPPROC_THREAD_ATTRIBUTE_LIST lpAttributeList, LPDWORD lpThreadId);
+WINBASEAPI BOOL WINAPI                      SetThreadGroupAffinity(HANDLE hThread, CONST GROUP_AFFINITY *GroupAffinity, PGROUP_AFFINITY PreviousGroupAffinity);
+// Processor groups
+WINBASEAPI WORD WINAPI                      GetActiveProcessorGroupCount(VOID);
+WINBASEAPI DWORD WINAPI                     GetActiveProcessorCount(WORD GroupNumber);
+// Privileges, advapi32.lib
+#define TOKEN_QUERY                 0x0008
+#define TOKEN_ADJUST_PRIVILEGES     0x0020
+#define SE_PRIVILEGE_ENABLED        0x00000002L
+#define ERROR_NOT_ALL_ASSIGNED      1300L
+WINADVAPI BOOL WINAPI                       OpenProcessToken(HANDLE ProcessHandle, DWORD DesiredAccess, HANDLE *TokenHandle);
+WINADVAPI BOOL WINAPI                       LookupPrivilegeValueA(LPCSTR lpSystemName, LPCSTR lpName, PLUID lpLuid);
+WINADVAPI BOOL WINAPI                       AdjustTokenPrivileges(HANDLE TokenHandle, BOOL DisableAllPrivileges, PTOKEN_PRIVILEGES NewState, DWORD BufferLength, PTOKEN_PRIVILEGES PreviousState, PDWORD ReturnLength);
+
+//////////////////////////////////////////////////////////////////////////////
+// libloaderapi.h
+//////////////////////////////////////////////////////////////////////////////
+
+WINBASEAPI FARPROC WINAPI   GetProcAddress(HMODULE hModule, LPCSTR lpProcName);
+WINBASEAPI HMODULE WINAPI   LoadLibraryExA(LPCSTR lpLibFileName, HANDLE hFile, DWORD dwFlags);
+WINBASEAPI HMODULE WINAPI   LoadLibraryExW(LPCWSTR lpLibFileName, HANDLE hFile, DWORD dwFlags);
+WINBASEAPI BOOL WINAPI      FreeLibrary(HMODULE hLibModule);
+WINBASEAPI HMODULE WINAPI   GetModuleHandleA(LPCSTR lpModuleName);
+WINBASEAPI HMODULE WINAPI   GetModuleHandleW(LPCWSTR lpModuleName);
+WINBASEAPI BOOL WINAPI      GetModuleHandleExA(DWORD dwFlags, LPCSTR lpModuleName, HMODULE *phModule);
+WINBASEAPI BOOL WINAPI      GetModuleHandleExW(DWORD dwFlags, LPCWSTR lpModuleName, HMODULE *phModule);
+
+#ifndef UNICODE
+    #define LoadLibraryEx       LoadLibraryExW
+    #define GetModuleHandle     GetModuleHandleW
+    #define GetModuleHandleEx   GetModuleHandleExW
+#else
+    #define LoadLibraryEx       LoadLibraryExA
+    #define GetModuleHandle     GetModuleHandleA
+    #define GetModuleHandleEx   GetModuleHandleExA
+#endif // UNICODE
+
+//////////////////////////////////////////////////////////////////////////////
+// WinBase.h
+//////////////////////////////////////////////////////////////////////////////
+
+#define STD_INPUT_HANDLE    ((DWORD)-10)
+#define STD_OUTPUT_HANDLE   ((DWORD)-11)
+#define STD_ERROR_HANDLE    ((DWORD)-12)
+
+#define IGNORE              0       // Ignore signal
+#define INFINITE            0xFFFFFFFF  // Infinite timeout
+
+#define FILE_BEGIN           0
+#define FILE_CURRENT         1
+#define FILE_END             2
+
+WINBASEAPI HANDLE WINAPI    CreateFileMappingA(HANDLE hFile, LPSECURITY_ATTRIBUTES lpFileMappingAttributes, DWORD flProtect, DWORD dwMaximumSizeHigh, DWORD dwMaximumSizeLow, LPCSTR lpName);
+WINBASEAPI HMODULE WINAPI   LoadLibraryA(LPCSTR lpLibFileName);
+WINBASEAPI HMODULE WINAPI   LoadLibraryW(LPCWSTR lpLibFileName);
+WINBASEAPI DWORD WINAPI     WaitForMultipleObjects(DWORD nCount, CONST HANDLE *lpHandles, BOOL bWaitAll, DWORD dwMilliseconds);
+WINBASEAPI HANDLE WINAPI    OpenFileMappingA(DWORD dwDesiredAccess, BOOL bInheritHandle, LPCSTR lpName);
+WINBASEAPI HANDLE WINAPI    OpenFileMappingW(DWORD dwDesiredAccess, BOOL bInheritHandle, LPCWSTR lpName);
+WINBASEAPI HANDLE WINAPI    CreateSemaphoreA(LPSECURITY_ATTRIBUTES lpSemaphoreAttributes, LONG lInitialCount, LONG lMaximumCount, LPCSTR lpName);
+WINBASEAPI HANDLE WINAPI    CreateSemaphoreW(LPSECURITY_ATTRIBUTES lpSemaphoreAttributes, LONG lInitialCount, LONG lMaximumCount, LPCWSTR lpName);
+WINBASEAPI HANDLE WINAPI    CreateSemaphoreExA(LPSECURITY_ATTRIBUTES lpSemaphoreAttributes, LONG lInitialCount, LONG lMaximumCount, LPCSTR lpName, DWORD dwFlags, DWORD dwDesiredAccess);
+
+#ifdef UNICODE
+    #define CreateFileMapping   CreateFileMappingW
+    #define LoadLibrary         LoadLibraryW
+    #define OpenFileMapping     OpenFileMappingW
+    #define CreateSemaphore     CreateSemaphoreW
+#else
+    #define CreateFileMapping   CreateFileMappingA
+    #define LoadLibrary         LoadLibraryA
+    #define OpenFileMapping     OpenFileMappingA
+    #define CreateSemaphore     CreateSemaphoreA
+    #define CreateSemaphoreEx   CreateSemaphoreExA
+#endif // UNICODE
+
+//////////////////////////////////////////////////////////////////////////////
+// syncapi.h
+//////////////////////////////////////////////////////////////////////////////
+
+typedef struct _LIST_ENTRY {
+   struct _LIST_ENTRY *Flink;
+   struct _LIST_ENTRY *Blink;
+} LIST_ENTRY, *PLIST_ENTRY, *PRLIST_ENTRY;
+typedef struct _RTL_CRITICAL_SECTION_DEBUG {
+    WORD   Type;
+    WORD   CreatorBackTraceIndex;
+    struct _RTL_CRITICAL_SECTION *CriticalSection;
+    LIST_ENTRY ProcessLocksList;
+    DWORD EntryCount;
+    DWORD ContentionCount;
+    DWORD Flags;
+    WORD   CreatorBackTraceIndexHigh;
+    WORD   SpareWORD  ;
+} RTL_CRITICAL_SECTION_DEBUG, *PRTL_CRITICAL_SECTION_DEBUG, RTL_RESOURCE_DEBUG, *PRTL_RESOURCE_DEBUG;
+typedef struct _RTL_CRITICAL_SECTION {
+    PRTL_CRITICAL_SECTION_DEBUG DebugInfo;
+
+    //
+    //  The following three fields control entering and exiting the critical
+    //  section for the resource
+    //
+
+    LONG LockCount;
+    LONG RecursionCount;
+    HANDLE OwningThread;        // from the thread's ClientId->UniqueThread
+    HANDLE LockSemaphore;
+    ULONG_PTR SpinCount;        // force size on 64-bit systems when packed
+} RTL_CRITICAL_SECTION, *PRTL_CRITICAL_SECTION;
+typedef RTL_CRITICAL_SECTION CRITICAL_SECTION, *LPCRITICAL_SECTION;
+
+// Mutexes
+WINBASEAPI HANDLE WINAPI    CreateMutexA(LPSECURITY_ATTRIBUTES lpMutexAttributes, BOOL bInitialOwner, LPCSTR lpName);
+WINBASEAPI HANDLE WINAPI    CreateMutexW(LPSECURITY_ATTRIBUTES lpMutexAttributes, BOOL bInitialOwner, LPCWSTR lpName);
+WINBASEAPI HANDLE WINAPI    CreateMutexExA(LPSECURITY_ATTRIBUTES lpMutexAttributes, LPCSTR lpName, DWORD dwFlags, DWORD dwDesiredAccess);
+WINBASEAPI HANDLE WINAPI    CreateMutexExW(LPSECURITY_ATTRIBUTES lpMutexAttributes, LPCWSTR lpName, DWORD dwFlags, DWORD dwDesiredAccess);
+WINBASEAPI BOOL WINAPI      ReleaseMutex(HANDLE hMutex);
+// Semaphores
+WINBASEAPI HANDLE WINAPI    CreateSemaphoreExW(LPSECURITY_ATTRIBUTES lpSemaphoreAttributes, LONG lInitialCount, LONG lMaximumCount, LPCWSTR lpName, DWORD dwFlags, DWORD dwDesiredAccess);
+WINBASEAPI BOOL WINAPI      ReleaseSemaphore(HANDLE hSemaphore, LONG lReleaseCount, LPLONG lpPreviousCount);
+// Events
+WINBASEAPI HANDLE WINAPI    CreateEventA(LPSECURITY_ATTRIBUTES lpEventAttributes, BOOL bManualReset, BOOL bInitialState, LPCSTR lpName);
+WINBASEAPI HANDLE WINAPI    CreateEventW(LPSECURITY_ATTRIBUTES lpEventAttributes, BOOL bManualReset, BOOL bInitialState, LPCWSTR lpName);
+WINBASEAPI HANDLE WINAPI    CreateEventExA(LPSECURITY_ATTRIBUTES lpEventAttributes, LPCSTR lpName, DWORD dwFlags, DWORD dwDesiredAccess);
+WINBASEAPI HANDLE WINAPI    CreateEventExW(LPSECURITY_ATTRIBUTES lpEventAttributes, LPCWSTR lpName, DWORD dwFlags, DWORD dwDesiredAccess);
+WINBASEAPI BOOL WINAPI      SetEvent(HANDLE hEvent);
+WINBASEAPI BOOL WINAPI      ResetEvent(HANDLE hEvent);
+// Critical sections
+WINBASEAPI VOID WINAPI      InitializeCriticalSection(LPCRITICAL_SECTION lpCriticalSection);
+WINBASEAPI VOID WINAPI      EnterCriticalSection(LPCRITICAL_SECTION lpCriticalSection);
+WINBASEAPI VOID WINAPI      LeaveCriticalSection(LPCRITICAL_SECTION lpCriticalSection);
+WINBASEAPI BOOL WINAPI      InitializeCriticalSectionAndSpinCount(LPCRITICAL_SECTION lpCriticalSection, DWORD dwSpinCount);
+WINBASEAPI BOOL WINAPI      InitializeCriticalSectionEx(LPCRITICAL_SECTION lpCriticalSection, DWORD dwSpinCount, DWORD Flags);
+WINBASEAPI DWORD WINAPI     SetCriticalSectionSpinCount(LPCRITICAL_SECTION lpCriticalSection, DWORD dwSpinCount);
+WINBASEAPI BOOL WINAPI      TryEnterCriticalSection(LPCRITICAL_SECTION lpCriticalSection);
+WINBASEAPI VOID WINAPI      DeleteCriticalSection(LPCRITICAL_SECTION lpCriticalSection);
+// Wait / sleep
+WINBASEAPI DWORD WINAPI     WaitForSingleObject(HANDLE hHandle, DWORD dwMilliseconds);
+WINBASEAPI DWORD WINAPI     WaitForSingleObjectEx(HANDLE hHandle, DWORD dwMilliseconds, BOOL bAlertable);
+WINBASEAPI DWORD WINAPI     WaitForMultipleObjectsEx(DWORD nCount, CONST HANDLE *lpHandles, BOOL bWaitAll, DWORD dwMilliseconds, BOOL bAlertable);
+WINBASEAPI DWORD WINAPI     SleepEx(DWORD dwMilliseconds, BOOL bAlertable);
+
+#ifdef UNICODE
+    #define CreateMutex     CreateMutexW
+    #define CreateMutexEx   CreateMutexExW
+    #define CreateEvent     CreateEventW
+    #define CreateEventEx   CreateEventExW
+#else
+    #define CreateMutex     CreateMutexA
+    #define CreateMutexEx   CreateMutexExA
+    #define CreateEvent     CreateEventA
+    #define CreateEventEx   CreateEventExA
+#endif // UNICODE
+
+//////////////////////////////////////////////////////////////////////////////
+// syncapi.h
+//////////////////////////////////////////////////////////////////////////////
+
+WINBASEAPI DWORD WINAPI     GetLastError(VOID);
+WINBASEAPI VOID WINAPI      SetLastError(DWORD dwErrCode);
+
+//////////////////////////////////////////////////////////////////////////////
+// processenv.h
+//////////////////////////////////////////////////////////////////////////////
+
+WINBASEAPI LPSTR WINAPI         GetCommandLineA(VOID);
+WINBASEAPI LPWSTR WINAPI        GetCommandLineW(VOID);
+WINBASEAPI DWORD WINAPI         GetCurrentDirectoryA(DWORD nBufferLength, LPSTR lpBuffer);
+WINBASEAPI DWORD WINAPI         GetCurrentDirectoryW(DWORD nBufferLength, LPWSTR lpBuffer);
+WINBASEAPI HANDLE WINAPI        GetStdHandle(DWORD nStdHandle);
+WINBASEAPI BOOL WINAPI          SetStdHandle(DWORD nStdHandle, HANDLE hHandle);
+
+#ifdef UNICODE
+#define GetCommandLine      GetCommandLineW
+#define GetCurrentDirectory GetCurrentDirectoryW
+#else
+#define GetCommandLine      GetCommandLineA
+#define GetCurrentDirectory GetCurrentDirectoryA
+#endif // UNICODE
+
+//////////////////////////////////////////////////////////////////////////////
+// sysinfoapi.h
+//////////////////////////////////////////////////////////////////////////////
+
+typedef struct _SYSTEM_INFO {
+    union {
+        DWORD dwOemId;          // Obsolete field...do not use
+        struct {
+            WORD wProcessorArchitecture;
+            WORD wReserved;
+        } DUMMYSTRUCTNAME;
+    } DUMMYUNIONNAME;
+    DWORD dwPageSize;
+    LPVOID lpMinimumApplicationAddress;
+    LPVOID lpMaximumApplicationAddress;
+    DWORD_PTR dwActiveProcessorMask;
+    DWORD dwNumberOfProcessors;
+    DWORD dwProcessorType;
+    DWORD dwAllocationGranularity;
+    WORD wProcessorLevel;
+    WORD wProcessorRevision;
+} SYSTEM_INFO, *LPSYSTEM_INFO;
+
+typedef struct _MEMORYSTATUSEX {
+    DWORD dwLength;
+    DWORD dwMemoryLoad;
+    DWORDLONG ullTotalPhys;
+    DWORDLONG ullAvailPhys;
+    DWORDLONG ullTotalPageFile;
+    DWORDLONG ullAvailPageFile;
+    DWORDLONG ullTotalVirtual;
+    DWORDLONG ullAvailVirtual;
+    DWORDLONG ullAvailExtendedVirtual;
+} MEMORYSTATUSEX, *LPMEMORYSTATUSEX;
+
+WINBASEAPI
+BOOL
+WINAPI
+GlobalMemoryStatusEx(
+    _Out_ LPMEMORYSTATUSEX lpBuffer
+    );
+
+WINBASEAPI
+VOID
+WINAPI
+GetSystemInfo(
+    _Out_ LPSYSTEM_INFO lpSystemInfo
+    );
+
+WINBASEAPI
+VOID
+WINAPI
+GetSystemTime(
+    _Out_ LPSYSTEMTIME lpSystemTime
+    );
+
+WINBASEAPI
+VOID
+WINAPI
+GetSystemTimeAsFileTime(
+    _Out_ LPFILETIME lpSystemTimeAsFileTime
+    );
+
+WINBASEAPI
+VOID
+WINAPI
+GetLocalTime(
+    _Out_ LPSYSTEMTIME lpSystemTime
+    );
+
+//////////////////////////////////////////////////////////////////////////////
+// profileapi.h
+//////////////////////////////////////////////////////////////////////////////
+
+WINBASEAPI
+BOOL
+WINAPI
+QueryPerformanceCounter(
+    _Out_ LARGE_INTEGER* lpPerformanceCount
+    );
+
+WINBASEAPI
+BOOL
+WINAPI
+QueryPerformanceFrequency(
+    _Out_ LARGE_INTEGER* lpFrequency
+    );
+
+//////////////////////////////////////////////////////////////////////////////
+// debugapi.h
+//////////////////////////////////////////////////////////////////////////////
+
+WINBASEAPI
+VOID
+WINAPI
+DebugBreak(
+    VOID
+    );
+
+WINBASEAPI
+VOID
+WINAPI
+OutputDebugStringA(
+    _In_opt_ LPCSTR lpOutputString
+    );
+
+WINBASEAPI
+VOID
+WINAPI
+OutputDebugStringW(
+    _In_opt_ LPCWSTR lpOutputString
+    );
+
+#ifdef UNICODE
+#define OutputDebugString  OutputDebugStringW
 #else
-    #define CreateDirectory     CreateDirectoryA
-    #define CreateFile          CreateFileA
-    #define DeleteFile          DeleteFileA
-    #define FindFirstFile       FindFirstFileA
-    #define RemoveDirectory     RemoveDirectoryA
-#endif // UNICODE
+#define OutputDebugString  OutputDebugStringA
+#endif // !UNICODE
+
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+
+#else
+    #include <windows.h>
+#endif
+
+
+
+
+
+//****************************************************************************
+//*** Array *****************************************************************
+//****************************************************************************
+
+template <typename type>
+struct array
+{
+    type        *Data;
+    u32         Size,
+                Capacity;
+
+
+    array(void);
+    array(u32 InitialCapacity);
+    ~array(void);
+
+
+    b32     NeedGrow(u32 Amount);
+    u32     Len(void);
+    u32     ByteSize(void);
+    void    Resize(u32 Amount);
+    void    Push(type Value);
+    void    Clear(void);
+    type    &operator[](u32 Index);
+};
+
+template <typename type>
+array<type>::array(void)
+{
+    this->Capacity = 1;
+    this->Size = 0;
+    this->Data = (type *)HeapAlloc(GetProcessHeap(), 0, sizeof(type));
+}
+
+template <typename type>
+array<type>::array(u32 InitialCapacity)
+{
+    this->Capacity = InitialCapacity;
+    this->Size = 0;
+    this->Data = (type *)HeapAlloc(GetProcessHeap(), 0, InitialCapacity * sizeof(type));
+}
+
+template <typename type>
+array<type>::~array(void)
+{
+    HeapFree(GetProcessHeap(), 0, this->Data);
+}
+
+template <typename type>
+b32
+array<type>::NeedGrow(u32 Amount)
+{
+    return ((this->Data == NULL) || (this->Size + Amount > this->Capacity));
+}
+
+template <typename type>
+u32
+array<type>::Len(void)
+{
+    return (this->Size);
+}
+
+template <typename type>
+u32
+array<type>::ByteSize(void)
+{
+    return (this->Size * sizeof(type));
+}
+
+template <typename type>
+void    
+array<type>::Resize(u32 Amount)
+{
+    u32     Cap;
+
+    if (this->Data)
+    {
+        Cap = Amount;
+    }
+    else
+    {
+        Cap = 0;
+    }
+
+    this->Data = (type *)HeapReAlloc(GetProcessHeap(), 0, this->Data, Cap * sizeof(type));
+    if (!this->Data)
+    {
+        this->Size = 0;
+    }
+
+    this->Capacity = Cap;
+}
+
+template <typename type>
+void    
+array<type>::Push(type Value)
+{
+    if (!(this->Data) || ((this->Data) && (this->NeedGrow(1))))
+    {
+        this->Resize(this->Capacity * 2);
+    }
+
+    this->Data[this->Size] = Value;
+    this->Size += 1;
+}
+
+template <typename type>
+void    
+array<type>::Clear(void)
+{
+    this->Size = 0;
+}
+
+template <typename type>
+type &
+array<type>::operator[](u32 Index)
+{
+    return (this->Data[Index]);
+}
+
+
+
+
+
+//****************************************************************************
+//*** Arena *****************************************************************
+//****************************************************************************
+
+// NOTE(matthew): An arena reserves its whole size of address space up front
+// and commits it ARENA_COMMIT_SIZE at a time as allocations reach it, so a
+// big reserve costs nothing until it's used and the memory never moves.
+// Allocations are 16 byte aligned and not cleared, nothing is freed on its
+// own. ArenaPushFrame()/ArenaPopFrame() free everything allocated in
+// between, for memory that lives for a frame, a job or a loop iteration.
+// ResetArena() frees everything, for memory that lives as long as a level
+// (the loaded volume, say), and keeps the pages committed so the next one
+// doesn't fault them back in. TrimArena() gives back the pages past the
+// current position.
+//
+// Every thread has a scratch arena, ScratchArena(), reserved on first use.
+// Kernels take per piece temporaries from it inside a frame instead of
+// allocating, so once it's committed a hot path doesn't allocate at all.
+// Frames nest, including across a WaitForJob() that runs other jobs on the
+// same thread, as long as each one is popped before whatever pushed it
+// returns.
+//
+// An arena isn't thread safe, give each thread its own.
+
+#define ARENA_ALIGN             16
+#define ARENA_COMMIT_SIZE       (64 * 1024)
+#define SCRATCH_ARENA_SIZE      (u64(1) << 30)      // reserved per thread
+
+struct arena
+{
+    u8          *Memory;
+    u64         Pos,
+                Committed,
+                Reserved;
+
+    // Stats
+    u64         Peak;                               // highest Pos
+    u64         AllocCount,
+                FailCount;                          // out of reserve or commit failed
+};
+
+struct arena_frame
+{
+    arena       *Arena;
+    u64         CurrentPos;
+};
+
+b32             CreateArena(arena *Arena, u64 ReserveSize);
+b32             DestroyArena(arena *Arena);
+void            *ArenaAlloc(arena *Arena, u64 Size);
+void            ResetArena(arena *Arena);
+void            TrimArena(arena *Arena);
+arena_frame     ArenaPushFrame(arena *Arena);
+void            ArenaPopFrame(arena_frame Frame);
+arena           *ScratchArena(void);
+void            ReleaseScratchArena(void);
+
+template <typename type>
+type *
+ArenaAllocArray(arena *Arena,
+                u64 Count)
+{
+    return ((type *)ArenaAlloc(Arena, Count * sizeof(type)));
+}
 
-//////////////////////////////////////////////////////////////////////////////
-// heapapi.h
-//////////////////////////////////////////////////////////////////////////////
+#ifdef MG_IMPL
 
-WINBASEAPI HANDLE WINAPI    HeapCreate(DWORD flOptions, SIZE_T dwInitialSize, SIZE_T dwMaximumSize);
-WINBASEAPI BOOL WINAPI      HeapDestroy(HANDLE hHeap);
-WINBASEAPI LPVOID WINAPI    HeapAlloc(HANDLE hHeap, DWORD dwFlags, SIZE_T dwBytes);
-WINBASEAPI LPVOID WINAPI    HeapReAlloc(HANDLE hHeap, DWORD dwFlags, LPVOID lpMem, SIZE_T dwBytes);
-WINBASEAPI BOOL WINAPI      HeapFree(HANDLE hHeap, DWORD dwFlags, LPVOID lpMem);
-WINBASEAPI HANDLE WINAPI    GetProcessHeap(VOID);
-WINBASEAPI SIZE_T WINAPI    HeapCompact(HANDLE hHeap, DWORD dwFlags);
-WINBASEAPI SIZE_T WINAPI    HeapSize(HANDLE hHeap, DWORD dwFlags, LPCVOID lpMem);
+static thread_local arena   gScratchArena = {};
 
-//////////////////////////////////////////////////////////////////////////////
-// WinUser.h
-//////////////////////////////////////////////////////////////////////////////
+b32
+CreateArena(arena *Arena,
+            u64 ReserveSize)
+{
+    *Arena = {};
 
-#define CS_VREDRAW          0x0001
-#define CS_HREDRAW          0x0002
-#define CS_OWNDC            0x0020
-#define CW_USEDEFAULT       ((int)0x80000000)
+    ReserveSize = (ReserveSize + ARENA_COMMIT_SIZE - 1) & ~u64(ARENA_COMMIT_SIZE - 1);
+    Arena->Memory = (u8 *)VirtualAlloc(NULL, ReserveSize, MEM_RESERVE, PAGE_NOACCESS);
+    if (!Arena->Memory)
+    {
+        return (FALSE);
+    }
 
-#define WS_OVERLAPPED       0x00000000L
-#define WS_POPUP            0x80000000L
-#define WS_CHILD            0x40000000L
-#define WS_MINIMIZE         0x20000000L
-#define WS_VISIBLE          0x10000000L
-#define WS_DISABLED         0x08000000L
-#define WS_CLIPSIBLINGS     0x04000000L
-#define WS_CLIPCHILDREN     0x02000000L
-#define WS_MAXIMIZE         0x01000000L
-#define WS_CAPTION          0x00C00000L     /* WS_BORDER | WS_DLGFRAME  */
-#define WS_BORDER           0x00800000L
-#define WS_DLGFRAME         0x00400000L
-#define WS_VSCROLL          0x00200000L
-#define WS_HSCROLL          0x00100000L
-#define WS_SYSMENU          0x00080000L
-#define WS_THICKFRAME       0x00040000L
-#define WS_GROUP            0x00020000L
-#define WS_TABSTOP          0x00010000L
-#define WS_MINIMIZEBOX      0x00020000L
-#define WS_MAXIMIZEBOX      0x00010000L
-#define WS_TILED            WS_OVERLAPPED
-#define WS_ICONIC           WS_MINIMIZE
-#define WS_SIZEBOX          WS_THICKFRAME
-#define WS_TILEDWINDOW      WS_OVERLAPPEDWINDOW
-#define WS_OVERLAPPEDWINDOW (WS_OVERLAPPED     | \
-                             WS_CAPTION        | \
-                             WS_SYSMENU        | \
-                             WS_THICKFRAME     | \
-                             WS_MINIMIZEBOX    | \
-                             WS_MAXIMIZEBOX)
-#define WS_POPUPWINDOW      (WS_POPUP          | \
-                             WS_BORDER         | \
-                             WS_SYSMENU)
-#define WS_CHILDWINDOW      (WS_CHILD)
+    Arena->Reserved = ReserveSize;
+
+    return (TRUE);
+}
+
+b32
+DestroyArena(arena *Arena)
+{
+    b32     Result = TRUE;
+
+
+    if (Arena->Memory)
+    {
+        Result = VirtualFree(Arena->Memory, 0, MEM_RELEASE) != 0;
+    }
+
+    *Arena = {};
+
+    return (Result);
+}
+
+// NULL once the reserve is used up
+void *
+ArenaAlloc(arena *Arena,
+           u64 Size)
+{
+    u64     AlignedSize = (Size + ARENA_ALIGN - 1) & ~u64(ARENA_ALIGN - 1);
+    u64     End = Arena->Pos + AlignedSize;
+    void    *Ptr = NULL;
+
+
+    if (End <= Arena->Reserved)
+    {
+        if (End > Arena->Committed)
+        {
+            u64 Commit = (End + ARENA_COMMIT_SIZE - 1) & ~u64(ARENA_COMMIT_SIZE - 1);
+
+            Commit = _Min(Commit, Arena->Reserved);
+            if (VirtualAlloc(Arena->Memory + Arena->Committed, Commit - Arena->Committed, MEM_COMMIT, PAGE_READWRITE))
+            {
+                Arena->Committed = Commit;
+            }
+        }
+
+        if (End <= Arena->Committed)
+        {
+            Ptr = Arena->Memory + Arena->Pos;
+            Arena->Pos = End;
+            Arena->Peak = _Max(Arena->Peak, End);
+            Arena->AllocCount++;
+        }
+    }
+
+    if (!Ptr)
+    {
+        Arena->FailCount++;
+    }
+
+    return (Ptr);
+}
+
+void
+ResetArena(arena *Arena)
+{
+    Arena->Pos = 0;
+}
+
+void
+TrimArena(arena *Arena)
+{
+    u64     Keep = (Arena->Pos + ARENA_COMMIT_SIZE - 1) & ~u64(ARENA_COMMIT_SIZE - 1);
+
+
+    if (Keep < Arena->Committed)
+    {
+        VirtualFree(Arena->Memory + Keep, Arena->Committed - Keep, MEM_DECOMMIT);
+        Arena->Committed = Keep;
+    }
+}
+
+arena_frame
+ArenaPushFrame(arena *Arena)
+{
+    arena_frame     Frame;
+
+    Frame.Arena = Arena;
+    Frame.CurrentPos = Arena->Pos;
+
+    return Frame;
+}
+
+void
+ArenaPopFrame(arena_frame Frame)
+{
+    Frame.Arena->Pos = Frame.CurrentPos;
+}
+
+// The calling thread's
+arena *
+ScratchArena(void)
+{
+    if (!gScratchArena.Memory)
+    {
+        CreateArena(&gScratchArena, SCRATCH_ARENA_SIZE);
+    }
+
+    return (&gScratchArena);
+}
+
+// Before a thread that used ScratchArena() exits
+void
+ReleaseScratchArena(void)
+{
+    DestroyArena(&gScratchArena);
+}
+
+#endif // MG_IMPL
+
+
+
+
+
+//****************************************************************************
+//*** Pages ******************************************************************
+//****************************************************************************
+
+// NOTE(matthew): For the big buffers that get sampled at random, the volume
+// above all. With 4 KB pages a 1024^3 f32 volume spans a million pages, far
+// more than the TLB holds, so nearly every random sample also walks the page
+// tables. AllocPages() backs them with large pages (2 MB on x64) when it can,
+// which needs the user to have "Lock pages in memory" (SeLockMemoryPrivilege)
+// for InitPages() to enable. Large pages are committed up front and never
+// paged out. Without the privilege, or without enough free contiguous
+// memory, it falls back to normal pages.
+//
+// With several NUMA nodes no node owns a fixed part of a buffer, the
+// kernels' pieces go to whichever worker steals them. PAGES_INTERLEAVE
+// prefers the nodes round robin, PAGES_INTERLEAVE_SIZE at a time, so the
+// traffic is spread evenly. Large pages are placed by the system when
+// they're allocated. Normal pages otherwise land on the node of the thread
+// that first touches them, so big buffers should be filled with a
+// ParallelFor(), not by one thread. page_allocator's default construction
+// doesn't touch anything, which leaves that to the first write.
+//
+// Buffers under PAGES_MIN_SIZE come from the heap.
+
+#include <new>
+#include <atomic>
+
+#define PAGES_LARGE             0x1
+#define PAGES_INTERLEAVE        0x2
+#define PAGES_MIN_SIZE          (u64(2) << 20)
+#define PAGES_INTERLEAVE_SIZE   (u64(2) << 20)
+
+struct page_stats
+{
+    u64                 LargePageSize;      // 0 when large pages aren't allowed
+    u32                 NodeCount;
+    std::atomic<u32>    LargeAllocs,
+                        SmallAllocs,
+                        LargeFallbacks;     // wanted large pages, got normal ones
+};
+
+extern u32          gPageFlags;
+extern page_stats   gPageStats;
+
+void    InitPages(u32 Flags);
+void    *AllocPages(u64 Size);
+void    FreePages(void *Memory, u64 Size);
+
+// For std::vectors of big buffers, allocates with the gPageFlags of the time
+template <typename type>
+struct page_allocator
+{
+    typedef type    value_type;
+
+    page_allocator(void) {}
+
+    template <typename other>
+    page_allocator(page_allocator<other> const &) {}
+
+    type *
+    allocate(size_t Count)
+    {
+        void *Memory = AllocPages(u64(Count) * sizeof(type));
+
+        if (!Memory)
+        {
+            throw std::bad_alloc();
+        }
+
+        return ((type *)Memory);
+    }
+
+    void
+    deallocate(type *Memory,
+               size_t Count)
+    {
+        FreePages(Memory, u64(Count) * sizeof(type));
+    }
+
+    // Default construction leaves the memory as it is, see above
+    template <typename other>
+    void
+    construct(other *Ptr)
+    {
+        ::new ((void *)Ptr) other;
+    }
+
+    template <typename other, typename... args>
+    void
+    construct(other *Ptr,
+              args &&... Args)
+    {
+        ::new ((void *)Ptr) other(static_cast<args &&>(Args)...);
+    }
+};
+
+template <typename a, typename b>
+bool
+operator==(page_allocator<a> const &, page_allocator<b> const &)
+{
+    return (true);
+}
+
+template <typename a, typename b>
+bool
+operator!=(page_allocator<a> const &, page_allocator<b> const &)
+{
+    return (false);
+}
+
+#ifdef MG_IMPL
+
+u32         gPageFlags = 0;
+page_stats  gPageStats;
+
+// Once at startup, before anything allocates with it
+void
+InitPages(u32 Flags)
+{
+    HANDLE              Token;
+    TOKEN_PRIVILEGES    Privileges = {};
+    ULONG               HighestNode = 0;
+
+
+    gPageFlags = Flags;
+    gPageStats.LargePageSize = 0;
+    gPageStats.LargeAllocs.store(0);
+    gPageStats.SmallAllocs.store(0);
+    gPageStats.LargeFallbacks.store(0);
+
+    if (GetNumaHighestNodeNumber(&HighestNode))
+    {
+        gPageStats.NodeCount = HighestNode + 1;
+    }
+    else
+    {
+        gPageStats.NodeCount = 1;
+    }
+
+    // AdjustTokenPrivileges() succeeds without the privilege too, it only
+    // says so in GetLastError()
+    if ((Flags & PAGES_LARGE) && OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &Token))
+    {
+        Privileges.PrivilegeCount = 1;
+        Privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+
+        if (LookupPrivilegeValueA(NULL, "SeLockMemoryPrivilege", &Privileges.Privileges[0].Luid) &&
+            AdjustTokenPrivileges(Token, FALSE, &Privileges, 0, NULL, NULL) &&
+            GetLastError() != ERROR_NOT_ALL_ASSIGNED)
+        {
+            gPageStats.LargePageSize = GetLargePageMinimum();
+        }
+
+        CloseHandle(Token);
+    }
+}
+
+// NULL when out of memory
+void *
+AllocPages(u64 Size)
+{
+    u8      *Memory;
+
+
+    if (Size < PAGES_MIN_SIZE)
+    {
+        return (HeapAlloc(GetProcessHeap(), 0, Size));
+    }
+
+    if ((gPageFlags & PAGES_LARGE) && gPageStats.LargePageSize)
+    {
+        u64 LargeSize = (Size + gPageStats.LargePageSize - 1) / gPageStats.LargePageSize * gPageStats.LargePageSize;
+
+        Memory = (u8 *)VirtualAlloc(NULL, LargeSize, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+        if (Memory)
+        {
+            gPageStats.LargeAllocs++;
+            return (Memory);
+        }
+
+        gPageStats.LargeFallbacks++;
+    }
+
+    Memory = (u8 *)VirtualAlloc(NULL, Size, MEM_RESERVE, PAGE_READWRITE);
+    if (!Memory)
+    {
+        return (NULL);
+    }
+
+    if ((gPageFlags & PAGES_INTERLEAVE) && gPageStats.NodeCount > 1)
+    {
+        u32 Node = 0;
+
+        for (u64 Offset = 0; Offset < Size; Offset += PAGES_INTERLEAVE_SIZE)
+        {
+            u64 ChunkSize = _Min(PAGES_INTERLEAVE_SIZE, Size - Offset);
+
+            if (!VirtualAllocExNuma(GetCurrentProcess(), Memory + Offset, ChunkSize, MEM_COMMIT, PAGE_READWRITE, Node))
+            {
+                VirtualFree(Memory, 0, MEM_RELEASE);
+                return (NULL);
+            }
+
+            Node = (Node + 1) % gPageStats.NodeCount;
+        }
+    }
+    else if (!VirtualAlloc(Memory, Size, MEM_COMMIT, PAGE_READWRITE))
+    {
+        VirtualFree(Memory, 0, MEM_RELEASE);
+        return (NULL);
+    }
+
+    gPageStats.SmallAllocs++;
+
+    return (Memory);
+}
+
+// Size as allocated
+void
+FreePages(void *Memory,
+          u64 Size)
+{
+    if (!Memory)
+    {
+        return;
+    }
+
+    if (Size < PAGES_MIN_SIZE)
+    {
+        HeapFree(GetProcessHeap(), 0, Memory);
+    }
+    else
+    {
+        VirtualFree(Memory, 0, MEM_RELEASE);
+    }
+}
+
+#endif // MG_IMPL
+
+
+
+
+
+//****************************************************************************
+//*** Timer ******************************************************************
+//****************************************************************************
+
+u64     ReadTimer(void);
+f64     TimerFrequency(void);
+f64     TimerSeconds(u64 Start, u64 End);
+
+#ifdef MG_IMPL
+
+u64
+ReadTimer(void)
+{
+    LARGE_INTEGER       Counter;
 
-#define WM_NULL             0x0000
-#define WM_CREATE           0x0001
-#define WM_DESTROY          0x0002
-#define WM_MOVE             0x0003
-#define WM_SIZE             0x0005
-#define WM_QUIT             0x0012
-#define WM_CLOSE            0x0010
-#define WM_PAINT            0x000F
-#define WM_KEYDOWN          0x0100
-#define WM_KEYUP            0x0101
 
-#define VK_ESCAPE           0x1B
+    QueryPerformanceCounter(&Counter);
 
-#define MB_OK                       0x00000000L
-#define MB_OKCANCEL                 0x00000001L
-#define MB_ABORTRETRYIGNORE         0x00000002L
-#define MB_YESNOCANCEL              0x00000003L
-#define MB_YESNO                    0x00000004L
-#define MB_RETRYCANCEL              0x00000005L
-#define MB_ICONHAND                 0x00000010L
-#define MB_ICONQUESTION             0x00000020L
-#define MB_ICONEXCLAMATION          0x00000030L
-#define MB_ICONASTERISK             0x00000040L
-#define MB_ICONERROR                MB_ICONHAND
+    return (u64(Counter.QuadPart));
+}
 
-#define SW_HIDE             0
-#define SW_SHOWNORMAL       1
-#define SW_NORMAL           1
-#define SW_SHOWMINIMIZED    2
-#define SW_SHOWMAXIMIZED    3
-#define SW_MAXIMIZE         3
-#define SW_SHOWNOACTIVATE   4
-#define SW_SHOW             5
-#define SW_MINIMIZE         6
-#define SW_SHOWMINNOACTIVE  7
-#define SW_SHOWNA           8
-#define SW_RESTORE          9
-#define SW_SHOWDEFAULT      10
-#define SW_FORCEMINIMIZE    11
-#define SW_MAX              11
+f64
+TimerFrequency(void)
+{
+    LARGE_INTEGER       Freq;
 
-#define PM_NOREMOVE         0x0000
-#define PM_REMOVE           0x0001
-#define PM_NOYIELD          0x0002
 
-#define GWLP_WNDPROC        (-4)
-#define GWLP_HINSTANCE      (-6)
-#define GWLP_HWNDPARENT     (-8)
-#define GWLP_USERDATA       (-21)
-#define GWLP_ID             (-12)
+    QueryPerformanceFrequency(&Freq);
+
+    return (f64(Freq.QuadPart));
+}
 
+// Workers and the render thread time themselves too, the static's
+// initialisation is the one that's thread safe
+f64
+TimerSeconds(u64 Start,
+             u64 End)
+{
+    static const f64    Frequency = TimerFrequency();
 
-typedef LRESULT (CALLBACK *WNDPROC)(HWND, UINT, WPARAM, LPARAM);
 
-typedef struct tagPOINT
+    return (f64(End - Start) / Frequency);
+}
+
+#endif // MG_IMPL
+
+
+
+
+
+//****************************************************************************
+//*** Jobs *******************************************************************
+//****************************************************************************
+
+// NOTE(matthew): Work-stealing job system. Every thread in it, the one that
+// called InitJobSystem() included, owns a ring of JOB_POOL_SIZE jobs and a
+// Chase-Lev deque. A thread pushes and pops the bottom of its own deque, so
+// it carries on with the newest and warmest work, and an idle thread steals
+// from the top of a random victim's, where the oldest and for a split range
+// the biggest pieces are.
+//
+// A job is finished when it and all its children are, WaitForJob() runs
+// other jobs until then. AddJobDependency() holds a job back until another
+// has finished, both have to be added before either job is submitted. Jobs
+// are recycled JOB_POOL_SIZE allocations later on the same thread, so a
+// finished job can't be waited on after that.
+//
+// ParallelFor() splits a 1D, 2D or 3D range in half along the axis with the
+// most grains, pushing one half and keeping the other, until a piece is one
+// grain. It returns when the whole range is done and the calling thread
+// works on it too. From a thread that isn't in a job system it just runs the
+// range, so the kernels work the same without one.
+//
+// Idle workers spin for JOB_SPIN_COUNT tries, then sleep on a semaphore
+// that submitting a job releases. Past 64 logical processors Windows splits
+// them into groups and a thread only runs within one, so the workers are
+// spread over the groups by hand.
+
+#include <atomic>
+
+#define JOB_POOL_SIZE           2048        // per thread, a power of two
+#define JOB_DATA_SIZE           64
+#define JOB_MAX_CONTINUATIONS   4
+#define JOB_SPIN_COUNT          1024
+#define JOB_MAX_SPLITS          512         // pieces of one ParallelFor()
+
+struct job;
+struct job_system;
+
+typedef void job_func(job *Job, void *Data);
+
+struct alignas(64) job
+{
+    job_func            *Func;
+    job                 *Parent;
+    std::atomic<s32>    Unfinished;         // itself and its children
+    std::atomic<s32>    Dependencies;       // jobs to wait for, + 1 until submitted
+    job                 *Continuations[JOB_MAX_CONTINUATIONS];
+    u32                 ContinuationCount;
+    u8                  Data[JOB_DATA_SIZE];
+};
+
+// Top and Bottom on their own cache lines, thieves hammer Top
+struct alignas(64) job_worker
+{
+    std::atomic<s64>    Top;
+    alignas(64)
+    std::atomic<s64>    Bottom;
+    std::atomic<job *>  *Queue;
+    job                 *Pool;
+    u32                 PoolNext;
+    u32                 Index;
+    u32                 Seed;
+    HANDLE              Thread;
+    job_system          *System;
+};
+
+struct job_system
 {
-    LONG  x;
-    LONG  y;
-} POINT, *PPOINT, *NPPOINT, *LPPOINT;
-typedef struct tagWNDCLASSA {
-    UINT        style;
-    WNDPROC     lpfnWndProc;
-    int         cbClsExtra;
-    int         cbWndExtra;
-    HINSTANCE   hInstance;
-    HICON       hIcon;
-    HCURSOR     hCursor;
-    HBRUSH      hbrBackground;
-    LPCSTR      lpszMenuName;
-    LPCSTR      lpszClassName;
-} WNDCLASSA, *PWNDCLASSA, *NPWNDCLASSA, *LPWNDCLASSA;
-typedef struct tagWNDCLASSW {
-    UINT        style;
-    WNDPROC     lpfnWndProc;
-    int         cbClsExtra;
-    int         cbWndExtra;
-    HINSTANCE   hInstance;
-    HICON       hIcon;
-    HCURSOR     hCursor;
-    HBRUSH      hbrBackground;
-    LPCWSTR     lpszMenuName;
-    LPCWSTR     lpszClassName;
-} WNDCLASSW, *PWNDCLASSW, *NPWNDCLASSW, *LPWNDCLASSW;
-typedef struct tagWNDCLASSEXA {
-    UINT        cbSize;
-    /* Win 3.x */
-    UINT        style;
-    WNDPROC     lpfnWndProc;
-    int         cbClsExtra;
-    int         cbWndExtra;
-    HINSTANCE   hInstance;
-    HICON       hIcon;
-    HCURSOR     hCursor;
-    HBRUSH      hbrBackground;
-    LPCSTR      lpszMenuName;
-    LPCSTR      lpszClassName;
-    /* Win 4.0 */
-    HICON       hIconSm;
-} WNDCLASSEXA, *PWNDCLASSEXA, *NPWNDCLASSEXA, *LPWNDCLASSEXA;
-typedef struct tagWNDCLASSEXW {
-    UINT        cbSize;
-    /* Win 3.x */
-    UINT        style;
-    WNDPROC     lpfnWndProc;
-    int         cbClsExtra;
-    int         cbWndExtra;
-    HINSTANCE   hInstance;
-    HICON       hIcon;
-    HCURSOR     hCursor;
-    HBRUSH      hbrBackground;
-    LPCWSTR     lpszMenuName;
-    LPCWSTR     lpszClassName;
-    /* Win 4.0 */
-    HICON       hIconSm;
-} WNDCLASSEXW, *PWNDCLASSEXW, *NPWNDCLASSEXW, *LPWNDCLASSEXW;
-typedef struct tagMSG {
-    HWND        hwnd;
-    UINT        message;
-    WPARAM      wParam;
-    LPARAM      lParam;
-    DWORD       time;
-    POINT       pt;
-} MSG, *PMSG, *NPMSG, *LPMSG;
-typedef struct tagRECT
+    job_worker          *Workers;
+    u32                 WorkerCount;
+    std::atomic<b32>    Running;
+    std::atomic<s32>    Sleeping;
+    HANDLE              Wake;
+};
+
+// Half open, unused axes are [0, 1)
+struct job_range
 {
-    LONG    left;
-    LONG    top;
-    LONG    right;
-    LONG    bottom;
-} RECT, *PRECT, *NPRECT, *LPRECT;
-typedef struct tagPAINTSTRUCT {
-    HDC         hdc;
-    BOOL        fErase;
-    RECT        rcPaint;
-    BOOL        fRestore;
-    BOOL        fIncUpdate;
-    BYTE        rgbReserved[32];
-} PAINTSTRUCT, *PPAINTSTRUCT, *NPPAINTSTRUCT, *LPPAINTSTRUCT;
+    v3i     Min,
+            Max;
+};
 
-// Class
-WINUSERAPI ATOM WINAPI      RegisterClassA(CONST WNDCLASSA *lpWndClass);
-WINUSERAPI ATOM WINAPI      RegisterClassW(CONST WNDCLASSW *lpWndClass);
-WINUSERAPI ATOM WINAPI      RegisterClassExA(CONST WNDCLASSEXA *);
-WINUSERAPI ATOM WINAPI      RegisterClassExW(CONST WNDCLASSEXW *);
-// Window
-WINUSERAPI HWND WINAPI      CreateWindowExA(DWORD dwExStyle, LPCSTR lpClassName, LPCSTR lpWindowName, DWORD dwStyle, int X, int Y, int nWidth, int nHeight, HWND hWndParent, HMENU hMenu, HINSTANCE hInstance, LPVOID lpParam);
-WINUSERAPI HWND WINAPI      CreateWindowExW(DWORD dwExStyle, LPCWSTR lpClassName, LPCWSTR lpWindowName, DWORD dwStyle, int X, int Y, int nWidth, int nHeight, HWND hWndParent, HMENU hMenu, HINSTANCE hInstance, LPVOID lpParam);
-WINUSERAPI BOOL WINAPI      DestroyWindow(HWND hWnd);
-WINUSERAPI BOOL WINAPI      ShowWindow(HWND hWnd, int nCmdShow);
-WINUSERAPI BOOL WINAPI      UpdateWindow(HWND hWnd);
-WINUSERAPI BOOL WINAPI      GetClientRect(HWND hWnd, LPRECT lpRect);
-WINUSERAPI BOOL WINAPI      GetWindowRect( HWND hWnd, LPRECT lpRect);
-WINUSERAPI BOOL WINAPI      AdjustWindowRect(LPRECT lpRect, DWORD dwStyle, BOOL bMenu);
-WINUSERAPI BOOL WINAPI      AdjustWindowRectEx(LPRECT lpRect, DWORD dwStyle, BOOL bMenu, DWORD dwExStyle);
-WINUSERAPI int WINAPI       MessageBoxA(HWND hWnd, LPCSTR lpText, LPCSTR lpCaption, UINT uType);
-WINUSERAPI int WINAPI       MessageBoxW(HWND hWnd, LPCWSTR lpText, LPCWSTR lpCaption, UINT uType);
-WINUSERAPI BOOL WINAPI      SetWindowTextA(HWND hWnd, LPCSTR lpString);
-WINUSERAPI BOOL WINAPI      SetWindowTextW(HWND hWnd, LPCWSTR lpString);
-WINUSERAPI LONG_PTR WINAPI  SetWindowLongPtrA(HWND hWnd, int nIndex, LONG_PTR dwNewLong);
-WINUSERAPI LONG_PTR WINAPI  SetWindowLongPtrW(HWND hWnd, int nIndex, LONG_PTR dwNewLong);
-WINUSERAPI LONG_PTR WINAPI	GetWindowLongPtrA(HWND hWnd, int nIndex);
-WINUSERAPI LONG_PTR WINAPI	GetWindowLongPtrW(HWND hWnd, int nIndex);
+typedef void parallel_for_func(void *Data, job_range Range);
+
+void    InitJobSystem(job_system *Jobs, u32 ThreadCount);
+void    ShutdownJobSystem(job_system *Jobs);
+void    LeaveJobSystem(void);
+void    EnterJobSystem(job_system *Jobs);
+u32     JobThreadCount(void);
+job     *CreateJob(job_func *Func, void const *Data, u32 DataSize);
+job     *CreateChildJob(job *Parent, job_func *Func, void const *Data, u32 DataSize);
+void    AddJobDependency(job *Job, job *Before);
+void    SubmitJob(job *Job);
+void    WaitForJob(job *Job);
+void    ParallelFor(u32 Count, u32 Grain, parallel_for_func *Func, void *Data);
+void    ParallelFor2D(u32 Width, u32 Height, u32 GrainX, u32 GrainY, parallel_for_func *Func, void *Data);
+void    ParallelFor3D(v3i Dims, v3i Grain, parallel_for_func *Func, void *Data);
+
+// The same with anything callable as Func(job_range), usually a lambda
+template <typename func>
+void
+ParallelForThunk(void *Data,
+                 job_range Range)
+{
+    (*(func *)Data)(Range);
+}
 
-// Message
-WINUSERAPI BOOL WINAPI      PeekMessageA(LPMSG lpMsg, HWND hWnd, UINT wMsgFilterMin, UINT wMsgFilterMax, UINT wRemoveMsg);
-WINUSERAPI BOOL WINAPI      PeekMessageW(LPMSG lpMsg, HWND hWnd, UINT wMsgFilterMin, UINT wMsgFilterMax, UINT wRemoveMsg);
-WINUSERAPI BOOL WINAPI      TranslateMessage(CONST MSG *lpMsg);
-WINUSERAPI LRESULT WINAPI   DispatchMessageA(CONST MSG *lpMsg);
-WINUSERAPI LRESULT WINAPI   DispatchMessageW(CONST MSG *lpMsg);
-WINUSERAPI BOOL WINAPI      GetMessageA(LPMSG lpMsg, HWND hWnd, UINT wMsgFilterMin, UINT wMsgFilterMax);
-WINUSERAPI BOOL WINAPI      GetMessageW(LPMSG lpMsg, HWND hWnd, UINT wMsgFilterMin, UINT wMsgFilterMax);
-WINUSERAPI LRESULT WINAPI   DefWindowProcA(HWND hWnd, UINT Msg, WPARAM wParam, LPARAM lParam);
-WINUSERAPI LRESULT WINAPI   DefWindowProcW(HWND hWnd, UINT Msg, WPARAM wParam, LPARAM lParam);
-WINUSERAPI VOID WINAPI      PostQuitMessage(int nExitCode);
-WINUSERAPI BOOL WINAPI      PostMessageA(HWND hWnd, UINT Msg, WPARAM wParam, LPARAM lParam);
-WINUSERAPI BOOL WINAPI      PostMessageW(HWND hWnd, UINT Msg, WPARAM wParam, LPARAM lParam);
-// DC / Paint
+template <typename func>
+void
+ParallelFor(u32 Count,
+            u32 Grain,
+            func const &Func)
+{
+    ParallelFor(Count, Grain, ParallelForThunk<func>, (void *)&Func);
+}
 
-WINUSERAPI HDC WINAPI       GetDC(HWND hWnd);
-WINUSERAPI HDC WINAPI       GetWindowDC(HWND hWnd);
-WINUSERAPI int WINAPI       ReleaseDC(HWND hWnd, HDC hDC);
-WINUSERAPI HDC WINAPI       BeginPaint(HWND hWnd, LPPAINTSTRUCT lpPaint);
-WINUSERAPI BOOL WINAPI      EndPaint(HWND hWnd, CONST PAINTSTRUCT *lpPaint);
+template <typename func>
+void
+ParallelFor2D(u32 Width,
+              u32 Height,
+              u32 GrainX,
+              u32 GrainY,
+              func const &Func)
+{
+    ParallelFor2D(Width, Height, GrainX, GrainY, ParallelForThunk<func>, (void *)&Func);
+}
 
-#ifdef UNICODE
-    typedef WNDCLASSW           WNDCLASS;
-    typedef PWNDCLASSW          PWNDCLASS;
-    typedef NPWNDCLASSW         NPWNDCLASS;
-    typedef LPWNDCLASSW         LPWNDCLASS;
-    typedef WNDCLASSEXW         WNDCLASSEX;
-    typedef PWNDCLASSEXW        PWNDCLASSEX;
-    typedef NPWNDCLASSEXW       NPWNDCLASSEX;
-    typedef LPWNDCLASSEXW       LPWNDCLASSEX;
-    #define RegisterClass       RegisterClassW
-    #define RegisterClassEx     RegisterClassExW
-    #define CreateWindowEx      CreateWindowExW
-    #define PeekMessage         PeekMessageW
-    #define MessageBox          MessageBoxW
-    #define DispatchMessage     DispatchMessageW
-    #define GetMessage          GetMessageExW
-    #define DefWindowProc       DefWindowProcW
-    #define PostMessage         PostMessageW
-    #define SetWindowText       SetWindowTextW
-    #define SetWindowLongPtr    SetWindowLongPtrW
-    #define GetWindowLongPtr    GetWindowLongPtrW
-#else
-    typedef WNDCLASSA           WNDCLASS;
-    typedef PWNDCLASSA          PWNDCLASS;
-    typedef NPWNDCLASSA         NPWNDCLASS;
-    typedef LPWNDCLASSA         LPWNDCLASS;
-    typedef WNDCLASSEXA         WNDCLASSEX;
-    typedef PWNDCLASSEXA        PWNDCLASSEX;
-    typedef NPWNDCLASSEXA       NPWNDCLASSEX;
-    typedef LPWNDCLASSEXA       LPWNDCLASSEX;
-    #define RegisterClass       RegisterClassA
-    #define RegisterClassEx     RegisterClassExA
-    #define CreateWindowEx      CreateWindowExA
-    #define PeekMessage         PeekMessageA
-    #define MessageBox          MessageBoxA
-    #define DispatchMessage     DispatchMessageA
-    #define GetMessage          GetMessageExA
-    #define DefWindowProc       DefWindowProcA
-    #define PostMessage         PostMessageA
-    #define SetWindowText       SetWindowTextA
-    #define SetWindowLongPtr    SetWindowLongPtrA
-    #define GetWindowLongPtr    GetWindowLongPtrA
-#endif // UNICODE
+template <typename func>
+void
+ParallelFor3D(v3i Dims,
+              v3i Grain,
+              func const &Func)
+{
+    ParallelFor3D(Dims, Grain, ParallelForThunk<func>, (void *)&Func);
+}
+
+#ifdef MG_IMPL
+
+static thread_local job_worker  *gJobWorker = NULL;
+
+struct parallel_for_job
+{
+    parallel_for_func   *Func;
+    void                *Data;
+    job_range           Range;
+    v3i                 Grain;
+};
+
+inline void
+JobPause(void)
+{
+#if defined(MG_USE_SSE)
+    _mm_pause();
+#endif
+}
 
-/////////////////////////////////////////////////////////////////////////////
-// wingdi.h
-//////////////////////////////////////////////////////////////////////////////
+// xorshift, only picks victims
+inline u32
+JobRandom(job_worker *Worker)
+{
+    u32     X = Worker->Seed;
 
-#define BI_RGB        0L
-#define BI_RLE8       1L
-#define BI_RLE4       2L
-#define BI_BITFIELDS  3L
-#define BI_JPEG       4L
-#define BI_PNG        5L
-#define DIB_RGB_COLORS      0 /* color table in RGBs */
-#define SRCCOPY             (DWORD)0x00CC0020 /* dest = source                   */
-#define SRCPAINT            (DWORD)0x00EE0086 /* dest = source OR dest           */
-#define SRCAND              (DWORD)0x008800C6 /* dest = source AND dest          */
-#define SRCINVERT           (DWORD)0x00660046 /* dest = source XOR dest          */
-#define SRCERASE            (DWORD)0x00440328 /* dest = source AND (NOT dest )   */
-#define NOTSRCCOPY          (DWORD)0x00330008 /* dest = (NOT source)             */
-#define NOTSRCERASE         (DWORD)0x001100A6 /* dest = (NOT src) AND (NOT dest) */
-#define MERGECOPY           (DWORD)0x00C000CA /* dest = (source AND pattern)     */
-#define MERGEPAINT          (DWORD)0x00BB0226 /* dest = (NOT source) OR dest     */
-#define PATCOPY             (DWORD)0x00F00021 /* dest = pattern                  */
-#define PATPAINT            (DWORD)0x00FB0A09 /* dest = DPSnoo                   */
-#define PATINVERT           (DWORD)0x005A0049 /* dest = pattern XOR dest         */
-#define DSTINVERT           (DWORD)0x00550009 /* dest = (NOT dest)               */
-#define BLACKNESS           (DWORD)0x00000042 /* dest = BLACK                    */
-#define WHITENESS           (DWORD)0x00FF0062 /* dest = WHITE                    */
 
-typedef struct tagBITMAPCOREHEADER {
-        DWORD   bcSize;                 /* used to get to color table */
-        WORD    bcWidth;
-        WORD    bcHeight;
-        WORD    bcPlanes;
-        WORD    bcBitCount;
-} BITMAPCOREHEADER, *LPBITMAPCOREHEADER, *PBITMAPCOREHEADER;
-typedef struct tagBITMAPINFOHEADER{
-        DWORD      biSize;
-        LONG       biWidth;
-        LONG       biHeight;
-        WORD       biPlanes;
-        WORD       biBitCount;
-        DWORD      biCompression;
-        DWORD      biSizeImage;
-        LONG       biXPelsPerMeter;
-        LONG       biYPelsPerMeter;
-        DWORD      biClrUsed;
-        DWORD      biClrImportant;
-} BITMAPINFOHEADER, *LPBITMAPINFOHEADER, *PBITMAPINFOHEADER;
-typedef struct tagRGBQUAD {
-        BYTE    rgbBlue;
-        BYTE    rgbGreen;
-        BYTE    rgbRed;
-        BYTE    rgbReserved;
-} RGBQUAD;
-typedef struct tagBITMAPINFO {
-    BITMAPINFOHEADER    bmiHeader;
-    RGBQUAD             bmiColors[1];
-} BITMAPINFO, *LPBITMAPINFO, *PBITMAPINFO;
+    X ^= X << 13;
+    X ^= X >> 17;
+    X ^= X << 5;
+    Worker->Seed = X;
 
-WINGDIAPI int WINAPI    StretchDIBits(HDC hdc, int xDest, int yDest, int DestWidth, int DestHeight, int xSrc, int ySrc, int SrcWidth, int SrcHeight, CONST VOID *lpBits, CONST BITMAPINFO *lpbmi, UINT iUsage, DWORD rop);
+    return (X);
+}
 
-//////////////////////////////////////////////////////////////////////////////
-// memoryapi.h
-//////////////////////////////////////////////////////////////////////////////
+// Owner only. A full deque runs the job here instead, its dependencies are
+// done so that's always allowed.
+b32
+PushJob(job_worker *Worker,
+        job *Job)
+{
+    s64     Bottom = Worker->Bottom.load(std::memory_order_relaxed),
+            Top = Worker->Top.load(std::memory_order_acquire);
 
-typedef struct _MEMORY_BASIC_INFORMATION {
-    PVOID BaseAddress;
-    PVOID AllocationBase;
-    DWORD AllocationProtect;
-    SIZE_T RegionSize;
-    DWORD State;
-    DWORD Protect;
-    DWORD Type;
-} MEMORY_BASIC_INFORMATION, *PMEMORY_BASIC_INFORMATION;
 
-// Virtual
-WINBASEAPI LPVOID WINAPI    VirtualAlloc(LPVOID lpAddress, SIZE_T dwSize, DWORD flAllocationType, DWORD flProtect);
-WINBASEAPI BOOL WINAPI      VirtualFree(LPVOID lpAddress, SIZE_T dwSize, DWORD dwFreeType);
-WINBASEAPI BOOL WINAPI      VirtualProtect(LPVOID lpAddress, SIZE_T dwSize, DWORD flNewProtect, PDWORD lpflOldProtect);
-WINBASEAPI SIZE_T WINAPI    VirtualQuery(LPCVOID lpAddress, PMEMORY_BASIC_INFORMATION lpBuffer, SIZE_T dwLength);
-WINBASEAPI LPVOID WINAPI    VirtualAllocEx(HANDLE hProcess, LPVOID lpAddress, SIZE_T dwSize, DWORD flAllocationType, DWORD flProtect);
-WINBASEAPI BOOL WINAPI      VirtualFreeEx(HANDLE hProcess, LPVOID lpAddress, SIZE_T dwSize, DWORD dwFreeType);
-WINBASEAPI BOOL WINAPI      VirtualProtectEx(HANDLE hProcess, LPVOID lpAddress, SIZE_T dwSize, DWORD flNewProtect, PDWORD lpflOldProtect);
-WINBASEAPI SIZE_T WINAPI    VirtualQueryEx(HANDLE hProcess, LPCVOID lpAddress, PMEMORY_BASIC_INFORMATION lpBuffer, SIZE_T dwLength);
-WINBASEAPI BOOL WINAPI      VirtualLock(LPVOID lpAddress, SIZE_T dwSize);
-WINBASEAPI BOOL WINAPI      VirtualUnlock(LPVOID lpAddress, SIZE_T dwSize);
-// Filemap
-WINBASEAPI HANDLE WINAPI    CreateFileMappingW(HANDLE hFile, LPSECURITY_ATTRIBUTES lpFileMappingAttributes, DWORD flProtect, DWORD dwMaximumSizeHigh, DWORD dwMaximumSizeLow, LPCWSTR lpName);
-WINBASEAPI LPVOID WINAPI    MapViewOfFile(HANDLE hFileMappingObject, DWORD dwDesiredAccess, DWORD dwFileOffsetHigh, DWORD dwFileOffsetLow, SIZE_T dwNumberOfBytesToMap);
-WINBASEAPI LPVOID WINAPI    MapViewOfFileEx(HANDLE hFileMappingObject, DWORD dwDesiredAccess, DWORD dwFileOffsetHigh, DWORD dwFileOffsetLow, SIZE_T dwNumberOfBytesToMap, LPVOID lpBaseAddress);
-WINBASEAPI BOOL WINAPI      FlushViewOfFile(LPCVOID lpBaseAddress, SIZE_T dwNumberOfBytesToFlush);
-WINBASEAPI BOOL WINAPI      UnmapViewOfFile(LPCVOID lpBaseAddress);
-// Memory
-WINBASEAPI BOOL WINAPI      ReadProcessMemory(HANDLE hProcess, LPCVOID lpBaseAddress, LPVOID lpBuffer, SIZE_T nSize, SIZE_T *lpNumberOfBytesRead);
-WINBASEAPI BOOL WINAPI      WriteProcessMemory(HANDLE hProcess, LPVOID lpBaseAddress, LPCVOID lpBuffer, SIZE_T nSize, SIZE_T *lpNumberOfBytesWritten);
+    if (Bottom - Top >= JOB_POOL_SIZE)
+    {
+        return (FALSE);
+    }
 
-//////////////////////////////////////////////////////////////////////////////
-// processthreadsapi.h
-//////////////////////////////////////////////////////////////////////////////
+    Worker->Queue[Bottom & (JOB_POOL_SIZE - 1)].store(Job, std::memory_order_relaxed);
+    Worker->Bottom.store(Bottom + 1, std::memory_order_release);
 
-typedef DWORD (WINAPI *PTHREAD_START_ROUTINE)(LPVOID lpThreadParameter);
-typedef PTHREAD_START_ROUTINE LPTHREAD_START_ROUTINE;
+    return (TRUE);
+}
 
-typedef struct _PROCESS_INFORMATION {
-    HANDLE hProcess;
-    HANDLE hThread;
-    DWORD dwProcessId;
-    DWORD dwThreadId;
-} PROCESS_INFORMATION, *PPROCESS_INFORMATION, *LPPROCESS_INFORMATION;
-typedef struct _STARTUPINFOA {
-    DWORD   cb;
-    LPSTR   lpReserved;
-    LPSTR   lpDesktop;
-    LPSTR   lpTitle;
-    DWORD   dwX;
-    DWORD   dwY;
-    DWORD   dwXSize;
-    DWORD   dwYSize;
-    DWORD   dwXCountChars;
-    DWORD   dwYCountChars;
-    DWORD   dwFillAttribute;
-    DWORD   dwFlags;
-    WORD    wShowWindow;
-    WORD    cbReserved2;
-    LPBYTE  lpReserved2;
-    HANDLE  hStdInput;
-    HANDLE  hStdOutput;
-    HANDLE  hStdError;
-} STARTUPINFOA, *LPSTARTUPINFOA;
-typedef struct _STARTUPINFOW {
-    DWORD   cb;
-    LPWSTR  lpReserved;
-    LPWSTR  lpDesktop;
-    LPWSTR  lpTitle;
-    DWORD   dwX;
-    DWORD   dwY;
-    DWORD   dwXSize;
-    DWORD   dwYSize;
-    DWORD   dwXCountChars;
-    DWORD   dwYCountChars;
-    DWORD   dwFillAttribute;
-    DWORD   dwFlags;
-    WORD    wShowWindow;
-    WORD    cbReserved2;
-    LPBYTE  lpReserved2;
-    HANDLE  hStdInput;
-    HANDLE  hStdOutput;
-    HANDLE  hStdError;
-} STARTUPINFOW, *LPSTARTUPINFOW;
-typedef struct _PROC_THREAD_ATTRIBUTE_LIST *PPROC_THREAD_ATTRIBUTE_LIST, *LPPROC_THREAD_ATTRIBUTE_LIST;
+// Owner only
+job *
+PopJob(job_worker *Worker)
+{
+    s64     Bottom = Worker->Bottom.load(std::memory_order_relaxed) - 1,
+            Top;
+    job     *Job = NULL;
 
-// Processes
-WINBASEAPI HANDLE WINAPI                    GetCurrentProcess(VOID);
-WINBASEAPI DWORD WINAPI                     GetCurrentProcessId(VOID);
-WINBASEAPI DECLSPEC_NORETURN VOID WINAPI    ExitProcess(UINT uExitCode);
-WINBASEAPI BOOL WINAPI                      TerminateProcess(HANDLE hProcess, UINT uExitCode);
-WINBASEAPI BOOL WINAPI                      GetExitCodeProcess(HANDLE hProcess, LPDWORD lpExitCode);
-WINBASEAPI BOOL WINAPI                      CreateProcessA(LPCSTR lpApplicationName, LPSTR lpCommandLine, LPSECURITY_ATTRIBUTES lpProcessAttributes, LPSECURITY_ATTRIBUTES lpThreadAttributes, BOOL bInheritHandles, DWORD dwCreationFlags, LPVOID lpEnvironment, LPCSTR lpCurrentDirectory, LPSTARTUPINFOA lpStartupInfo, LPPROCESS_INFORMATION lpProcessInformation);
-WINBASEAPI BOOL WINAPI                      CreateProcessW(LPCWSTR lpApplicationName, LPWSTR lpCommandLine, LPSECURITY_ATTRIBUTES lpProcessAttributes, LPSECURITY_ATTRIBUTES lpThreadAttributes, BOOL bInheritHandles, DWORD dwCreationFlags, LPVOID lpEnvironment, LPCWSTR lpCurrentDirectory, LPSTARTUPINFOW lpStartupInfo, LPPROCESS_INFORMATION lpProcessInformation);
-WINBASEAPI DWORD WINAPI                     GetProcessId(HANDLE Process);
-// TLS
-WINBASEAPI DWORD WINAPI                     TlsAlloc(VOID);
-WINBASEAPI LPVOID WINAPI                    TlsGetValue(DWORD dwTlsIndex);
-WINBASEAPI BOOL WINAPI                      TlsSetValue(DWORD dwTlsIndex, LPVOID lpTlsValue);
-WINBASEAPI BOOL WINAPI                      TlsFree(DWORD dwTlsIndex);
-// Threads
-WINBASEAPI HANDLE WINAPI                    CreateThread(LPSECURITY_ATTRIBUTES lpThreadAttributes, SIZE_T dwStackSize, LPTHREAD_START_ROUTINE lpStartAddress, LPVOID lpParameter, DWORD dwCreationFlags, LPDWORD lpThreadId);
-WINBASEAPI HANDLE WINAPI                    CreateRemoteThread(HANDLE hProcess, LPSECURITY_ATTRIBUTES lpThreadAttributes, SIZE_T dwStackSize, LPTHREAD_START_ROUTINE lpStartAddress, LPVOID lpParameter, DWORD dwCreationFlags, LPDWORD lpThreadId);
-WINBASEAPI HANDLE WINAPI                    OpenThread(DWORD dwDesiredAccess, BOOL bInheritHandle, DWORD dwThreadId);
-WINBASEAPI DECLSPEC_NORETURN VOID WINAPI    ExitThread(DWORD dwExitCode);
-WINBASEAPI BOOL WINAPI                      TerminateThread(HANDLE hThread, DWORD dwExitCode);
-WINBASEAPI BOOL WINAPI                      GetExitCodeThread(HANDLE hThread, LPDWORD lpExitCode);
-WINBASEAPI DWORD WINAPI                     SuspendThread(HANDLE hThread);
-WINBASEAPI DWORD WINAPI                     ResumeThread(HANDLE hThread);
-WINBASEAPI DWORD WINAPI                     GetThreadId(HANDLE Thread);
-WINBASEAPI HANDLE WINAPI                    CreateRemoteThreadEx(HANDLE hProcess, LPSECURITY_ATTRIBUTES lpThreadAttributes, SIZE_T dwStackSize, LPTHREAD_START_ROUTINE lpStartAddress, LPVOID lpParameter, DWORD dwCreationFlags, LPPROC_THREAD_ATTRIBUTE_LIST lpAttributeList, LPDWORD lpThreadId);
 
-//////////////////////////////////////////////////////////////////////////////
-// libloaderapi.h
-//////////////////////////////////////////////////////////////////////////////
+    Worker->Bottom.store(Bottom, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    Top = Worker->Top.load(std::memory_order_relaxed);
 
-WINBASEAPI FARPROC WINAPI   GetProcAddress(HMODULE hModule, LPCSTR lpProcName);
-WINBASEAPI HMODULE WINAPI   LoadLibraryExA(LPCSTR lpLibFileName, HANDLE hFile, DWORD dwFlags);
-WINBASEAPI HMODULE WINAPI   LoadLibraryExW(LPCWSTR lpLibFileName, HANDLE hFile, DWORD dwFlags);
-WINBASEAPI BOOL WINAPI      FreeLibrary(HMODULE hLibModule);
-WINBASEAPI HMODULE WINAPI   GetModuleHandleA(LPCSTR lpModuleName);
-WINBASEAPI HMODULE WINAPI   GetModuleHandleW(LPCWSTR lpModuleName);
-WINBASEAPI BOOL WINAPI      GetModuleHandleExA(DWORD dwFlags, LPCSTR lpModuleName, HMODULE *phModule);
-WINBASEAPI BOOL WINAPI      GetModuleHandleExW(DWORD dwFlags, LPCWSTR lpModuleName, HMODULE *phModule);
+    if (Top <= Bottom)
+    {
+        Job = Worker->Queue[Bottom & (JOB_POOL_SIZE - 1)].load(std::memory_order_relaxed);
 
-#ifndef UNICODE
-    #define LoadLibraryEx       LoadLibraryExW
-    #define GetModuleHandle     GetModuleHandleW
-    #define GetModuleHandleEx   GetModuleHandleExW
-#else
-    #define LoadLibraryEx       LoadLibraryExA
-    #define GetModuleHandle     GetModuleHandleA
-    #define GetModuleHandleEx   GetModuleHandleExA
-#endif // UNICODE
+        // Last one, race the thieves for it
+        if (Top == Bottom)
+        {
+            if (!Worker->Top.compare_exchange_strong(Top, Top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            {
+                Job = NULL;
+            }
+            Worker->Bottom.store(Bottom + 1, std::memory_order_relaxed);
+        }
+    }
+    else
+    {
+        Worker->Bottom.store(Bottom + 1, std::memory_order_relaxed);
+    }
 
-//////////////////////////////////////////////////////////////////////////////
-// WinBase.h
-//////////////////////////////////////////////////////////////////////////////
+    return (Job);
+}
 
-#define STD_INPUT_HANDLE    ((DWORD)-10)
-#define STD_OUTPUT_HANDLE   ((DWORD)-11)
-#define STD_ERROR_HANDLE    ((DWORD)-12)
+// Any thread
+job *
+StealJob(job_worker *Worker)
+{
+    s64     Top = Worker->Top.load(std::memory_order_acquire),
+            Bottom;
+    job     *Job = NULL;
 
-#define IGNORE              0       // Ignore signal
-#define INFINITE            0xFFFFFFFF  // Infinite timeout
 
-#define FILE_BEGIN           0
-#define FILE_CURRENT         1
-#define FILE_END             2
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    Bottom = Worker->Bottom.load(std::memory_order_acquire);
 
-WINBASEAPI HANDLE WINAPI    CreateFileMappingA(HANDLE hFile, LPSECURITY_ATTRIBUTES lpFileMappingAttributes, DWORD flProtect, DWORD dwMaximumSizeHigh, DWORD dwMaximumSizeLow, LPCSTR lpName);
-WINBASEAPI HMODULE WINAPI   LoadLibraryA(LPCSTR lpLibFileName);
-WINBASEAPI HMODULE WINAPI   LoadLibraryW(LPCWSTR lpLibFileName);
-WINBASEAPI DWORD WINAPI     WaitForMultipleObjects(DWORD nCount, CONST HANDLE *lpHandles, BOOL bWaitAll, DWORD dwMilliseconds);
-WINBASEAPI HANDLE WINAPI    OpenFileMappingA(DWORD dwDesiredAccess, BOOL bInheritHandle, LPCSTR lpName);
-WINBASEAPI HANDLE WINAPI    OpenFileMappingW(DWORD dwDesiredAccess, BOOL bInheritHandle, LPCWSTR lpName);
-WINBASEAPI HANDLE WINAPI    CreateSemaphoreA(LPSECURITY_ATTRIBUTES lpSemaphoreAttributes, LONG lInitialCount, LONG lMaximumCount, LPCSTR lpName);
-WINBASEAPI HANDLE WINAPI    CreateSemaphoreW(LPSECURITY_ATTRIBUTES lpSemaphoreAttributes, LONG lInitialCount, LONG lMaximumCount, LPCWSTR lpName);
-WINBASEAPI HANDLE WINAPI    CreateSemaphoreExA(LPSECURITY_ATTRIBUTES lpSemaphoreAttributes, LONG lInitialCount, LONG lMaximumCount, LPCSTR lpName, DWORD dwFlags, DWORD dwDesiredAccess);
+    if (Top < Bottom)
+    {
+        Job = Worker->Queue[Top & (JOB_POOL_SIZE - 1)].load(std::memory_order_relaxed);
+        if (!Worker->Top.compare_exchange_strong(Top, Top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        {
+            Job = NULL;
+        }
+    }
 
-#ifdef UNICODE
-    #define CreateFileMapping   CreateFileMappingW
-    #define LoadLibrary         LoadLibraryW
-    #define OpenFileMapping     OpenFileMappingW
-    #define CreateSemaphore     CreateSemaphoreW
-#else
-    #define CreateFileMapping   CreateFileMappingA
-    #define LoadLibrary         LoadLibraryA
-    #define OpenFileMapping     OpenFileMappingA
-    #define CreateSemaphore     CreateSemaphoreA
-    #define CreateSemaphoreEx   CreateSemaphoreExA
-#endif // UNICODE
+    return (Job);
+}
+
+job *
+GetJob(job_worker *Worker)
+{
+    job_system  *System = Worker->System;
+    job         *Job = PopJob(Worker);
+
+
+    if (!Job && System->WorkerCount > 1)
+    {
+        u32 First = JobRandom(Worker) % System->WorkerCount;
+
+        for (u32 I = 0; I < System->WorkerCount && !Job; I++)
+        {
+            job_worker *Victim = &System->Workers[(First + I) % System->WorkerCount];
+
+            if (Victim != Worker)
+            {
+                Job = StealJob(Victim);
+            }
+        }
+    }
 
-//////////////////////////////////////////////////////////////////////////////
-// syncapi.h
-//////////////////////////////////////////////////////////////////////////////
+    return (Job);
+}
 
-typedef struct _LIST_ENTRY {
-   struct _LIST_ENTRY *Flink;
-   struct _LIST_ENTRY *Blink;
-} LIST_ENTRY, *PLIST_ENTRY, *PRLIST_ENTRY;
-typedef struct _RTL_CRITICAL_SECTION_DEBUG {
-    WORD   Type;
-    WORD   CreatorBackTraceIndex;
-    struct _RTL_CRITICAL_SECTION *CriticalSection;
-    LIST_ENTRY ProcessLocksList;
-    DWORD EntryCount;
-    DWORD ContentionCount;
-    DWORD Flags;
-    WORD   CreatorBackTraceIndexHigh;
-    WORD   SpareWORD  ;
-} RTL_CRITICAL_SECTION_DEBUG, *PRTL_CRITICAL_SECTION_DEBUG, RTL_RESOURCE_DEBUG, *PRTL_RESOURCE_DEBUG;
-typedef struct _RTL_CRITICAL_SECTION {
-    PRTL_CRITICAL_SECTION_DEBUG DebugInfo;
+void    ExecuteJob(job_worker *Worker, job *Job);
 
-    //
-    //  The following three fields control entering and exiting the critical
-    //  section for the resource
-    //
+// Queues a job whose dependencies are all done, waking a sleeper if there
+// is one
+void
+ReadyJob(job_worker *Worker,
+         job *Job)
+{
+    job_system  *System = Worker->System;
 
-    LONG LockCount;
-    LONG RecursionCount;
-    HANDLE OwningThread;        // from the thread's ClientId->UniqueThread
-    HANDLE LockSemaphore;
-    ULONG_PTR SpinCount;        // force size on 64-bit systems when packed
-} RTL_CRITICAL_SECTION, *PRTL_CRITICAL_SECTION;
-typedef RTL_CRITICAL_SECTION CRITICAL_SECTION, *LPCRITICAL_SECTION;
 
-// Mutexes
-WINBASEAPI HANDLE WINAPI    CreateMutexA(LPSECURITY_ATTRIBUTES lpMutexAttributes, BOOL bInitialOwner, LPCSTR lpName);
-WINBASEAPI HANDLE WINAPI    CreateMutexW(LPSECURITY_ATTRIBUTES lpMutexAttributes, BOOL bInitialOwner, LPCWSTR lpName);
-WINBASEAPI HANDLE WINAPI    CreateMutexExA(LPSECURITY_ATTRIBUTES lpMutexAttributes, LPCSTR lpName, DWORD dwFlags, DWORD dwDesiredAccess);
-WINBASEAPI HANDLE WINAPI    CreateMutexExW(LPSECURITY_ATTRIBUTES lpMutexAttributes, LPCWSTR lpName, DWORD dwFlags, DWORD dwDesiredAccess);
-WINBASEAPI BOOL WINAPI      ReleaseMutex(HANDLE hMutex);
-// Semaphores
-WINBASEAPI HANDLE WINAPI    CreateSemaphoreExW(LPSECURITY_ATTRIBUTES lpSemaphoreAttributes, LONG lInitialCount, LONG lMaximumCount, LPCWSTR lpName, DWORD dwFlags, DWORD dwDesiredAccess);
-WINBASEAPI BOOL WINAPI      ReleaseSemaphore(HANDLE hSemaphore, LONG lReleaseCount, LPLONG lpPreviousCount);
-// Events
-WINBASEAPI HANDLE WINAPI    CreateEventA(LPSECURITY_ATTRIBUTES lpEventAttributes, BOOL bManualReset, BOOL bInitialState, LPCSTR lpName);
-WINBASEAPI HANDLE WINAPI    CreateEventW(LPSECURITY_ATTRIBUTES lpEventAttributes, BOOL bManualReset, BOOL bInitialState, LPCWSTR lpName);
-WINBASEAPI HANDLE WINAPI    CreateEventExA(LPSECURITY_ATTRIBUTES lpEventAttributes, LPCSTR lpName, DWORD dwFlags, DWORD dwDesiredAccess);
-WINBASEAPI HANDLE WINAPI    CreateEventExW(LPSECURITY_ATTRIBUTES lpEventAttributes, LPCWSTR lpName, DWORD dwFlags, DWORD dwDesiredAccess);
-WINBASEAPI BOOL WINAPI      SetEvent(HANDLE hEvent);
-WINBASEAPI BOOL WINAPI      ResetEvent(HANDLE hEvent);
-// Critical sections
-WINBASEAPI VOID WINAPI      InitializeCriticalSection(LPCRITICAL_SECTION lpCriticalSection);
-WINBASEAPI VOID WINAPI      EnterCriticalSection(LPCRITICAL_SECTION lpCriticalSection);
-WINBASEAPI VOID WINAPI      LeaveCriticalSection(LPCRITICAL_SECTION lpCriticalSection);
-WINBASEAPI BOOL WINAPI      InitializeCriticalSectionAndSpinCount(LPCRITICAL_SECTION lpCriticalSection, DWORD dwSpinCount);
-WINBASEAPI BOOL WINAPI      InitializeCriticalSectionEx(LPCRITICAL_SECTION lpCriticalSection, DWORD dwSpinCount, DWORD Flags);
-WINBASEAPI DWORD WINAPI     SetCriticalSectionSpinCount(LPCRITICAL_SECTION lpCriticalSection, DWORD dwSpinCount);
-WINBASEAPI BOOL WINAPI      TryEnterCriticalSection(LPCRITICAL_SECTION lpCriticalSection);
-WINBASEAPI VOID WINAPI      DeleteCriticalSection(LPCRITICAL_SECTION lpCriticalSection);
-// Wait / sleep
-WINBASEAPI DWORD WINAPI     WaitForSingleObject(HANDLE hHandle, DWORD dwMilliseconds);
-WINBASEAPI DWORD WINAPI     WaitForSingleObjectEx(HANDLE hHandle, DWORD dwMilliseconds, BOOL bAlertable);
-WINBASEAPI DWORD WINAPI     WaitForMultipleObjectsEx(DWORD nCount, CONST HANDLE *lpHandles, BOOL bWaitAll, DWORD dwMilliseconds, BOOL bAlertable);
-WINBASEAPI DWORD WINAPI     SleepEx(DWORD dwMilliseconds, BOOL bAlertable);
+    if (!PushJob(Worker, Job))
+    {
+        ExecuteJob(Worker, Job);
+        return;
+    }
 
-#ifdef UNICODE
-    #define CreateMutex     CreateMutexW
-    #define CreateMutexEx   CreateMutexExW
-    #define CreateEvent     CreateEventW
-    #define CreateEventEx   CreateEventExW
-#else
-    #define CreateMutex     CreateMutexA
-    #define CreateMutexEx   CreateMutexExA
-    #define CreateEvent     CreateEventA
-    #define CreateEventEx   CreateEventExA
-#endif // UNICODE
+    // Orders the push before the check, a worker going to sleep bumps
+    // Sleeping before its last look at the deques
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (System->Sleeping.load(std::memory_order_relaxed) > 0)
+    {
+        ReleaseSemaphore(System->Wake, 1, NULL);
+    }
+}
 
-//////////////////////////////////////////////////////////////////////////////
-// syncapi.h
-//////////////////////////////////////////////////////////////////////////////
+// Reads everything it needs first, the job can be recycled as soon as
+// Unfinished hits 0
+void
+FinishJob(job_worker *Worker,
+          job *Job)
+{
+    job     *Parent = Job->Parent,
+            *Continuations[JOB_MAX_CONTINUATIONS];
+    u32     ContinuationCount = Job->ContinuationCount;
 
-WINBASEAPI DWORD WINAPI     GetLastError(VOID);
-WINBASEAPI VOID WINAPI      SetLastError(DWORD dwErrCode);
 
-//////////////////////////////////////////////////////////////////////////////
-// processenv.h
-//////////////////////////////////////////////////////////////////////////////
+    for (u32 I = 0; I < ContinuationCount; I++)
+    {
+        Continuations[I] = Job->Continuations[I];
+    }
 
-WINBASEAPI LPSTR WINAPI         GetCommandLineA(VOID);
-WINBASEAPI LPWSTR WINAPI        GetCommandLineW(VOID);
-WINBASEAPI DWORD WINAPI         GetCurrentDirectoryA(DWORD nBufferLength, LPSTR lpBuffer);
-WINBASEAPI DWORD WINAPI         GetCurrentDirectoryW(DWORD nBufferLength, LPWSTR lpBuffer);
-WINBASEAPI HANDLE WINAPI        GetStdHandle(DWORD nStdHandle);
-WINBASEAPI BOOL WINAPI          SetStdHandle(DWORD nStdHandle, HANDLE hHandle);
+    if (Job->Unfinished.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        for (u32 I = 0; I < ContinuationCount; I++)
+        {
+            if (Continuations[I]->Dependencies.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            {
+                ReadyJob(Worker, Continuations[I]);
+            }
+        }
 
-#ifdef UNICODE
-#define GetCommandLine      GetCommandLineW
-#define GetCurrentDirectory GetCurrentDirectoryW
-#else
-#define GetCommandLine      GetCommandLineA
-#define GetCurrentDirectory GetCurrentDirectoryA
-#endif // UNICODE
+        if (Parent)
+        {
+            FinishJob(Worker, Parent);
+        }
+    }
+}
 
-//////////////////////////////////////////////////////////////////////////////
-// sysinfoapi.h
-//////////////////////////////////////////////////////////////////////////////
+void
+ExecuteJob(job_worker *Worker,
+           job *Job)
+{
+    Job->Func(Job, Job->Data);
+    FinishJob(Worker, Job);
+}
 
-typedef struct _SYSTEM_INFO {
-    union {
-        DWORD dwOemId;          // Obsolete field...do not use
-        struct {
-            WORD wProcessorArchitecture;
-            WORD wReserved;
-        } DUMMYSTRUCTNAME;
-    } DUMMYUNIONNAME;
-    DWORD dwPageSize;
-    LPVOID lpMinimumApplicationAddress;
-    LPVOID lpMaximumApplicationAddress;
-    DWORD_PTR dwActiveProcessorMask;
-    DWORD dwNumberOfProcessors;
-    DWORD dwProcessorType;
-    DWORD dwAllocationGranularity;
-    WORD wProcessorLevel;
-    WORD wProcessorRevision;
-} SYSTEM_INFO, *LPSYSTEM_INFO;
+DWORD WINAPI
+JobWorkerThread(LPVOID Param)
+{
+    job_worker  *Worker = (job_worker *)Param;
+    job_system  *System = Worker->System;
+    u32         Idle = 0;
 
-typedef struct _MEMORYSTATUSEX {
-    DWORD dwLength;
-    DWORD dwMemoryLoad;
-    DWORDLONG ullTotalPhys;
-    DWORDLONG ullAvailPhys;
-    DWORDLONG ullTotalPageFile;
-    DWORDLONG ullAvailPageFile;
-    DWORDLONG ullTotalVirtual;
-    DWORDLONG ullAvailVirtual;
-    DWORDLONG ullAvailExtendedVirtual;
-} MEMORYSTATUSEX, *LPMEMORYSTATUSEX;
 
-WINBASEAPI
-BOOL
-WINAPI
-GlobalMemoryStatusEx(
-    _Out_ LPMEMORYSTATUSEX lpBuffer
-    );
+    gJobWorker = Worker;
 
-WINBASEAPI
-VOID
-WINAPI
-GetSystemInfo(
-    _Out_ LPSYSTEM_INFO lpSystemInfo
-    );
+    while (System->Running.load(std::memory_order_acquire))
+    {
+        job *Job = GetJob(Worker);
 
-WINBASEAPI
-VOID
-WINAPI
-GetSystemTime(
-    _Out_ LPSYSTEMTIME lpSystemTime
-    );
+        if (Job)
+        {
+            ExecuteJob(Worker, Job);
+            Idle = 0;
+        }
+        else if (++Idle < JOB_SPIN_COUNT)
+        {
+            JobPause();
+        }
+        else
+        {
+            // One more look after saying we're asleep, a job pushed before
+            // that is seen here and one pushed after releases Wake
+            System->Sleeping.fetch_add(1, std::memory_order_seq_cst);
+            Job = GetJob(Worker);
+            if (Job)
+            {
+                System->Sleeping.fetch_sub(1, std::memory_order_relaxed);
+                ExecuteJob(Worker, Job);
+            }
+            else
+            {
+                WaitForSingleObject(System->Wake, INFINITE);
+                System->Sleeping.fetch_sub(1, std::memory_order_relaxed);
+            }
+            Idle = 0;
+        }
+    }
 
-WINBASEAPI
-VOID
-WINAPI
-GetSystemTimeAsFileTime(
-    _Out_ LPFILETIME lpSystemTimeAsFileTime
-    );
+    gJobWorker = NULL;
+    ReleaseScratchArena();
 
-WINBASEAPI
-VOID
-WINAPI
-GetLocalTime(
-    _Out_ LPSYSTEMTIME lpSystemTime
-    );
+    return (0);
+}
 
-//////////////////////////////////////////////////////////////////////////////
-// profileapi.h
-//////////////////////////////////////////////////////////////////////////////
+// ThreadCount 0 is one per logical processor. The calling thread becomes
+// worker 0.
+void
+InitJobSystem(job_system *Jobs,
+              u32 ThreadCount)
+{
+    WORD        GroupCount = GetActiveProcessorGroupCount();
+    WORD        Group = 0;
+    u32         GroupFirst = 0;
 
-WINBASEAPI
-BOOL
-WINAPI
-QueryPerformanceCounter(
-    _Out_ LARGE_INTEGER* lpPerformanceCount
-    );
 
-WINBASEAPI
-BOOL
-WINAPI
-QueryPerformanceFrequency(
-    _Out_ LARGE_INTEGER* lpFrequency
-    );
+    if (ThreadCount == 0)
+    {
+        ThreadCount = _Max(u32(GetActiveProcessorCount(ALL_PROCESSOR_GROUPS)), 1u);
+    }
 
-//////////////////////////////////////////////////////////////////////////////
-// debugapi.h
-//////////////////////////////////////////////////////////////////////////////
+    Jobs->Workers = new job_worker[ThreadCount];
+    Jobs->WorkerCount = ThreadCount;
+    Jobs->Running.store(TRUE);
+    Jobs->Sleeping.store(0);
+    Jobs->Wake = CreateSemaphoreA(NULL, 0, 0x7FFFFFFF, NULL);
 
-WINBASEAPI
-VOID
-WINAPI
-DebugBreak(
-    VOID
-    );
+    for (u32 I = 0; I < ThreadCount; I++)
+    {
+        job_worker *Worker = &Jobs->Workers[I];
+
+        Worker->Top.store(0);
+        Worker->Bottom.store(0);
+        Worker->Queue = new std::atomic<job *>[JOB_POOL_SIZE];
+        Worker->Pool = new job[JOB_POOL_SIZE];
+        Worker->PoolNext = 0;
+        Worker->Index = I;
+        Worker->Seed = 0x9E3779B9u * (I + 1);
+        Worker->Thread = NULL;
+        Worker->System = Jobs;
+
+        for (u32 J = 0; J < JOB_POOL_SIZE; J++)
+        {
+            Worker->Pool[J].Unfinished.store(0);
+        }
+    }
 
-WINBASEAPI
-VOID
-WINAPI
-OutputDebugStringA(
-    _In_opt_ LPCSTR lpOutputString
-    );
+    gJobWorker = &Jobs->Workers[0];
 
-WINBASEAPI
-VOID
-WINAPI
-OutputDebugStringW(
-    _In_opt_ LPCWSTR lpOutputString
-    );
+    for (u32 I = 1; I < ThreadCount; I++)
+    {
+        job_worker *Worker = &Jobs->Workers[I];
 
-#ifdef UNICODE
-#define OutputDebugString  OutputDebugStringW
-#else
-#define OutputDebugString  OutputDebugStringA
-#endif // !UNICODE
+        Worker->Thread = CreateThread(NULL, 0, JobWorkerThread, Worker, CREATE_SUSPENDED, NULL);
+
+        if (GroupCount > 1)
+        {
+            GROUP_AFFINITY Affinity = {};
+            u32 GroupSize = GetActiveProcessorCount(Group);
+
+            while (I - GroupFirst >= GroupSize && Group + 1 < GroupCount)
+            {
+                GroupFirst += GroupSize;
+                Group++;
+                GroupSize = GetActiveProcessorCount(Group);
+            }
+
+            Affinity.Group = Group;
+            Affinity.Mask = (GroupSize >= 64) ? ~KAFFINITY(0) : (KAFFINITY(1) << GroupSize) - 1;
+            SetThreadGroupAffinity(Worker->Thread, &Affinity, NULL);
+        }
+
+        ResumeThread(Worker->Thread);
+    }
+}
+
+// Every job has to be finished. Wakes the sleepers, joins the workers and
+// frees everything.
+void
+ShutdownJobSystem(job_system *Jobs)
+{
+    Jobs->Running.store(FALSE, std::memory_order_release);
+    ReleaseSemaphore(Jobs->Wake, Jobs->WorkerCount, NULL);
 
-#ifdef __cplusplus
-}
-#endif // __cplusplus
+    // One at a time, WaitForMultipleObjects() stops at 64
+    for (u32 I = 1; I < Jobs->WorkerCount; I++)
+    {
+        WaitForSingleObject(Jobs->Workers[I].Thread, INFINITE);
+        CloseHandle(Jobs->Workers[I].Thread);
+    }
 
-#else
-    #include <windows.h>
-#endif
+    for (u32 I = 0; I < Jobs->WorkerCount; I++)
+    {
+        delete[] Jobs->Workers[I].Queue;
+        delete[] Jobs->Workers[I].Pool;
+    }
 
+    CloseHandle(Jobs->Wake);
+    delete[] Jobs->Workers;
 
+    Jobs->Workers = NULL;
+    Jobs->WorkerCount = 0;
+    gJobWorker = NULL;
+}
 
+// Worker 0 belongs to the thread that called InitJobSystem(), these hand it
+// to another one. The old thread leaves and stops using the system, the new
+// one enters after that, e.g. once it's been created.
+void
+LeaveJobSystem(void)
+{
+    gJobWorker = NULL;
+}
 
+void
+EnterJobSystem(job_system *Jobs)
+{
+    gJobWorker = &Jobs->Workers[0];
+}
 
-//****************************************************************************
-//*** Array *****************************************************************
-//****************************************************************************
+// Threads in the calling thread's job system, 1 outside of one
+u32
+JobThreadCount(void)
+{
+    return (gJobWorker ? gJobWorker->System->WorkerCount : 1);
+}
 
-template <typename type>
-struct array
+// Has to be called from a thread in the job system. Data is copied into the
+// job. Skips jobs that are still in flight, running other jobs if the whole
+// ring is.
+job *
+CreateJob(job_func *Func,
+          void const *Data,
+          u32 DataSize)
 {
-    type        *Data;
-    u32         Size,
-                Capacity;
+    job_worker  *Worker = gJobWorker;
+    job         *Job;
 
 
-    array(void);
-    array(u32 InitialCapacity);
-    ~array(void);
+    for (u32 Tries = 1; ; Tries++)
+    {
+        Job = &Worker->Pool[Worker->PoolNext++ & (JOB_POOL_SIZE - 1)];
 
+        if (Job->Unfinished.load(std::memory_order_acquire) == 0)
+        {
+            break;
+        }
 
-    b32     NeedGrow(u32 Amount);
-    u32     Len(void);
-    u32     ByteSize(void);
-    void    Resize(u32 Amount);
-    void    Push(type Value);
-    void    Clear(void);
-    type    &operator[](u32 Index);
-};
+        if ((Tries % JOB_POOL_SIZE) == 0)
+        {
+            job *Other = GetJob(Worker);
 
-template <typename type>
-array<type>::array(void)
-{
-    this->Capacity = 1;
-    this->Size = 0;
-    this->Data = (type *)HeapAlloc(GetProcessHeap(), 0, sizeof(type));
+            if (Other)
+            {
+                ExecuteJob(Worker, Other);
+            }
+            else
+            {
+                JobPause();
+            }
+        }
+    }
+
+    Job->Func = Func;
+    Job->Parent = NULL;
+    Job->Unfinished.store(1, std::memory_order_relaxed);
+    Job->Dependencies.store(1, std::memory_order_relaxed);
+    Job->ContinuationCount = 0;
+    if (DataSize)
+    {
+        memcpy(Job->Data, Data, _Min(DataSize, u32(JOB_DATA_SIZE)));
+    }
+
+    return (Job);
 }
 
-template <typename type>
-array<type>::array(u32 InitialCapacity)
+// Parent isn't finished until the child is. Call before Parent finishes,
+// i.e. from Parent itself or before it's submitted.
+job *
+CreateChildJob(job *Parent,
+               job_func *Func,
+               void const *Data,
+               u32 DataSize)
 {
-    this->Capacity = InitialCapcity;
-    this->Size = 0;
-    this->Data = (type *)HeapAlloc(GetProcessHeap(), 0, InitialCapacity * sizeof(type));
+    job     *Job = CreateJob(Func, Data, DataSize);
+
+
+    Parent->Unfinished.fetch_add(1, std::memory_order_relaxed);
+    Job->Parent = Parent;
+
+    return (Job);
 }
 
-template <typename type>
-array<type>::~array(void)
+// Job runs after Before has finished. Neither can have been submitted, and
+// Before takes JOB_MAX_CONTINUATIONS at most.
+void
+AddJobDependency(job *Job,
+                 job *Before)
 {
-    HeapFree(GetProcessHeap(), 0, this->Data);
+    if (Before->ContinuationCount < JOB_MAX_CONTINUATIONS)
+    {
+        Before->Continuations[Before->ContinuationCount++] = Job;
+        Job->Dependencies.fetch_add(1, std::memory_order_relaxed);
+    }
 }
 
-template <typename type>
-b32
-array<type>::NeedGrow(u32 Amount)
+void
+SubmitJob(job *Job)
 {
-    return ((this->Data == NULL) || (this->Size + Amount > this->Capacity));
+    if (Job->Dependencies.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        ReadyJob(gJobWorker, Job);
+    }
 }
 
-template <typename type>
-u32
-array<type>::Len(void)
+void
+WaitForJob(job *Job)
 {
-    return (this->Size);
+    job_worker  *Worker = gJobWorker;
+
+
+    while (Job->Unfinished.load(std::memory_order_acquire) > 0)
+    {
+        job *Other = GetJob(Worker);
+
+        if (Other)
+        {
+            ExecuteJob(Worker, Other);
+        }
+        else
+        {
+            JobPause();
+        }
+    }
 }
 
-template <typename type>
-u32
-array<type>::ByteSize(void)
+// Splits off halves until what's left is one grain, then runs it
+void
+ParallelForJob(job *Job,
+               void *Data)
 {
-    return (this->Size * sizeof(type));
+    parallel_for_job    *Work = (parallel_for_job *)Data;
+    job_range           Range = Work->Range;
+
+
+    for (;;)
+    {
+        u32 Axis = 0;
+        s32 Most = 1;
+
+        for (u32 I = 0; I < 3; I++)
+        {
+            s32 Grains = (Range.Max.Elements[I] - Range.Min.Elements[I] + Work->Grain.Elements[I] - 1) / Work->Grain.Elements[I];
+
+            if (Grains > Most)
+            {
+                Most = Grains;
+                Axis = I;
+            }
+        }
+
+        if (Most <= 1)
+        {
+            break;
+        }
+
+        parallel_for_job Half = *Work;
+        s32 Split = Range.Min.Elements[Axis] + (Most / 2) * Work->Grain.Elements[Axis];
+
+        Half.Range = Range;
+        Half.Range.Min.Elements[Axis] = Split;
+        Range.Max.Elements[Axis] = Split;
+
+        SubmitJob(CreateChildJob(Job, ParallelForJob, &Half, sizeof(Half)));
+    }
+
+    Work->Func(Work->Data, Range);
 }
 
-template <typename type>
-void    
-array<type>::Resize(u32 Amount)
+void
+ParallelFor3D(v3i Dims,
+              v3i Grain,
+              parallel_for_func *Func,
+              void *Data)
 {
-    u32     Cap;
+    parallel_for_job    Work;
+    s64                 Pieces = 1;
 
-    if (this->Data)
+
+    if (Dims.x <= 0 || Dims.y <= 0 || Dims.z <= 0)
     {
-        Cap = Amount;
+        return;
     }
-    else
+
+    Work.Func = Func;
+    Work.Data = Data;
+    Work.Range.Min = v3i(0, 0, 0);
+    Work.Range.Max = Dims;
+
+    for (u32 I = 0; I < 3; I++)
     {
-        Cap = 0;
+        Work.Grain.Elements[I] = _Min(_Max(Grain.Elements[I], 1), Dims.Elements[I]);
+        Pieces *= (Dims.Elements[I] + Work.Grain.Elements[I] - 1) / Work.Grain.Elements[I];
     }
 
-    this->Data = (type *)HeapReAlloc(GetProcessHeap(), 0, this->Data, Cap * sizeof(type));
-    if (!this->Data)
+    // Coarser grains on the most split axis until the pieces fit
+    while (Pieces > JOB_MAX_SPLITS)
     {
-        this->Size = 0;
+        u32 Axis = 0;
+        s32 Most = 0;
+
+        for (u32 I = 0; I < 3; I++)
+        {
+            s32 Grains = (Dims.Elements[I] + Work.Grain.Elements[I] - 1) / Work.Grain.Elements[I];
+
+            if (Grains > Most)
+            {
+                Most = Grains;
+                Axis = I;
+            }
+        }
+
+        Pieces /= Most;
+        Work.Grain.Elements[Axis] = _Min(2 * Work.Grain.Elements[Axis], Dims.Elements[Axis]);
+        Pieces *= (Dims.Elements[Axis] + Work.Grain.Elements[Axis] - 1) / Work.Grain.Elements[Axis];
     }
 
-    this->Capacity = Cap;
+    if (!gJobWorker || gJobWorker->System->WorkerCount == 1 || Pieces == 1)
+    {
+        Func(Data, Work.Range);
+        return;
+    }
+
+    job *Root = CreateJob(ParallelForJob, &Work, sizeof(Work));
+
+    SubmitJob(Root);
+    WaitForJob(Root);
+}
+
+void
+ParallelFor2D(u32 Width,
+              u32 Height,
+              u32 GrainX,
+              u32 GrainY,
+              parallel_for_func *Func,
+              void *Data)
+{
+    ParallelFor3D(v3i(s32(Width), s32(Height), 1), v3i(s32(GrainX), s32(GrainY), 1), Func, Data);
+}
+
+void
+ParallelFor(u32 Count,
+            u32 Grain,
+            parallel_for_func *Func,
+            void *Data)
+{
+    ParallelFor3D(v3i(s32(Count), 1, 1), v3i(s32(Grain), 1, 1), Func, Data);
 }
 
+#endif // MG_IMPL
+
+
+
+
+
+//****************************************************************************
+//*** Triple buffer **********************************************************
+//****************************************************************************
+
+// NOTE(matthew): Hands the latest of a stream of values from one thread to
+// another without either waiting. Of the three slots the writer owns one,
+// the reader owns one and the middle one is in between. The writer fills its
+// slot in place and swaps it with the middle, the reader swaps the middle
+// with its own only if a write has happened since. Values the writer gets
+// through faster than the reader looks are skipped.
+
+#define TRIPLE_BUFFER_FRESH     4       // in Middle, set by a write, cleared by a read
+
 template <typename type>
-void    
-array<type>::Push(type Value)
+struct triple_buffer
 {
-    if (!(this->Data) || ((this->Data) && (this->NeedGrow(1))))
+    type                Slots[3];
+    std::atomic<u32>    Middle;         // slot index | TRIPLE_BUFFER_FRESH
+    u32                 Back,           // the writer's
+                        Front;          // the reader's
+};
+
+template <typename type>
+void
+InitTripleBuffer(triple_buffer<type> *Buffer)
+{
+    for (u32 I = 0; I < 3; I++)
     {
-        this->Resize(this->Capacity * 2);
+        Buffer->Slots[I] = type();
     }
 
-    this->Data[this->Size] = Value;
-    this->Size += 1;
+    Buffer->Back = 0;
+    Buffer->Middle.store(1);
+    Buffer->Front = 2;
 }
 
+// Writer only, the slot to fill before PublishTripleBuffer(). It holds
+// whatever was written to it two publishes ago.
 template <typename type>
-void    
-array<type>::Clear(void)
+type *
+TripleBufferBack(triple_buffer<type> *Buffer)
 {
-    this->Size = 0;
+    return (&Buffer->Slots[Buffer->Back]);
 }
 
+// Writer only
 template <typename type>
-type &
-array<type>::operator[](u32 Index)
+void
+PublishTripleBuffer(triple_buffer<type> *Buffer)
 {
-    return (this->Data[Index]);
+    u32 Old = Buffer->Middle.exchange(Buffer->Back | TRIPLE_BUFFER_FRESH, std::memory_order_acq_rel);
+
+    Buffer->Back = Old & 3;
 }
 
+// Reader only, the latest published value. Fresh, if there is one, says
+// whether it's new since the last read. The slot stays the reader's until
+// its next read.
+template <typename type>
+type *
+ReadTripleBuffer(triple_buffer<type> *Buffer,
+                 b32 *Fresh)
+{
+    b32 New = (Buffer->Middle.load(std::memory_order_relaxed) & TRIPLE_BUFFER_FRESH) != 0;
+
+    if (New)
+    {
+        u32 Old = Buffer->Middle.exchange(Buffer->Front, std::memory_order_acq_rel);
 
+        Buffer->Front = Old & 3;
+    }
 
+    if (Fresh)
+    {
+        *Fresh = New;
+    }
 
+    return (&Buffer->Slots[Buffer->Front]);
+}
 
 //****************************************************************************
-//*** Arena *****************************************************************
+//*** Param channel **********************************************************
 //****************************************************************************
 
-struct arena
+// NOTE(matthew): A seqlock for parameter structs. One writer publishes
+// snapshots, any number of readers copy out the latest without a lock and
+// without holding the writer up. A reader that overlaps a write sees
+// Sequence change under it and copies again. The value is kept as relaxed
+// atomic words so the copy a reader throws away still isn't a data race,
+// which means the type has to be plain old data.
+//
+// Every publish that changes the value bumps the version, one that doesn't
+// is free, so a reader can tell its inputs changed without comparing them.
+// The writer compares with ParamsEqual(), which the type has to have, field
+// by field: padding bytes can differ between two copies of the same value.
+
+#define PARAM_CHANNEL_WORDS(type)   ((sizeof(type) + 3) / 4)
+
+template <typename type>
+struct param_channel
 {
-    u8          *Memory;
-    u32         Pos;
-    u32         MemorySize;
-    HANDLE      Heap;
+    std::atomic<u32>    Sequence;       // the version times two, odd during a write
+    std::atomic<u32>    Words[PARAM_CHANNEL_WORDS(type)];
 };
 
-struct arena_frame
+template <typename type>
+void
+InitParamChannel(param_channel<type> *Channel,
+                 type const *Value)
 {
-    arena       *Arena;
-    u32         CurrentPos;
-};
+    u32     Words[PARAM_CHANNEL_WORDS(type)] = {};
 
-b32             CreateArena(arena *Arena, u32 Size);
-b32             DestroyArena(arena *Arena);
-void            *ArenaAlloc(arena *Arena, u32 Size);
-arena_frame     ArenaPushFrame(arena *Arena);
-void            ArenaPopFrame(arena_frame Frame);
 
-#ifdef MG_IMPL
+    memcpy(Words, Value, sizeof(type));
+    for (u32 I = 0; I < PARAM_CHANNEL_WORDS(type); I++)
+    {
+        Channel->Words[I].store(Words[I], std::memory_order_relaxed);
+    }
 
-b32
-CreateArena(arena *Arena,
-            u32 Size)
+    Channel->Sequence.store(0, std::memory_order_release);
+}
+
+// Writer only, returns the version Value is published as
+template <typename type>
+u32
+PublishParamChannel(param_channel<type> *Channel,
+                    type const *Value)
 {
-    Arena->Heap = GetProcessHeap();
+    u32     Words[PARAM_CHANNEL_WORDS(type)] = {};
+    u32     Sequence = Channel->Sequence.load(std::memory_order_relaxed);
+    type    Current;
 
-    Arena->Memory = (u8 *)HeapAlloc(Arena->Heap, 0, Size);
-    Arena->MemorySize = Size;
-    Arena->Pos = 0;
 
-    return (TRUE);
-}
+    // The only writer, so the words can't change under it
+    for (u32 I = 0; I < PARAM_CHANNEL_WORDS(type); I++)
+    {
+        Words[I] = Channel->Words[I].load(std::memory_order_relaxed);
+    }
+    memcpy(&Current, Words, sizeof(type));
 
-b32
-DestroyArena(arena *Arena)
-{
-    HeapFree(Arena->Heap, 0, Arena->Memory);
+    if (!ParamsEqual(&Current, Value))
+    {
+        memcpy(Words, Value, sizeof(type));
 
-    Arena->Pos = 0;
-    Arena->MemorySize = 0;
-    Arena->Memory = NULL;
-    Arena->Heap = 0;
+        Channel->Sequence.store(Sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
 
-    return (TRUE);
+        for (u32 I = 0; I < PARAM_CHANNEL_WORDS(type); I++)
+        {
+            Channel->Words[I].store(Words[I], std::memory_order_relaxed);
+        }
+
+        Sequence += 2;
+        Channel->Sequence.store(Sequence, std::memory_order_release);
+    }
+
+    return (Sequence / 2);
 }
 
-void *
-ArenaAlloc(arena *Arena,
-           u32 Size)
+// Any thread, copies the latest value to Value and returns its version
+template <typename type>
+u32
+ReadParamChannel(param_channel<type> *Channel,
+                 type *Value)
 {
-    void        *Ptr = NULL;
-    u32         AlignedSize = ((Size + 15) & (~15));
+    u32     Words[PARAM_CHANNEL_WORDS(type)];
+    u32     Sequence;
 
 
-    if (Arena->Pos + AlignedSize < Arena->MemorySize)
+    for (;;)
     {
-        Ptr = Arena->Memory + Arena->Pos;
-        Arena->Pos += AlignedSize;
-    }
+        Sequence = Channel->Sequence.load(std::memory_order_acquire);
 
-    return (Ptr);
-}
+        if ((Sequence & 1) == 0)
+        {
+            for (u32 I = 0; I < PARAM_CHANNEL_WORDS(type); I++)
+            {
+                Words[I] = Channel->Words[I].load(std::memory_order_relaxed);
+            }
 
-arena_frame
-ArenaPushFrame(arena *Arena)
-{
-    arena_frame     Frame;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (Channel->Sequence.load(std::memory_order_relaxed) == Sequence)
+            {
+                break;
+            }
+        }
 
-    Frame.Arena = Arena;
-    Frame.CurrentPos = Arena->Pos;
+#if defined(MG_USE_SSE)
+        _mm_pause();
+#endif
+    }
 
-    return Frame;
+    memcpy(Value, Words, sizeof(type));
+
+    return (Sequence / 2);
 }
 
-void
-ArenaPopFrame(arena_frame Frame)
+// Any thread, the latest version without copying the value
+template <typename type>
+u32
+ParamChannelVersion(param_channel<type> *Channel)
 {
-    Frame.Arena->Pos = Frame.CurrentPos;
+    return (Channel->Sequence.load(std::memory_order_acquire) / 2);
 }
 
-#endif MG_IMPL
-
 
 
 
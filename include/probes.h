@@ -0,0 +1,830 @@
+#ifndef __PROBES_H__
+#define __PROBES_H__
+
+#include <vector>
+#include <mg.h>
+#include <volume.h>
+
+//////////////////////////////////////////////////////////////////////////////
+// Probe grid
+
+// Transmittance towards each light, Lights[i] goes in component i
+struct probe
+{
+	v3		Position;
+	f32		_Pad0;
+	v4		Transmittance;
+};
+
+// NOTE(matthew): Mirrors grid_params in the shaders. ProbeLayout sits in the
+// slot HLSL would otherwise pad after GridMin.
+struct grid_params
+{
+	v3i		GridDims;
+	u32		ProbeCount;
+
+	v3		GridMin;
+	u32		ProbeLayout;
+
+	v3		GridMax;
+	f32		_Pad1;
+
+	v3		GridExtents;
+	f32		_Pad2;
+
+	v3		GridExtentsRcp;
+	f32		_Pad3;
+
+	v3		CellSize;
+	f32		_Pad4;
+};
+
+#define LIGHTMARCH_STEPS	64
+
+// How LookupProbeData() blends probes. The cubic filters read the 4^3
+// neighbourhood instead of 2^3 but never overshoot the probe values.
+enum probe_filter
+{
+	PROBE_FILTER_TRILINEAR,
+	PROBE_FILTER_BSPLINE,		// approximating, smooths peaks slightly
+	PROBE_FILTER_MONOTONE,		// interpolating, stays between the nearest probes
+
+	PROBE_FILTER_COUNT,
+};
+
+extern const char	*ProbeFilterNames[PROBE_FILTER_COUNT];
+
+// Limits used when sizing the grid for a volume
+struct probe_budget
+{
+	f32		VoxelsPerProbe;			// target probe spacing, in voxels
+	f32		MemoryMB;				// cap on the probe buffer size
+	f32		BakeMs;					// cap on the estimated CPU bake time
+	f32		OccupancyThreshold;		// fraction of the max density that counts as occupied
+	s32		MinDim,
+			MaxDim;
+};
+
+// What FitProbeGrid() found, mostly for display
+struct probe_fit
+{
+	v3		OccupiedMin,			// texture space bounds of the occupied voxels
+			OccupiedMax;
+	f32		Occupancy;				// fraction of voxels inside those bounds that are occupied
+	f64		BakeNsPerProbe;
+	f32		MemoryMB;
+	f32		BakeMs;
+};
+
+void	InitGridParams(grid_params *Grid, v3i GridDims, v3 GridMin, v3 GridMax, u32 Layout);
+u32		ProbeStorageCount(grid_params *Grid);
+u32		GridCoordToProbeIndex(grid_params *Grid, v3i Coord);
+v3i		BaseGridCoord(grid_params *Grid, v3 Pos);
+v3		GridCoordToPosition(grid_params *Grid, v3i Coord);
+void	ConvertProbeLayout(std::vector<probe> &Probes, grid_params *Grid, u32 Layout);
+probe_budget	DefaultProbeBudget(void);
+void	ComputeOccupancy(volume *Volume, f32 Threshold, v3 *BoundsMin, v3 *BoundsMax, f32 *Occupancy);
+f64		EstimateBakeNsPerProbe(volume *Volume, grid_params *Grid, raymarch_params *Params, m4 &InvWorld);
+void	FitProbeGrid(grid_params *Grid, volume *Volume, raymarch_params *Params, m4 &World, probe_budget *Budget, probe_fit *Fit);
+
+b32		IntersectBox(v3 Origin, v3 Dir, v3 BoxMin, v3 BoxMax, f32 *tNear, f32 *tFar);
+b32		LightDirection(light *Light, v3 Pos, v3 *Dir);
+f32		MarchLength(light *Light, v3 Pos, f32 tFar);
+f32		Lightmarch(volume *Volume, grid_params *Grid, raymarch_params *Params, m4 &InvWorld, light *Light, v3 Pos);
+v4		LightmarchAll(volume *Volume, grid_params *Grid, raymarch_params *Params, m4 &InvWorld, v3 Pos);
+void	BakeProbes(probe *Probes, volume *Volume, grid_params *Grid, raymarch_params *Params, m4 &InvWorld);
+v4		LookupProbeData(probe *Probes, grid_params *Grid, v3 Pos);
+v4		LookupProbeDataCubic(probe *Probes, grid_params *Grid, v3 Pos, u32 Filter);
+v4		SampleProbes(probe *Probes, grid_params *Grid, v3 Pos, u32 Filter);
+
+#ifdef PROBES_IMPL
+
+const char	*ProbeFilterNames[PROBE_FILTER_COUNT] =
+{
+	"Trilinear",
+	"B-spline",
+	"Monotone",
+};
+
+void
+InitGridParams(grid_params *Grid,
+			   v3i GridDims,
+			   v3 GridMin,
+			   v3 GridMax,
+			   u32 Layout)
+{
+	*Grid = {};
+
+	Grid->GridDims = GridDims;
+	Grid->ProbeCount = GridDims.x * GridDims.y * GridDims.z;
+	Grid->ProbeLayout = Layout;
+	Grid->GridMin = GridMin;
+	Grid->GridMax = GridMax;
+	Grid->GridExtents = Grid->GridMax - Grid->GridMin;
+	Grid->GridExtentsRcp.x = 1.f / Grid->GridExtents.x;
+	Grid->GridExtentsRcp.y = 1.f / Grid->GridExtents.y;
+	Grid->GridExtentsRcp.z = 1.f / Grid->GridExtents.z;
+	Grid->CellSize.x = Grid->GridExtents.x / (Grid->GridDims.x - 1);
+	Grid->CellSize.y = Grid->GridExtents.y / (Grid->GridDims.y - 1);
+	Grid->CellSize.z = Grid->GridExtents.z / (Grid->GridDims.z - 1);
+}
+
+// Number of probe slots the buffer needs, which is more than ProbeCount when
+// the layout pads the grid
+u32
+ProbeStorageCount(grid_params *Grid)
+{
+	return (LayoutStorageSize(Grid->ProbeLayout, Grid->GridDims.x, Grid->GridDims.y, Grid->GridDims.z));
+}
+
+u32
+GridCoordToProbeIndex(grid_params *Grid,
+					  v3i Coord)
+{
+	return (LayoutIndex(Grid->ProbeLayout, Coord.x, Coord.y, Coord.z, Grid->GridDims.x, Grid->GridDims.y));
+}
+
+v3i
+BaseGridCoord(grid_params *Grid,
+			  v3 Pos)
+{
+	v3		NormalizedPos = Hadamard(Pos - Grid->GridMin, Grid->GridExtentsRcp);
+	v3i		Coord;
+
+
+	// Clamp so the +1 corner of the trilinear lookup stays inside the grid
+	for (u32 I = 0; I < 3; I++)
+	{
+		s32 Max = Grid->GridDims.Elements[I] - 2;
+		s32 C = s32(floorf(NormalizedPos.Elements[I] * (Grid->GridDims.Elements[I] - 1)));
+
+		Coord.Elements[I] = C < 0 ? 0 : (C > Max ? Max : C);
+	}
+
+	return (Coord);
+}
+
+v3
+GridCoordToPosition(grid_params *Grid,
+					v3i Coord)
+{
+	v3 Pos = v3(f32(Coord.x), f32(Coord.y), f32(Coord.z));
+
+	return (Grid->GridMin + Hadamard(Grid->CellSize, Pos));
+}
+
+void
+ConvertProbeLayout(std::vector<probe> &Probes,
+				   grid_params *Grid,
+				   u32 Layout)
+{
+	grid_params				NewGrid = *Grid;
+	std::vector<probe>		Converted;
+
+
+	NewGrid.ProbeLayout = Layout;
+	Converted.assign(ProbeStorageCount(&NewGrid), probe{});
+
+	for (s32 Z = 0; Z < Grid->GridDims.z; Z++)
+	{
+		for (s32 Y = 0; Y < Grid->GridDims.y; Y++)
+		{
+			for (s32 X = 0; X < Grid->GridDims.x; X++)
+			{
+				v3i Coord = v3i(X, Y, Z);
+
+				Converted[GridCoordToProbeIndex(&NewGrid, Coord)] = Probes[GridCoordToProbeIndex(Grid, Coord)];
+			}
+		}
+	}
+
+	Probes.swap(Converted);
+	Grid->ProbeLayout = Layout;
+}
+
+probe_budget
+DefaultProbeBudget(void)
+{
+	probe_budget	Budget;
+
+
+	Budget.VoxelsPerProbe = 2.0f;
+	Budget.MemoryMB = 64.0f;
+	Budget.BakeMs = 500.0f;
+	Budget.OccupancyThreshold = 0.01f;
+	Budget.MinDim = 4;
+	Budget.MaxDim = 256;
+
+	return (Budget);
+}
+
+// Texture space bounds of every voxel above Threshold * max, padded by a
+// voxel so trilinear taps at the edge still see the falloff
+void
+ComputeOccupancy(volume *Volume,
+				 f32 Threshold,
+				 v3 *BoundsMin,
+				 v3 *BoundsMax,
+				 f32 *Occupancy)
+{
+	f32						MaxDensity = 0;
+	s32						MinX = S32_MAX, MinY = S32_MAX, MinZ = S32_MAX,
+							MaxX = -1, MaxY = -1, MaxZ = -1;
+	u64						Occupied = 0,
+							BoxVoxels;
+	std::vector<f32>		SliceMax(Volume->Depth, 0.0f);
+	std::vector<v3i>		SliceMin(Volume->Depth),
+							SliceMaxCoord(Volume->Depth);
+	std::vector<u64>		SliceOccupied(Volume->Depth, 0);
+
+
+	// Both passes go a slice per piece, with the results per slice
+	ParallelFor(Volume->Depth, 1, [&](job_range Range)
+	{
+		for (s32 Z = Range.Min.x; Z < Range.Max.x; Z++)
+		{
+			for (s32 Y = 0; Y < s32(Volume->Height); Y++)
+			{
+				u32 Row = Volume->OffsetY[Y] + Volume->OffsetZ[Z];
+
+				for (s32 X = 0; X < s32(Volume->Width); X++)
+				{
+					SliceMax[Z] = _Max(SliceMax[Z], Volume->Data[Row + Volume->OffsetX[X]]);
+				}
+			}
+		}
+	});
+
+	for (u32 Z = 0; Z < Volume->Depth; Z++)
+	{
+		MaxDensity = _Max(MaxDensity, SliceMax[Z]);
+	}
+
+	Threshold *= MaxDensity;
+
+	ParallelFor(Volume->Depth, 1, [&](job_range Range)
+	{
+		for (s32 Z = Range.Min.x; Z < Range.Max.x; Z++)
+		{
+			v3i Min = v3i(S32_MAX, S32_MAX, S32_MAX),
+				Max = v3i(-1, -1, -1);
+
+			for (s32 Y = 0; Y < s32(Volume->Height); Y++)
+			{
+				u32 Row = Volume->OffsetY[Y] + Volume->OffsetZ[Z];
+
+				for (s32 X = 0; X < s32(Volume->Width); X++)
+				{
+					if (Volume->Data[Row + Volume->OffsetX[X]] > Threshold)
+					{
+						Min.x = _Min(Min.x, X); Max.x = _Max(Max.x, X);
+						Min.y = _Min(Min.y, Y); Max.y = _Max(Max.y, Y);
+						SliceOccupied[Z]++;
+					}
+				}
+			}
+
+			SliceMin[Z] = Min;
+			SliceMaxCoord[Z] = Max;
+		}
+	});
+
+	for (s32 Z = 0; Z < s32(Volume->Depth); Z++)
+	{
+		if (SliceOccupied[Z])
+		{
+			MinX = _Min(MinX, SliceMin[Z].x); MaxX = _Max(MaxX, SliceMaxCoord[Z].x);
+			MinY = _Min(MinY, SliceMin[Z].y); MaxY = _Max(MaxY, SliceMaxCoord[Z].y);
+			MinZ = _Min(MinZ, Z); MaxZ = _Max(MaxZ, Z);
+			Occupied += SliceOccupied[Z];
+		}
+	}
+
+	if (Occupied == 0)
+	{
+		*BoundsMin = v3(0, 0, 0);
+		*BoundsMax = v3(1, 1, 1);
+		*Occupancy = 0;
+
+		return;
+	}
+
+	MinX = _Max(MinX - 1, 0); MaxX = _Min(MaxX + 2, s32(Volume->Width));
+	MinY = _Max(MinY - 1, 0); MaxY = _Min(MaxY + 2, s32(Volume->Height));
+	MinZ = _Max(MinZ - 1, 0); MaxZ = _Min(MaxZ + 2, s32(Volume->Depth));
+
+	BoxVoxels = u64(MaxX - MinX) * u64(MaxY - MinY) * u64(MaxZ - MinZ);
+
+	*BoundsMin = v3(f32(MinX) / Volume->Width, f32(MinY) / Volume->Height, f32(MinZ) / Volume->Depth);
+	*BoundsMax = v3(f32(MaxX) / Volume->Width, f32(MaxY) / Volume->Height, f32(MaxZ) / Volume->Depth);
+	*Occupancy = f32(f64(Occupied) / f64(BoxVoxels));
+}
+
+// Times a small CPU bake over the same bounds. The per-probe cost depends on
+// how much of the volume the light rays cross, so this is calibrated per
+// volume rather than a constant.
+f64
+EstimateBakeNsPerProbe(volume *Volume,
+					   grid_params *Grid,
+					   raymarch_params *Params,
+					   m4 &InvWorld)
+{
+	grid_params				SampleGrid;
+	std::vector<probe>		Probes;
+	u64						Start,
+							End;
+
+
+	InitGridParams(&SampleGrid, v3i(8, 8, 8), Grid->GridMin, Grid->GridMax, LAYOUT_LINEAR);
+	Probes.resize(SampleGrid.ProbeCount);
+
+	Start = ReadTimer();
+	BakeProbes(Probes.data(), Volume, &SampleGrid, Params, InvWorld);
+	End = ReadTimer();
+
+	return (TimerSeconds(Start, End) * 1e9 / SampleGrid.ProbeCount);
+}
+
+// Picks GridDims/GridMin/GridMax for a volume: the grid covers the occupied
+// bounds at roughly one probe per VoxelsPerProbe voxels, then shrinks
+// uniformly until the buffer and the estimated bake fit the budget. The
+// current ProbeLayout is kept.
+void
+FitProbeGrid(grid_params *Grid,
+			 volume *Volume,
+			 raymarch_params *Params,
+			 m4 &World,
+			 probe_budget *Budget,
+			 probe_fit *Fit)
+{
+	u32		Layout = Grid->ProbeLayout;
+	v3		WorldMin = v3( F32_MAX,  F32_MAX,  F32_MAX),
+			WorldMax = v3(-F32_MAX, -F32_MAX, -F32_MAX);
+	m4		InvWorld = Mat4Inverse(World);
+	f64		MaxProbesMemory,
+			MaxProbesTime;
+	s32		Dims[3];
+
+
+	ComputeOccupancy(Volume, Budget->OccupancyThreshold, &Fit->OccupiedMin, &Fit->OccupiedMax, &Fit->Occupancy);
+
+	for (u32 I = 0; I < 8; I++)
+	{
+		v4 Corner = v4((I & 1) ? Fit->OccupiedMax.x : Fit->OccupiedMin.x,
+					   (I & 2) ? Fit->OccupiedMax.y : Fit->OccupiedMin.y,
+					   (I & 4) ? Fit->OccupiedMax.z : Fit->OccupiedMin.z, 1);
+		v4 P = World * Corner;
+
+		WorldMin = MinV3(WorldMin, v3(P.x, P.y, P.z));
+		WorldMax = MaxV3(WorldMax, v3(P.x, P.y, P.z));
+	}
+
+	u32 VolumeDims[3] = { Volume->Width, Volume->Height, Volume->Depth };
+
+	for (u32 I = 0; I < 3; I++)
+	{
+		f32 Voxels = (Fit->OccupiedMax.Elements[I] - Fit->OccupiedMin.Elements[I]) * VolumeDims[I];
+		s32 Dim = s32(Round(Voxels / Budget->VoxelsPerProbe));
+
+		Dims[I] = _Min(_Max(Dim, Budget->MinDim), Budget->MaxDim);
+	}
+
+	InitGridParams(Grid, v3i(Dims[0], Dims[1], Dims[2]), WorldMin, WorldMax, Layout);
+
+	Fit->BakeNsPerProbe = EstimateBakeNsPerProbe(Volume, Grid, Params, InvWorld);
+	MaxProbesMemory = Budget->MemoryMB * 1024.0 * 1024.0 / sizeof(probe);
+	MaxProbesTime = Budget->BakeMs * 1e6 / Fit->BakeNsPerProbe;
+
+	// Memory is checked against the storage count since Morton pads to a
+	// power of two cube, the bake only touches the real probes
+	for (;;)
+	{
+		f64 Scale = 1.0;
+		b32 AtMin = (Dims[0] <= Budget->MinDim && Dims[1] <= Budget->MinDim && Dims[2] <= Budget->MinDim);
+
+		if (f64(ProbeStorageCount(Grid)) > MaxProbesMemory)
+		{
+			Scale = _Min(Scale, cbrt(MaxProbesMemory / ProbeStorageCount(Grid)));
+		}
+		if (f64(Grid->ProbeCount) > MaxProbesTime)
+		{
+			Scale = _Min(Scale, cbrt(MaxProbesTime / Grid->ProbeCount));
+		}
+
+		if (Scale >= 1.0 || AtMin)
+		{
+			break;
+		}
+
+		Scale = _Min(Scale, 0.95);
+
+		for (u32 I = 0; I < 3; I++)
+		{
+			Dims[I] = _Max(s32(Dims[I] * Scale), Budget->MinDim);
+		}
+
+		InitGridParams(Grid, v3i(Dims[0], Dims[1], Dims[2]), WorldMin, WorldMax, Layout);
+	}
+
+	Fit->MemoryMB = f32(f64(ProbeStorageCount(Grid)) * sizeof(probe) / (1024.0 * 1024.0));
+	Fit->BakeMs = f32(Fit->BakeNsPerProbe * Grid->ProbeCount * 1e-6);
+}
+
+b32
+IntersectBox(v3 Origin,
+			 v3 Dir,
+			 v3 BoxMin,
+			 v3 BoxMax,
+			 f32 *tNear,
+			 f32 *tFar)
+{
+	v3		tMin,
+			tMax;
+
+
+	for (u32 I = 0; I < 3; I++)
+	{
+		// A ray parallel to a slab would give 0 * inf = NaN when it starts
+		// on the slab's plane, it's either inside the slab for all t or never
+		if (Dir.Elements[I] == 0.0f)
+		{
+			b32 Inside = Origin.Elements[I] >= BoxMin.Elements[I] && Origin.Elements[I] <= BoxMax.Elements[I];
+
+			tMin.Elements[I] = Inside ? -F32_MAX : F32_MAX;
+			tMax.Elements[I] = Inside ? F32_MAX : -F32_MAX;
+			continue;
+		}
+
+		f32 InvR = 1.0f / Dir.Elements[I];
+		f32 tBot = InvR * (BoxMin.Elements[I] - Origin.Elements[I]);
+		f32 tTop = InvR * (BoxMax.Elements[I] - Origin.Elements[I]);
+
+		tMin.Elements[I] = _Min(tTop, tBot);
+		tMax.Elements[I] = _Max(tTop, tBot);
+	}
+
+	*tNear = _Max(_Max(tMin.x, tMin.y), tMin.z);
+	*tFar = _Min(_Min(tMax.x, tMax.y), tMax.z);
+
+	return (*tNear < *tFar);
+}
+
+// Direction from Pos towards the light, FALSE for a point light sitting
+// right on Pos (nothing in between, so full transmittance)
+b32
+LightDirection(light *Light,
+			   v3 Pos,
+			   v3 *Dir)
+{
+	v3		ToLight = Light->Position;
+
+
+	if (Light->Type == LIGHT_POINT)
+	{
+		ToLight = Light->Position - Pos;
+	}
+
+	if (Dot(ToLight, ToLight) < 1e-12f)
+	{
+		return (FALSE);
+	}
+
+	*Dir = Normalize(ToLight);
+
+	return (TRUE);
+}
+
+// How far to march towards the light, to where the ray leaves the box or to
+// a point light inside it, whichever is first
+f32
+MarchLength(light *Light,
+			v3 Pos,
+			f32 tFar)
+{
+	f32		Distance = Abs(tFar);
+
+
+	if (Light->Type == LIGHT_POINT)
+	{
+		Distance = _Min(Distance, Length(Light->Position - Pos));
+	}
+
+	return (Distance);
+}
+
+// CPU version of Lightmarch() in raymarch.ps. The world -> texture transform
+// is affine, so it's applied once to the start point and step instead of on
+// every sample.
+f32
+Lightmarch(volume *Volume,
+		   grid_params *Grid,
+		   raymarch_params *Params,
+		   m4 &InvWorld,
+		   light *Light,
+		   v3 Pos)
+{
+	v3		LightDir;
+	f32		tNear,
+			tFar;
+	f32		dt,
+			TotalDensity = 0;
+	v4		TexPos,
+			TexStep;
+
+
+	if (!LightDirection(Light, Pos, &LightDir))
+	{
+		return (1.0f);
+	}
+
+	IntersectBox(Pos, LightDir, Grid->GridMin, Grid->GridMax, &tNear, &tFar);
+	dt = MarchLength(Light, Pos, tFar) / f32(LIGHTMARCH_STEPS);
+
+	TexPos = InvWorld * v4(Pos.x, Pos.y, Pos.z, 1);
+	TexStep = InvWorld * v4(dt * LightDir.x, dt * LightDir.y, dt * LightDir.z, 0);
+
+	for (u32 I = 0; I < LIGHTMARCH_STEPS; I++)
+	{
+		f32 Density = Params->DensityScale * SampleVolume(Volume, v3(TexPos.x, TexPos.y, TexPos.z));
+
+		TotalDensity += Density * dt;
+		TexPos += TexStep;
+	}
+
+	return (FastExp(-TotalDensity * Params->Absorption));
+}
+
+// CPU version of LightmarchAll() in probe.cs. Every march starts at Pos, so
+// the first sample and the world -> texture transform of the origin are
+// shared between the lights. The lights are marched one after the other
+// rather than interleaved, interleaving was slower on the CPU. Unused lights
+// get a transmittance of 0.
+v4
+LightmarchAll(volume *Volume,
+			  grid_params *Grid,
+			  raymarch_params *Params,
+			  m4 &InvWorld,
+			  v3 Pos)
+{
+	v4		Transmittance = v4(0, 0, 0, 0),
+			Exponents = v4(0, 0, 0, 0);
+	u32		LightCount = _Min(Params->LightCount, u32(MAX_LIGHTS));
+	v4		Origin = InvWorld * v4(Pos.x, Pos.y, Pos.z, 1);
+	f32		Density0 = Params->DensityScale * SampleVolume(Volume, v3(Origin.x, Origin.y, Origin.z));
+
+
+	for (u32 L = 0; L < LightCount; L++)
+	{
+		v3		LightDir;
+		f32		tNear,
+				tFar;
+
+		// No direction means no march, an exponent of 0 is transmittance 1
+		if (!LightDirection(&Params->Lights[L], Pos, &LightDir))
+		{
+			continue;
+		}
+
+		IntersectBox(Pos, LightDir, Grid->GridMin, Grid->GridMax, &tNear, &tFar);
+
+		f32 dt = MarchLength(&Params->Lights[L], Pos, tFar) / f32(LIGHTMARCH_STEPS);
+		f32 TotalDensity = Density0 * dt;
+		v4 TexStep = InvWorld * v4(dt * LightDir.x, dt * LightDir.y, dt * LightDir.z, 0);
+		v4 TexPos = Origin + TexStep;
+
+		for (u32 I = 1; I < LIGHTMARCH_STEPS; I++)
+		{
+			f32 Density = Params->DensityScale * SampleVolume(Volume, v3(TexPos.x, TexPos.y, TexPos.z));
+
+			TotalDensity += Density * dt;
+			TexPos += TexStep;
+		}
+
+		Exponents.Elements[L] = -TotalDensity * Params->Absorption;
+	}
+
+	// One exp for every light, then the unused ones back to 0
+	F32x4Store(Transmittance.Elements, F32x4Exp(F32x4Load(Exponents.Elements), MG_EXP_TIER));
+	for (u32 L = LightCount; L < MAX_LIGHTS; L++)
+	{
+		Transmittance.Elements[L] = 0;
+	}
+
+	return (Transmittance);
+}
+
+void
+BakeProbes(probe *Probes,
+		   volume *Volume,
+		   grid_params *Grid,
+		   raymarch_params *Params,
+		   m4 &InvWorld)
+{
+	// A row of probes per piece
+	ParallelFor3D(Grid->GridDims, v3i(Grid->GridDims.x, 1, 1), [&](job_range Range)
+	{
+		for (s32 Z = Range.Min.z; Z < Range.Max.z; Z++)
+		{
+			for (s32 Y = Range.Min.y; Y < Range.Max.y; Y++)
+			{
+				for (s32 X = Range.Min.x; X < Range.Max.x; X++)
+				{
+					v3i Coord = v3i(X, Y, Z);
+					v3 Pos = GridCoordToPosition(Grid, Coord);
+					probe *Probe = &Probes[GridCoordToProbeIndex(Grid, Coord)];
+
+					Probe->Position = Pos;
+					Probe->Transmittance = LightmarchAll(Volume, Grid, Params, InvWorld, Pos);
+				}
+			}
+		}
+	});
+}
+
+// CPU version of LookupProbeData() in raymarch.ps
+v4
+LookupProbeData(probe *Probes,
+				grid_params *Grid,
+				v3 Pos)
+{
+	v3i		BaseCoord = BaseGridCoord(Grid, Pos);
+	v3		BaseProbePos = GridCoordToPosition(Grid, BaseCoord);
+	v3		Alpha;
+	u32		AxisOffsets[3][2];
+	v4		LightTransmittance = v4(0, 0, 0, 0);
+
+
+	for (u32 I = 0; I < 3; I++)
+	{
+		f32 A = (Pos.Elements[I] - BaseProbePos.Elements[I]) / Grid->CellSize.Elements[I];
+
+		Alpha.Elements[I] = A < 0 ? 0 : (A > 1 ? 1 : A);
+	}
+
+	// The layouts are separable, so resolve each axis once instead of doing a
+	// full index computation per corner
+	for (u32 I = 0; I < 3; I++)
+	{
+		for (u32 Corner = 0; Corner < 2; Corner++)
+		{
+			AxisOffsets[I][Corner] = LayoutAxisOffset(Grid->ProbeLayout, I, BaseCoord.Elements[I] + Corner,
+													  Grid->GridDims.x, Grid->GridDims.y);
+		}
+	}
+
+	for (u32 I = 0; I < 8; I++)
+	{
+		v3i Offset = v3i(I & 1, (I >> 1) & 1, (I >> 2) & 1);
+		probe *Probe = &Probes[AxisOffsets[0][Offset.x] + AxisOffsets[1][Offset.y] + AxisOffsets[2][Offset.z]];
+		f32 WX = Offset.x ? Alpha.x : 1.0f - Alpha.x;
+		f32 WY = Offset.y ? Alpha.y : 1.0f - Alpha.y;
+		f32 WZ = Offset.z ? Alpha.z : 1.0f - Alpha.z;
+		f32 Weight = _Max(0.00001f, WX * WY * WZ);
+
+		LightTransmittance += Weight * Probe->Transmittance;
+	}
+
+	return (LightTransmittance);
+}
+
+// Slope at the middle sample for a monotone cubic, the harmonic mean of the
+// two secants (Fritsch-Butland), 0 at extrema so nothing overshoots
+f32
+MonotoneSlope(f32 D0,
+			  f32 D1)
+{
+	return (D0 * D1 > 0 ? 2.0f * D0 * D1 / (D0 + D1) : 0.0f);
+}
+
+// Cubic Hermite between P[1] and P[2], per component
+v4
+MonotoneCubic(v4 *P,
+			  f32 T)
+{
+	f32		T2 = T * T,
+			T3 = T2 * T;
+	f32		H00 = 2 * T3 - 3 * T2 + 1,
+			H10 = T3 - 2 * T2 + T,
+			H01 = -2 * T3 + 3 * T2,
+			H11 = T3 - T2;
+	v4		Result;
+
+
+	for (u32 C = 0; C < 4; C++)
+	{
+		f32 D0 = P[1].Elements[C] - P[0].Elements[C];
+		f32 D1 = P[2].Elements[C] - P[1].Elements[C];
+		f32 D2 = P[3].Elements[C] - P[2].Elements[C];
+
+		Result.Elements[C] = H00 * P[1].Elements[C] + H10 * MonotoneSlope(D0, D1) +
+							 H01 * P[2].Elements[C] + H11 * MonotoneSlope(D1, D2);
+	}
+
+	return (Result);
+}
+
+// NOTE(matthew): Both filters are separable over the 4^3 probes around Pos,
+// with the out of range taps clamped to the edge. The B-spline weights are
+// all positive so it's a convex blend. The monotone filter runs a 1D
+// monotone cubic along x for each of the 16 rows, then y, then z, and each
+// pass stays between its two middle inputs, so the result stays within the
+// 8 probes trilinear would have used.
+v4
+LookupProbeDataCubic(probe *Probes,
+					 grid_params *Grid,
+					 v3 Pos,
+					 u32 Filter)
+{
+	v3		NormalizedPos = Hadamard(Pos - Grid->GridMin, Grid->GridExtentsRcp);
+	u32		AxisOffsets[3][4];
+	f32		Weights[3][4];
+	v3		Fraction;
+	v4		LightTransmittance = v4(0, 0, 0, 0);
+
+
+	for (u32 I = 0; I < 3; I++)
+	{
+		s32 Max = Grid->GridDims.Elements[I] - 1;
+		f32 U = _Min(_Max(NormalizedPos.Elements[I], 0.0f), 1.0f) * Max;
+		s32 Base = _Min(s32(U), Max - 1);
+		f32 F = U - Base;
+
+		Fraction.Elements[I] = F;
+
+		for (s32 Tap = 0; Tap < 4; Tap++)
+		{
+			s32 C = Base + Tap - 1;
+
+			C = C < 0 ? 0 : (C > Max ? Max : C);
+			AxisOffsets[I][Tap] = LayoutAxisOffset(Grid->ProbeLayout, I, C, Grid->GridDims.x, Grid->GridDims.y);
+		}
+
+		Weights[I][0] = (1 - F) * (1 - F) * (1 - F) / 6.0f;
+		Weights[I][1] = (3 * F * F * F - 6 * F * F + 4) / 6.0f;
+		Weights[I][2] = (-3 * F * F * F + 3 * F * F + 3 * F + 1) / 6.0f;
+		Weights[I][3] = F * F * F / 6.0f;
+	}
+
+	if (Filter == PROBE_FILTER_BSPLINE)
+	{
+		for (u32 Z = 0; Z < 4; Z++)
+		{
+			for (u32 Y = 0; Y < 4; Y++)
+			{
+				u32 Row = AxisOffsets[2][Z] + AxisOffsets[1][Y];
+				f32 WYZ = Weights[2][Z] * Weights[1][Y];
+
+				for (u32 X = 0; X < 4; X++)
+				{
+					LightTransmittance += (WYZ * Weights[0][X]) * Probes[Row + AxisOffsets[0][X]].Transmittance;
+				}
+			}
+		}
+	}
+	else
+	{
+		v4 Planes[4];
+
+		for (u32 Z = 0; Z < 4; Z++)
+		{
+			v4 Rows[4];
+
+			for (u32 Y = 0; Y < 4; Y++)
+			{
+				u32 Row = AxisOffsets[2][Z] + AxisOffsets[1][Y];
+				v4 Taps[4];
+
+				for (u32 X = 0; X < 4; X++)
+				{
+					Taps[X] = Probes[Row + AxisOffsets[0][X]].Transmittance;
+				}
+
+				Rows[Y] = MonotoneCubic(Taps, Fraction.x);
+			}
+
+			Planes[Z] = MonotoneCubic(Rows, Fraction.y);
+		}
+
+		LightTransmittance = MonotoneCubic(Planes, Fraction.z);
+	}
+
+	return (LightTransmittance);
+}
+
+v4
+SampleProbes(probe *Probes,
+			 grid_params *Grid,
+			 v3 Pos,
+			 u32 Filter)
+{
+	if (Filter == PROBE_FILTER_TRILINEAR)
+	{
+		return (LookupProbeData(Probes, Grid, Pos));
+	}
+
+	return (LookupProbeDataCubic(Probes, Grid, Pos, Filter));
+}
+
+#endif // PROBES_IMPL
+
+#endif // __PROBES_H__
@@ -0,0 +1,1644 @@
+#ifndef __RENDER_H__
+#define __RENDER_H__
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <mg.h>
+#include <volume.h>
+#include <probes.h>
+#include <scatter.h>
+#include <shadow.h>
+
+//////////////////////////////////////////////////////////////////////////////
+// CPU renderer
+
+// NOTE(matthew): Reference/offline version of raymarch.ps. Rays come from
+// unprojecting each pixel instead of the front/back face textures, so the
+// camera can be inside the volume. Pixels are premultiplied RGBA.
+//
+// A single march samples at fixed multiples of dt from the box entry, which
+// shows up as banding at coarse steps. RenderVolumeProgressive() instead
+// starts every ray a fraction MarchJitter() of a step in, a different
+// fraction per pixel and per frame, and averages the frames in an
+// image_accumulator. The average converges on the integral the march is
+// approximating, so a coarse StepScale gets close to a fine march given
+// enough frames. The viewer does the same with FrameIndex.
+//
+// RenderVolumeScaled() marches every Downsample x Downsample block of
+// pixels once and upsamples with UpsampleDepthAware(), like the viewer's
+// Downsample option. The cloud itself is smooth enough for bilinear, the
+// edges that aren't are where the ray's path through the box changes
+// quickly, mostly the box silhouette. So that path length is the guide,
+// each bilinear tap is weighted down by how different its length is from
+// the full resolution pixel's.
+//
+// NOTE(matthew): The length is the guide rather than the entry depth. Past
+// a box edge the depth jumps but the length goes smoothly to 0, and so does
+// the opacity, a depth guide only copies the inside over the edge. It's
+// still a small win over plain bilinear, the volume's own edges aren't in
+// any guide, see BenchDownsample().
+
+#define UPSAMPLE_SIGMA		0.2f	// length difference a tap falls off over, in box sizes
+#define RENDER_TILE			16		// pixels per side of a ParallelFor2D() piece
+
+// NOTE(matthew): How CastRayLight() gets the transmittance of each step.
+// TRANSMITTANCE_STEP is the shader's order, one exp per step multiplied
+// into the running transmittance. TRANSMITTANCE_SEGMENT samples four steps,
+// sums their optical depths and takes the exp of all four partial sums with
+// one F32x4Exp(), each relative to the transmittance at the start of the
+// segment. Same integral, a quarter of the exps, and no per step product
+// to drift.
+
+#define TRANSMITTANCE_STEP		0
+#define TRANSMITTANCE_SEGMENT	1
+
+struct image
+{
+	u32					Width,
+						Height;
+	std::vector<v4>		Pixels;
+};
+
+struct image_accumulator
+{
+	u32					Width,
+						Height;
+	u32					SampleCount;	// per pixel so far
+	u32					PassCount;		// seeds the pass, never reset so restarts get new noise
+	std::vector<v4>		Sum;
+};
+
+struct render_scene
+{
+	volume				*Volume;
+	grid_params			*Grid;
+	probe				*Probes;		// only read for LIGHTING_PROBES
+	shadow_volume		*Shadows;		// only read for LIGHTING_SHADOW_VOLUME
+	deep_shadow_map		*DeepShadows;	// only read for LIGHTING_DEEP_SHADOW_MAP
+	scatter_volume		*Scatter;		// only read when Params->ScatterOrder is set
+	raymarch_params		*Params;
+	m4					World,
+						InvWorld;
+	u32					TransmittanceMode;	// TRANSMITTANCE_*, 0 is per step
+};
+
+v3		LightRadiance(raymarch_params *Params, v4 Transmittance);
+v3		InscatteredRadiance(render_scene *Scene, v3 Pos, v4 TexPos, v3 RayDirection);
+v4		CastRayLight(render_scene *Scene, v3 RayOrigin, v3 RayDirection, f32 tMin, f32 tMax, f32 dt, f32 *tDepth);
+f32		MarchStep(volume *Volume, raymarch_params *Params);
+f32		MarchJitter(u32 X, u32 Y, u32 Frame);
+void	DeriveParams(derived_params *Derived, m4 &World, m4 &View, m4 &Proj, volume *Volume, raymarch_params *Params);
+b32		PixelRayBox(derived_params *Derived, f32 X, f32 Y, u32 Width, u32 Height, v3 *Origin, v3 *Dir, f32 *tMin, f32 *tMax);
+void	RenderVolume(image *Image, render_scene *Scene, m4 &View, m4 &Proj);
+void	RenderVolumeJittered(image *Image, std::vector<v4> *Positions, render_scene *Scene, m4 &View, m4 &Proj, u32 Frame);
+void	RenderVolumeProgressive(image_accumulator *Accum, render_scene *Scene, m4 &View, m4 &Proj);
+void	RenderRayLengths(std::vector<f32> *Lengths, u32 Width, u32 Height, render_scene *Scene, m4 &View, m4 &Proj);
+void	UpsampleDepthAware(image *Full, image *Low, std::vector<f32> &FullLengths, std::vector<f32> &LowLengths, u32 Downsample, f32 Sigma);
+void	RenderVolumeScaled(image *Image, render_scene *Scene, m4 &View, m4 &Proj, u32 Downsample);
+void	ResolveAccumulator(image *Image, image_accumulator *Accum);
+b32		WriteImagePPM(image *Image, char const *Path);
+void	DifferenceImage(image *Difference, image *A, image *B, f32 Gain);
+
+//////////////////////////////////////////////////////////////////////////////
+// Temporal reprojection
+
+// NOTE(matthew): CPU version of the viewer's temporal pass (temporal.ps).
+// Every frame is one jittered march, ResolveTemporal() blends it into the
+// history. When the camera hasn't moved it's the same running mean as
+// RenderVolumeProgressive(). When it has, each pixel follows its depth
+// estimate (the opacity weighted t from CastRayLight()) back into the
+// previous frame, samples the history there, clamps it to what the current
+// frame's 3x3 neighbourhood looks like so disocclusions and parallax errors
+// can't smear, and blends with weight 1 / (MaxFrames + 1) at most. Pixels
+// that reproject off screen or miss the volume take the current frame.
+//
+// A camera path is one camera per frame, recorded in the viewer and played
+// back with `main.exe -temporal <path file> [vdb]` to measure the error of a
+// coarse temporal march against a fine one along it.
+
+#define TEMPORAL_CLAMP_SIGMA		1.0f
+
+struct temporal_history
+{
+	u32					Width,
+						Height;
+	u32					Frames;			// effective frames in Color, 0 when empty
+	m4					ViewProj;		// Color was resolved with
+	std::vector<v4>		Color;
+};
+
+struct camera_key
+{
+	v3					Pos,
+						Front,
+						Up;
+};
+
+struct camera_path
+{
+	std::vector<camera_key>		Keys;
+};
+
+void	CatmullRomWeights(f32 t, f32 *Weights);
+v4		SampleHistory(temporal_history *History, f32 U, f32 V);
+void	ResolveTemporal(temporal_history *History, image *Current, std::vector<v4> &Positions, m4 &ViewProj, u32 MaxFrames);
+b32		LoadCameraPath(camera_path *Path, char const *FileName);
+b32		SaveCameraPath(camera_path *Path, char const *FileName);
+
+//////////////////////////////////////////////////////////////////////////////
+// Tracking renderer
+
+// NOTE(matthew): Unbiased Monte Carlo version of CastRayLight(). The
+// extinction along a ray is Absorption * DensityScale * density, and
+// CastRayLight() integrates DensityScale * density * Radiance against its
+// transmittance, so with collisions sampled proportionally to
+// extinction-weighted transmittance (delta tracking) each real collision
+// contributes Radiance / Absorption. Alpha is whether there was a collision
+// at all. The transmittance towards each light at the collision comes from
+// ratio tracking instead of the lightmarch, so there's no step size anywhere
+// and the only error is noise. Absorption has to be above 0.
+//
+// Both trackers walk a grid of MAJORANT_BRICK^3 voxel bricks holding the
+// largest density a trilinear fetch inside the brick can return, so empty
+// and thin bricks are crossed in a few big steps instead of one global
+// majorant for the whole volume.
+//
+// Samples accumulate in an image_accumulator, a pass adds
+// SamplesPerPixel to every pixel and ResolveAccumulator() averages them.
+// Tiles go through ParallelFor2D(), every pixel seeds its own random series
+// from the pass so the result doesn't depend on the thread count.
+//
+// The renderer tracks four pixels at a time, one per lane of a ray_batch,
+// with DeltaTrackBatch() and RatioTrackBatch(). Each lane walks its own
+// bricks; the DDA and the majorant lookup stay scalar per lane, a gather
+// either way. The free flight draws, the positions, the density fetches,
+// the collision tests and the transmittance updates are four wide. Lanes
+// that collide or leave the volume are masked off until none are left. A
+// lane draws from its pixel's series in the same order DeltaTrackRay() and
+// RatioTrackLight() would, and the wide ops agree with the scalar ones to
+// the bit, so the image is the same as tracking one ray at a time.
+// BenchTracking() times and checks the two against each other; the packets
+// win by around a tenth, as a packet waits on its longest path.
+
+#define MAJORANT_BRICK			8
+
+struct majorant_grid
+{
+	v3i					Dims;			// bricks per axis
+	v3					BricksPerTex;	// texture coordinate -> brick coordinate
+	std::vector<f32>	Max;			// DensityScale * density, x fastest
+};
+
+void	BuildMajorantGrid(majorant_grid *Grid, volume *Volume, f32 DensityScale);
+f32		RatioTrackLight(render_scene *Scene, majorant_grid *Majorants, light *Light, v3 Pos, random_series *Series);
+v4		DeltaTrackRay(render_scene *Scene, majorant_grid *Majorants, v3 RayOrigin, v3 RayDirection, f32 tMin, f32 tMax, random_series *Series);
+f32x4	RatioTrackBatch(render_scene *Scene, majorant_grid *Majorants, light *Light, v3x4 Pos, b32x4 Active, random_series *Series);
+void	DeltaTrackBatch(render_scene *Scene, majorant_grid *Majorants, ray_batch *Rays, random_series *Series);
+void	RenderVolumeTracked(image_accumulator *Accum, render_scene *Scene, majorant_grid *Majorants, m4 &View, m4 &Proj, u32 SamplesPerPixel);
+
+#ifdef RENDER_IMPL
+
+// Sum of every light scaled by its transmittance
+v3
+LightRadiance(raymarch_params *Params,
+			  v4 Transmittance)
+{
+	v3		Radiance = v3(0, 0, 0);
+
+
+	for (u32 L = 0; L < _Min(Params->LightCount, u32(MAX_LIGHTS)); L++)
+	{
+		light *Light = &Params->Lights[L];
+
+		Radiance = Radiance + (Light->Intensity * Transmittance.Elements[L]) * Light->Color;
+	}
+
+	return (Radiance);
+}
+
+// Light reaching Pos from every light and the ambient, plus multiple
+// scattering towards -RayDirection if it's on. TexPos is Pos in texture
+// space.
+v3
+InscatteredRadiance(render_scene *Scene,
+					v3 Pos,
+					v4 TexPos,
+					v3 RayDirection)
+{
+	raymarch_params		*Params = Scene->Params;
+	v4					LightTransmittance;
+
+
+	if (Params->LightingMode == LIGHTING_PROBES)
+	{
+		LightTransmittance = SampleProbes(Scene->Probes, Scene->Grid, Pos, Params->ProbeFilter);
+	}
+	else if (Params->LightingMode == LIGHTING_SHADOW_VOLUME)
+	{
+		LightTransmittance = SampleShadowVolume(Scene->Shadows, v3(TexPos.x, TexPos.y, TexPos.z));
+	}
+	else if (Params->LightingMode == LIGHTING_DEEP_SHADOW_MAP)
+	{
+		LightTransmittance = SampleDeepShadowMap(Scene->DeepShadows, Params, Pos);
+	}
+	else
+	{
+		LightTransmittance = LightmarchAll(Scene->Volume, Scene->Grid, Params, Scene->InvWorld, Pos);
+	}
+
+	v3 Radiance = LightRadiance(Params, LightTransmittance) + v3(Params->Ambient, Params->Ambient, Params->Ambient);
+
+	if (Params->ScatterOrder != SCATTER_OFF)
+	{
+		Radiance = Radiance + Params->MultiScatter * LookupScatter(Scene->Scatter, Scene->Grid, Pos, RayDirection, Params->PhaseG);
+	}
+
+	return (Radiance);
+}
+
+// CPU version of CastRayLight() in raymarch.ps, t is in world units. tDepth
+// (optional) gets the t of the ray's opacity weighted mean, tMax if nothing
+// on the ray absorbs.
+//
+// Each step's weight is the exact integral over the step with the density
+// held constant, (Tbefore - Tafter) / Absorption. Density * dt * Tbefore is
+// only its limit for thin steps.
+v4
+CastRayLight(render_scene *Scene,
+			 v3 RayOrigin,
+			 v3 RayDirection,
+			 f32 tMin,
+			 f32 tMax,
+			 f32 dt,
+			 f32 *tDepth)
+{
+	raymarch_params		*Params = Scene->Params;
+	f32					Transmittance = 1;
+	f32					DepthSum = 0;
+	v3					LightEnergy = v3(0, 0, 0);
+	v4					TexPos,
+						TexStep;
+
+
+	TexPos = Scene->InvWorld * v4(RayOrigin.x + tMin * RayDirection.x,
+								  RayOrigin.y + tMin * RayDirection.y,
+								  RayOrigin.z + tMin * RayDirection.z, 1);
+	TexStep = Scene->InvWorld * v4(dt * RayDirection.x, dt * RayDirection.y, dt * RayDirection.z, 0);
+
+	if (Scene->TransmittanceMode == TRANSMITTANCE_SEGMENT)
+	{
+		f32 t = tMin;
+
+		while (t < tMax)
+		{
+			f32 Ts[4],
+				Densities[4],
+				Exponents[4],
+				After[4];
+			v4 TexPositions[4];
+			f32 OpticalDepth = 0;
+			u32 Count = 0;
+
+			// Same t sequence as the per step loop below
+			for (; Count < 4 && t < tMax; Count++, t += dt)
+			{
+				Ts[Count] = t;
+				TexPositions[Count] = TexPos;
+				Densities[Count] = Params->DensityScale * SampleVolume(Scene->Volume, v3(TexPos.x, TexPos.y, TexPos.z));
+				OpticalDepth += Densities[Count] * dt * Params->Absorption;
+				Exponents[Count] = -OpticalDepth;
+				TexPos += TexStep;
+			}
+			for (u32 K = Count; K < 4; K++)
+			{
+				Exponents[K] = -OpticalDepth;
+			}
+
+			F32x4Store(After, F32x4Exp(F32x4Load(Exponents), MG_EXP_TIER));
+
+			for (u32 K = 0; K < Count; K++)
+			{
+				if (Densities[K] > 0)
+				{
+					f32 Before = Transmittance * (K ? After[K - 1] : 1.0f);
+					f32 Absorbed = Before - Transmittance * After[K];
+					v3 Pos = RayOrigin + Ts[K] * RayDirection;
+					v3 Radiance = InscatteredRadiance(Scene, Pos, TexPositions[K], RayDirection);
+					f32 Weight = Params->Absorption > 0 ? Absorbed / Params->Absorption : Densities[K] * dt * Before;
+
+					LightEnergy = LightEnergy + Weight * Radiance;
+					DepthSum += Ts[K] * Absorbed;
+				}
+			}
+
+			Transmittance *= After[Count - 1];
+		}
+	}
+	else
+	{
+		for (f32 t = tMin; t < tMax; t += dt)
+		{
+			f32 Density = Params->DensityScale * SampleVolume(Scene->Volume, v3(TexPos.x, TexPos.y, TexPos.z));
+
+			if (Density > 0)
+			{
+				v3 Pos = RayOrigin + t * RayDirection;
+				v3 Radiance = InscatteredRadiance(Scene, Pos, TexPos, RayDirection);
+				f32 StepTransmittance = FastExp(-Density * dt * Params->Absorption);
+				f32 Weight = Params->Absorption > 0 ? (1 - StepTransmittance) / Params->Absorption : Density * dt;
+
+				LightEnergy = LightEnergy + (Weight * Transmittance) * Radiance;
+				DepthSum += t * Transmittance * (1 - StepTransmittance);
+				Transmittance *= StepTransmittance;
+			}
+
+			TexPos += TexStep;
+		}
+	}
+
+	if (tDepth)
+	{
+		*tDepth = Transmittance < 0.9999f ? DepthSum / (1 - Transmittance) : tMax;
+	}
+
+	return (v4(LightEnergy.x, LightEnergy.y, LightEnergy.z, 1 - Transmittance));
+}
+
+// Same step as the shader: StepScale voxels of the densest axis, in world
+// units
+f32
+MarchStep(volume *Volume,
+		  raymarch_params *Params)
+{
+	f32		Scale = Params->StepScale > 0 ? Params->StepScale : 1.0f;
+
+
+	return (Scale / f32(_Max(_Max(Volume->Width, Volume->Height), Volume->Depth)));
+}
+
+// Fraction of a step to start the march at. Interleaved gradient noise
+// spreads neighbouring pixels evenly over [0, 1) without a blue noise
+// texture, and each frame adds the golden ratio so a pixel's own offsets
+// stay evenly spread as frames accumulate. Matches MarchJitter() in
+// raymarch.ps.
+f32
+MarchJitter(u32 X,
+			u32 Y,
+			u32 Frame)
+{
+	f32		Noise = 0.06711056f * f32(X) + 0.00583715f * f32(Y);
+
+
+	Noise = 52.9829189f * (Noise - floorf(Noise));
+	Noise -= floorf(Noise);
+
+	// 2^32 / golden ratio, wraps instead of losing precision for large frames
+	Noise += f32((Frame * 2654435769u) >> 8) / 16777216.0f;
+
+	return (Noise < 1 ? Noise : Noise - 1);
+}
+
+// Everything the renderers need per frame that doesn't change per pixel.
+// The viewer uploads the same block for the shaders.
+void
+DeriveParams(derived_params *Derived,
+			 m4 &World,
+			 m4 &View,
+			 m4 &Proj,
+			 volume *Volume,
+			 raymarch_params *Params)
+{
+	v4		BoxMin = World * v4(0, 0, 0, 1),
+			BoxMax = World * v4(1, 1, 1, 1);
+
+
+	Derived->InvWorld = Mat4Inverse(World);
+	Derived->InvViewProj = Mat4Inverse(Proj * View);
+	Derived->BoxMin = v3(BoxMin.x, BoxMin.y, BoxMin.z);
+	Derived->BoxMax = v3(BoxMax.x, BoxMax.y, BoxMax.z);
+	Derived->MarchStep = MarchStep(Volume, Params);
+	Derived->_Pad0 = 0;
+}
+
+// The ray through (X, Y) of a Width x Height image, pixel centres are at
+// + 0.5, from the near plane and clipped to the box. FALSE where it misses
+// the box or the box is behind the camera, tMin is 0 from inside the box.
+// raymarch.ps and composite.ps do the same for the viewer, which saves
+// rasterizing the box's front and back faces into position textures.
+b32
+PixelRayBox(derived_params *Derived,
+			f32 X,
+			f32 Y,
+			u32 Width,
+			u32 Height,
+			v3 *Origin,
+			v3 *Dir,
+			f32 *tMin,
+			f32 *tMax)
+{
+	f32		NdcX = 2.0f * X / Width - 1.0f,
+			NdcY = 1.0f - 2.0f * Y / Height;
+	v4		Near = Derived->InvViewProj * v4(NdcX, NdcY, 0, 1),
+			Far = Derived->InvViewProj * v4(NdcX, NdcY, 1, 1);
+	f32		tNear,
+			tFar;
+
+
+	*Origin = v3(Near.x, Near.y, Near.z) / Near.w;
+	*Dir = Normalize(v3(Far.x, Far.y, Far.z) / Far.w - *Origin);
+
+	if (!IntersectBox(*Origin, *Dir, Derived->BoxMin, Derived->BoxMax, &tNear, &tFar) || tFar <= 0)
+	{
+		return (FALSE);
+	}
+
+	*tMin = _Max(tNear, 0.0f);
+	*tMax = tFar;
+
+	return (TRUE);
+}
+
+void
+RenderVolume(image *Image,
+			 render_scene *Scene,
+			 m4 &View,
+			 m4 &Proj)
+{
+	derived_params		Derived;
+
+
+	DeriveParams(&Derived, Scene->World, View, Proj, Scene->Volume, Scene->Params);
+	Image->Pixels.assign(u64(Image->Width) * Image->Height, v4(0, 0, 0, 0));
+
+	ParallelFor2D(Image->Width, Image->Height, RENDER_TILE, RENDER_TILE, [&](job_range Range)
+	{
+		for (u32 Y = u32(Range.Min.y); Y < u32(Range.Max.y); Y++)
+		{
+			for (u32 X = u32(Range.Min.x); X < u32(Range.Max.x); X++)
+			{
+				v3 Origin, Dir;
+				f32 tMin, tMax;
+
+				if (PixelRayBox(&Derived, X + 0.5f, Y + 0.5f, Image->Width, Image->Height, &Origin, &Dir, &tMin, &tMax))
+				{
+					Image->Pixels[u64(Y) * Image->Width + X] = CastRayLight(Scene, Origin, Dir, tMin, tMax, Derived.MarchStep, nullptr);
+				}
+			}
+		}
+	});
+}
+
+// One march with every ray starting MarchJitter(X, Y, Frame) of a step in.
+// Positions (optional) gets the world position at each ray's tDepth with w
+// = 1, w = 0 where the ray misses the volume.
+void
+RenderVolumeJittered(image *Image,
+					 std::vector<v4> *Positions,
+					 render_scene *Scene,
+					 m4 &View,
+					 m4 &Proj,
+					 u32 Frame)
+{
+	derived_params		Derived;
+
+
+	DeriveParams(&Derived, Scene->World, View, Proj, Scene->Volume, Scene->Params);
+	Image->Pixels.assign(u64(Image->Width) * Image->Height, v4(0, 0, 0, 0));
+	if (Positions)
+	{
+		Positions->assign(Image->Pixels.size(), v4(0, 0, 0, 0));
+	}
+
+	ParallelFor2D(Image->Width, Image->Height, RENDER_TILE, RENDER_TILE, [&](job_range Range)
+	{
+		for (u32 Y = u32(Range.Min.y); Y < u32(Range.Max.y); Y++)
+		{
+			for (u32 X = u32(Range.Min.x); X < u32(Range.Max.x); X++)
+			{
+				v3 Origin, Dir;
+				f32 tMin, tMax;
+
+				if (PixelRayBox(&Derived, X + 0.5f, Y + 0.5f, Image->Width, Image->Height, &Origin, &Dir, &tMin, &tMax))
+				{
+					u64 Pixel = u64(Y) * Image->Width + X;
+					f32 tDepth;
+
+					tMin += MarchJitter(X, Y, Frame) * Derived.MarchStep;
+					Image->Pixels[Pixel] = CastRayLight(Scene, Origin, Dir, tMin, tMax, Derived.MarchStep, &tDepth);
+					if (Positions)
+					{
+						v3 Pos = Origin + tDepth * Dir;
+
+						(*Positions)[Pixel] = v4(Pos.x, Pos.y, Pos.z, 1);
+					}
+				}
+			}
+		}
+	});
+}
+
+// Adds one jittered frame to every pixel of Accum, which starts over when
+// it's empty or the size doesn't match. Frame N of the accumulation uses
+// jitter frame N, the viewer uses a running frame counter but any run of
+// consecutive frames is spread as evenly as any other.
+void
+RenderVolumeProgressive(image_accumulator *Accum,
+						render_scene *Scene,
+						m4 &View,
+						m4 &Proj)
+{
+	image	Frame;
+
+
+	if (Accum->Sum.size() != u64(Accum->Width) * Accum->Height)
+	{
+		Accum->Sum.assign(u64(Accum->Width) * Accum->Height, v4(0, 0, 0, 0));
+		Accum->SampleCount = 0;
+	}
+
+	Frame.Width = Accum->Width;
+	Frame.Height = Accum->Height;
+	RenderVolumeJittered(&Frame, nullptr, Scene, View, Proj, Accum->SampleCount);
+
+	for (u64 I = 0; I < Accum->Sum.size(); I++)
+	{
+		Accum->Sum[I] += Frame.Pixels[I];
+	}
+
+	Accum->SampleCount++;
+	Accum->PassCount++;
+}
+
+// Length of each pixel's ray inside the volume box over the box's longest
+// edge, 0 where it misses
+void
+RenderRayLengths(std::vector<f32> *Lengths,
+				 u32 Width,
+				 u32 Height,
+				 render_scene *Scene,
+				 m4 &View,
+				 m4 &Proj)
+{
+	derived_params		Derived;
+
+
+	DeriveParams(&Derived, Scene->World, View, Proj, Scene->Volume, Scene->Params);
+
+	v3 Extent = Derived.BoxMax - Derived.BoxMin;
+	f32 BoxSize = _Max(_Max(Extent.x, Extent.y), Extent.z);
+
+	Lengths->assign(u64(Width) * Height, 0.0f);
+
+	ParallelFor2D(Width, Height, RENDER_TILE, RENDER_TILE, [&](job_range Range)
+	{
+		for (u32 Y = u32(Range.Min.y); Y < u32(Range.Max.y); Y++)
+		{
+			for (u32 X = u32(Range.Min.x); X < u32(Range.Max.x); X++)
+			{
+				v3 Origin, Dir;
+				f32 tMin, tMax;
+
+				if (PixelRayBox(&Derived, X + 0.5f, Y + 0.5f, Width, Height, &Origin, &Dir, &tMin, &tMax))
+				{
+					(*Lengths)[u64(Y) * Width + X] = (tMax - tMin) / BoxSize;
+				}
+			}
+		}
+	});
+}
+
+// Joint bilateral upsample of Low to Full's size with the ray lengths as the
+// guide. Full->Width and Height have to be set, Low is Downsample times
+// smaller rounded up. Where every tap is rejected the closest length wins.
+void
+UpsampleDepthAware(image *Full,
+				   image *Low,
+				   std::vector<f32> &FullLengths,
+				   std::vector<f32> &LowLengths,
+				   u32 Downsample,
+				   f32 Sigma)
+{
+	s32		LowWidth = s32(Low->Width),
+			LowHeight = s32(Low->Height);
+
+
+	Full->Pixels.resize(u64(Full->Width) * Full->Height);
+
+	ParallelFor2D(Full->Width, Full->Height, RENDER_TILE, RENDER_TILE, [&](job_range Range)
+	{
+		for (u32 Y = u32(Range.Min.y); Y < u32(Range.Max.y); Y++)
+		{
+			for (u32 X = u32(Range.Min.x); X < u32(Range.Max.x); X++)
+			{
+				u64 Pixel = u64(Y) * Full->Width + X;
+				f32 Length = FullLengths[Pixel];
+
+				// Low pixel centres are at integers here
+				f32 U = (X + 0.5f) / Downsample - 0.5f;
+				f32 V = (Y + 0.5f) / Downsample - 0.5f;
+				s32 X0 = s32(floorf(U)),
+					Y0 = s32(floorf(V));
+				f32 Fx = U - X0,
+					Fy = V - Y0;
+				v4 Sum = v4(0, 0, 0, 0);
+				f32 WeightSum = 0;
+				f32 Closest = INFINITY;
+				v4 ClosestColor = v4(0, 0, 0, 0);
+
+				for (s32 J = 0; J < 2; J++)
+				{
+					for (s32 I = 0; I < 2; I++)
+					{
+						s32 Tx = _Min(_Max(X0 + I, 0), LowWidth - 1);
+						s32 Ty = _Min(_Max(Y0 + J, 0), LowHeight - 1);
+						u64 Tap = u64(Ty) * LowWidth + Tx;
+						f32 Difference = fabsf(LowLengths[Tap] - Length);
+						f32 Falloff = Difference / Sigma;
+						f32 Weight = (I ? Fx : 1 - Fx) * (J ? Fy : 1 - Fy) * FastExp(-Falloff * Falloff);
+
+						Sum += Weight * Low->Pixels[Tap];
+						WeightSum += Weight;
+
+						if (Difference < Closest)
+						{
+							Closest = Difference;
+							ClosestColor = Low->Pixels[Tap];
+						}
+					}
+				}
+
+				Full->Pixels[Pixel] = WeightSum > 1e-6f ? Sum / WeightSum : ClosestColor;
+			}
+		}
+	});
+}
+
+// RenderVolume() at 1 / Downsample of the resolution, upsampled back
+void
+RenderVolumeScaled(image *Image,
+				   render_scene *Scene,
+				   m4 &View,
+				   m4 &Proj,
+				   u32 Downsample)
+{
+	image				Low;
+	std::vector<f32>	FullLengths,
+						LowLengths;
+
+
+	if (Downsample <= 1)
+	{
+		RenderVolume(Image, Scene, View, Proj);
+		return;
+	}
+
+	Low.Width = (Image->Width + Downsample - 1) / Downsample;
+	Low.Height = (Image->Height + Downsample - 1) / Downsample;
+
+	// Rounding up makes Low cover a little more than Image, stretch the
+	// projection so its pixels still land on block centres
+	v3 Stretch = v3(f32(Image->Width) / f32(Low.Width * Downsample), f32(Image->Height) / f32(Low.Height * Downsample), 1);
+	m4 LowProj = Mat4Translate(Stretch.x - 1, 1 - Stretch.y, 0) * Mat4Scale(Stretch) * Proj;
+
+	RenderVolume(&Low, Scene, View, LowProj);
+	RenderRayLengths(&FullLengths, Image->Width, Image->Height, Scene, View, Proj);
+	RenderRayLengths(&LowLengths, Low.Width, Low.Height, Scene, View, LowProj);
+	UpsampleDepthAware(Image, &Low, FullLengths, LowLengths, Downsample, UPSAMPLE_SIGMA);
+}
+
+void
+ResolveAccumulator(image *Image,
+				   image_accumulator *Accum)
+{
+	f32		Scale = 1.0f / _Max(Accum->SampleCount, 1u);
+
+
+	Image->Width = Accum->Width;
+	Image->Height = Accum->Height;
+	Image->Pixels.resize(Accum->Sum.size());
+
+	for (u64 I = 0; I < Accum->Sum.size(); I++)
+	{
+		Image->Pixels[I] = Scale * Accum->Sum[I];
+	}
+}
+
+// Binary PPM over black
+b32
+WriteImagePPM(image *Image,
+			  char const *Path)
+{
+	FILE				*File = fopen(Path, "wb");
+	std::vector<u8>		Row(Image->Width * 3);
+
+
+	if (!File)
+	{
+		return (FALSE);
+	}
+
+	fprintf(File, "P6\n%u %u\n255\n", Image->Width, Image->Height);
+
+	for (u32 Y = 0; Y < Image->Height; Y++)
+	{
+		for (u32 X = 0; X < Image->Width; X++)
+		{
+			v4 Pixel = Image->Pixels[u64(Y) * Image->Width + X];
+
+			for (u32 C = 0; C < 3; C++)
+			{
+				f32 Value = Pixel.Elements[C] < 0 ? 0 : (Pixel.Elements[C] > 1 ? 1 : Pixel.Elements[C]);
+
+				Row[X * 3 + C] = u8(Value * 255.0f + 0.5f);
+			}
+		}
+
+		fwrite(Row.data(), 1, Row.size(), File);
+	}
+
+	fclose(File);
+
+	return (TRUE);
+}
+
+// |A - B| * Gain per channel, alpha's difference goes in every channel it's
+// bigger than so coverage errors show up in white
+void
+DifferenceImage(image *Difference,
+				image *A,
+				image *B,
+				f32 Gain)
+{
+	Difference->Width = A->Width;
+	Difference->Height = A->Height;
+	Difference->Pixels.resize(A->Pixels.size());
+
+	for (u64 I = 0; I < A->Pixels.size(); I++)
+	{
+		v4 Delta = A->Pixels[I] - B->Pixels[I];
+		f32 Alpha = fabsf(Delta.w) * Gain;
+
+		for (u32 C = 0; C < 3; C++)
+		{
+			Difference->Pixels[I].Elements[C] = _Max(fabsf(Delta.Elements[C]) * Gain, Alpha);
+		}
+		Difference->Pixels[I].w = 1;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Temporal reprojection
+
+// Weights of the 4 taps around a fraction t between taps 1 and 2
+void
+CatmullRomWeights(f32 t,
+				  f32 *Weights)
+{
+	f32		t2 = t * t,
+			t3 = t2 * t;
+
+
+	Weights[0] = 0.5f * (-t3 + 2 * t2 - t);
+	Weights[1] = 0.5f * (3 * t3 - 5 * t2 + 2);
+	Weights[2] = 0.5f * (-3 * t3 + 4 * t2 + t);
+	Weights[3] = 0.5f * (t3 - t2);
+}
+
+// Catmull-Rom over the 4x4 texels around (U, V), texel centres at integers.
+// Bilinear softens the history a little on every reprojection and it adds
+// up over a few frames, this keeps it sharp. The clamp afterwards takes care
+// of the overshoot.
+v4
+SampleHistory(temporal_history *History,
+			  f32 U,
+			  f32 V)
+{
+	s32		Width = s32(History->Width),
+			Height = s32(History->Height),
+			X0 = s32(floorf(U)),
+			Y0 = s32(floorf(V));
+	f32		Wx[4],
+			Wy[4];
+	v4		Result = v4(0, 0, 0, 0);
+
+
+	CatmullRomWeights(U - X0, Wx);
+	CatmullRomWeights(V - Y0, Wy);
+
+	for (s32 J = 0; J < 4; J++)
+	{
+		s32 Y = _Min(_Max(Y0 - 1 + J, 0), Height - 1);
+
+		for (s32 I = 0; I < 4; I++)
+		{
+			s32 X = _Min(_Max(X0 - 1 + I, 0), Width - 1);
+
+			Result += (Wx[I] * Wy[J]) * History->Color[u64(Y) * Width + X];
+		}
+	}
+
+	return (Result);
+}
+
+void
+ResolveTemporal(temporal_history *History,
+				image *Current,
+				std::vector<v4> &Positions,
+				m4 &ViewProj,
+				u32 MaxFrames)
+{
+	std::vector<v4>		Resolved;
+	s32					Width = s32(Current->Width),
+						Height = s32(Current->Height);
+	b32					Moved;
+	u32					Frames;
+	f32					Weight;
+
+
+	if (History->Width != Current->Width || History->Height != Current->Height ||
+		History->Color.size() != Current->Pixels.size() || !History->Frames)
+	{
+		History->Width = Current->Width;
+		History->Height = Current->Height;
+		History->Color = Current->Pixels;
+		History->Frames = 1;
+		History->ViewProj = ViewProj;
+		return;
+	}
+
+	Moved = memcmp(&ViewProj, &History->ViewProj, sizeof(m4)) != 0;
+	Frames = Moved ? _Min(History->Frames, MaxFrames) : History->Frames;
+	Weight = 1.0f / f32(Frames + 1);
+
+	Resolved.resize(Current->Pixels.size());
+
+	ParallelFor2D(u32(Width), u32(Height), RENDER_TILE, RENDER_TILE, [&](job_range Range)
+	{
+		for (s32 Y = Range.Min.y; Y < Range.Max.y; Y++)
+		{
+			for (s32 X = Range.Min.x; X < Range.Max.x; X++)
+			{
+				u64 Pixel = u64(Y) * Width + X;
+				v4 New = Current->Pixels[Pixel];
+				v4 Previous;
+
+				if (!Moved)
+				{
+					Previous = History->Color[Pixel];
+				}
+				else
+				{
+					v4 Pos = Positions[Pixel];
+					v4 Clip = History->ViewProj * v4(Pos.x, Pos.y, Pos.z, 1);
+
+					if (Pos.w == 0 || Clip.w <= 0)
+					{
+						Resolved[Pixel] = New;
+						continue;
+					}
+
+					// Pixel centres at integers, like the bilinear fetch in the
+					// shader
+					f32 U = (0.5f + 0.5f * Clip.x / Clip.w) * Width - 0.5f;
+					f32 V = (0.5f - 0.5f * Clip.y / Clip.w) * Height - 0.5f;
+
+					if (U < -0.5f || V < -0.5f || U > Width - 0.5f || V > Height - 0.5f)
+					{
+						Resolved[Pixel] = New;
+						continue;
+					}
+
+					Previous = SampleHistory(History, U, V);
+
+					// Neighbourhood clamp to the mean +- TEMPORAL_CLAMP_SIGMA standard
+					// deviations, tighter than the min/max box when the frame is
+					// noisy
+					v4 Mean = v4(0, 0, 0, 0),
+					   Square = v4(0, 0, 0, 0);
+
+					for (s32 Dy = -1; Dy <= 1; Dy++)
+					{
+						for (s32 Dx = -1; Dx <= 1; Dx++)
+						{
+							s32 Nx = _Min(_Max(X + Dx, 0), Width - 1);
+							s32 Ny = _Min(_Max(Y + Dy, 0), Height - 1);
+							v4 Neighbour = Current->Pixels[u64(Ny) * Width + Nx];
+
+							Mean += Neighbour;
+							Square += Hadamard(Neighbour, Neighbour);
+						}
+					}
+
+					for (u32 C = 0; C < 4; C++)
+					{
+						f32 M = Mean.Elements[C] / 9.0f;
+						f32 Sigma = sqrtf(_Max(Square.Elements[C] / 9.0f - M * M, 0.0f));
+
+						Previous.Elements[C] = _Min(_Max(Previous.Elements[C], M - TEMPORAL_CLAMP_SIGMA * Sigma), M + TEMPORAL_CLAMP_SIGMA * Sigma);
+					}
+				}
+
+				Resolved[Pixel] = Previous + Weight * (New - Previous);
+			}
+		}
+	});
+
+	History->Color.swap(Resolved);
+	History->Frames = Frames + 1;
+	History->ViewProj = ViewProj;
+}
+
+// Text, one "pos front up" camera per line
+b32
+LoadCameraPath(camera_path *Path,
+			   char const *FileName)
+{
+	FILE		*File = fopen(FileName, "r");
+	camera_key	Key;
+
+
+	if (!File)
+	{
+		return (FALSE);
+	}
+
+	Path->Keys.clear();
+	while (fscanf(File, "%f %f %f %f %f %f %f %f %f",
+				  &Key.Pos.x, &Key.Pos.y, &Key.Pos.z,
+				  &Key.Front.x, &Key.Front.y, &Key.Front.z,
+				  &Key.Up.x, &Key.Up.y, &Key.Up.z) == 9)
+	{
+		Path->Keys.push_back(Key);
+	}
+
+	fclose(File);
+
+	return (!Path->Keys.empty());
+}
+
+b32
+SaveCameraPath(camera_path *Path,
+			   char const *FileName)
+{
+	FILE		*File = fopen(FileName, "w");
+
+
+	if (!File)
+	{
+		return (FALSE);
+	}
+
+	for (u64 I = 0; I < Path->Keys.size(); I++)
+	{
+		camera_key *Key = &Path->Keys[I];
+
+		fprintf(File, "%f %f %f %f %f %f %f %f %f\n",
+				Key->Pos.x, Key->Pos.y, Key->Pos.z,
+				Key->Front.x, Key->Front.y, Key->Front.z,
+				Key->Up.x, Key->Up.y, Key->Up.z);
+	}
+
+	fclose(File);
+
+	return (TRUE);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Tracking renderer
+
+void
+BuildMajorantGrid(majorant_grid *Grid,
+				  volume *Volume,
+				  f32 DensityScale)
+{
+	s32		VolumeDims[3] = { s32(Volume->Width), s32(Volume->Height), s32(Volume->Depth) };
+
+
+	Grid->Dims = v3i((VolumeDims[0] + MAJORANT_BRICK - 1) / MAJORANT_BRICK,
+					 (VolumeDims[1] + MAJORANT_BRICK - 1) / MAJORANT_BRICK,
+					 (VolumeDims[2] + MAJORANT_BRICK - 1) / MAJORANT_BRICK);
+	Grid->BricksPerTex = v3(f32(VolumeDims[0]) / MAJORANT_BRICK,
+							f32(VolumeDims[1]) / MAJORANT_BRICK,
+							f32(VolumeDims[2]) / MAJORANT_BRICK);
+	Grid->Max.assign(u64(Grid->Dims.x) * Grid->Dims.y * Grid->Dims.z, 0.0f);
+
+	// A row of bricks per piece
+	ParallelFor3D(Grid->Dims, v3i(Grid->Dims.x, 1, 1), [&](job_range Range)
+	{
+		for (s32 BZ = Range.Min.z; BZ < Range.Max.z; BZ++)
+		{
+			for (s32 BY = Range.Min.y; BY < Range.Max.y; BY++)
+			{
+				for (s32 BX = Range.Min.x; BX < Range.Max.x; BX++)
+				{
+					s32 Brick[3] = { BX, BY, BZ };
+					s32 First[3], Last[3];
+					f32 Max = 0;
+
+					// A trilinear fetch inside the brick reads one voxel past it
+					// on each side
+					for (u32 I = 0; I < 3; I++)
+					{
+						First[I] = _Max(Brick[I] * MAJORANT_BRICK - 1, 0);
+						Last[I] = _Min(Brick[I] * MAJORANT_BRICK + MAJORANT_BRICK, VolumeDims[I] - 1);
+					}
+
+					for (s32 Z = First[2]; Z <= Last[2]; Z++)
+					{
+						for (s32 Y = First[1]; Y <= Last[1]; Y++)
+						{
+							f32 *Row = &Volume->Data[(u64(Z) * VolumeDims[1] + Y) * VolumeDims[0]];
+
+							for (s32 X = First[0]; X <= Last[0]; X++)
+							{
+								Max = _Max(Max, Row[X]);
+							}
+						}
+					}
+
+					Grid->Max[(u64(BZ) * Grid->Dims.y + BY) * Grid->Dims.x + BX] = DensityScale * Max;
+				}
+			}
+		}
+	});
+}
+
+// 3D DDA over the bricks a ray crosses, t in world units
+struct majorant_walk
+{
+	majorant_grid		*Grid;
+	s32					Brick[3],
+						Step[3];
+	f32					tNext[3],
+						tDelta[3];
+	f32					t,
+						tEnd;
+};
+
+void
+BeginMajorantWalk(majorant_walk *Walk,
+				  majorant_grid *Grid,
+				  m4 &InvWorld,
+				  v3 RayOrigin,
+				  v3 RayDirection,
+				  f32 tMin,
+				  f32 tMax)
+{
+	v4		TexOrigin = InvWorld * v4(RayOrigin.x, RayOrigin.y, RayOrigin.z, 1);
+	v4		TexDir = InvWorld * v4(RayDirection.x, RayDirection.y, RayDirection.z, 0);
+	s32		Dims[3] = { Grid->Dims.x, Grid->Dims.y, Grid->Dims.z };
+
+
+	Walk->Grid = Grid;
+	Walk->t = tMin;
+	Walk->tEnd = tMax;
+
+	for (u32 I = 0; I < 3; I++)
+	{
+		f32 Origin = TexOrigin.Elements[I] * Grid->BricksPerTex.Elements[I];
+		f32 Dir = TexDir.Elements[I] * Grid->BricksPerTex.Elements[I];
+		f32 Start = Origin + tMin * Dir;
+
+		Walk->Brick[I] = _Min(_Max(s32(floorf(Start)), 0), Dims[I] - 1);
+
+		if (Dir > 0)
+		{
+			Walk->Step[I] = 1;
+			Walk->tDelta[I] = 1.0f / Dir;
+			Walk->tNext[I] = tMin + (Walk->Brick[I] + 1 - Start) / Dir;
+		}
+		else if (Dir < 0)
+		{
+			Walk->Step[I] = -1;
+			Walk->tDelta[I] = -1.0f / Dir;
+			Walk->tNext[I] = tMin + (Walk->Brick[I] - Start) / Dir;
+		}
+		else
+		{
+			Walk->Step[I] = 0;
+			Walk->tDelta[I] = 0;
+			Walk->tNext[I] = F32_MAX;
+		}
+	}
+}
+
+// Next segment [*t0, *t1) of the ray inside one brick, FALSE past tEnd
+b32
+NextMajorantSegment(majorant_walk *Walk,
+					f32 *t0,
+					f32 *t1,
+					f32 *Majorant)
+{
+	majorant_grid		*Grid = Walk->Grid;
+	u32					Axis = 0;
+
+
+	if (Walk->t >= Walk->tEnd ||
+		Walk->Brick[0] < 0 || Walk->Brick[0] >= Grid->Dims.x ||
+		Walk->Brick[1] < 0 || Walk->Brick[1] >= Grid->Dims.y ||
+		Walk->Brick[2] < 0 || Walk->Brick[2] >= Grid->Dims.z)
+	{
+		return (FALSE);
+	}
+
+	if (Walk->tNext[1] < Walk->tNext[Axis])
+	{
+		Axis = 1;
+	}
+	if (Walk->tNext[2] < Walk->tNext[Axis])
+	{
+		Axis = 2;
+	}
+
+	*t0 = Walk->t;
+	*t1 = _Min(Walk->tNext[Axis], Walk->tEnd);
+	*Majorant = Grid->Max[(u64(Walk->Brick[2]) * Grid->Dims.y + Walk->Brick[1]) * Grid->Dims.x + Walk->Brick[0]];
+
+	Walk->t = *t1;
+	Walk->Brick[Axis] += Walk->Step[Axis];
+	Walk->tNext[Axis] += Walk->tDelta[Axis];
+
+	return (TRUE);
+}
+
+// Transmittance from Pos towards Light, an unbiased estimate. Stops at the
+// box or at a point light inside it, like the lightmarch.
+f32
+RatioTrackLight(render_scene *Scene,
+				majorant_grid *Majorants,
+				light *Light,
+				v3 Pos,
+				random_series *Series)
+{
+	raymarch_params		*Params = Scene->Params;
+	v4					BoxMin = Scene->World * v4(0, 0, 0, 1),
+						BoxMax = Scene->World * v4(1, 1, 1, 1);
+	majorant_walk		Walk;
+	v3					LightDir;
+	f32					tNear,
+						tFar,
+						t0,
+						t1,
+						Majorant;
+	f32					Transmittance = 1;
+
+
+	if (!LightDirection(Light, Pos, &LightDir))
+	{
+		return (1.0f);
+	}
+
+	IntersectBox(Pos, LightDir, v3(BoxMin.x, BoxMin.y, BoxMin.z), v3(BoxMax.x, BoxMax.y, BoxMax.z), &tNear, &tFar);
+	BeginMajorantWalk(&Walk, Majorants, Scene->InvWorld, Pos, LightDir, 0, MarchLength(Light, Pos, tFar));
+
+	while (NextMajorantSegment(&Walk, &t0, &t1, &Majorant))
+	{
+		f32 Extinction = Majorant * Params->Absorption;
+
+		if (Extinction <= 0)
+		{
+			continue;
+		}
+
+		for (f32 t = t0 - FastLog(1 - RandomUnilateral(Series)) / Extinction;
+			 t < t1;
+			 t -= FastLog(1 - RandomUnilateral(Series)) / Extinction)
+		{
+			v4 TexPos = Scene->InvWorld * v4(Pos.x + t * LightDir.x, Pos.y + t * LightDir.y, Pos.z + t * LightDir.z, 1);
+			f32 Density = Params->DensityScale * SampleVolume(Scene->Volume, v3(TexPos.x, TexPos.y, TexPos.z));
+
+			Transmittance *= 1 - Density * Params->Absorption / Extinction;
+		}
+	}
+
+	return (Transmittance);
+}
+
+// One sample of CastRayLight(): radiance / Absorption at the first real
+// collision, alpha 1 if there was one
+v4
+DeltaTrackRay(render_scene *Scene,
+			  majorant_grid *Majorants,
+			  v3 RayOrigin,
+			  v3 RayDirection,
+			  f32 tMin,
+			  f32 tMax,
+			  random_series *Series)
+{
+	raymarch_params		*Params = Scene->Params;
+	majorant_walk		Walk;
+	f32					t0,
+						t1,
+						Majorant;
+
+
+	BeginMajorantWalk(&Walk, Majorants, Scene->InvWorld, RayOrigin, RayDirection, tMin, tMax);
+
+	while (NextMajorantSegment(&Walk, &t0, &t1, &Majorant))
+	{
+		f32 Extinction = Majorant * Params->Absorption;
+
+		if (Extinction <= 0)
+		{
+			continue;
+		}
+
+		for (f32 t = t0 - FastLog(1 - RandomUnilateral(Series)) / Extinction;
+			 t < t1;
+			 t -= FastLog(1 - RandomUnilateral(Series)) / Extinction)
+		{
+			v3 Pos = RayOrigin + t * RayDirection;
+			v4 TexPos = Scene->InvWorld * v4(Pos.x, Pos.y, Pos.z, 1);
+			f32 Density = Params->DensityScale * SampleVolume(Scene->Volume, v3(TexPos.x, TexPos.y, TexPos.z));
+
+			// Null collision
+			if (RandomUnilateral(Series) * Extinction >= Density * Params->Absorption)
+			{
+				continue;
+			}
+
+			v4 LightTransmittance = v4(0, 0, 0, 0);
+
+			for (u32 L = 0; L < _Min(Params->LightCount, u32(MAX_LIGHTS)); L++)
+			{
+				LightTransmittance.Elements[L] = RatioTrackLight(Scene, Majorants, &Params->Lights[L], Pos, Series);
+			}
+
+			v3 Radiance = LightRadiance(Params, LightTransmittance) + v3(Params->Ambient, Params->Ambient, Params->Ambient);
+
+			if (Params->ScatterOrder != SCATTER_OFF)
+			{
+				Radiance = Radiance + Params->MultiScatter * LookupScatter(Scene->Scatter, Scene->Grid, Pos, RayDirection, Params->PhaseG);
+			}
+
+			Radiance = Radiance / Params->Absorption;
+
+			return (v4(Radiance.x, Radiance.y, Radiance.z, 1));
+		}
+	}
+
+	return (v4(0, 0, 0, 0));
+}
+
+// -log(1 - Xi) / Extinction, an exponential free flight distance, for each
+// lane in Lanes. Lane L draws Xi from Series[L].
+f32x4
+FreeFlightX4(random_series *Series,
+			 u32 Lanes,
+			 f32x4 Extinction)
+{
+	f32		Xi[4] = { 1, 1, 1, 1 };
+
+
+	for (u32 L = 0; L < 4; L++)
+	{
+		if (Lanes & (1 << L))
+		{
+			Xi[L] = 1 - RandomUnilateral(&Series[L]);
+		}
+	}
+
+	return (F32x4Sub(F32x4Set1(0), F32x4Div(F32x4Log(F32x4Load(Xi), MG_EXP_TIER), Extinction)));
+}
+
+// The lanes of Tracking whose t is past the end of their segment move on to
+// the next brick with anything in it and draw a free flight into it. Lanes
+// whose walk ends are cleared from Tracking.
+void
+AdvanceMajorantWalks(majorant_walk *Walks,
+					 f32 Absorption,
+					 random_series *Series,
+					 b32x4 *Tracking,
+					 f32x4 *t,
+					 f32x4 *t1,
+					 f32x4 *Extinction)
+{
+	u32		Lanes = B32x4Bits(B32x4AndNot(*Tracking, F32x4Less(*t, *t1)));
+	u32		Ended = 0;
+	f32		T0[4] = {},
+			T1[4] = {},
+			Extinctions[4] = { 1, 1, 1, 1 };
+	f32		Majorant;
+
+
+	if (!Lanes)
+	{
+		return;
+	}
+
+	for (u32 L = 0; L < 4; L++)
+	{
+		if (!(Lanes & (1 << L)))
+		{
+			continue;
+		}
+
+		do
+		{
+			if (!NextMajorantSegment(&Walks[L], &T0[L], &T1[L], &Majorant))
+			{
+				Ended |= 1 << L;
+				break;
+			}
+
+			Extinctions[L] = Majorant * Absorption;
+		} while (Extinctions[L] <= 0);
+	}
+
+	Lanes &= ~Ended;
+
+	b32x4 Moved = B32x4FromBits(Lanes);
+	f32x4 NewExtinction = F32x4Load(Extinctions);
+
+	*t = F32x4Select(Moved, F32x4Add(F32x4Load(T0), FreeFlightX4(Series, Lanes, NewExtinction)), *t);
+	*t1 = F32x4Select(Moved, F32x4Load(T1), *t1);
+	*Extinction = F32x4Select(Moved, NewExtinction, *Extinction);
+	*Tracking = B32x4AndNot(*Tracking, B32x4FromBits(Ended));
+}
+
+// RatioTrackLight() from four points, the lanes outside Active come back 1
+f32x4
+RatioTrackBatch(render_scene *Scene,
+				majorant_grid *Majorants,
+				light *Light,
+				v3x4 Pos,
+				b32x4 Active,
+				random_series *Series)
+{
+	raymarch_params		*Params = Scene->Params;
+	v4					BoxMin = Scene->World * v4(0, 0, 0, 1),
+						BoxMax = Scene->World * v4(1, 1, 1, 1);
+	f32x4				Absorption = F32x4Set1(Params->Absorption),
+						DensityScale = F32x4Set1(Params->DensityScale),
+						One = F32x4Set1(1),
+						Transmittance = One,
+						t = F32x4Set1(0),
+						t1 = F32x4Set1(0),
+						Extinction = One;
+	majorant_walk		Walks[4];
+	v3					Dirs[4];
+	u32					Lanes = 0;
+
+
+	for (u32 L = 0; L < 4; L++)
+	{
+		v3 Origin = V3x4Lane(Pos, L);
+		f32 tNear, tFar;
+
+		Dirs[L] = v3(0, 0, 1);
+
+		if (!(B32x4Bits(Active) & (1 << L)) || !LightDirection(Light, Origin, &Dirs[L]))
+		{
+			continue;
+		}
+
+		IntersectBox(Origin, Dirs[L], v3(BoxMin.x, BoxMin.y, BoxMin.z), v3(BoxMax.x, BoxMax.y, BoxMax.z), &tNear, &tFar);
+		BeginMajorantWalk(&Walks[L], Majorants, Scene->InvWorld, Origin, Dirs[L], 0, MarchLength(Light, Origin, tFar));
+		Lanes |= 1 << L;
+	}
+
+	b32x4 Tracking = B32x4FromBits(Lanes);
+	v3x4 LightDir = V3x4Load(Dirs);
+
+	for (;;)
+	{
+		AdvanceMajorantWalks(Walks, Params->Absorption, Series, &Tracking, &t, &t1, &Extinction);
+
+		if (!B32x4Any(Tracking))
+		{
+			break;
+		}
+
+		b32x4 Collisions = B32x4And(Tracking, F32x4Less(t, t1));
+
+		if (!B32x4Any(Collisions))
+		{
+			continue;
+		}
+
+		v3x4 TexPos = TransformPoint(Scene->InvWorld, Pos + t * LightDir);
+		f32x4 Density = F32x4Mul(DensityScale, SampleVolumeX4(Scene->Volume, TexPos, Collisions));
+		f32x4 Null = F32x4Sub(One, F32x4Div(F32x4Mul(Density, Absorption), Extinction));
+
+		Transmittance = F32x4Select(Collisions, F32x4Mul(Transmittance, Null), Transmittance);
+		t = F32x4Select(Collisions, F32x4Add(t, FreeFlightX4(Series, B32x4Bits(Collisions), Extinction)), t);
+	}
+
+	return (Transmittance);
+}
+
+// DeltaTrackRay() for the active rays of Rays. Energy gets radiance /
+// Absorption and Transmittance 0 for the lanes that collided, the others
+// keep theirs. Lane L draws from Series[L].
+void
+DeltaTrackBatch(render_scene *Scene,
+				majorant_grid *Majorants,
+				ray_batch *Rays,
+				random_series *Series)
+{
+	raymarch_params		*Params = Scene->Params;
+	f32x4				Absorption = F32x4Set1(Params->Absorption),
+						DensityScale = F32x4Set1(Params->DensityScale),
+						t = F32x4Set1(0),
+						t1 = F32x4Set1(0),
+						Extinction = F32x4Set1(1);
+	b32x4				Tracking = Rays->Active;
+	v3x4				Collision = Rays->Origin;
+	majorant_walk		Walks[4];
+	f32					tMin[4],
+						tMax[4];
+	u32					Collided = 0;
+
+
+	F32x4Store(tMin, Rays->tMin);
+	F32x4Store(tMax, Rays->tMax);
+
+	for (u32 L = 0; L < 4; L++)
+	{
+		if (B32x4Bits(Rays->Active) & (1 << L))
+		{
+			BeginMajorantWalk(&Walks[L], Majorants, Scene->InvWorld, V3x4Lane(Rays->Origin, L), V3x4Lane(Rays->Dir, L), tMin[L], tMax[L]);
+		}
+	}
+
+	for (;;)
+	{
+		AdvanceMajorantWalks(Walks, Params->Absorption, Series, &Tracking, &t, &t1, &Extinction);
+
+		if (!B32x4Any(Tracking))
+		{
+			break;
+		}
+
+		b32x4 Candidates = B32x4And(Tracking, F32x4Less(t, t1));
+		u32 Lanes = B32x4Bits(Candidates);
+
+		if (!Lanes)
+		{
+			continue;
+		}
+
+		v3x4 Pos = Rays->Origin + t * Rays->Dir;
+		f32x4 Density = F32x4Mul(DensityScale, SampleVolumeX4(Scene->Volume, TransformPoint(Scene->InvWorld, Pos), Candidates));
+		f32 Xi[4] = {};
+
+		for (u32 L = 0; L < 4; L++)
+		{
+			if (Lanes & (1 << L))
+			{
+				Xi[L] = RandomUnilateral(&Series[L]);
+			}
+		}
+
+		// Null collisions fly on, real ones stop
+		b32x4 Null = B32x4And(Candidates, F32x4GreaterEqual(F32x4Mul(F32x4Load(Xi), Extinction), F32x4Mul(Density, Absorption)));
+		b32x4 Real = B32x4AndNot(Candidates, Null);
+
+		t = F32x4Select(Null, F32x4Add(t, FreeFlightX4(Series, B32x4Bits(Null), Extinction)), t);
+		Collision = V3x4Select(Real, Pos, Collision);
+		Collided |= B32x4Bits(Real);
+		Tracking = B32x4AndNot(Tracking, Real);
+	}
+
+	if (!Collided)
+	{
+		return;
+	}
+
+	// Every light for all the collisions at once, each lane still draws its
+	// lights in order
+	v4 LightTransmittance[4];
+	v3 Energy[4];
+	f32 Lights[MAX_LIGHTS][4];
+
+	for (u32 L = 0; L < _Min(Params->LightCount, u32(MAX_LIGHTS)); L++)
+	{
+		F32x4Store(Lights[L], RatioTrackBatch(Scene, Majorants, &Params->Lights[L], Collision, B32x4FromBits(Collided), Series));
+	}
+
+	for (u32 Lane = 0; Lane < 4; Lane++)
+	{
+		Energy[Lane] = V3x4Lane(Rays->Energy, Lane);
+
+		if (!(Collided & (1 << Lane)))
+		{
+			continue;
+		}
+
+		v3 Pos = V3x4Lane(Collision, Lane);
+
+		for (u32 L = 0; L < _Min(Params->LightCount, u32(MAX_LIGHTS)); L++)
+		{
+			LightTransmittance[Lane].Elements[L] = Lights[L][Lane];
+		}
+
+		v3 Radiance = LightRadiance(Params, LightTransmittance[Lane]) + v3(Params->Ambient, Params->Ambient, Params->Ambient);
+
+		if (Params->ScatterOrder != SCATTER_OFF)
+		{
+			Radiance = Radiance + Params->MultiScatter * LookupScatter(Scene->Scatter, Scene->Grid, Pos, V3x4Lane(Rays->Dir, Lane), Params->PhaseG);
+		}
+
+		Energy[Lane] = Radiance / Params->Absorption;
+	}
+
+	Rays->Energy = V3x4Load(Energy);
+	Rays->Transmittance = F32x4Select(B32x4FromBits(Collided), F32x4Set1(0), Rays->Transmittance);
+}
+
+// Adds SamplesPerPixel samples to every pixel of Accum, which starts over
+// when it's empty or the size doesn't match
+void
+RenderVolumeTracked(image_accumulator *Accum,
+					render_scene *Scene,
+					majorant_grid *Majorants,
+					m4 &View,
+					m4 &Proj,
+					u32 SamplesPerPixel)
+{
+	derived_params		Derived;
+
+
+	if (Accum->Sum.size() != u64(Accum->Width) * Accum->Height)
+	{
+		Accum->Sum.assign(u64(Accum->Width) * Accum->Height, v4(0, 0, 0, 0));
+		Accum->SampleCount = 0;
+	}
+
+	DeriveParams(&Derived, Scene->World, View, Proj, Scene->Volume, Scene->Params);
+
+	ParallelFor2D(Accum->Width, Accum->Height, RENDER_TILE, RENDER_TILE, [&](job_range Range)
+	{
+		for (u32 Y = u32(Range.Min.y); Y < u32(Range.Max.y); Y++)
+		{
+			// Four pixels of the row per ray_batch
+			for (u32 X = u32(Range.Min.x); X < u32(Range.Max.x); X += 4)
+			{
+				u32 Count = _Min(u32(Range.Max.x) - X, 4u);
+				u64 Pixel = u64(Y) * Accum->Width + X;
+				random_series Series[4];
+				v4 Sum[4];
+
+				for (u32 L = 0; L < Count; L++)
+				{
+					Series[L] = RandomSeed(Accum->PassCount, Pixel + L);
+				}
+
+				for (u32 S = 0; S < SamplesPerPixel; S++)
+				{
+					v3 Origins[4], Dirs[4];
+					f32 tMin[4] = {}, tMax[4] = {};
+					u32 Hits = 0;
+					ray_batch Rays;
+
+					for (u32 L = 0; L < Count; L++)
+					{
+						// Jittered within the pixel, which also antialiases
+						f32 PixelX = (X + L) + RandomUnilateral(&Series[L]);
+						f32 PixelY = Y + RandomUnilateral(&Series[L]);
+
+						if (PixelRayBox(&Derived, PixelX, PixelY, Accum->Width, Accum->Height, &Origins[L], &Dirs[L], &tMin[L], &tMax[L]))
+						{
+							Hits |= 1 << L;
+						}
+					}
+
+					if (!Hits)
+					{
+						continue;
+					}
+
+					InitRayBatch(&Rays, Origins, Dirs, 4);
+					Rays.tMin = F32x4Load(tMin);
+					Rays.tMax = F32x4Load(tMax);
+					Rays.Active = B32x4FromBits(Hits);
+
+					DeltaTrackBatch(Scene, Majorants, &Rays, Series);
+
+					for (u32 L = 0; L < Count; L++)
+					{
+						if (Hits & (1 << L))
+						{
+							v3 Energy = V3x4Lane(Rays.Energy, L);
+
+							Sum[L] += v4(Energy.x, Energy.y, Energy.z, 1 - F32x4Lane(Rays.Transmittance, L));
+						}
+					}
+				}
+
+				for (u32 L = 0; L < Count; L++)
+				{
+					Accum->Sum[Pixel + L] += Sum[L];
+				}
+			}
+		}
+	});
+
+	Accum->SampleCount += SamplesPerPixel;
+	Accum->PassCount++;
+}
+
+#endif // RENDER_IMPL
+
+#endif // __RENDER_H__
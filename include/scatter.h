@@ -0,0 +1,643 @@
+#ifndef __SCATTER_H__
+#define __SCATTER_H__
+
+#include <vector>
+#include <mg.h>
+#include <volume.h>
+#include <probes.h>
+
+//////////////////////////////////////////////////////////////////////////////
+// Multiple scattering probes
+
+// NOTE(matthew): A coarse grid of spherical harmonic probes holding the
+// radiance arriving at each probe after one extra bounce. Each probe shoots
+// a fixed set of rays, and along each ray the in-scattered light is
+// accumulated the same way CastRayLight() does for the eye ray, with the
+// light transmittance looked up in the transmittance probes the raymarch
+// uses, so a rebake doesn't bake those again. That radiance is projected
+// onto L1 (4) or L2 (9) coefficients per colour channel.
+//
+// At shading time the phase function is applied by convolving with the
+// Henyey-Greenstein zonal harmonics (band l is scaled by g^l) and
+// evaluating in the view direction, so it costs one filtered fetch per
+// float4 of coefficients, 3 for L1 and 7 for L2.
+//
+// The coefficients live in a float4 3D texture with one slot of Dims.z
+// slices per float4, stacked along z. Sampling clamps to texel centres
+// inside a slot so the hardware filter never blends two slots.
+//
+// SCATTER_DIFFUSION is the cheap alternative: an isotropic radiance per
+// transmittance probe from relaxing a diffusion equation over the probe grid,
+// see RelaxScatterProbes(). It uses a single slot, so a single fetch.
+
+enum scatter_order
+{
+	SCATTER_OFF,
+	SCATTER_L1,
+	SCATTER_L2,
+	SCATTER_DIFFUSION,
+};
+
+#define SH_MAX_COEFFS		9
+
+struct scatter_bake_params
+{
+	u32		Order;
+	u32		RaysPerProbe;
+	u32		StepsPerRay;
+	s32		ProbeSpacing;		// transmittance probes per scatter probe, along each axis
+	u32		Iterations;			// red-black sweeps for SCATTER_DIFFUSION
+};
+
+struct scatter_volume
+{
+	v3i					Dims;
+	u32					Order;
+	u32					SlotCount;
+	std::vector<v4>		Texels;			// Dims.x * Dims.y * (Dims.z * SlotCount)
+};
+
+u32		ShCoeffCount(u32 Order);
+void	ShBasis(v3 Dir, f32 *Y);
+scatter_bake_params	DefaultScatterBakeParams(void);
+void	BakeScatterProbes(scatter_volume *Scatter, probe *Probes, volume *Volume, grid_params *Grid, raymarch_params *Params, m4 &InvWorld, scatter_bake_params *Bake);
+void	RelaxScatterProbes(scatter_volume *Scatter, probe *Probes, volume *Volume, grid_params *Grid, raymarch_params *Params, m4 &InvWorld, u32 Iterations);
+v3		LookupScatter(scatter_volume *Scatter, grid_params *Grid, v3 Pos, v3 Dir, f32 PhaseG);
+
+#ifdef SCATTER_IMPL
+
+u32
+ShCoeffCount(u32 Order)
+{
+	// Diffusion stores rgb in the first float4, which reads like one L0
+	// coefficient per channel
+	return (Order == SCATTER_DIFFUSION ? 1 : (Order + 1) * (Order + 1));
+}
+
+// Real SH basis up to L2, must match ShBasis() in raymarch.ps
+void
+ShBasis(v3 Dir,
+		f32 *Y)
+{
+	Y[0] = 0.282095f;
+
+	Y[1] = 0.488603f * Dir.y;
+	Y[2] = 0.488603f * Dir.z;
+	Y[3] = 0.488603f * Dir.x;
+
+	Y[4] = 1.092548f * Dir.x * Dir.y;
+	Y[5] = 1.092548f * Dir.y * Dir.z;
+	Y[6] = 0.315392f * (3.0f * Dir.z * Dir.z - 1.0f);
+	Y[7] = 1.092548f * Dir.x * Dir.z;
+	Y[8] = 0.546274f * (Dir.x * Dir.x - Dir.y * Dir.y);
+}
+
+scatter_bake_params
+DefaultScatterBakeParams(void)
+{
+	scatter_bake_params		Bake;
+
+
+	Bake.Order = SCATTER_L1;
+	Bake.RaysPerProbe = 64;
+	Bake.StepsPerRay = 32;
+	Bake.ProbeSpacing = 2;
+	Bake.Iterations = 32;
+
+	return (Bake);
+}
+
+// Evenly spread directions on the sphere, the same set for every probe
+void
+SphericalFibonacci(std::vector<v3> &Dirs,
+				   u32 Count)
+{
+	f32		GoldenAngle = 2.39996323f;
+
+
+	Dirs.resize(Count);
+
+	for (u32 I = 0; I < Count; I++)
+	{
+		f32 Z = 1.0f - (2.0f * I + 1.0f) / Count;
+		f32 R = SquareRoot(_Max(0.0f, 1.0f - Z * Z));
+		f32 Phi = GoldenAngle * I;
+
+		Dirs[I] = v3(R * cosf(Phi), R * sinf(Phi), Z);
+	}
+}
+
+// Float index Channel * Coeffs + Coeff of the probe goes in slot Index / 4,
+// component Index % 4
+u32
+ScatterTexelIndex(scatter_volume *Scatter,
+				  v3i Coord,
+				  u32 Slot)
+{
+	u32 Z = Coord.z + Slot * Scatter->Dims.z;
+
+	return ((Z * Scatter->Dims.y + Coord.y) * Scatter->Dims.x + Coord.x);
+}
+
+void
+BakeScatterProbes(scatter_volume *Scatter,
+				  probe *Probes,
+				  volume *Volume,
+				  grid_params *Grid,
+				  raymarch_params *Params,
+				  m4 &InvWorld,
+				  scatter_bake_params *Bake)
+{
+	u32						Coeffs = ShCoeffCount(Bake->Order);
+	grid_params				ScatterGrid;
+	std::vector<v3>			Dirs;
+	v3						AmbientRadiance = v3(Params->Ambient, Params->Ambient, Params->Ambient);
+	v3i						Dims;
+
+
+	// The transmittance lookups along the rays go to the light probes
+	// already baked on Grid, one scatter probe per ProbeSpacing of those
+	for (u32 I = 0; I < 3; I++)
+	{
+		Dims.Elements[I] = _Max(2, (Grid->GridDims.Elements[I] + Bake->ProbeSpacing - 1) / Bake->ProbeSpacing);
+	}
+
+	InitGridParams(&ScatterGrid, Dims, Grid->GridMin, Grid->GridMax, LAYOUT_LINEAR);
+
+	SphericalFibonacci(Dirs, Bake->RaysPerProbe);
+
+	Scatter->Dims = Dims;
+	Scatter->Order = Bake->Order;
+	Scatter->SlotCount = (3 * Coeffs + 3) / 4;
+	Scatter->Texels.assign(u64(Dims.x) * Dims.y * Dims.z * Scatter->SlotCount, v4(0, 0, 0, 0));
+
+	// A row of probes per piece
+	ParallelFor3D(Dims, v3i(Dims.x, 1, 1), [&](job_range Range)
+	{
+		for (s32 Z = Range.Min.z; Z < Range.Max.z; Z++)
+		{
+			for (s32 Y = Range.Min.y; Y < Range.Max.y; Y++)
+			{
+				for (s32 X = Range.Min.x; X < Range.Max.x; X++)
+				{
+					v3i Coord = v3i(X, Y, Z);
+					v3 Origin = GridCoordToPosition(&ScatterGrid, Coord);
+					f32 Sh[3][SH_MAX_COEFFS] = {};
+
+					for (u32 R = 0; R < Dirs.size(); R++)
+					{
+						v3 Dir = Dirs[R];
+						v3 Radiance = v3(0, 0, 0);
+						f32 Transmittance = 1;
+						f32 tNear, tFar;
+						f32 YBasis[SH_MAX_COEFFS];
+
+						IntersectBox(Origin, Dir, Grid->GridMin, Grid->GridMax, &tNear, &tFar);
+
+						f32 dt = _Max(tFar, 0.0f) / Bake->StepsPerRay;
+
+						for (u32 Step = 0; Step < Bake->StepsPerRay && Transmittance > 0.001f; Step++)
+						{
+							v3 Pos = Origin + ((Step + 0.5f) * dt) * Dir;
+							v4 TexPos = InvWorld * v4(Pos.x, Pos.y, Pos.z, 1);
+							f32 Density = Params->DensityScale * SampleVolume(Volume, v3(TexPos.x, TexPos.y, TexPos.z));
+
+							if (Density > 0)
+							{
+								v4 LightTransmittance = SampleProbes(Probes, Grid, Pos, Params->ProbeFilter);
+								v3 Source = AmbientRadiance;
+
+								for (u32 L = 0; L < _Min(Params->LightCount, u32(MAX_LIGHTS)); L++)
+								{
+									light *Light = &Params->Lights[L];
+
+									Source = Source + (Light->Intensity * LightTransmittance.Elements[L]) * Light->Color;
+								}
+
+								Radiance = Radiance + (Density * dt * Transmittance) * Source;
+								Transmittance *= FastExp(-Density * dt * Params->Absorption);
+							}
+						}
+
+						ShBasis(Dir, YBasis);
+
+						for (u32 K = 0; K < Coeffs; K++)
+						{
+							Sh[0][K] += Radiance.x * YBasis[K];
+							Sh[1][K] += Radiance.y * YBasis[K];
+							Sh[2][K] += Radiance.z * YBasis[K];
+						}
+					}
+
+					// Monte Carlo weight of each ray over the sphere
+					f32 Weight = 4.0f * PI / Dirs.size();
+
+					for (u32 C = 0; C < 3; C++)
+					{
+						for (u32 K = 0; K < Coeffs; K++)
+						{
+							u32 Index = C * Coeffs + K;
+
+							Scatter->Texels[ScatterTexelIndex(Scatter, Coord, Index / 4)].Elements[Index % 4] = Sh[C][K] * Weight;
+						}
+					}
+				}
+			}
+		}
+	});
+}
+
+// NOTE(matthew): Treats the probe grid as a discretised diffusion problem,
+//
+//     -div(D grad(Phi)) + SigmaA Phi = SigmaS L
+//
+// with D = 1 / (3 SigmaT), L the single scattered radiance from the baked
+// transmittance, and Phi = 0 outside the grid. Faces use the harmonic mean of
+// the two cells' D so thin dense walls still block diffusion. Phi is seeded
+// with the local solution SigmaS L / diagonal and spread out with
+// over-relaxed red-black Gauss-Seidel sweeps. Omega = 1.8 gets a 32^3 grid
+// within a few percent of converged in 32 sweeps, plain Gauss-Seidel needs
+// hundreds. Scatter->Texels holds Phi throughout.
+//
+// Each half sweep only reads cells of the other colour, so all the cells of
+// one colour can be updated in any order or in parallel, and they are, a few
+// slices per piece.
+//
+// The sweeps run on a red-black, structure of arrays copy of the grid. Each
+// colour has one plane per channel of Phi and of the source, one per
+// conductance and one of 1 / diagonal, with rows indexed by X / 2. So the
+// cells of one colour in a row are consecutive floats, and so are each of
+// their six neighbours, and four cells go through every f32x4 op. The
+// planes are ringed with ghost cells: a row before and after in y and z, a
+// cell before and after in x, and padding to whole f32x4s. Ghosts hold zero
+// conductance and zero Phi, so the faces need no branches. The operations
+// are the ones a cell at a time would do, in the same order.
+
+struct diffusion_cell
+{
+	f32		Conductance[3];		// towards +x, +y and +z, 0 on the far boundary
+	f32		InvDiagonal;
+};
+
+struct diffusion_planes
+{
+	v3i					Dims;
+	s64					Pitch,				// floats per row, ghosts and padding included
+						RowsY;				// rows per slice, Dims.y + 2
+	std::vector<f32>	Phi[2][3],			// [colour][channel]
+						Source[2][3],
+						Conductance[2][3],	// [colour][axis], towards +x, +y and +z
+						InvDiagonal[2];
+};
+
+void
+InitDiffusionPlanes(diffusion_planes *Planes,
+					v3i Dims)
+{
+	s64		HalfWidth = (Dims.x + 1) / 2;
+	u64		Count;
+
+
+	Planes->Dims = Dims;
+	Planes->Pitch = ((HalfWidth + 3) & ~3) + 2;
+	Planes->RowsY = Dims.y + 2;
+	Count = u64(Planes->Pitch) * Planes->RowsY * (Dims.z + 2);
+
+	for (u32 Color = 0; Color < 2; Color++)
+	{
+		for (u32 I = 0; I < 3; I++)
+		{
+			Planes->Phi[Color][I].assign(Count, 0.0f);
+			Planes->Source[Color][I].assign(Count, 0.0f);
+			Planes->Conductance[Color][I].assign(Count, 0.0f);
+		}
+		Planes->InvDiagonal[Color].assign(Count, 0.0f);
+	}
+}
+
+// Where (X, Y, Z) goes in its colour's planes, (X + Y + Z) & 1
+inline s64
+DiffusionPlaneIndex(diffusion_planes *Planes,
+					s32 X,
+					s32 Y,
+					s32 Z)
+{
+	return ((s64(Z + 1) * Planes->RowsY + (Y + 1)) * Planes->Pitch + 1 + (X >> 1));
+}
+
+// One half sweep over the cells of Color in row (Y, Z), four at a time.
+// Runs past the last cell only touch ghosts, which stay 0.
+void
+RelaxDiffusionRow(diffusion_planes *Planes,
+				  s32 Color,
+				  s32 Y,
+				  s32 Z,
+				  f32 Omega)
+{
+	s32			Other = Color ^ 1;
+	s32			First = (Y + Z + Color) & 1;
+	s32			Count = (Planes->Dims.x - First + 1) / 2;
+	s64			Row = DiffusionPlaneIndex(Planes, First, Y, Z),
+				Up = DiffusionPlaneIndex(Planes, First, Y + 1, Z),
+				Down = DiffusionPlaneIndex(Planes, First, Y - 1, Z),
+				Front = DiffusionPlaneIndex(Planes, First, Y, Z + 1),
+				Back = DiffusionPlaneIndex(Planes, First, Y, Z - 1);
+	f32x4		WideOmega = F32x4Set1(Omega);
+	f32			*Conductance[3],
+				*Facing[3],
+				*InvDiagonal = Planes->InvDiagonal[Color].data();
+
+
+	// The other colour's +x neighbour of the first cell is at X / 2 + First,
+	// its -x one just before, the y and z ones at the same X / 2
+	for (u32 I = 0; I < 3; I++)
+	{
+		Conductance[I] = Planes->Conductance[Color][I].data();
+		Facing[I] = Planes->Conductance[Other][I].data();
+	}
+
+	for (s64 K = 0; K < Count; K += 4)
+	{
+		f32x4 C0 = F32x4Load(&Conductance[0][Row + K]);
+		f32x4 C1 = F32x4Load(&Conductance[1][Row + K]);
+		f32x4 C2 = F32x4Load(&Conductance[2][Row + K]);
+		f32x4 F0 = F32x4Load(&Facing[0][Row + K + First - 1]);
+		f32x4 F1 = F32x4Load(&Facing[1][Down + K]);
+		f32x4 F2 = F32x4Load(&Facing[2][Back + K]);
+		f32x4 D = F32x4Load(&InvDiagonal[Row + K]);
+
+		for (u32 Channel = 0; Channel < 3; Channel++)
+		{
+			f32 *Phi = Planes->Phi[Color][Channel].data();
+			f32 *Near = Planes->Phi[Other][Channel].data();
+			f32x4 Old = F32x4Load(&Phi[Row + K]);
+			f32x4 Sum = F32x4Load(&Planes->Source[Color][Channel][Row + K]);
+
+			Sum = F32x4Add(Sum, F32x4Mul(C0, F32x4Load(&Near[Row + K + First])));
+			Sum = F32x4Add(Sum, F32x4Mul(C1, F32x4Load(&Near[Up + K])));
+			Sum = F32x4Add(Sum, F32x4Mul(C2, F32x4Load(&Near[Front + K])));
+			Sum = F32x4Add(Sum, F32x4Mul(F0, F32x4Load(&Near[Row + K + First - 1])));
+			Sum = F32x4Add(Sum, F32x4Mul(F1, F32x4Load(&Near[Down + K])));
+			Sum = F32x4Add(Sum, F32x4Mul(F2, F32x4Load(&Near[Back + K])));
+
+			Sum = F32x4Sub(F32x4Mul(D, Sum), Old);
+			F32x4Store(&Phi[Row + K], F32x4Add(Old, F32x4Mul(WideOmega, Sum)));
+		}
+	}
+}
+
+void
+RelaxScatterProbes(scatter_volume *Scatter,
+				   probe *Probes,
+				   volume *Volume,
+				   grid_params *Grid,
+				   raymarch_params *Params,
+				   m4 &InvWorld,
+				   u32 Iterations)
+{
+	v3i								Dims = Grid->GridDims;
+	u64								Count = u64(Dims.x) * Dims.y * Dims.z;
+	s64								Stride[3] = { 1, Dims.x, s64(Dims.x) * Dims.y };
+	std::vector<f32>				Diffusion(Count),
+									SigmaA(Count);
+	std::vector<v4>					Source(Count);
+	std::vector<diffusion_cell>		Cells(Count);
+	diffusion_planes				Planes;
+	f32								MinSigmaT;
+	f32								Omega = 1.8f;
+	v3								InvCellSize2;
+
+
+	Scatter->Dims = Dims;
+	Scatter->Order = SCATTER_DIFFUSION;
+	Scatter->SlotCount = 1;
+	Scatter->Texels.resize(Count);
+
+	// Keeps D finite in empty space, one mean free path across the grid
+	MinSigmaT = 1.0f / Length(Grid->GridExtents);
+
+	for (u32 I = 0; I < 3; I++)
+	{
+		InvCellSize2.Elements[I] = 1.0f / (Grid->CellSize.Elements[I] * Grid->CellSize.Elements[I]);
+	}
+
+	// Source and material per cell
+	ParallelFor(u32(Dims.z), 1, [&](job_range Range)
+	{
+		for (s32 Z = Range.Min.x; Z < Range.Max.x; Z++)
+		{
+			for (s32 Y = 0; Y < Dims.y; Y++)
+			{
+				for (s32 X = 0; X < Dims.x; X++)
+				{
+					v3i Coord = v3i(X, Y, Z);
+					u64 Cell = u64(Z) * Stride[2] + u64(Y) * Stride[1] + X;
+					v3 Pos = GridCoordToPosition(Grid, Coord);
+					v4 TexPos = InvWorld * v4(Pos.x, Pos.y, Pos.z, 1);
+					f32 SigmaS = Params->DensityScale * _Max(SampleVolume(Volume, v3(TexPos.x, TexPos.y, TexPos.z)), 0.0f);
+					f32 SigmaT = _Max(SigmaS * Params->Absorption, MinSigmaT);
+					v4 Transmittance = Probes[GridCoordToProbeIndex(Grid, Coord)].Transmittance;
+					v3 Radiance = v3(Params->Ambient, Params->Ambient, Params->Ambient);
+
+					for (u32 L = 0; L < _Min(Params->LightCount, u32(MAX_LIGHTS)); L++)
+					{
+						light *Light = &Params->Lights[L];
+
+						Radiance = Radiance + (Light->Intensity * Transmittance.Elements[L]) * Light->Color;
+					}
+
+					Diffusion[Cell] = 1.0f / (3.0f * SigmaT);
+					SigmaA[Cell] = _Max(SigmaS * Params->Absorption - SigmaS, 0.0f);
+					Source[Cell] = v4(SigmaS * Radiance.x, SigmaS * Radiance.y, SigmaS * Radiance.z, 0);
+				}
+			}
+		}
+	});
+
+	// The stencil only changes with the material, so do it once. Cells on
+	// the near boundary pick up their -axis face from the neighbour's +axis
+	// one, faces leaving the grid lead to Phi = 0 half a cell out.
+	ParallelFor(u32(Dims.z), 1, [&](job_range Range)
+	{
+		for (u64 Cell = u64(Range.Min.x * Stride[2]); Cell < u64(Range.Max.x * Stride[2]); Cell++)
+		{
+			u64 Rest = Cell;
+			s32 Coord[3];
+			f32 Diagonal = SigmaA[Cell];
+
+			Coord[0] = s32(Rest % Dims.x); Rest /= Dims.x;
+			Coord[1] = s32(Rest % Dims.y); Rest /= Dims.y;
+			Coord[2] = s32(Rest);
+
+			for (u32 I = 0; I < 3; I++)
+			{
+				f32 DI = Diffusion[Cell];
+
+				if (Coord[I] + 1 < Dims.Elements[I])
+				{
+					f32 DJ = Diffusion[Cell + Stride[I]];
+
+					Cells[Cell].Conductance[I] = (2.0f * DI * DJ / (DI + DJ)) * InvCellSize2.Elements[I];
+					Diagonal += Cells[Cell].Conductance[I];
+				}
+				else
+				{
+					Cells[Cell].Conductance[I] = 0;
+					Diagonal += 2.0f * DI * InvCellSize2.Elements[I];
+				}
+
+				if (Coord[I] > 0)
+				{
+					f32 DJ = Diffusion[Cell - Stride[I]];
+
+					Diagonal += (2.0f * DI * DJ / (DI + DJ)) * InvCellSize2.Elements[I];
+				}
+				else
+				{
+					Diagonal += 2.0f * DI * InvCellSize2.Elements[I];
+				}
+			}
+
+			Cells[Cell].InvDiagonal = 1.0f / Diagonal;
+			Scatter->Texels[Cell] = Cells[Cell].InvDiagonal * Source[Cell];
+		}
+	});
+
+	// Into the planes
+	InitDiffusionPlanes(&Planes, Dims);
+
+	ParallelFor(u32(Dims.z), 1, [&](job_range Range)
+	{
+		for (s32 Z = Range.Min.x; Z < Range.Max.x; Z++)
+		{
+			for (s32 Y = 0; Y < Dims.y; Y++)
+			{
+				for (s32 X = 0; X < Dims.x; X++)
+				{
+					u64 Cell = u64(Z) * Stride[2] + u64(Y) * Stride[1] + X;
+					s64 Index = DiffusionPlaneIndex(&Planes, X, Y, Z);
+					s32 Color = (X + Y + Z) & 1;
+
+					for (u32 I = 0; I < 3; I++)
+					{
+						Planes.Phi[Color][I][Index] = Scatter->Texels[Cell].Elements[I];
+						Planes.Source[Color][I][Index] = Source[Cell].Elements[I];
+						Planes.Conductance[Color][I][Index] = Cells[Cell].Conductance[I];
+					}
+					Planes.InvDiagonal[Color][Index] = Cells[Cell].InvDiagonal;
+				}
+			}
+		}
+	});
+
+	for (u32 Iteration = 0; Iteration < Iterations; Iteration++)
+	{
+		for (s32 Color = 0; Color < 2; Color++)
+		{
+			ParallelFor(u32(Dims.z), 1, [&](job_range Range)
+			{
+				for (s32 Z = Range.Min.x; Z < Range.Max.x; Z++)
+				{
+					for (s32 Y = 0; Y < Dims.y; Y++)
+					{
+						RelaxDiffusionRow(&Planes, Color, Y, Z, Omega);
+					}
+				}
+			});
+		}
+	}
+
+	// And back out
+	ParallelFor(u32(Dims.z), 1, [&](job_range Range)
+	{
+		for (s32 Z = Range.Min.x; Z < Range.Max.x; Z++)
+		{
+			for (s32 Y = 0; Y < Dims.y; Y++)
+			{
+				for (s32 X = 0; X < Dims.x; X++)
+				{
+					u64 Cell = u64(Z) * Stride[2] + u64(Y) * Stride[1] + X;
+					s64 Index = DiffusionPlaneIndex(&Planes, X, Y, Z);
+					s32 Color = (X + Y + Z) & 1;
+
+					Scatter->Texels[Cell] = v4(Planes.Phi[Color][0][Index], Planes.Phi[Color][1][Index], Planes.Phi[Color][2][Index], 0);
+				}
+			}
+		}
+	});
+}
+
+// CPU version of LookupScatter() in raymarch.ps: radiance scattered along
+// -Dir (towards the eye for a view ray Dir) by a Henyey-Greenstein phase
+// function with asymmetry PhaseG. The phase function integrates to one, so
+// its zonal convolution is just g^l per band.
+v3
+LookupScatter(scatter_volume *Scatter,
+			  grid_params *Grid,
+			  v3 Pos,
+			  v3 Dir,
+			  f32 PhaseG)
+{
+	u32		Coeffs = ShCoeffCount(Scatter->Order);
+	v3		Normalized = Hadamard(Pos - Grid->GridMin, Grid->GridExtentsRcp);
+	f32		Sh[3 * SH_MAX_COEFFS + 3] = {};
+	f32		YBasis[SH_MAX_COEFFS];
+	f32		Band[SH_MAX_COEFFS] = { 1, PhaseG, PhaseG, PhaseG,
+									PhaseG * PhaseG, PhaseG * PhaseG, PhaseG * PhaseG, PhaseG * PhaseG, PhaseG * PhaseG };
+	v3		Radiance;
+	v3		F;
+	v3i		Base;
+
+
+	for (u32 I = 0; I < 3; I++)
+	{
+		f32 P = _Min(_Max(Normalized.Elements[I], 0.0f), 1.0f) * (Scatter->Dims.Elements[I] - 1);
+
+		Base.Elements[I] = _Min(s32(P), Scatter->Dims.Elements[I] - 2);
+		F.Elements[I] = P - Base.Elements[I];
+	}
+
+	for (u32 Corner = 0; Corner < 8; Corner++)
+	{
+		v3i Offset = v3i(Corner & 1, (Corner >> 1) & 1, (Corner >> 2) & 1);
+		f32 WX = Offset.x ? F.x : 1.0f - F.x;
+		f32 WY = Offset.y ? F.y : 1.0f - F.y;
+		f32 WZ = Offset.z ? F.z : 1.0f - F.z;
+		f32 W = WX * WY * WZ;
+
+		for (u32 Slot = 0; Slot < Scatter->SlotCount; Slot++)
+		{
+			v4 Texel = Scatter->Texels[ScatterTexelIndex(Scatter, Base + Offset, Slot)];
+
+			for (u32 C = 0; C < 4; C++)
+			{
+				Sh[Slot * 4 + C] += W * Texel.Elements[C];
+			}
+		}
+	}
+
+	if (Scatter->Order == SCATTER_DIFFUSION)
+	{
+		return (v3(_Max(Sh[0], 0.0f), _Max(Sh[1], 0.0f), _Max(Sh[2], 0.0f)));
+	}
+
+	ShBasis(Dir, YBasis);
+
+	for (u32 C = 0; C < 3; C++)
+	{
+		f32 Sum = 0;
+
+		for (u32 K = 0; K < Coeffs; K++)
+		{
+			Sum += Band[K] * Sh[C * Coeffs + K] * YBasis[K];
+		}
+
+		Radiance.Elements[C] = _Max(Sum, 0.0f);
+	}
+
+	return (Radiance);
+}
+
+#endif // SCATTER_IMPL
+
+#endif // __SCATTER_H__
@@ -0,0 +1,1091 @@
+#ifndef __SHADOW_H__
+#define __SHADOW_H__
+
+#include <vector>
+#include <algorithm>
+#include <mg.h>
+#include <volume.h>
+#include <probes.h>
+
+//////////////////////////////////////////////////////////////////////////////
+// Shadow volume
+
+// NOTE(matthew): Transmittance towards every light at the volume's own
+// resolution, so the march doesn't interpolate between coarse probes. The
+// values live on the voxel corners, (Width + 1) x (Height + 1) x
+// (Depth + 1) nodes, so the faces of the box are stored exactly rather than
+// extrapolated from the outermost voxel centres, which is where most of the
+// shadow gradient is for a light outside the volume. Light i goes in
+// component i, stored as halves to match an R16G16B16A16_FLOAT texture.
+//
+// It's built with a slice sweep rather than a march per node. Sweeping along
+// an axis, each node steps towards the light until it lands on the previous
+// slice, and its optical depth is the one already computed there (bilinear
+// within the slice) plus the segment in between. A directional light only
+// needs a sweep along its dominant axis. A point light gets a sweep along
+// each axis outwards from the light's slice, and each node keeps the result
+// of the axis its light direction is closest to, so the step to the previous
+// slice is never longer than sqrt(3) nodes.
+//
+// Every node of a slice only reads the previous slice, so a slice can be
+// split across threads as is.
+
+struct shadow_volume
+{
+	u32					Width,
+						Height,
+						Depth;
+	std::vector<u16>	Texels;			// 4 halves per node, x fastest
+};
+
+u16		F32ToF16(f32 Value);
+f32		F16ToF32(u16 Value);
+void	BuildShadowVolume(shadow_volume *Shadow, volume *Volume, raymarch_params *Params, m4 &World);
+v4		SampleShadowVolume(shadow_volume *Shadow, v3 Pos);
+
+//////////////////////////////////////////////////////////////////////////////
+// Light aligned volume
+
+// NOTE(matthew): The density resampled onto a grid whose z axis runs along a
+// directional light, covering the volume's bounding sphere. Rows along the
+// light are contiguous, so anything that walks towards or away from the
+// light (the deep shadow map's rays, sweeps, half-angle slices) streams
+// through memory instead of doing a trilinear fetch per step.
+//
+// Directions are snapped to LIGHT_BUCKETS x LIGHT_BUCKETS octahedral
+// buckets, about 0.8 degrees apart, and the resampled grids are kept in a
+// small LRU cache keyed by the volume and bucket. Changing anything but the
+// volume or the light's direction then skips the resample. Anything that
+// reads the grid has to use the bucket direction, LightBucketDirection(),
+// rather than the light's own or the two won't line up.
+//
+// Every row is resampled independently, so this can be split across threads
+// as is.
+
+#define LIGHT_BUCKETS				256
+#define LIGHT_ALIGNED_CACHE_SIZE	8
+
+struct light_aligned_volume
+{
+	u64					VolumeKey;
+	u32					Bucket;
+	v3					Origin;			// world position of sample (0, 0, 0)
+	v3					Right,			// world step per sample along each axis,
+						Up,				// Forward points away from the light
+						Forward;
+	u32					Width,
+						Height,
+						Depth;			// along Forward
+	std::vector<f32>	Data;			// density, [y][x][z]
+};
+
+struct light_aligned_cache
+{
+	std::vector<light_aligned_volume>	Entries;	// least recently used first
+	u32									Hits,
+										Misses;
+};
+
+v2		OctahedralEncode(v3 Dir);
+v3		OctahedralDecode(v2 P);
+void	LightFrame(v3 Forward, v3 *Right, v3 *Up);
+u32		LightBucket(v3 ToLight);
+v3		LightBucketDirection(v3 ToLight);
+void	ResampleLightAligned(light_aligned_volume *Aligned, volume *Volume, m4 &World, u32 Bucket, u32 Width, u32 Height, u32 Depth);
+light_aligned_volume	*GetLightAlignedVolume(light_aligned_cache *Cache, volume *Volume, u64 VolumeKey, m4 &World, v3 ToLight, u32 Width, u32 Height, u32 Depth);
+
+//////////////////////////////////////////////////////////////////////////////
+// Deep shadow map
+
+// NOTE(matthew): Transmittance stored along rays from each light instead of
+// on a world aligned grid, so the resolution follows the light: a point
+// light close to the volume gets its detail where the shadow rays actually
+// converge. Each texel is one ray through the volume, and holds its
+// transmittance as a piecewise function of the distance from the light
+// (Lokovic and Veach's deep shadow maps).
+//
+// The function is compressed to DEEP_SHADOW_NODES distances at fixed
+// transmittance levels, evenly spaced between 1 and the ray's final
+// transmittance, which goes in the last component. Spacing the nodes by
+// transmittance rather than distance puts them where the function changes.
+// Between nodes the optical depth is interpolated rather than the
+// transmittance, which is exact wherever the density is constant: against
+// linear transmittance it cuts the error of 7 nodes by 4x.
+// A texel is DEEP_SHADOW_SLICES float4s, each in its own array slice so the
+// map uploads as a Texture2DArray.
+//
+// The light space mapping is recomputed from the light and the volume's
+// bounding sphere wherever it's used:
+//
+//   - Directional lights are an orthographic projection of the sphere, along
+//     the light's bucket direction so the rays are the rows of its light
+//     aligned volume.
+//   - Point lights outside the sphere are a perspective projection with the
+//     sphere just inside the frustum.
+//   - Point lights inside the sphere use an octahedral map of every
+//     direction.
+//
+// Every texel is marched independently, so the build can be split across
+// threads as is.
+
+#define DEEP_SHADOW_NODES		7
+#define DEEP_SHADOW_SLICES		((DEEP_SHADOW_NODES + 1) / 4)
+#define DEEP_SHADOW_MAP_SIZE	128
+
+struct deep_shadow_map
+{
+	u32					Size;			// Size x Size texels per light
+	v3					Center;			// bounding sphere of the volume, world space
+	f32					Radius;
+	std::vector<v4>		Texels;			// [light][slice][y][x]
+};
+
+v2		DeepShadowProject(deep_shadow_map *Map, light *Light, v3 Pos, f32 *Distance);
+void	DeepShadowRay(deep_shadow_map *Map, light *Light, v2 UV, v3 *Origin, v3 *Dir);
+void	CompressDeepShadowRay(f32 *Transmittance, u32 StepCount, f32 tStart, f32 dt, f32 *Nodes);
+b32		BuildDeepShadowMap(deep_shadow_map *Map, volume *Volume, raymarch_params *Params, m4 &World, u32 Size, light_aligned_cache *Cache, u64 VolumeKey);
+f32		EvaluateDeepShadow(v4 *Texel, f32 Distance);
+v4		SampleDeepShadowMap(deep_shadow_map *Map, raymarch_params *Params, v3 Pos);
+
+#ifdef SHADOW_IMPL
+
+// Round to nearest, no denormals or NaN, which transmittance never needs
+u16
+F32ToF16(f32 Value)
+{
+	u32		Bits;
+	u32		Sign;
+	s32		Exponent;
+	u32		Mantissa;
+
+
+	memcpy(&Bits, &Value, sizeof(Bits));
+	Sign = (Bits >> 16) & 0x8000;
+	Exponent = s32((Bits >> 23) & 0xff) - 127 + 15;
+	Mantissa = Bits & 0x7fffff;
+
+	if (Exponent <= 0)
+	{
+		return (u16(Sign));
+	}
+	if (Exponent >= 31)
+	{
+		return (u16(Sign | 0x7bff));
+	}
+
+	u32 Half = Sign | (u32(Exponent) << 10) | (Mantissa >> 13);
+
+	// Carrying into the exponent is still the right rounding
+	Half += (Mantissa >> 12) & 1;
+
+	return (u16(_Min(Half & 0x7fff, 0x7bffu) | Sign));
+}
+
+f32
+F16ToF32(u16 Value)
+{
+	u32		Sign = u32(Value & 0x8000) << 16;
+	u32		Exponent = (Value >> 10) & 0x1f;
+	u32		Mantissa = Value & 0x3ff;
+	u32		Bits;
+	f32		Result;
+
+
+	Bits = Exponent ? Sign | ((Exponent - 15 + 127) << 23) | (Mantissa << 13) : Sign;
+	memcpy(&Result, &Bits, sizeof(Result));
+
+	return (Result);
+}
+
+// One slice of a sweep along a single axis. Coordinates are permuted so the
+// sweep axis is always the last one: Coord[Axes[I]] is the I'th component.
+// Node i of an axis sits at texture coordinate i / (Dims - 1).
+void
+SweepShadowSlice(std::vector<f32> &Sigma,
+				 std::vector<f32> &Depth,
+				 s32 NodeDims[3],
+				 light *Light,
+				 v3 LightNode,
+				 v3 WorldPerNode,
+				 u32 Axes[3],
+				 s32 Slice,
+				 s32 Direction)
+{
+	s64		Stride[3] = { 1, s64(NodeDims[0]), s64(NodeDims[0]) * NodeDims[1] };
+	s32		Dims[3] = { NodeDims[Axes[0]], NodeDims[Axes[1]], NodeDims[Axes[2]] };
+	s32		Prev = Slice - Direction;
+
+
+	// Rows of the slice only read the previous slice
+	ParallelFor(u32(Dims[1]), 4, [&](job_range Range)
+	{
+		for (s32 B = Range.Min.x; B < Range.Max.x; B++)
+		{
+			for (s32 A = 0; A < Dims[0]; A++)
+			{
+				s32 Coord[3];
+
+				Coord[Axes[0]] = A;
+				Coord[Axes[1]] = B;
+				Coord[Axes[2]] = Slice;
+
+				v3 Node = v3(f32(Coord[0]), f32(Coord[1]), f32(Coord[2]));
+				v3 ToLight = (Light->Type == LIGHT_POINT) ? LightNode - Node : LightNode;
+				f32 Along = ToLight.Elements[Axes[2]] * Direction;
+				u64 Index = u64(Coord[2]) * Stride[2] + u64(Coord[1]) * Stride[1] + Coord[0];
+
+				// On the light's slice, or past it. Not this sweep's node.
+				if (Along >= 0)
+				{
+					Depth[Index] = 0;
+					continue;
+				}
+
+				// Step back one slice, or to the light if it's closer
+				f32 t = _Min(1.0f / -Along, 1.0f);
+				v3 Step = t * ToLight;
+				v3 P = Node + Step;
+				f32 SegmentLength = Length(Hadamard(Step, WorldPerNode));
+				f32 PrevDepth = 0;
+				f32 PrevSigma = Sigma[Index];
+
+				if (Light->Type == LIGHT_POINT && t == 1.0f)
+				{
+					// Reached the light
+				}
+				else if (Prev < 0 || Prev >= Dims[2])
+				{
+					// Left the volume through the near face, nothing beyond
+					PrevSigma = 0;
+				}
+				else
+				{
+					f32 FA = P.Elements[Axes[0]],
+						FB = P.Elements[Axes[1]];
+					s32 A0 = s32(floorf(FA)),
+						B0 = s32(floorf(FB));
+					f32 TA = FA - A0,
+						TB = FB - B0;
+
+					PrevSigma = 0;
+
+					// Bilinear within the previous slice, 0 outside the volume
+					for (u32 Corner = 0; Corner < 4; Corner++)
+					{
+						s32 CA = A0 + (Corner & 1);
+						s32 CB = B0 + (Corner >> 1);
+						f32 W = ((Corner & 1) ? TA : 1 - TA) * ((Corner >> 1) ? TB : 1 - TB);
+
+						if (CA >= 0 && CA < Dims[0] && CB >= 0 && CB < Dims[1] && W > 0)
+						{
+							s32 C[3];
+
+							C[Axes[0]] = CA;
+							C[Axes[1]] = CB;
+							C[Axes[2]] = Prev;
+
+							u64 PrevIndex = u64(C[2]) * Stride[2] + u64(C[1]) * Stride[1] + C[0];
+
+							PrevDepth += W * Depth[PrevIndex];
+							PrevSigma += W * Sigma[PrevIndex];
+						}
+					}
+				}
+
+				Depth[Index] = PrevDepth + 0.5f * (Sigma[Index] + PrevSigma) * SegmentLength;
+			}
+		}
+	});
+}
+
+void
+BuildShadowVolume(shadow_volume *Shadow,
+				  volume *Volume,
+				  raymarch_params *Params,
+				  m4 &World)
+{
+	s32						NodeDims[3] = { s32(Volume->Width) + 1, s32(Volume->Height) + 1, s32(Volume->Depth) + 1 };
+	u64						Count = u64(NodeDims[0]) * NodeDims[1] * NodeDims[2];
+	std::vector<f32>		Sigma(Count),
+							Depth(Count),
+							Best(Count),
+							BestAlong(Count);
+	m4						InvWorld = Mat4Inverse(World);
+	v4						WorldX = World * v4(1.0f / Volume->Width, 0, 0, 0),
+							WorldY = World * v4(0, 1.0f / Volume->Height, 0, 0),
+							WorldZ = World * v4(0, 0, 1.0f / Volume->Depth, 0);
+	v3						WorldPerNode;
+
+
+	// World is a scale and translation here, so a node step maps to a world
+	// step axis by axis
+	WorldPerNode = v3(Length(v3(WorldX.x, WorldX.y, WorldX.z)),
+					  Length(v3(WorldY.x, WorldY.y, WorldY.z)),
+					  Length(v3(WorldZ.x, WorldZ.y, WorldZ.z)));
+
+	Shadow->Width = NodeDims[0];
+	Shadow->Height = NodeDims[1];
+	Shadow->Depth = NodeDims[2];
+	Shadow->Texels.assign(Count * 4, 0);
+
+	// Extinction at the nodes, sampled the way the march samples it so the
+	// faces get the border blend too
+	ParallelFor(u32(NodeDims[2]), 1, [&](job_range Range)
+	{
+		for (s32 Z = Range.Min.x; Z < Range.Max.x; Z++)
+		{
+			for (s32 Y = 0; Y < NodeDims[1]; Y++)
+			{
+				for (s32 X = 0; X < NodeDims[0]; X++)
+				{
+					v3 Tex = v3(f32(X) / Volume->Width, f32(Y) / Volume->Height, f32(Z) / Volume->Depth);
+
+					Sigma[(u64(Z) * NodeDims[1] + Y) * NodeDims[0] + X] = Params->DensityScale * SampleVolume(Volume, Tex);
+				}
+			}
+		}
+	});
+
+	for (u32 L = 0; L < _Min(Params->LightCount, u32(MAX_LIGHTS)); L++)
+	{
+		light *Light = &Params->Lights[L];
+		v3 LightNode;
+		u32 FirstAxis = 0,
+			LastAxis = 2;
+
+		// Light position, or direction towards it, in node units
+		if (Light->Type == LIGHT_POINT)
+		{
+			v4 Tex = InvWorld * v4(Light->Position.x, Light->Position.y, Light->Position.z, 1);
+
+			LightNode = v3(Tex.x * Volume->Width, Tex.y * Volume->Height, Tex.z * Volume->Depth);
+		}
+		else
+		{
+			v4 Tex = InvWorld * v4(Light->Position.x, Light->Position.y, Light->Position.z, 0);
+
+			LightNode = v3(Tex.x * Volume->Width, Tex.y * Volume->Height, Tex.z * Volume->Depth);
+
+			// Only the dominant axis
+			FirstAxis = LastAxis = 0;
+			for (u32 I = 1; I < 3; I++)
+			{
+				if (Abs(LightNode.Elements[I]) > Abs(LightNode.Elements[FirstAxis]))
+				{
+					FirstAxis = LastAxis = I;
+				}
+			}
+		}
+
+		std::fill(BestAlong.begin(), BestAlong.end(), -1.0f);
+
+		for (u32 Axis = FirstAxis; Axis <= LastAxis; Axis++)
+		{
+			u32 Axes[3] = { (Axis + 1) % 3, (Axis + 2) % 3, Axis };
+			s32 SliceCount = NodeDims[Axis];
+			f32 LightSlice = LightNode.Elements[Axis];
+
+			// Slices neither half sweep reaches are behind a directional
+			// light or on a point light's slice, where this axis never wins
+			std::fill(Depth.begin(), Depth.end(), 0.0f);
+
+			// Outwards from the light's slice in both directions. A
+			// directional light is infinitely far towards +LightNode, so it
+			// sweeps from that side only.
+			for (s32 Direction = -1; Direction <= 1; Direction += 2)
+			{
+				s32 First,
+					Last;
+
+				if (Light->Type == LIGHT_POINT)
+				{
+					First = (Direction > 0) ? s32(floorf(LightSlice)) + 1 : s32(ceilf(LightSlice)) - 1;
+				}
+				else
+				{
+					if ((LightSlice > 0) != (Direction < 0))
+					{
+						continue;
+					}
+					First = (Direction > 0) ? 0 : SliceCount - 1;
+				}
+
+				// A light outside the volume sweeps all of it from the near
+				// side, or none of it
+				if (Direction > 0)
+				{
+					First = _Max(First, 0);
+					Last = SliceCount - 1;
+				}
+				else
+				{
+					First = _Min(First, SliceCount - 1);
+					Last = 0;
+				}
+
+				if ((Direction > 0 && First > Last) || (Direction < 0 && First < Last))
+				{
+					continue;
+				}
+
+				for (s32 Slice = First; ; Slice += Direction)
+				{
+					SweepShadowSlice(Sigma, Depth, NodeDims, Light, LightNode, WorldPerNode, Axes, Slice, Direction);
+
+					if (Slice == Last)
+					{
+						break;
+					}
+				}
+			}
+
+			// Keep each node's result from the axis closest to its light
+			// direction
+			ParallelFor(u32(NodeDims[2]), 1, [&](job_range Range)
+			{
+				for (s32 Z = Range.Min.x; Z < Range.Max.x; Z++)
+				{
+					for (s32 Y = 0; Y < NodeDims[1]; Y++)
+					{
+						for (s32 X = 0; X < NodeDims[0]; X++)
+						{
+							u64 Index = (u64(Z) * NodeDims[1] + Y) * NodeDims[0] + X;
+							v3 ToLight = (Light->Type == LIGHT_POINT) ? LightNode - v3(f32(X), f32(Y), f32(Z)) : LightNode;
+							f32 Along = Abs(ToLight.Elements[Axis]);
+
+							if (Along > BestAlong[Index])
+							{
+								BestAlong[Index] = Along;
+								Best[Index] = Depth[Index];
+							}
+						}
+					}
+				}
+			});
+		}
+
+		ParallelFor(u32(NodeDims[2]), 1, [&](job_range Range)
+		{
+			u64 SliceSize = u64(NodeDims[0]) * NodeDims[1];
+
+			for (u64 Index = Range.Min.x * SliceSize; Index < Range.Max.x * SliceSize; Index++)
+			{
+				Shadow->Texels[Index * 4 + L] = F32ToF16(FastExp(-Best[Index] * Params->Absorption));
+			}
+		});
+	}
+}
+
+// CPU version of LookupShadowVolume() in raymarch.ps, trilinear between the
+// nodes at texture coordinates
+v4
+SampleShadowVolume(shadow_volume *Shadow,
+				   v3 Pos)
+{
+	s32		Dims[3] = { s32(Shadow->Width), s32(Shadow->Height), s32(Shadow->Depth) };
+	s32		Base[3];
+	f32		Frac[3];
+	v4		Result = v4(0, 0, 0, 0);
+
+
+	for (u32 I = 0; I < 3; I++)
+	{
+		f32 F = _Min(_Max(Pos.Elements[I], 0.0f), 1.0f) * (Dims[I] - 1);
+
+		Base[I] = _Min(s32(F), Dims[I] - 2);
+		Frac[I] = F - Base[I];
+	}
+
+	for (u32 Corner = 0; Corner < 8; Corner++)
+	{
+		s32 X = Base[0] + (Corner & 1);
+		s32 Y = Base[1] + ((Corner >> 1) & 1);
+		s32 Z = Base[2] + ((Corner >> 2) & 1);
+		f32 W = ((Corner & 1) ? Frac[0] : 1 - Frac[0]) *
+				(((Corner >> 1) & 1) ? Frac[1] : 1 - Frac[1]) *
+				(((Corner >> 2) & 1) ? Frac[2] : 1 - Frac[2]);
+		u16 *Texel = &Shadow->Texels[((u64(Z) * Dims[1] + Y) * Dims[0] + X) * 4];
+
+		Result += W * v4(F16ToF32(Texel[0]), F16ToF32(Texel[1]), F16ToF32(Texel[2]), F16ToF32(Texel[3]));
+	}
+
+	return (Result);
+}
+
+// Unit direction to [-1, 1]^2, the lower hemisphere folded over the
+// diagonals
+v2
+OctahedralEncode(v3 Dir)
+{
+	f32		Norm = Abs(Dir.x) + Abs(Dir.y) + Abs(Dir.z);
+	v2		P = v2(Dir.x / Norm, Dir.y / Norm);
+
+
+	if (Dir.z < 0)
+	{
+		P = v2((1 - Abs(P.y)) * (P.x >= 0 ? 1.0f : -1.0f),
+			   (1 - Abs(P.x)) * (P.y >= 0 ? 1.0f : -1.0f));
+	}
+
+	return (P);
+}
+
+v3
+OctahedralDecode(v2 P)
+{
+	v3		Dir = v3(P.x, P.y, 1 - Abs(P.x) - Abs(P.y));
+
+
+	if (Dir.z < 0)
+	{
+		Dir.x = (1 - Abs(P.y)) * (P.x >= 0 ? 1.0f : -1.0f);
+		Dir.y = (1 - Abs(P.x)) * (P.y >= 0 ? 1.0f : -1.0f);
+	}
+
+	return (Normalize(Dir));
+}
+
+// Any orthonormal frame around Forward, as long as the shader picks the same
+void
+LightFrame(v3 Forward,
+		   v3 *Right,
+		   v3 *Up)
+{
+	v3		Reference = (Abs(Forward.y) < 0.99f) ? v3(0, 1, 0) : v3(1, 0, 0);
+
+
+	*Right = Normalize(Cross(Reference, Forward));
+	*Up = Cross(Forward, *Right);
+}
+
+u32
+LightBucket(v3 ToLight)
+{
+	v2		P = OctahedralEncode(Normalize(ToLight));
+	u32		X = _Min(u32((0.5f * P.x + 0.5f) * LIGHT_BUCKETS), u32(LIGHT_BUCKETS - 1)),
+			Y = _Min(u32((0.5f * P.y + 0.5f) * LIGHT_BUCKETS), u32(LIGHT_BUCKETS - 1));
+
+
+	return (Y * LIGHT_BUCKETS + X);
+}
+
+// Centre of ToLight's bucket
+v3
+LightBucketDirection(v3 ToLight)
+{
+	u32		Bucket = LightBucket(ToLight);
+	v2		P = v2(2.0f * ((Bucket % LIGHT_BUCKETS) + 0.5f) / LIGHT_BUCKETS - 1.0f,
+				   2.0f * ((Bucket / LIGHT_BUCKETS) + 0.5f) / LIGHT_BUCKETS - 1.0f);
+
+
+	return (OctahedralDecode(P));
+}
+
+// Samples are at the centres of a Width x Height grid across the bounding
+// sphere, and Depth samples from the sphere's near side to its far side
+// inclusive, so row (x, y) is the ray of texel (x, y) of a Width x Height
+// deep shadow map
+void
+ResampleLightAligned(light_aligned_volume *Aligned,
+					 volume *Volume,
+					 m4 &World,
+					 u32 Bucket,
+					 u32 Width,
+					 u32 Height,
+					 u32 Depth)
+{
+	m4		InvWorld = Mat4Inverse(World);
+	v4		BoxMin = World * v4(0, 0, 0, 1),
+			BoxMax = World * v4(1, 1, 1, 1);
+	v3		Center = 0.5f * v3(BoxMin.x + BoxMax.x, BoxMin.y + BoxMax.y, BoxMin.z + BoxMax.z);
+	f32		Radius = 0.5f * Length(v3(BoxMax.x - BoxMin.x, BoxMax.y - BoxMin.y, BoxMax.z - BoxMin.z));
+	v2		P = v2(2.0f * ((Bucket % LIGHT_BUCKETS) + 0.5f) / LIGHT_BUCKETS - 1.0f,
+				   2.0f * ((Bucket / LIGHT_BUCKETS) + 0.5f) / LIGHT_BUCKETS - 1.0f);
+	v3		Forward = -1.0f * OctahedralDecode(P),
+			Right,
+			Up;
+
+
+	LightFrame(Forward, &Right, &Up);
+
+	Aligned->Bucket = Bucket;
+	Aligned->Width = Width;
+	Aligned->Height = Height;
+	Aligned->Depth = Depth;
+	Aligned->Right = (2.0f * Radius / Width) * Right;
+	Aligned->Up = (2.0f * Radius / Height) * Up;
+	Aligned->Forward = (2.0f * Radius / (Depth - 1)) * Forward;
+	Aligned->Origin = Center - Radius * Forward + (Radius / Width - Radius) * Right + (Radius / Height - Radius) * Up;
+	Aligned->Data.assign(u64(Width) * Height * Depth, 0.0f);
+
+	f32 dz = Length(Aligned->Forward);
+	v4 TexForward = InvWorld * v4(Aligned->Forward.x, Aligned->Forward.y, Aligned->Forward.z, 0);
+
+	ParallelFor(Height, 1, [&](job_range Range)
+	{
+		for (u32 Y = u32(Range.Min.x); Y < u32(Range.Max.x); Y++)
+		{
+			for (u32 X = 0; X < Width; X++)
+			{
+				v3 RowOrigin = Aligned->Origin + f32(X) * Aligned->Right + f32(Y) * Aligned->Up;
+				f32 *Row = &Aligned->Data[(u64(Y) * Width + X) * Depth];
+				f32 tNear, tFar;
+
+				// Only the samples next to the box, the corners of the
+				// sphere's square are empty
+				if (!IntersectBox(RowOrigin, Forward, v3(BoxMin.x, BoxMin.y, BoxMin.z), v3(BoxMax.x, BoxMax.y, BoxMax.z), &tNear, &tFar))
+				{
+					continue;
+				}
+
+				u32 First = u32(_Max(floorf(tNear / dz), 0.0f));
+				u32 Last = _Min(u32(ceilf(tFar / dz)), Depth - 1);
+				v4 TexPos = InvWorld * v4(RowOrigin.x, RowOrigin.y, RowOrigin.z, 1) + f32(First) * TexForward;
+
+				for (u32 Z = First; Z <= Last; Z++)
+				{
+					Row[Z] = SampleVolume(Volume, v3(TexPos.x, TexPos.y, TexPos.z));
+					TexPos += TexForward;
+				}
+			}
+		}
+	});
+}
+
+// The resampled grid for ToLight's bucket, from the cache if it's there
+light_aligned_volume *
+GetLightAlignedVolume(light_aligned_cache *Cache,
+					  volume *Volume,
+					  u64 VolumeKey,
+					  m4 &World,
+					  v3 ToLight,
+					  u32 Width,
+					  u32 Height,
+					  u32 Depth)
+{
+	u32		Bucket = LightBucket(ToLight);
+
+
+	for (u32 I = 0; I < Cache->Entries.size(); I++)
+	{
+		light_aligned_volume *Entry = &Cache->Entries[I];
+
+		if (Entry->VolumeKey == VolumeKey && Entry->Bucket == Bucket &&
+			Entry->Width == Width && Entry->Height == Height && Entry->Depth == Depth)
+		{
+			// Move to the back, most recently used
+			std::rotate(Cache->Entries.begin() + I, Cache->Entries.begin() + I + 1, Cache->Entries.end());
+			Cache->Hits++;
+
+			return (&Cache->Entries.back());
+		}
+	}
+
+	if (Cache->Entries.size() >= LIGHT_ALIGNED_CACHE_SIZE)
+	{
+		Cache->Entries.erase(Cache->Entries.begin());
+	}
+	Cache->Entries.emplace_back();
+	Cache->Misses++;
+
+	light_aligned_volume *Aligned = &Cache->Entries.back();
+
+	Aligned->VolumeKey = VolumeKey;
+	ResampleLightAligned(Aligned, Volume, World, Bucket, Width, Height, Depth);
+
+	return (Aligned);
+}
+
+// Map coordinates in [0, 1]^2 of a world position, and its distance from
+// the light along the texel's ray
+v2
+DeepShadowProject(deep_shadow_map *Map,
+				  light *Light,
+				  v3 Pos,
+				  f32 *Distance)
+{
+	v3		Right,
+			Up;
+	v2		P;
+
+
+	if (Light->Type == LIGHT_DIRECTIONAL)
+	{
+		v3 Forward = -1.0f * LightBucketDirection(Light->Position);
+		v3 Offset = Pos - Map->Center;
+
+		LightFrame(Forward, &Right, &Up);
+		P = v2(Dot(Offset, Right), Dot(Offset, Up)) / Map->Radius;
+		*Distance = Map->Radius + Dot(Offset, Forward);
+	}
+	else
+	{
+		v3 ToCenter = Map->Center - Light->Position;
+		v3 Offset = Pos - Light->Position;
+		f32 CenterDistance = Length(ToCenter);
+
+		*Distance = Length(Offset);
+
+		if (CenterDistance > Map->Radius)
+		{
+			v3 Forward = ToCenter / CenterDistance;
+			f32 TanHalfAngle = Map->Radius / sqrtf(CenterDistance * CenterDistance - Map->Radius * Map->Radius);
+			f32 Z = _Max(Dot(Offset, Forward), 1e-6f);
+
+			LightFrame(Forward, &Right, &Up);
+			P = v2(Dot(Offset, Right), Dot(Offset, Up)) / (Z * TanHalfAngle);
+		}
+		else
+		{
+			P = OctahedralEncode(Offset / _Max(*Distance, 1e-6f));
+		}
+	}
+
+	return (v2(0.5f * P.x + 0.5f, 0.5f * P.y + 0.5f));
+}
+
+// Inverse of DeepShadowProject(), the ray of a map position. Distances along
+// Dir from Origin are the ones DeepShadowProject() returns.
+void
+DeepShadowRay(deep_shadow_map *Map,
+			  light *Light,
+			  v2 UV,
+			  v3 *Origin,
+			  v3 *Dir)
+{
+	v2		P = v2(2 * UV.x - 1, 2 * UV.y - 1);
+	v3		Right,
+			Up;
+
+
+	if (Light->Type == LIGHT_DIRECTIONAL)
+	{
+		v3 Forward = -1.0f * LightBucketDirection(Light->Position);
+
+		LightFrame(Forward, &Right, &Up);
+		*Origin = Map->Center - Map->Radius * Forward + Map->Radius * (P.x * Right + P.y * Up);
+		*Dir = Forward;
+	}
+	else
+	{
+		v3 ToCenter = Map->Center - Light->Position;
+		f32 CenterDistance = Length(ToCenter);
+
+		*Origin = Light->Position;
+
+		if (CenterDistance > Map->Radius)
+		{
+			v3 Forward = ToCenter / CenterDistance;
+			f32 TanHalfAngle = Map->Radius / sqrtf(CenterDistance * CenterDistance - Map->Radius * Map->Radius);
+
+			LightFrame(Forward, &Right, &Up);
+			*Dir = Normalize(Forward + TanHalfAngle * (P.x * Right + P.y * Up));
+		}
+		else
+		{
+			*Dir = OctahedralDecode(P);
+		}
+	}
+}
+
+// Nodes of one texel from its transmittance at StepCount + 1 evenly spaced
+// distances. Node 0 is where the transmittance starts to drop, the rest
+// where it crosses each level.
+void
+CompressDeepShadowRay(f32 *Transmittance,
+					  u32 StepCount,
+					  f32 tStart,
+					  f32 dt,
+					  f32 *Nodes)
+{
+	f32		Final = Transmittance[StepCount];
+	u32		Step = 0;
+
+
+	while (Step < StepCount && Transmittance[Step + 1] >= 1)
+	{
+		Step++;
+	}
+	Nodes[0] = tStart + Step * dt;
+
+	for (u32 N = 1; N < DEEP_SHADOW_NODES; N++)
+	{
+		// Exactly Final for the last node, or rounding can push it to the
+		// end of the ray
+		f32 Level = (N == DEEP_SHADOW_NODES - 1) ? Final : 1 - (1 - Final) * N / f32(DEEP_SHADOW_NODES - 1);
+
+		while (Step < StepCount && Transmittance[Step + 1] > Level)
+		{
+			Step++;
+		}
+
+		if (Step == StepCount)
+		{
+			Nodes[N] = tStart + StepCount * dt;
+		}
+		else
+		{
+			f32 Drop = Transmittance[Step] - Transmittance[Step + 1];
+
+			Nodes[N] = tStart + (Step + ((Drop > 0) ? (Transmittance[Step] - Level) / Drop : 1.0f)) * dt;
+		}
+	}
+	Nodes[DEEP_SHADOW_NODES] = Final;
+}
+
+// Directional lights read their rays from the light aligned volume, which
+// comes from Cache when there is one. Point lights march the volume.
+// Returns false when a thread's scratch arena couldn't hold a ray's
+// transmittances, those rays are left unshadowed.
+b32
+BuildDeepShadowMap(deep_shadow_map *Map,
+				   volume *Volume,
+				   raymarch_params *Params,
+				   m4 &World,
+				   u32 Size,
+				   light_aligned_cache *Cache,
+				   u64 VolumeKey)
+{
+	m4						InvWorld = Mat4Inverse(World);
+	v4						BoxMin = World * v4(0, 0, 0, 1),
+							BoxMax = World * v4(1, 1, 1, 1),
+							VoxelSize = World * v4(1.0f / Volume->Width, 1.0f / Volume->Height, 1.0f / Volume->Depth, 0);
+	f32						StepLength = _Min(_Min(Abs(VoxelSize.x), Abs(VoxelSize.y)), Abs(VoxelSize.z));
+	u64						SliceSize = u64(Size) * Size;
+	light_aligned_volume	Uncached;
+	std::atomic<b32>		Failed(false);
+
+
+	Map->Size = Size;
+	Map->Center = 0.5f * v3(BoxMin.x + BoxMax.x, BoxMin.y + BoxMax.y, BoxMin.z + BoxMax.z);
+	Map->Radius = 0.5f * Length(v3(BoxMax.x - BoxMin.x, BoxMax.y - BoxMin.y, BoxMax.z - BoxMin.z));
+	Map->Texels.assign(MAX_LIGHTS * DEEP_SHADOW_SLICES * SliceSize, v4(0, 0, 0, 1));
+
+	for (u32 L = 0; L < _Min(Params->LightCount, u32(MAX_LIGHTS)); L++)
+	{
+		light *Light = &Params->Lights[L];
+		light_aligned_volume *Aligned = nullptr;
+
+		if (Light->Type == LIGHT_DIRECTIONAL)
+		{
+			u32 Depth = u32(ceilf(2.0f * Map->Radius / StepLength)) + 1;
+
+			if (Cache)
+			{
+				Aligned = GetLightAlignedVolume(Cache, Volume, VolumeKey, World, Light->Position, Size, Size, Depth);
+			}
+			else
+			{
+				Aligned = &Uncached;
+				ResampleLightAligned(Aligned, Volume, World, LightBucket(Light->Position), Size, Size, Depth);
+			}
+		}
+
+		// A row of texels per piece. Each ray's transmittances go in the
+		// thread's scratch arena, over the last ray's.
+		ParallelFor(Size, 1, [&](job_range Range)
+		{
+			arena *Scratch = ScratchArena();
+			arena_frame Frame = ArenaPushFrame(Scratch);
+
+			for (u32 Y = u32(Range.Min.x); Y < u32(Range.Max.x); Y++)
+			{
+				for (u32 X = 0; X < Size; X++)
+				{
+					f32 Nodes[DEEP_SHADOW_NODES + 1];
+
+					if (Aligned)
+					{
+						f32 *Row = &Aligned->Data[(u64(Y) * Size + X) * Aligned->Depth];
+						u32 StepCount = Aligned->Depth - 1;
+						f32 dt = Length(Aligned->Forward);
+						v3 Origin = Aligned->Origin + f32(X) * Aligned->Right + f32(Y) * Aligned->Up;
+						v3 Dir = Aligned->Forward / dt;
+						f32 tNear, tFar;
+						f32 OpticalDepth = 0;
+
+						if (!IntersectBox(Origin, Dir, v3(BoxMin.x, BoxMin.y, BoxMin.z), v3(BoxMax.x, BoxMax.y, BoxMax.z), &tNear, &tFar))
+						{
+							continue;
+						}
+
+						// Trapezoid along the row, clipped to the box like the
+						// march so the border blend outside the faces doesn't
+						// count. Transmittance at every sample, exponentiated
+						// after the march like below.
+						ArenaPopFrame(Frame);
+						f32 *Transmittance = ArenaAllocArray<f32>(Scratch, StepCount + 1);
+
+						if (!Transmittance)
+						{
+							Failed = true;
+							continue;
+						}
+
+						Transmittance[0] = 1;
+						for (u32 I = 1; I <= StepCount; I++)
+						{
+							f32 A = _Max((I - 1) * dt, tNear),
+								B = _Min(I * dt, tFar);
+
+							if (B > A)
+							{
+								f32 SigmaA = Row[I - 1] + (A / dt - (I - 1)) * (Row[I] - Row[I - 1]);
+								f32 SigmaB = Row[I - 1] + (B / dt - (I - 1)) * (Row[I] - Row[I - 1]);
+
+								OpticalDepth += 0.5f * Params->DensityScale * (SigmaA + SigmaB) * (B - A);
+							}
+							Transmittance[I] = -OpticalDepth * Params->Absorption;
+						}
+						ExpArray(&Transmittance[1], StepCount, MG_EXP_TIER);
+
+						CompressDeepShadowRay(Transmittance, StepCount, 0, dt, Nodes);
+					}
+					else
+					{
+						v2 UV = v2((X + 0.5f) / Size, (Y + 0.5f) / Size);
+						v3 Origin, Dir;
+						f32 tNear, tFar;
+
+						DeepShadowRay(Map, Light, UV, &Origin, &Dir);
+
+						// Rays that miss keep the default: every node at 0 and a
+						// final transmittance of 1
+						if (!IntersectBox(Origin, Dir, v3(BoxMin.x, BoxMin.y, BoxMin.z), v3(BoxMax.x, BoxMax.y, BoxMax.z), &tNear, &tFar) ||
+							tFar <= 0)
+						{
+							continue;
+						}
+
+						tNear = _Max(tNear, 0.0f);
+
+						u32 StepCount = _Max(u32(ceilf((tFar - tNear) / StepLength)), 1u);
+						f32 dt = (tFar - tNear) / StepCount;
+						v4 TexPos = InvWorld * v4(Origin.x + tNear * Dir.x, Origin.y + tNear * Dir.y, Origin.z + tNear * Dir.z, 1);
+						v4 TexStep = InvWorld * v4(dt * Dir.x, dt * Dir.y, dt * Dir.z, 0);
+						f32 Sigma = Params->DensityScale * SampleVolume(Volume, v3(TexPos.x, TexPos.y, TexPos.z));
+						f32 OpticalDepth = 0;
+
+						// Trapezoid march, transmittance at every step boundary.
+						// The optical depths go in first and are exponentiated
+						// four at a time after the march.
+						ArenaPopFrame(Frame);
+						f32 *Transmittance = ArenaAllocArray<f32>(Scratch, StepCount + 1);
+
+						if (!Transmittance)
+						{
+							Failed = true;
+							continue;
+						}
+
+						Transmittance[0] = 1;
+						for (u32 I = 1; I <= StepCount; I++)
+						{
+							TexPos += TexStep;
+
+							f32 NextSigma = Params->DensityScale * SampleVolume(Volume, v3(TexPos.x, TexPos.y, TexPos.z));
+
+							OpticalDepth += 0.5f * (Sigma + NextSigma) * dt;
+							Transmittance[I] = -OpticalDepth * Params->Absorption;
+							Sigma = NextSigma;
+						}
+						ExpArray(&Transmittance[1], StepCount, MG_EXP_TIER);
+
+						CompressDeepShadowRay(Transmittance, StepCount, tNear, dt, Nodes);
+					}
+
+					for (u32 Slice = 0; Slice < DEEP_SHADOW_SLICES; Slice++)
+					{
+						Map->Texels[(L * DEEP_SHADOW_SLICES + Slice) * SliceSize + u64(Y) * Size + X] =
+							v4(Nodes[Slice * 4], Nodes[Slice * 4 + 1], Nodes[Slice * 4 + 2], Nodes[Slice * 4 + 3]);
+					}
+				}
+			}
+
+			ArenaPopFrame(Frame);
+		});
+	}
+
+	return (!Failed);
+}
+
+// Transmittance of one texel's function, Texel is its DEEP_SHADOW_SLICES
+// float4s side by side
+f32
+EvaluateDeepShadow(v4 *Texel,
+				   f32 Distance)
+{
+	f32		*Nodes = Texel[0].Elements;
+	f32		Final = Nodes[DEEP_SHADOW_NODES];
+	f32		Previous = 1;
+
+
+	if (Distance <= Nodes[0])
+	{
+		return (1.0f);
+	}
+
+	for (u32 N = 1; N < DEEP_SHADOW_NODES; N++)
+	{
+		f32 Level = _Max(1 - (1 - Final) * N / f32(DEEP_SHADOW_NODES - 1), 1e-6f);
+
+		// Linear in optical depth between the nodes
+		if (Distance < Nodes[N])
+		{
+			f32 t = (Distance - Nodes[N - 1]) / (Nodes[N] - Nodes[N - 1]);
+
+			return (Previous * powf(Level / Previous, t));
+		}
+
+		Previous = Level;
+	}
+
+	return (Final);
+}
+
+// CPU version of LookupDeepShadowMap() in raymarch.ps. The functions of the
+// four nearest texels are evaluated and blended, blending the nodes would
+// mix distances of unrelated features.
+v4
+SampleDeepShadowMap(deep_shadow_map *Map,
+					raymarch_params *Params,
+					v3 Pos)
+{
+	u64		SliceSize = u64(Map->Size) * Map->Size;
+	s32		Last = s32(Map->Size) - 1;
+	v4		Result = v4(0, 0, 0, 0);
+
+
+	for (u32 L = 0; L < _Min(Params->LightCount, u32(MAX_LIGHTS)); L++)
+	{
+		f32 Distance;
+		v2 UV = DeepShadowProject(Map, &Params->Lights[L], Pos, &Distance);
+		f32 FX = UV.x * Map->Size - 0.5f,
+			FY = UV.y * Map->Size - 0.5f;
+		s32 X0 = s32(floorf(FX)),
+			Y0 = s32(floorf(FY));
+		f32 TX = FX - X0,
+			TY = FY - Y0;
+
+		for (u32 Corner = 0; Corner < 4; Corner++)
+		{
+			s32 X = _Min(_Max(X0 + s32(Corner & 1), 0), Last);
+			s32 Y = _Min(_Max(Y0 + s32(Corner >> 1), 0), Last);
+			f32 W = ((Corner & 1) ? TX : 1 - TX) * ((Corner >> 1) ? TY : 1 - TY);
+			v4 Texel[DEEP_SHADOW_SLICES];
+
+			for (u32 Slice = 0; Slice < DEEP_SHADOW_SLICES; Slice++)
+			{
+				Texel[Slice] = Map->Texels[(L * DEEP_SHADOW_SLICES + Slice) * SliceSize + u64(Y) * Map->Size + X];
+			}
+
+			Result.Elements[L] += W * EvaluateDeepShadow(Texel, Distance);
+		}
+	}
+
+	return (Result);
+}
+
+#endif // SHADOW_IMPL
+
+#endif // __SHADOW_H__
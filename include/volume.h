@@ -0,0 +1,686 @@
+#ifndef __VOLUME_H__
+#define __VOLUME_H__
+
+#include <vector>
+#include <mg.h>
+
+//////////////////////////////////////////////////////////////////////////////
+// Shader params
+
+// NOTE(matthew): These mirror the cbuffers in the shaders, so the layout and
+// padding have to match the HLSL packing rules.
+
+struct model_params
+{
+	m4		World,
+			View,
+			Proj;
+};
+
+// What the shaders would otherwise work out per pixel or per probe from the
+// volume's model_params and raymarch_params, see DeriveParams() in render.h
+struct derived_params
+{
+	m4		InvWorld,
+			InvViewProj;
+	v3		BoxMin;				// World's unit cube
+	f32		MarchStep;			// MarchStep() in render.h
+	v3		BoxMax;
+	f32		_Pad0;
+};
+
+enum light_type
+{
+	LIGHT_POINT,
+	LIGHT_DIRECTIONAL,
+};
+
+// Probes store one transmittance per light packed in a float4, so that's the
+// most we can have
+#define MAX_LIGHTS		4
+
+// Where the march gets the transmittance towards the lights from
+enum lighting_mode
+{
+	LIGHTING_MARCH,				// a lightmarch per sample
+	LIGHTING_PROBES,			// the baked probe grid
+	LIGHTING_SHADOW_VOLUME,		// the per-voxel shadow volume, see shadow.h
+	LIGHTING_DEEP_SHADOW_MAP,	// per-light deep shadow maps, see shadow.h
+
+	LIGHTING_MODE_COUNT,
+};
+
+extern const char	*LightingModeNames[LIGHTING_MODE_COUNT];
+
+// For LIGHT_DIRECTIONAL, Position is the direction towards the light
+struct light
+{
+	v3		Position;
+	u32		Type;
+	v3		Color;
+	f32		Intensity;
+};
+
+// NOTE(matthew): HLSL starts arrays on a new register, keep what's before
+// Lights a multiple of 4 fields.
+struct raymarch_params
+{
+	u32		ScreenWidth,
+			ScreenHeight;
+	f32		MinVal,
+			MaxVal;
+	f32		Absorption;
+	f32		DensityScale;
+	u32		LightingMode;
+	f32		Ambient;
+	u32		LightCount;
+	u32		ScatterOrder;		// scatter_order in scatter.h
+	f32		PhaseG;
+	f32		MultiScatter;
+	u32		ProbeFilter;		// probe_filter in probes.h
+	u32		FrameIndex;			// counts up every frame, picks the march jitter
+	f32		StepScale;			// march step in voxels, 0 is treated as 1
+	u32		Downsample;			// march one pixel in every Downsample x Downsample, see composite.ps
+	light	Lights[MAX_LIGHTS];
+};
+
+// temporal.ps and composite.ps, Weight is how much of the new frame goes
+// into the history. Width and Height are the size of the march, which only
+// fills the top left of its render targets when Downsample > 1.
+struct temporal_params
+{
+	m4		PrevViewProj;
+	f32		Weight;
+	u32		Reproject;
+	u32		Width,
+			Height;
+	u32		Downsample;
+	f32		UpsampleSigma;		// UPSAMPLE_SIGMA in world units
+	f32		_Pad0[2];
+};
+
+light	PointLight(v3 Position, v3 Color, f32 Intensity);
+light	DirectionalLight(v3 Direction, v3 Color, f32 Intensity);
+b32		ParamsEqual(model_params const *A, model_params const *B);
+b32		ParamsEqual(raymarch_params const *A, raymarch_params const *B);
+
+//////////////////////////////////////////////////////////////////////////////
+// Layouts
+
+// NOTE(matthew): Every layout we support is separable, i.e. the storage index
+// of (x, y, z) is OffsetX(x) + OffsetY(y) + OffsetZ(z). For LINEAR that's the
+// usual row-major z*H*W + y*W + x. MORTON interleaves the bits of the three
+// coordinates over the next power-of-two cube, so it's only worth it for
+// (roughly) cubic grids. TILED stores 4x4x4 bricks in row-major order with a
+// Morton walk inside each brick, which keeps the 8 corners of a trilinear
+// lookup within one or two cache lines without the power-of-two padding.
+
+enum data_layout
+{
+	LAYOUT_LINEAR,
+	LAYOUT_MORTON,
+	LAYOUT_TILED,
+
+	LAYOUT_COUNT
+};
+
+#define TILE_SIZE		4
+#define TILE_SHIFT		2
+#define TILE_VOXELS		(TILE_SIZE * TILE_SIZE * TILE_SIZE)
+
+extern const char	*LayoutNames[LAYOUT_COUNT];
+
+u32		LayoutAxisOffset(u32 Layout, u32 Axis, u32 Coord, u32 Width, u32 Height);
+u32		LayoutIndex(u32 Layout, u32 X, u32 Y, u32 Z, u32 Width, u32 Height);
+u32		LayoutStorageSize(u32 Layout, u32 Width, u32 Height, u32 Depth);
+
+//////////////////////////////////////////////////////////////////////////////
+// Volume
+
+// CPU copy of the density volume. Data is indexed through the per-axis offset
+// tables so the samplers don't care which layout is active. It's sampled at
+// random, so it goes on large pages when it can, see AllocPages() in mg.h.
+struct volume
+{
+	u32										Width,
+											Height,
+											Depth;
+	u32										Layout;
+	std::vector<f32, page_allocator<f32>>	Data;
+	std::vector<u32>						OffsetX,
+											OffsetY,
+											OffsetZ;
+};
+
+#define VOLUME_FILL_PIECE	(1 << 20)		// voxels per piece of FillVolumeData()
+
+void	InitVolume(volume *Volume, u32 Width, u32 Height, u32 Depth, u32 Layout);
+void	FillVolumeData(volume *Volume, f32 const *Source);
+void	BuildVolumeOffsets(volume *Volume);
+void	SetVolumeLayout(volume *Volume, u32 Layout);
+f32		VolumeFetch(volume *Volume, s32 X, s32 Y, s32 Z);
+f32		SampleVolume(volume *Volume, v3 Pos);
+f32x4	SampleVolumeX4(volume *Volume, v3x4 Pos, b32x4 Active);
+void	GenerateNoiseVolume(volume *Volume, u32 Width, u32 Height, u32 Depth, f32 *MinVal, f32 *MaxVal);
+
+#ifdef VOLUME_IMPL
+
+#include <perlin.h>
+
+light
+PointLight(v3 Position,
+		   v3 Color,
+		   f32 Intensity)
+{
+	light	Light;
+
+
+	Light.Position = Position;
+	Light.Type = LIGHT_POINT;
+	Light.Color = Color;
+	Light.Intensity = Intensity;
+
+	return (Light);
+}
+
+light
+DirectionalLight(v3 Direction,
+				 v3 Color,
+				 f32 Intensity)
+{
+	light	Light;
+
+
+	Light.Position = Normalize(Direction);
+	Light.Type = LIGHT_DIRECTIONAL;
+	Light.Color = Color;
+	Light.Intensity = Intensity;
+
+	return (Light);
+}
+
+// NOTE(matthew): Field by field, for PublishParamChannel(). Comparing the
+// bytes would count padding, which nothing keeps. A field added to the
+// structs has to be added here or changing it won't publish.
+
+b32
+ParamsEqual(model_params const *A,
+			model_params const *B)
+{
+	for (u32 I = 0; I < 16; I++)
+	{
+		if (A->World.Elements[I] != B->World.Elements[I] ||
+			A->View.Elements[I] != B->View.Elements[I] ||
+			A->Proj.Elements[I] != B->Proj.Elements[I])
+		{
+			return (false);
+		}
+	}
+
+	return (true);
+}
+
+b32
+ParamsEqual(raymarch_params const *A,
+			raymarch_params const *B)
+{
+	if (A->ScreenWidth != B->ScreenWidth || A->ScreenHeight != B->ScreenHeight ||
+		A->MinVal != B->MinVal || A->MaxVal != B->MaxVal ||
+		A->Absorption != B->Absorption || A->DensityScale != B->DensityScale ||
+		A->LightingMode != B->LightingMode || A->Ambient != B->Ambient ||
+		A->LightCount != B->LightCount || A->ScatterOrder != B->ScatterOrder ||
+		A->PhaseG != B->PhaseG || A->MultiScatter != B->MultiScatter ||
+		A->ProbeFilter != B->ProbeFilter || A->FrameIndex != B->FrameIndex ||
+		A->StepScale != B->StepScale || A->Downsample != B->Downsample)
+	{
+		return (false);
+	}
+
+	for (u32 L = 0; L < MAX_LIGHTS; L++)
+	{
+		light const *LightA = &A->Lights[L];
+		light const *LightB = &B->Lights[L];
+
+		if (LightA->Type != LightB->Type || LightA->Intensity != LightB->Intensity)
+		{
+			return (false);
+		}
+
+		for (u32 I = 0; I < 3; I++)
+		{
+			if (LightA->Position.Elements[I] != LightB->Position.Elements[I] ||
+				LightA->Color.Elements[I] != LightB->Color.Elements[I])
+			{
+				return (false);
+			}
+		}
+	}
+
+	return (true);
+}
+
+const char	*LightingModeNames[LIGHTING_MODE_COUNT] =
+{
+	"Lightmarch",
+	"Probes",
+	"Shadow volume",
+	"Deep shadow map",
+};
+
+const char	*LayoutNames[LAYOUT_COUNT] =
+{
+	"Linear",
+	"Morton",
+	"Tiled 4x4x4",
+};
+
+u32
+LayoutAxisOffset(u32 Layout,
+				 u32 Axis,
+				 u32 Coord,
+				 u32 Width,
+				 u32 Height)
+{
+	u32		Offset = 0;
+
+
+	switch (Layout)
+	{
+		case LAYOUT_LINEAR:
+		{
+			u32 Strides[3] = { 1, Width, Width * Height };
+
+			Offset = Coord * Strides[Axis];
+		} break;
+
+		case LAYOUT_MORTON:
+		{
+			Offset = MortonPart1By2(Coord) << Axis;
+		} break;
+
+		case LAYOUT_TILED:
+		{
+			u32 BricksX = (Width + TILE_SIZE - 1) >> TILE_SHIFT;
+			u32 BricksY = (Height + TILE_SIZE - 1) >> TILE_SHIFT;
+			u32 Strides[3] = { 1, BricksX, BricksX * BricksY };
+
+			Offset = (Coord >> TILE_SHIFT) * Strides[Axis] * TILE_VOXELS;
+			Offset += MortonPart1By2(Coord & (TILE_SIZE - 1)) << Axis;
+		} break;
+	}
+
+	return (Offset);
+}
+
+u32
+LayoutIndex(u32 Layout,
+			u32 X,
+			u32 Y,
+			u32 Z,
+			u32 Width,
+			u32 Height)
+{
+	return (LayoutAxisOffset(Layout, 0, X, Width, Height) +
+			LayoutAxisOffset(Layout, 1, Y, Width, Height) +
+			LayoutAxisOffset(Layout, 2, Z, Width, Height));
+}
+
+u32
+LayoutStorageSize(u32 Layout,
+				  u32 Width,
+				  u32 Height,
+				  u32 Depth)
+{
+	u32		Size = 0;
+
+
+	switch (Layout)
+	{
+		case LAYOUT_LINEAR:
+		{
+			Size = Width * Height * Depth;
+		} break;
+
+		case LAYOUT_MORTON:
+		{
+			u32 Dim = NextPow2(_Max(_Max(Width, Height), Depth));
+
+			Size = Dim * Dim * Dim;
+		} break;
+
+		case LAYOUT_TILED:
+		{
+			u32 BricksX = (Width + TILE_SIZE - 1) >> TILE_SHIFT;
+			u32 BricksY = (Height + TILE_SIZE - 1) >> TILE_SHIFT;
+			u32 BricksZ = (Depth + TILE_SIZE - 1) >> TILE_SHIFT;
+
+			Size = BricksX * BricksY * BricksZ * TILE_VOXELS;
+		} break;
+	}
+
+	return (Size);
+}
+
+void
+InitVolume(volume *Volume,
+		   u32 Width,
+		   u32 Height,
+		   u32 Depth,
+		   u32 Layout)
+{
+	Volume->Width = Width;
+	Volume->Height = Height;
+	Volume->Depth = Depth;
+	Volume->Layout = Layout;
+	FillVolumeData(Volume, NULL);
+
+	BuildVolumeOffsets(Volume);
+}
+
+// Sizes Data for the volume's dims and layout and copies Source in, zeros
+// without one. In pieces over the workers, so the first touch of the pages
+// is spread over the nodes they run on.
+void
+FillVolumeData(volume *Volume,
+			   f32 const *Source)
+{
+	u64		Count = LayoutStorageSize(Volume->Layout, Volume->Width, Volume->Height, Volume->Depth);
+
+
+	Volume->Data.clear();
+	Volume->Data.resize(Count);
+
+	ParallelFor(u32((Count + VOLUME_FILL_PIECE - 1) / VOLUME_FILL_PIECE), 1, [&](job_range Range)
+	{
+		u64 Begin = u64(Range.Min.x) * VOLUME_FILL_PIECE;
+		u64 End = _Min(u64(Range.Max.x) * VOLUME_FILL_PIECE, Count);
+
+		if (Source)
+		{
+			memcpy(&Volume->Data[Begin], &Source[Begin], (End - Begin) * sizeof(f32));
+		}
+		else
+		{
+			memset(&Volume->Data[Begin], 0, (End - Begin) * sizeof(f32));
+		}
+	});
+}
+
+void
+BuildVolumeOffsets(volume *Volume)
+{
+	Volume->OffsetX.resize(Volume->Width);
+	Volume->OffsetY.resize(Volume->Height);
+	Volume->OffsetZ.resize(Volume->Depth);
+
+	for (u32 X = 0; X < Volume->Width; X++)
+	{
+		Volume->OffsetX[X] = LayoutAxisOffset(Volume->Layout, 0, X, Volume->Width, Volume->Height);
+	}
+	for (u32 Y = 0; Y < Volume->Height; Y++)
+	{
+		Volume->OffsetY[Y] = LayoutAxisOffset(Volume->Layout, 1, Y, Volume->Width, Volume->Height);
+	}
+	for (u32 Z = 0; Z < Volume->Depth; Z++)
+	{
+		Volume->OffsetZ[Z] = LayoutAxisOffset(Volume->Layout, 2, Z, Volume->Width, Volume->Height);
+	}
+}
+
+// Conversion pass between any two layouts. Walks the destination in source
+// order so at least one side of the copy streams.
+void
+SetVolumeLayout(volume *Volume,
+				u32 Layout)
+{
+	volume		Converted;
+
+
+	if (Volume->Layout == Layout)
+	{
+		return;
+	}
+
+	InitVolume(&Converted, Volume->Width, Volume->Height, Volume->Depth, Layout);
+
+	for (u32 Z = 0; Z < Volume->Depth; Z++)
+	{
+		for (u32 Y = 0; Y < Volume->Height; Y++)
+		{
+			u32 SrcRow = Volume->OffsetY[Y] + Volume->OffsetZ[Z];
+			u32 DstRow = Converted.OffsetY[Y] + Converted.OffsetZ[Z];
+
+			for (u32 X = 0; X < Volume->Width; X++)
+			{
+				Converted.Data[DstRow + Converted.OffsetX[X]] = Volume->Data[SrcRow + Volume->OffsetX[X]];
+			}
+		}
+	}
+
+	Volume->Layout = Layout;
+	Volume->Data.swap(Converted.Data);
+	Volume->OffsetX.swap(Converted.OffsetX);
+	Volume->OffsetY.swap(Converted.OffsetY);
+	Volume->OffsetZ.swap(Converted.OffsetZ);
+}
+
+// Border addressing, same as the GPU sampler: anything outside reads as 0
+f32
+VolumeFetch(volume *Volume,
+			s32 X,
+			s32 Y,
+			s32 Z)
+{
+	if (X < 0 || Y < 0 || Z < 0 ||
+		X >= s32(Volume->Width) || Y >= s32(Volume->Height) || Z >= s32(Volume->Depth))
+	{
+		return (0.0f);
+	}
+
+	return (Volume->Data[Volume->OffsetX[X] + Volume->OffsetY[Y] + Volume->OffsetZ[Z]]);
+}
+
+// Trilinear sample at normalized texture coordinates, matching
+// Volume.SampleLevel(LinearSampler, Pos, 0) in the shaders
+f32
+SampleVolume(volume *Volume,
+			 v3 Pos)
+{
+	f32		FX = Pos.x * Volume->Width - 0.5f,
+			FY = Pos.y * Volume->Height - 0.5f,
+			FZ = Pos.z * Volume->Depth - 0.5f;
+	f32		BaseX = floorf(FX),
+			BaseY = floorf(FY),
+			BaseZ = floorf(FZ);
+	f32		TX = FX - BaseX,
+			TY = FY - BaseY,
+			TZ = FZ - BaseZ;
+	s32		X = s32(BaseX),
+			Y = s32(BaseY),
+			Z = s32(BaseZ);
+	f32		C000, C100, C010, C110,
+			C001, C101, C011, C111;
+
+
+	if (X >= 0 && Y >= 0 && Z >= 0 &&
+		X + 1 < s32(Volume->Width) && Y + 1 < s32(Volume->Height) && Z + 1 < s32(Volume->Depth))
+	{
+		// Interior fast path, no border checks
+		u32 X0 = Volume->OffsetX[X], X1 = Volume->OffsetX[X + 1];
+		u32 Y0 = Volume->OffsetY[Y], Y1 = Volume->OffsetY[Y + 1];
+		u32 Z0 = Volume->OffsetZ[Z], Z1 = Volume->OffsetZ[Z + 1];
+		f32 *Data = Volume->Data.data();
+
+		C000 = Data[X0 + Y0 + Z0]; C100 = Data[X1 + Y0 + Z0];
+		C010 = Data[X0 + Y1 + Z0]; C110 = Data[X1 + Y1 + Z0];
+		C001 = Data[X0 + Y0 + Z1]; C101 = Data[X1 + Y0 + Z1];
+		C011 = Data[X0 + Y1 + Z1]; C111 = Data[X1 + Y1 + Z1];
+	}
+	else
+	{
+		C000 = VolumeFetch(Volume, X, Y, Z); C100 = VolumeFetch(Volume, X + 1, Y, Z);
+		C010 = VolumeFetch(Volume, X, Y + 1, Z); C110 = VolumeFetch(Volume, X + 1, Y + 1, Z);
+		C001 = VolumeFetch(Volume, X, Y, Z + 1); C101 = VolumeFetch(Volume, X + 1, Y, Z + 1);
+		C011 = VolumeFetch(Volume, X, Y + 1, Z + 1); C111 = VolumeFetch(Volume, X + 1, Y + 1, Z + 1);
+	}
+
+	f32 C00 = C000 + TX * (C100 - C000);
+	f32 C10 = C010 + TX * (C110 - C010);
+	f32 C01 = C001 + TX * (C101 - C001);
+	f32 C11 = C011 + TX * (C111 - C011);
+	f32 C0 = C00 + TY * (C10 - C00);
+	f32 C1 = C01 + TY * (C11 - C01);
+
+	return (C0 + TZ * (C1 - C0));
+}
+
+// SampleVolume() at four positions. The coordinates and the lerps are four
+// wide, the corners are gathered one lane at a time. Lanes outside Active
+// aren't read and come back 0. Agrees with SampleVolume() to the bit.
+f32x4
+SampleVolumeX4(volume *Volume,
+			   v3x4 Pos,
+			   b32x4 Active)
+{
+	f32x4	Half = F32x4Set1(0.5f),
+			FX = F32x4Sub(F32x4Mul(Pos.x, F32x4Set1(f32(Volume->Width))), Half),
+			FY = F32x4Sub(F32x4Mul(Pos.y, F32x4Set1(f32(Volume->Height))), Half),
+			FZ = F32x4Sub(F32x4Mul(Pos.z, F32x4Set1(f32(Volume->Depth))), Half);
+	f32x4	BaseX = F32x4Floor(FX),
+			BaseY = F32x4Floor(FY),
+			BaseZ = F32x4Floor(FZ);
+	f32x4	TX = F32x4Sub(FX, BaseX),
+			TY = F32x4Sub(FY, BaseY),
+			TZ = F32x4Sub(FZ, BaseZ);
+	f32		Bases[3][4];
+	f32		Corners[8][4] = {};
+	u32		Lanes = B32x4Bits(Active);
+	f32x4	C[8];
+
+
+	F32x4Store(Bases[0], BaseX);
+	F32x4Store(Bases[1], BaseY);
+	F32x4Store(Bases[2], BaseZ);
+
+	for (u32 L = 0; L < 4; L++)
+	{
+		if (!(Lanes & (1 << L)))
+		{
+			continue;
+		}
+
+		s32 X = s32(Bases[0][L]);
+		s32 Y = s32(Bases[1][L]);
+		s32 Z = s32(Bases[2][L]);
+
+		if (X >= 0 && Y >= 0 && Z >= 0 &&
+			X + 1 < s32(Volume->Width) && Y + 1 < s32(Volume->Height) && Z + 1 < s32(Volume->Depth))
+		{
+			u32 X0 = Volume->OffsetX[X], X1 = Volume->OffsetX[X + 1];
+			u32 Y0 = Volume->OffsetY[Y], Y1 = Volume->OffsetY[Y + 1];
+			u32 Z0 = Volume->OffsetZ[Z], Z1 = Volume->OffsetZ[Z + 1];
+			f32 *Data = Volume->Data.data();
+
+			Corners[0][L] = Data[X0 + Y0 + Z0]; Corners[1][L] = Data[X1 + Y0 + Z0];
+			Corners[2][L] = Data[X0 + Y1 + Z0]; Corners[3][L] = Data[X1 + Y1 + Z0];
+			Corners[4][L] = Data[X0 + Y0 + Z1]; Corners[5][L] = Data[X1 + Y0 + Z1];
+			Corners[6][L] = Data[X0 + Y1 + Z1]; Corners[7][L] = Data[X1 + Y1 + Z1];
+		}
+		else
+		{
+			Corners[0][L] = VolumeFetch(Volume, X, Y, Z); Corners[1][L] = VolumeFetch(Volume, X + 1, Y, Z);
+			Corners[2][L] = VolumeFetch(Volume, X, Y + 1, Z); Corners[3][L] = VolumeFetch(Volume, X + 1, Y + 1, Z);
+			Corners[4][L] = VolumeFetch(Volume, X, Y, Z + 1); Corners[5][L] = VolumeFetch(Volume, X + 1, Y, Z + 1);
+			Corners[6][L] = VolumeFetch(Volume, X, Y + 1, Z + 1); Corners[7][L] = VolumeFetch(Volume, X + 1, Y + 1, Z + 1);
+		}
+	}
+
+	for (u32 I = 0; I < 8; I++)
+	{
+		C[I] = F32x4Load(Corners[I]);
+	}
+
+	f32x4 C00 = F32x4Add(C[0], F32x4Mul(TX, F32x4Sub(C[1], C[0])));
+	f32x4 C10 = F32x4Add(C[2], F32x4Mul(TX, F32x4Sub(C[3], C[2])));
+	f32x4 C01 = F32x4Add(C[4], F32x4Mul(TX, F32x4Sub(C[5], C[4])));
+	f32x4 C11 = F32x4Add(C[6], F32x4Mul(TX, F32x4Sub(C[7], C[6])));
+	f32x4 C0 = F32x4Add(C00, F32x4Mul(TY, F32x4Sub(C10, C00)));
+	f32x4 C1 = F32x4Add(C01, F32x4Mul(TY, F32x4Sub(C11, C01)));
+
+	return (F32x4Select(Active, F32x4Add(C0, F32x4Mul(TZ, F32x4Sub(C1, C0))), F32x4Set1(0)));
+}
+
+void
+GenerateNoiseVolume(volume *Volume,
+					u32 Width,
+					u32 Height,
+					u32 Depth,
+					f32 *MinVal,
+					f32 *MaxVal)
+{
+	std::vector<int>	P;
+	std::vector<f32>	SliceMin(Depth,  10000.0f),
+						SliceMax(Depth, -10000.0f);
+	f32					MinNoise =  10000.0f,
+						MaxNoise = -10000.0f;
+
+
+	P = get_permutation_vector();
+	InitVolume(Volume, Width, Height, Depth, LAYOUT_LINEAR);
+
+	// A slice per piece, each with its own min and max
+	ParallelFor(Depth, 1, [&](job_range Range)
+	{
+		for (u32 z = u32(Range.Min.x); z < u32(Range.Max.x); z++)
+		{
+			for (u32 y = 0; y < Height; y++)
+			{
+				for (u32 x = 0; x < Width; x++)
+				{
+					f32 Noise = 0;
+					f32 Amp = 16;
+					f32 Freq = 1.5f;
+					u32 Octaves = 1;
+
+					for (u32 i = 0; i < Octaves; i++)
+					{
+						f32 SampleX = ((2.0f * x / (f32)Width) - 1.0f) * Freq;
+						f32 SampleY = ((2.0f * y / (f32)Height) - 1.0f) * Freq;
+						f32 SampleZ = ((2.0f * z / (f32)Depth) - 1.0f) * Freq;
+
+						Noise += fabs(perlin(SampleX, SampleY, SampleZ, P) * Amp);
+
+						Freq *= 2.0f;
+						Amp *= 0.5f;
+					}
+
+					u32 Index = (z * Height * Width) + y * Width + x;
+
+					if (Noise < SliceMin[z])
+					{
+						SliceMin[z] = Noise;
+					}
+					if (Noise > SliceMax[z])
+					{
+						SliceMax[z] = Noise;
+					}
+
+					Volume->Data[Index] = Noise;
+				}
+			}
+		}
+	});
+
+	for (u32 z = 0; z < Depth; z++)
+	{
+		MinNoise = _Min(MinNoise, SliceMin[z]);
+		MaxNoise = _Max(MaxNoise, SliceMax[z]);
+	}
+
+	*MinVal = MinNoise;
+	*MaxVal = MaxNoise;
+}
+
+#endif // VOLUME_IMPL
+
+#endif // __VOLUME_H__
@@ -2,7 +2,7 @@
 
 set CPP_FLAGS=/W4 /MP /Zi /wd4201 /I ../include /I ../include/imgui /I ../include/implot /nologo /MD /FC /EHsc /c
 set CPP_SRC=../source/*.cpp ../source/imgui/*.cpp ../source/implot/*.cpp
-set CPP_LIBS=glfw3_mt.lib openvdb.lib user32.lib gdi32.lib d3d11.lib dxgi.lib d3dcompiler.lib shell32.lib comdlg32.lib
+set CPP_LIBS=glfw3_mt.lib openvdb.lib user32.lib gdi32.lib d3d11.lib dxgi.lib d3dcompiler.lib shell32.lib comdlg32.lib advapi32.lib
 
 if not exist build (
 	mkdir build
@@ -6,6 +6,7 @@
 #include <GLFW/glfw3.h>
 #define GLFW_EXPOSE_NATIVE_WIN32
 #include <GLFW/glfw3native.h>
+#include <string.h>
 #include <vector>
 #include <string>
 
@@ -13,7 +14,22 @@
 #define MG_IMPL
 #include <mg.h>
 #include <data.h>
-#include <perlin.h>
+#define VOLUME_IMPL
+#include <volume.h>
+#define PROBES_IMPL
+#include <probes.h>
+#define SCATTER_IMPL
+#include <scatter.h>
+#define SHADOW_IMPL
+#include <shadow.h>
+#define RENDER_IMPL
+#include <render.h>
+#define FRAME_IMPL
+#include <frame.h>
+#define BENCH_IMPL
+#include <bench.h>
+#define CACHE_IMPL
+#include <cache.h>
 #include <imgui/imgui.h>
 #include <imgui/imgui_impl_dx11.h>
 #include <imgui/imgui_impl_glfw.h>
@@ -27,19 +43,8 @@
 #define VOLUME_DEPTH	64
 #define VOLUME_SIZE		VOLUME_WIDTH * VOLUME_HEIGHT * VOLUME_DEPTH
 
-#define PROBE_COUNT_X		32
-#define PROBE_COUNT_Y		32
-#define PROBE_COUNT_Z		32
-#define PROBE_COUNT_TOTAL	PROBE_COUNT_X * PROBE_COUNT_Y * PROBE_COUNT_Z
 v3 		VOLUME_SCALE(5.f, 5.f, 5.f);
 
-struct model_params
-{
-	m4		World,
-			View,
-			Proj;
-};
-
 struct camera
 {
 	v3		Pos,
@@ -47,58 +52,53 @@ struct camera
 			Up;
 };
 
-struct raymarch_params
-{
-	u32		ScreenWidth,
-			ScreenHeight;
-	f32		MinVal,
-			MaxVal;
-	v3		LightPos;
-	f32		Absorption;
-	f32		DensityScale;
-	b32 	UseProbes;
-	f32		Ambient;
-	f32		_Pad0[1];
-};
-
-struct probe
-{
-	v3		Position;
-	f32		Transmittance;
-};
-
-struct grid_params
-{
-	v3i		GridDims;
-	u32		ProbeCount;
-
-	v3		GridMin;
-	f32		_Pad0;
-
-	v3		GridMax;
-	f32		_Pad1;
-
-	v3		GridExtents;
-	f32		_Pad2;
-
-	v3		GridExtentsRcp;
-	f32		_Pad3;
-
-	v3		CellSize;
-	f32		_Pad4;
-};
-
 camera gCamera;
 f32 gDeltaTime = 0;
 f32 gLastFrame = 0;
 b32 gFirstMouse = TRUE;
 b32 gImGuiControl = FALSE;
 
-std::vector<f32>			gVolumeData;
-ID3D11Texture3D				*gVolume;
-ID3D11ShaderResourceView	*gVolumeSRV;
+job_system					gJobs;
+
+// The UI stage's, the render stage gets copies in frame_input
 model_params				gModelParams = {};
 raymarch_params				gRaymarchParams = {};
+probe_budget				gProbeBudget = DefaultProbeBudget();
+scatter_bake_params			gScatterBake = DefaultScatterBakeParams();
+
+// From here on the render stage's, see frame.h
+volume						gVolumeData;
+f32							gVolumeMinVal,		// replaces the UI's MinVal/MaxVal
+							gVolumeMaxVal;
+ID3D11Texture3D				*gVolume;
+ID3D11ShaderResourceView	*gVolumeSRV;
+
+grid_params					gGridParams = {};
+probe_fit					gProbeFit = {};
+u32							gProbeStorage;
+ID3D11Buffer				*gProbesBuffer;
+ID3D11ShaderResourceView	*gProbesSRV;
+ID3D11UnorderedAccessView	*gProbesUAV;
+
+bake_cache					gBakeCache;
+u64							gVolumeHash;
+u64							gBakedKey;
+
+scatter_volume				gScatter;
+ID3D11Texture3D				*gScatterTexture;
+ID3D11ShaderResourceView	*gScatterSRV;
+u64							gScatterKey;
+
+shadow_volume				gShadowVolume;
+ID3D11Texture3D				*gShadowTexture;
+ID3D11ShaderResourceView	*gShadowSRV;
+u64							gShadowKey;
+
+deep_shadow_map				gDeepShadowMap;
+ID3D11Texture2D				*gDeepShadowTexture;
+ID3D11ShaderResourceView	*gDeepShadowSRV;
+u64							gDeepShadowKey;
+light_aligned_cache			gLightAlignedCache;
 
 ID3D11ShaderResourceView		*NULL_SRV[8] = {};
 ID3D11UnorderedAccessView		*NULL_UAV[8] = {};
@@ -112,11 +112,381 @@ void		__cdecl LoadVDB(std::string FileName, std::vector<f32> &VolumeData, u32 &V
 
 std::string	GetVDBFilename(HWND hWnd);
 void		UpdateVolume(std::string Filename, ID3D11Device *Device);
+void		UpdateProbeGrid(ID3D11Device *Device, raymarch_params *Params, probe_budget *Budget);
+void		InitRaymarchParams(raymarch_params *Params);
+void		LoadHeadlessVolume(std::string Filename, volume *Volume, raymarch_params *Params);
+void		ReadbackProbes(ID3D11Device *Device, ID3D11DeviceContext *Context, std::vector<probe> &Probes);
+void		UpdateScatterProbes(ID3D11Device *Device, ID3D11DeviceContext *Context, raymarch_params *Params, scatter_bake_params *Bake);
+void		UpdateShadowVolume(ID3D11Device *Device, raymarch_params *Params);
+void		UpdateDeepShadowMap(ID3D11Device *Device, raymarch_params *Params);
+b32			UpdateConstants(ID3D11DeviceContext *Context, ID3D11Buffer *Buffer, void const *Data, void *Uploaded, u32 Size);
 
 
 int
-main()
+main(int ArgCount,
+	 char **Args)
 {
+	// Large pages for the volume if the user may lock memory, spread over
+	// the NUMA nodes if there are several
+	InitPages(PAGES_LARGE | PAGES_INTERLEAVE);
+
+	//////////////////////////////////////////////////////////////////////////
+	// Headless modes
+
+	if (ArgCount > 1 && strcmp(Args[1], "-bench") == 0)
+	{
+		u32 MaxVolumeSize = (ArgCount > 2) ? u32(atoi(Args[2])) : 256;
+
+		RunBenchmarks(MaxVolumeSize);
+
+		return (0);
+	}
+
+	if (ArgCount > 1 && strcmp(Args[1], "-params") == 0)
+	{
+		u32 PublishCount = (ArgCount > 2) ? u32(atoi(Args[2])) : 200000;
+
+		RunParamChannelTest(3, _Max(PublishCount, 1u));
+
+		return (0);
+	}
+
+	// Every CPU kernel below goes through ParallelFor(). The benchmarks
+	// bring up their own.
+	InitJobSystem(&gJobs, 0);
+
+	if (ArgCount > 1 && strcmp(Args[1], "-pipeline") == 0)
+	{
+		u32 FrameCount = (ArgCount > 2) ? u32(atoi(Args[2])) : 120;
+
+		RunPipelineTest(&gJobs, _Max(FrameCount, 1u));
+		ShutdownJobSystem(&gJobs);
+
+		return (0);
+	}
+
+	if (ArgCount > 1 && strcmp(Args[1], "-analyze") == 0)
+	{
+		volume				Volume;
+		raymarch_params		Params = {};
+		m4					World = Mat4Scale(VOLUME_SCALE);
+		u32					SampleCount = 1 << 16;
+		f32					TargetError = 0;
+		b32					Csv = FALSE;
+		std::string			VDBFileName;
+
+
+		InitRaymarchParams(&Params);
+
+		for (s32 I = 2; I < ArgCount; I++)
+		{
+			if (strcmp(Args[I], "-samples") == 0 && I + 1 < ArgCount)
+			{
+				s32 Samples = atoi(Args[++I]);
+
+				if (Samples < 1)
+				{
+					printf("Usage: %s -analyze [file.vdb] [-samples N >= 1] [-target ERROR] [-light X Y Z] [-filter N] [-csv]\n", Args[0]);
+					ShutdownJobSystem(&gJobs);
+
+					return (1);
+				}
+
+				SampleCount = u32(Samples);
+			}
+			else if (strcmp(Args[I], "-target") == 0 && I + 1 < ArgCount)
+			{
+				TargetError = f32(atof(Args[++I]));
+			}
+			else if (strcmp(Args[I], "-light") == 0 && I + 3 < ArgCount)
+			{
+				Params.Lights[0].Position.x = f32(atof(Args[++I]));
+				Params.Lights[0].Position.y = f32(atof(Args[++I]));
+				Params.Lights[0].Position.z = f32(atof(Args[++I]));
+			}
+			else if (strcmp(Args[I], "-csv") == 0)
+			{
+				Csv = TRUE;
+			}
+			else if (strcmp(Args[I], "-filter") == 0 && I + 1 < ArgCount)
+			{
+				Params.ProbeFilter = _Min(u32(atoi(Args[++I])), u32(PROBE_FILTER_COUNT - 1));
+			}
+			else
+			{
+				VDBFileName = Args[I];
+			}
+		}
+
+		LoadHeadlessVolume(VDBFileName, &Volume, &Params);
+		RunProbeAnalysis(&Volume, &Params, World, SampleCount, TargetError, Csv);
+		ShutdownJobSystem(&gJobs);
+
+		return (0);
+	}
+
+	if (ArgCount > 2 && strcmp(Args[1], "-render") == 0)
+	{
+		volume				Volume;
+		raymarch_params		Params = {};
+		grid_params			Grid = {};
+		probe_budget		Budget = DefaultProbeBudget();
+		probe_fit			Fit;
+		std::vector<probe>	Probes;
+		scatter_volume		Scatter;
+		shadow_volume		Shadows;
+		deep_shadow_map		DeepShadows;
+		render_scene		Scene;
+		image				Image;
+		char const			*OutFileName = Args[2],
+							*PathFileName = nullptr,
+							*DiffFileName = nullptr;
+		std::string			VDBFileName;
+		u32					TrackSamples = 0,
+							Frames = 0;
+		m4					View,
+							Proj;
+
+
+		InitRaymarchParams(&Params);
+		Image.Width = 640;
+		Image.Height = 360;
+
+		for (s32 I = 3; I < ArgCount; I++)
+		{
+			if (strcmp(Args[I], "-size") == 0 && I + 2 < ArgCount)
+			{
+				Image.Width = u32(atoi(Args[++I]));
+				Image.Height = u32(atoi(Args[++I]));
+			}
+			else if (strcmp(Args[I], "-march") == 0)
+			{
+				Params.LightingMode = LIGHTING_MARCH;
+			}
+			else if (strcmp(Args[I], "-shadow") == 0)
+			{
+				Params.LightingMode = LIGHTING_SHADOW_VOLUME;
+			}
+			else if (strcmp(Args[I], "-deep") == 0)
+			{
+				Params.LightingMode = LIGHTING_DEEP_SHADOW_MAP;
+			}
+			else if (strcmp(Args[I], "-track") == 0 && I + 1 < ArgCount)
+			{
+				TrackSamples = u32(atoi(Args[++I]));
+			}
+			else if (strcmp(Args[I], "-frames") == 0 && I + 1 < ArgCount)
+			{
+				Frames = u32(atoi(Args[++I]));
+			}
+			else if (strcmp(Args[I], "-step") == 0 && I + 1 < ArgCount)
+			{
+				Params.StepScale = f32(atof(Args[++I]));
+			}
+			else if (strcmp(Args[I], "-path") == 0 && I + 1 < ArgCount)
+			{
+				PathFileName = Args[++I];
+			}
+			else if (strcmp(Args[I], "-scale") == 0 && I + 1 < ArgCount)
+			{
+				Params.Downsample = _Max(u32(atoi(Args[++I])), 1u);
+			}
+			else if (strcmp(Args[I], "-diff") == 0 && I + 1 < ArgCount)
+			{
+				DiffFileName = Args[++I];
+			}
+			else if (strcmp(Args[I], "-filter") == 0 && I + 1 < ArgCount)
+			{
+				Params.ProbeFilter = _Min(u32(atoi(Args[++I])), u32(PROBE_FILTER_COUNT - 1));
+			}
+			else if (strcmp(Args[I], "-scatter") == 0 && I + 1 < ArgCount)
+			{
+				Params.ScatterOrder = _Min(u32(atoi(Args[++I])), u32(SCATTER_DIFFUSION));
+			}
+			else
+			{
+				VDBFileName = Args[I];
+			}
+		}
+
+		LoadHeadlessVolume(VDBFileName, &Volume, &Params);
+
+		Scene.Volume = &Volume;
+		Scene.Grid = &Grid;
+		Scene.Params = &Params;
+		Scene.World = Mat4Scale(VOLUME_SCALE);
+		Scene.InvWorld = Mat4Inverse(Scene.World);
+
+		FitProbeGrid(&Grid, &Volume, &Params, Scene.World, &Budget, &Fit);
+		Probes.resize(ProbeStorageCount(&Grid));
+		BakeProbes(Probes.data(), &Volume, &Grid, &Params, Scene.InvWorld);
+		Scene.Probes = Probes.data();
+
+		if (Params.ScatterOrder == SCATTER_DIFFUSION)
+		{
+			RelaxScatterProbes(&Scatter, Probes.data(), &Volume, &Grid, &Params, Scene.InvWorld, DefaultScatterBakeParams().Iterations);
+		}
+		else if (Params.ScatterOrder != SCATTER_OFF)
+		{
+			scatter_bake_params Bake = DefaultScatterBakeParams();
+
+			Bake.Order = Params.ScatterOrder;
+			BakeScatterProbes(&Scatter, Probes.data(), &Volume, &Grid, &Params, Scene.InvWorld, &Bake);
+		}
+		Scene.Scatter = &Scatter;
+
+		if (Params.LightingMode == LIGHTING_SHADOW_VOLUME)
+		{
+			BuildShadowVolume(&Shadows, &Volume, &Params, Scene.World);
+		}
+		Scene.Shadows = &Shadows;
+
+		if (Params.LightingMode == LIGHTING_DEEP_SHADOW_MAP)
+		{
+			if (!BuildDeepShadowMap(&DeepShadows, &Volume, &Params, Scene.World, DEEP_SHADOW_MAP_SIZE, nullptr, 0))
+			{
+				printf("Out of scratch memory building the deep shadow map\n");
+				ShutdownJobSystem(&gJobs);
+
+				return (-1);
+			}
+		}
+		Scene.DeepShadows = &DeepShadows;
+
+		// Same camera as the interactive view starts with
+		View = Mat4LookAtLH(v3(3, 1.5f, -3.5f), v3(3, 1.5f, -3.5f) + v3(-0.5f, -0.25f, 0.8f), v3(0, 1, 0));
+		Proj = Mat4PerspectiveLH(45.0f, f32(Image.Width) / f32(Image.Height), 0.1f, 1000.0f);
+
+		if (PathFileName)
+		{
+			camera_path		Path;
+
+			if (!LoadCameraPath(&Path, PathFileName))
+			{
+				printf("Failed to read %s\n", PathFileName);
+				ShutdownJobSystem(&gJobs);
+
+				return (-1);
+			}
+
+			// -step is the coarse step here, the reference is always 1
+			PrintCameraPathHeader();
+			ReplayCameraPath(&Scene, &Path, "Recorded", Image.Width, Image.Height, Params.StepScale, 8, &Image);
+		}
+		else if (TrackSamples)
+		{
+			majorant_grid			Majorants;
+			image_accumulator		Accum = {};
+
+			BuildMajorantGrid(&Majorants, &Volume, Params.DensityScale);
+			Accum.Width = Image.Width;
+			Accum.Height = Image.Height;
+
+			// Progressively, so a long render shows how far along it is
+			while (Accum.SampleCount < TrackSamples)
+			{
+				RenderVolumeTracked(&Accum, &Scene, &Majorants, View, Proj, _Min(TrackSamples - Accum.SampleCount, 16u));
+				printf("%u / %u samples\r", Accum.SampleCount, TrackSamples);
+			}
+			printf("\n");
+
+			ResolveAccumulator(&Image, &Accum);
+		}
+		else if (Frames)
+		{
+			image_accumulator	Accum = {};
+
+			Accum.Width = Image.Width;
+			Accum.Height = Image.Height;
+
+			while (Accum.SampleCount < Frames)
+			{
+				RenderVolumeProgressive(&Accum, &Scene, View, Proj);
+				printf("%u / %u frames\r", Accum.SampleCount, Frames);
+			}
+			printf("\n");
+
+			ResolveAccumulator(&Image, &Accum);
+		}
+		else if (Params.Downsample > 1)
+		{
+			image			Reference = Image,
+							Difference;
+			image_diff		Diff;
+
+
+			// Reduced resolution, with a report against full resolution
+			u64 Start = ReadTimer();
+			RenderVolume(&Reference, &Scene, View, Proj);
+			f64 FullMs = TimerSeconds(Start, ReadTimer()) * 1e3;
+
+			Start = ReadTimer();
+			RenderVolumeScaled(&Image, &Scene, View, Proj, Params.Downsample);
+			f64 ScaledMs = TimerSeconds(Start, ReadTimer()) * 1e3;
+
+			PrintImageDiffHeader();
+			DiffImages(&Reference, &Reference, 1.0f / 64, &Diff);
+			PrintImageDiff("Full", FullMs, &Diff);
+			DiffImages(&Image, &Reference, 1.0f / 64, &Diff);
+			PrintImageDiff("Scaled", ScaledMs, &Diff);
+
+			if (DiffFileName)
+			{
+				DifferenceImage(&Difference, &Image, &Reference, 8.0f);
+
+				if (!WriteImagePPM(&Difference, DiffFileName))
+				{
+					printf("Failed to write %s\n", DiffFileName);
+					ShutdownJobSystem(&gJobs);
+
+					return (-1);
+				}
+			}
+		}
+		else
+		{
+			RenderVolume(&Image, &Scene, View, Proj);
+		}
+
+		if (!WriteImagePPM(&Image, OutFileName))
+		{
+			printf("Failed to write %s\n", OutFileName);
+			ShutdownJobSystem(&gJobs);
+
+			return (-1);
+		}
+
+		ShutdownJobSystem(&gJobs);
+
+		return (0);
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	// Options
+
+	char const		*CacheDirectory = "probe_cache";
+	u64				CacheMaxMB = 1024;
+	b32				CacheCompress = TRUE;
+
+
+	for (s32 I = 1; I < ArgCount; I++)
+	{
+		if (strcmp(Args[I], "-cache-dir") == 0 && I + 1 < ArgCount)
+		{
+			CacheDirectory = Args[++I];
+		}
+		else if (strcmp(Args[I], "-cache-mb") == 0 && I + 1 < ArgCount)
+		{
+			CacheMaxMB = u64(atoi(Args[++I]));
+		}
+		else if (strcmp(Args[I], "-cache-raw") == 0)
+		{
+			CacheCompress = FALSE;
+		}
+	}
+
+	InitBakeCache(&gBakeCache, CacheDirectory, CacheMaxMB * 1024 * 1024, CacheCompress);
+
 	//////////////////////////////////////////////////////////////////////////
 	// GLFW setup
 
@@ -132,6 +502,8 @@ main()
 	if (!Window)
 	{
 		printf("Failed to create window...!\r\n");
+		ShutdownJobSystem(&gJobs);
+
 		return (-1);
 	}
 
@@ -150,9 +522,7 @@ main()
 								*DepthBuffer;
 	ID3D11RenderTargetView		*BackbufferRTV;
 	ID3D11DepthStencilView 		*BackbufferDSV;
-	ID3D11RasterizerState 		*CullFront,
-						  		*CullBack,
-						  		*CullNone;
+	ID3D11RasterizerState 		*CullNone;
 	IDXGISwapChain 				*SwapChain;
 	DXGI_SWAP_CHAIN_DESC 		SwapChainDesc = {};
 	D3D11_TEXTURE2D_DESC 		DepthBufferDesc = {};
@@ -196,53 +566,51 @@ main()
 	RasterStateDesc.DepthClipEnable = TRUE;
 	Hr = Device->CreateRasterizerState(&RasterStateDesc, &CullNone);
 
-	RasterStateDesc.CullMode = D3D11_CULL_FRONT;
-	Hr = Device->CreateRasterizerState(&RasterStateDesc, &CullFront);
-
-	RasterStateDesc.CullMode = D3D11_CULL_BACK;
-	Hr = Device->CreateRasterizerState(&RasterStateDesc, &CullBack);
-
 	//////////////////////////////////////////////////////////////////////////
 	// Shader setup
 
-	ID3D11VertexShader		*ModelVS,
-							*RaymarchVS,
+	ID3D11VertexShader		*RaymarchVS,
 							*LampVS,
-							*ProbeDebugVS;
-	ID3D11PixelShader 		*ModelPS,
-							*RaymarchPS,
+							*ProbeDebugVS,
+							*FullscreenVS;
+	ID3D11PixelShader 		*RaymarchPS,
 							*LampPS,
-							*ProbeDebugPS;
+							*ProbeDebugPS,
+							*TemporalPS,
+							*CompositePS;
 	ID3D11ComputeShader		*ProbeCS;
-	ID3DBlob 				*ModelVSBlob,
-			 				*ModelPSBlob,
-							*RaymarchVSBlob,
+	ID3DBlob 				*RaymarchVSBlob,
 			 				*RaymarchPSBlob,
 							*LampVSBlob,
 			 				*LampPSBlob,
 							*ProbeDebugVSBlob,
 			 				*ProbeDebugPSBlob,
+							*FullscreenVSBlob,
+							*TemporalPSBlob,
+							*CompositePSBlob,
 							*ProbeCSBlob;
 
 
-	Hr = D3DReadFileToBlob(L"build/model_vs.cso", &ModelVSBlob);
-	Hr = D3DReadFileToBlob(L"build/model_ps.cso", &ModelPSBlob);
 	Hr = D3DReadFileToBlob(L"build/raymarch_vs.cso", &RaymarchVSBlob);
 	Hr = D3DReadFileToBlob(L"build/raymarch_ps.cso", &RaymarchPSBlob);
 	Hr = D3DReadFileToBlob(L"build/lamp_vs.cso", &LampVSBlob);
 	Hr = D3DReadFileToBlob(L"build/lamp_ps.cso", &LampPSBlob);
 	Hr = D3DReadFileToBlob(L"build/probe_debug_vs.cso", &ProbeDebugVSBlob);
 	Hr = D3DReadFileToBlob(L"build/probe_debug_ps.cso", &ProbeDebugPSBlob);
+	Hr = D3DReadFileToBlob(L"build/fullscreen_vs.cso", &FullscreenVSBlob);
+	Hr = D3DReadFileToBlob(L"build/temporal_ps.cso", &TemporalPSBlob);
+	Hr = D3DReadFileToBlob(L"build/composite_ps.cso", &CompositePSBlob);
 	Hr = D3DReadFileToBlob(L"build/probe_cs.cso", &ProbeCSBlob);
 
-	Device->CreateVertexShader(ModelVSBlob->GetBufferPointer(), ModelVSBlob->GetBufferSize(), NULL, &ModelVS);
-	Device->CreatePixelShader(ModelPSBlob->GetBufferPointer(), ModelPSBlob->GetBufferSize(), NULL, &ModelPS);
 	Device->CreateVertexShader(RaymarchVSBlob->GetBufferPointer(), RaymarchVSBlob->GetBufferSize(), NULL, &RaymarchVS);
 	Device->CreatePixelShader(RaymarchPSBlob->GetBufferPointer(), RaymarchPSBlob->GetBufferSize(), NULL, &RaymarchPS);
 	Device->CreateVertexShader(LampVSBlob->GetBufferPointer(), LampVSBlob->GetBufferSize(), NULL, &LampVS);
 	Device->CreatePixelShader(LampPSBlob->GetBufferPointer(), LampPSBlob->GetBufferSize(), NULL, &LampPS);
 	Device->CreateVertexShader(ProbeDebugVSBlob->GetBufferPointer(), ProbeDebugVSBlob->GetBufferSize(), NULL, &ProbeDebugVS);
 	Device->CreatePixelShader(ProbeDebugPSBlob->GetBufferPointer(), ProbeDebugPSBlob->GetBufferSize(), NULL, &ProbeDebugPS);
+	Device->CreateVertexShader(FullscreenVSBlob->GetBufferPointer(), FullscreenVSBlob->GetBufferSize(), NULL, &FullscreenVS);
+	Device->CreatePixelShader(TemporalPSBlob->GetBufferPointer(), TemporalPSBlob->GetBufferSize(), NULL, &TemporalPS);
+	Device->CreatePixelShader(CompositePSBlob->GetBufferPointer(), CompositePSBlob->GetBufferSize(), NULL, &CompositePS);
 	Device->CreateComputeShader(ProbeCSBlob->GetBufferPointer(), ProbeCSBlob->GetBufferSize(), NULL, &ProbeCS);
 
 	//////////////////////////////////////////////////////////////////////////
@@ -318,12 +686,12 @@ main()
 	//////////////////////////////////////////////////////////////////////////
 	// Render targets
 
-	ID3D11Texture2D						*FrontTexture,
-										*BackTexture;
-	ID3D11ShaderResourceView			*FrontSRV,
-										*BackSRV;
-	ID3D11RenderTargetView				*FrontRTV,
-										*BackRTV;
+	ID3D11Texture2D						*MarchTexture[2],
+										*HistoryTexture[2];
+	ID3D11ShaderResourceView			*MarchSRV[2],
+										*HistorySRV[2];
+	ID3D11RenderTargetView				*MarchRTV[2],
+										*HistoryRTV[2];
 	D3D11_TEXTURE2D_DESC				RenderTextureDesc = {};
 	D3D11_SHADER_RESOURCE_VIEW_DESC		RenderTextureSRVDesc = {};
 	D3D11_RENDER_TARGET_VIEW_DESC		RenderTextureRTVDesc = {};
@@ -346,12 +714,18 @@ main()
 	RenderTextureRTVDesc.ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2D;
 	RenderTextureRTVDesc.Texture2D.MipSlice = 0;
 
-	Device->CreateTexture2D(&RenderTextureDesc, nullptr, &FrontTexture);
-	Device->CreateTexture2D(&RenderTextureDesc, nullptr, &BackTexture);
-	Device->CreateShaderResourceView(FrontTexture, &RenderTextureSRVDesc, &FrontSRV);
-	Device->CreateShaderResourceView(BackTexture, &RenderTextureSRVDesc, &BackSRV);
-	Device->CreateRenderTargetView(FrontTexture, &RenderTextureRTVDesc, &FrontRTV);
-	Device->CreateRenderTargetView(BackTexture, &RenderTextureRTVDesc, &BackRTV);
+	// The march writes color and the position of its depth estimate, the
+	// temporal pass ping-pongs the history between two more. The rays come
+	// from PixelRayBox() rather than position textures of the box's faces.
+	for (u32 I = 0; I < 2; I++)
+	{
+		Device->CreateTexture2D(&RenderTextureDesc, nullptr, &MarchTexture[I]);
+		Device->CreateShaderResourceView(MarchTexture[I], &RenderTextureSRVDesc, &MarchSRV[I]);
+		Device->CreateRenderTargetView(MarchTexture[I], &RenderTextureRTVDesc, &MarchRTV[I]);
+		Device->CreateTexture2D(&RenderTextureDesc, nullptr, &HistoryTexture[I]);
+		Device->CreateShaderResourceView(HistoryTexture[I], &RenderTextureSRVDesc, &HistorySRV[I]);
+		Device->CreateRenderTargetView(HistoryTexture[I], &RenderTextureRTVDesc, &HistoryRTV[I]);
+	}
 
 	//////////////////////////////////////////////////////////////////////////
 	// Sampler
@@ -412,53 +786,12 @@ main()
 	D3D11_TEXTURE3D_DESC				VolumeDesc = {};
 	D3D11_SHADER_RESOURCE_VIEW_DESC		VolumeSRVDesc = {};
 	D3D11_SUBRESOURCE_DATA				VolumeSubData = {};
-	f32									*VolumeData;
-	std::vector<int>					P;
-	f32									MinNoise =  10000.0f,
-										MaxNoise = -10000.0f;
-
-
-	P = get_permutation_vector();
-	VolumeData = (f32 *)HeapAlloc(GetProcessHeap(), 0, VOLUME_SIZE * sizeof(*VolumeData));
-
-	for (u32 z = 0; z < VOLUME_DEPTH; z++)
-	{
-		for (u32 y = 0; y < VOLUME_HEIGHT; y++)
-		{
-			for (u32 x = 0; x < VOLUME_WIDTH; x++)
-			{
-				f32 Noise = 0;
-				f32 Amp = 16;
-				f32 Freq = 1.5f;
-				u32 Octaves = 1;
-
-				for (u32 i = 0; i < Octaves; i++)
-				{
-					f32 SampleX = ((2.0f * x / (f32)VOLUME_WIDTH) - 1.0f) * Freq;
-					f32 SampleY = ((2.0f * y / (f32)VOLUME_HEIGHT) - 1.0f) * Freq;
-					f32 SampleZ = ((2.0f * z / (f32)VOLUME_DEPTH) - 1.0f) * Freq;
-
-					Noise += fabs(perlin(SampleX, SampleY, SampleZ, P) * Amp);
-
-					Freq *= 2.0f;
-					Amp *= 0.5f;
-				}
-
-				u32 Index = (z * VOLUME_HEIGHT * VOLUME_WIDTH) + y * VOLUME_WIDTH + x;
+	f32									MinNoise,
+										MaxNoise;
 
-				if (Noise < MinNoise)
-				{
-					MinNoise = Noise;
-				}
-				if (Noise > MaxNoise)
-				{
-					MaxNoise = Noise;
-				}
 
-				VolumeData[Index] = Noise;
-			}
-		}
-	}
+	GenerateNoiseVolume(&gVolumeData, VOLUME_WIDTH, VOLUME_HEIGHT, VOLUME_DEPTH, &MinNoise, &MaxNoise);
+	gVolumeHash = HashVolume(&gVolumeData);
 		
 	VolumeDesc.Width = VOLUME_WIDTH;
 	VolumeDesc.Height = VOLUME_HEIGHT;
@@ -467,7 +800,7 @@ main()
 	VolumeDesc.MipLevels = 1;
 	VolumeDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
 
-	VolumeSubData.pSysMem = VolumeData;
+	VolumeSubData.pSysMem = gVolumeData.Data.data();
 	VolumeSubData.SysMemPitch = VolumeDesc.Width * sizeof(f32);
 	VolumeSubData.SysMemSlicePitch = VolumeDesc.Width * VolumeDesc.Height * sizeof(f32);
 
@@ -479,95 +812,72 @@ main()
 	Device->CreateTexture3D(&VolumeDesc, &VolumeSubData, &gVolume);
 	Device->CreateShaderResourceView(gVolume, &VolumeSRVDesc, &gVolumeSRV);
 
-	HeapFree(GetProcessHeap(), 0, VolumeData);
-
 	//////////////////////////////////////////////////////////////////////////
 	// Params
 
 	ID3D11Buffer			*ModelParamsBuffer,
-							*RaymarchParamsBuffer;
+							*RaymarchParamsBuffer,
+							*TemporalParamsBuffer,
+							*DerivedParamsBuffer;
 	D3D11_BUFFER_DESC		ModelParamsBufferDesc = {},
-							RaymarchParamsBufferDesc = {};
+							RaymarchParamsBufferDesc = {},
+							TemporalParamsBufferDesc = {},
+							DerivedParamsBufferDesc = {};
+	model_params			UploadedModelParams;
+	raymarch_params			UploadedRaymarchParams;
+	temporal_params			UploadedTemporalParams;
+	derived_params			DerivedParams,
+							UploadedDerivedParams;
 
 
 	ModelParamsBufferDesc.ByteWidth = sizeof(gModelParams);
 	ModelParamsBufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
 	RaymarchParamsBufferDesc.ByteWidth = sizeof(gRaymarchParams);
 	RaymarchParamsBufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	TemporalParamsBufferDesc.ByteWidth = sizeof(temporal_params);
+	TemporalParamsBufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+	DerivedParamsBufferDesc.ByteWidth = sizeof(derived_params);
+	DerivedParamsBufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
 
 	Device->CreateBuffer(&ModelParamsBufferDesc, nullptr, &ModelParamsBuffer);
 	Device->CreateBuffer(&RaymarchParamsBufferDesc, nullptr, &RaymarchParamsBuffer);
+	Device->CreateBuffer(&TemporalParamsBufferDesc, nullptr, &TemporalParamsBuffer);
+	Device->CreateBuffer(&DerivedParamsBufferDesc, nullptr, &DerivedParamsBuffer);
+
+	// Shadow copies of what's in each buffer, see UpdateConstants(). No
+	// valid params are all ones, so the first frame always uploads.
+	memset(&UploadedModelParams, 0xFF, sizeof(UploadedModelParams));
+	memset(&UploadedRaymarchParams, 0xFF, sizeof(UploadedRaymarchParams));
+	memset(&UploadedTemporalParams, 0xFF, sizeof(UploadedTemporalParams));
+	memset(&UploadedDerivedParams, 0xFF, sizeof(UploadedDerivedParams));
 
 	gCamera.Pos = v3(3, 1.5f, -3.5f);
 	gCamera.Front = v3(-0.5f, -0.25f, 0.8f);
 	gCamera.Up = v3(0, 1, 0);	
 
+	InitRaymarchParams(&gRaymarchParams);
 	gRaymarchParams.ScreenWidth = SCR_WIDTH;
 	gRaymarchParams.ScreenHeight = SCR_HEIGHT;
 	gRaymarchParams.MinVal = MinNoise;
 	gRaymarchParams.MaxVal = MaxNoise;
-	gRaymarchParams.LightPos = v3(1, 1, 1);
-	gRaymarchParams.Absorption = 1.0;
-	gRaymarchParams.DensityScale = 1.0;
-	gRaymarchParams.UseProbes = TRUE;
-	gRaymarchParams.Ambient = 0.1f;
+	gVolumeMinVal = MinNoise;
+	gVolumeMaxVal = MaxNoise;
 
 	//////////////////////////////////////////////////////////////////////////
 	// Grid params
 
-	grid_params					GridParams;
 	ID3D11Buffer				*GridParamsBuffer;
 	D3D11_BUFFER_DESC			GridParamsBufferDesc = {};
-	D3D11_SUBRESOURCE_DATA		GridParamsSubData = {};
-
-
-	GridParams.GridDims = v3i(PROBE_COUNT_X, PROBE_COUNT_Y, PROBE_COUNT_Z);
-	GridParams.ProbeCount = PROBE_COUNT_TOTAL;
-	GridParams.GridMin = v3(0, 0, 0);
-	GridParams.GridMax = VOLUME_SCALE;
-	GridParams.GridExtents = GridParams.GridMax - GridParams.GridMin;
-	GridParams.GridExtentsRcp.x = 1.f / GridParams.GridExtents.x;
-	GridParams.GridExtentsRcp.y = 1.f / GridParams.GridExtents.y;
-	GridParams.GridExtentsRcp.z = 1.f / GridParams.GridExtents.z;
-	GridParams.CellSize.x = GridParams.GridExtents.x / (GridParams.GridDims.x - 1);
-	GridParams.CellSize.y = GridParams.GridExtents.y / (GridParams.GridDims.y - 1);
-	GridParams.CellSize.z = GridParams.GridExtents.z / (GridParams.GridDims.z - 1);
-
-	GridParamsBufferDesc.ByteWidth = sizeof(GridParams);
-	GridParamsBufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-	GridParamsSubData.pSysMem = &GridParams;
-
-	Device->CreateBuffer(&GridParamsBufferDesc, &GridParamsSubData, &GridParamsBuffer);
-
-	//////////////////////////////////////////////////////////////////////////
-    // Light probes
-
-	ID3D11Buffer							*ProbesBuffer;
-	ID3D11ShaderResourceView				*ProbesSRV;
-	ID3D11UnorderedAccessView				*ProbesUAV;
-	D3D11_BUFFER_DESC						ProbesBufferDesc = {};
-	D3D11_SHADER_RESOURCE_VIEW_DESC			ProbesSRVDesc = {};
-	D3D11_UNORDERED_ACCESS_VIEW_DESC		ProbesUAVDesc = {};
-
 
-	ProbesBufferDesc.ByteWidth = PROBE_COUNT_TOTAL * sizeof(probe); // TODO(matthew): hardcoded for now
-	ProbesBufferDesc.StructureByteStride = sizeof(probe);
-	ProbesBufferDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS;
-	ProbesBufferDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
 
-	ProbesSRVDesc.Format = DXGI_FORMAT_UNKNOWN;
-	ProbesSRVDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
-	ProbesSRVDesc.Buffer.FirstElement = 0;
-	ProbesSRVDesc.Buffer.NumElements = PROBE_COUNT_TOTAL;
+	gGridParams.ProbeLayout = LAYOUT_LINEAR;
+	UpdateProbeGrid(Device, &gRaymarchParams, &gProbeBudget);
 
-	ProbesUAVDesc.Format = DXGI_FORMAT_UNKNOWN;
-	ProbesUAVDesc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
-	ProbesUAVDesc.Buffer.FirstElement = 0;
-	ProbesUAVDesc.Buffer.NumElements = PROBE_COUNT_TOTAL;
+	GridParamsBufferDesc.ByteWidth = sizeof(gGridParams);
+	GridParamsBufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
 
-	Device->CreateBuffer(&ProbesBufferDesc, nullptr, &ProbesBuffer);
-	Device->CreateShaderResourceView(ProbesBuffer, &ProbesSRVDesc, &ProbesSRV);
-	Device->CreateUnorderedAccessView(ProbesBuffer, &ProbesUAVDesc, &ProbesUAV);
+	Device->CreateBuffer(&GridParamsBufferDesc, nullptr, &GridParamsBuffer);
+	Context->UpdateSubresource(GridParamsBuffer, 0, 0, &gGridParams, 0, 0);
 
 	//////////////////////////////////////////////////////////////////////////
 	// ImGui setup
@@ -589,10 +899,18 @@ main()
 	D3D11_SHADER_RESOURCE_VIEW_DESC		ColormapSRVDesc = {};
 	D3D11_SUBRESOURCE_DATA				ColormapSubData = {};
 	u32									ColormapSize = 512;
+	arena_frame							ColormapFrame = ArenaPushFrame(ScratchArena());
 	v4									*ColormapData;
 
 
-	ColormapData = (v4 *)HeapAlloc(GetProcessHeap(), 0, ColormapSize * sizeof(*ColormapData));
+	ColormapData = ArenaAllocArray<v4>(ColormapFrame.Arena, ColormapSize);
+	if (!ColormapData)
+	{
+		printf("Out of scratch memory for the colormap\n");
+		ShutdownJobSystem(&gJobs);
+
+		return (-1);
+	}
 
 	f32 t = 0;
 	f32 dt = 1.0f / (ColormapSize - 1);
@@ -624,7 +942,7 @@ main()
 	Device->CreateTexture1D(&ColormapDesc, &ColormapSubData, &Colormap);
 	Device->CreateShaderResourceView(Colormap, &ColormapSRVDesc, &ColormapSRV);	
 
-	HeapFree(GetProcessHeap(), 0, ColormapData);
+	ArenaPopFrame(ColormapFrame);
 
     //////////////////////////////////////////////////////////////////////////
     // Blend state
@@ -645,104 +963,220 @@ main()
 	Hr = Device->CreateBlendState(&BlendStateDesc, &BlendState);
 
 	//////////////////////////////////////////////////////////////////////////
-	// Main loop
+	// Render stage
 
-	f32 Time = 0;
-	bool ShowProbes = false;
-	s32 UpdatePerfCounter = 0;
-	f32 MsPerFrame = 0;
+	// NOTE(matthew): RenderFrame() is the render stage of the frame pipeline,
+	// see frame.h, and the loop after it is the UI stage. From here on only
+	// the render thread touches the device context and the state below, and
+	// it only reads the UI's params through the frame_input.
 
-	while (!glfwWindowShouldClose(Window))
+	f32 Time = 0;
+	std::vector<probe> CachedProbes;
+	b32 StoreBake = FALSE;
+	u32 AccumFrames = 0;
+	u64 AccumKey = 0;
+	u32 FrameCounter = 0;
+	u32 FrameIndex = 0;
+	u32 HistoryIndex = 0;
+	m4 PrevViewProj = {};
+	u32 VolumeSerial = 0;
+	u32 RefitSerial = 0;
+	u64 ParamsKey = 0;
+	u32 ParamsKeyVersion = 0;
+	u64 ParamsKeyVolume = 0;
+	frame_pipeline Pipeline;
+
+	auto RenderFrame = [&](frame_input *Input, frame_output *Output)
 	{
-		glfwPollEvents();
-		ProcessInput(Window);
-
-		f32 CurrentFrame = f32(glfwGetTime());
-		gDeltaTime = CurrentFrame - gLastFrame;
-		gLastFrame = CurrentFrame;
+		raymarch_params Params;
+		model_params Model;
+		scatter_bake_params ScatterBake = Input->Ui.ScatterBake;
+		u32 ParamsVersion = ReadParamChannel(&Pipeline.Params, &Params);
 
-		ImGui_ImplDX11_NewFrame();
-		ImGui_ImplGlfw_NewFrame();
-		ImGui::NewFrame();
+		ReadParamChannel(&Pipeline.Model, &Model);
 
-		ImGui::Begin("Performance");
-			if (UpdatePerfCounter % 50 == 0)
+		// ImGui's texture requests and the draw lists' references to them
+		// belong to the UI stage, resolve them before it carries on
+		for (ImTextureData *Texture : ImGui::GetPlatformIO().Textures)
+		{
+			if (Texture->Status != ImTextureStatus_OK)
 			{
-				MsPerFrame = gDeltaTime * 1000;
-				UpdatePerfCounter = 0;
+				ImGui_ImplDX11_UpdateTexture(Texture);
 			}
-			ImGui::Text("Frametime: %f ms", MsPerFrame);
-			ImGui::Text("FPS: %f", 1 / gDeltaTime);
-		ImGui::End();
-		UpdatePerfCounter += 1;
-
-		ImGui::Begin("Controls");
-			if (ImGui::Button("Open VDB file"))
+		}
+		for (ImDrawList *List : Input->Overlay)
+		{
+			for (ImDrawCmd &Cmd : List->CmdBuffer)
 			{
-				std::string VDBFileName = GetVDBFilename(hWnd);
-
-				if (VDBFileName != "")
-				{
-					UpdateVolume(VDBFileName, Device);
-				}
+				Cmd.TexRef = ImTextureRef(Cmd.GetTexID());
 			}
-			ImGui::DragFloat("Light X", &gRaymarchParams.LightPos.x, 0.01f, -20, 20);
-			ImGui::DragFloat("Light Y", &gRaymarchParams.LightPos.y, 0.01f, -20, 20);
-			ImGui::DragFloat("Light Z", &gRaymarchParams.LightPos.z, 0.01f, -20, 20);
-			ImGui::DragFloat("Absorption", &gRaymarchParams.Absorption, 0.01f, 0, 5);
-			ImGui::DragFloat("Density scale", &gRaymarchParams.DensityScale, 0.01f, 0, 100);
-			ImGui::DragFloat("Ambient", &gRaymarchParams.Ambient, 0.001f, 0, 1);
-			ImGui::SliderInt("Use probes", &gRaymarchParams.UseProbes, 0, 1);
-			ImGui::Checkbox("Show probes", &ShowProbes);
-		ImGui::End();
-		Context->UpdateSubresource(RaymarchParamsBuffer, 0, 0, &gRaymarchParams, 0, 0);
+		}
+		EndFrameLatch(&Pipeline);
+
+		// Requests from the UI, see frame_ui. The volume's range replaces the
+		// UI's, it only changes here.
+		b32 Refit = FALSE;
+
+		if (Input->Ui.VolumeSerial != VolumeSerial)
+		{
+			UpdateVolume(Input->Ui.VolumeFile, Device);
+			VolumeSerial = Input->Ui.VolumeSerial;
+			Refit = TRUE;
+		}
+		if (Input->Ui.RefitSerial != RefitSerial)
+		{
+			gGridParams.ProbeLayout = Input->Ui.ProbeLayout;
+			RefitSerial = Input->Ui.RefitSerial;
+			Refit = TRUE;
+		}
+
+		Params.MinVal = gVolumeMinVal;
+		Params.MaxVal = gVolumeMaxVal;
+
+		if (Refit)
+		{
+			UpdateProbeGrid(Device, &Params, &Input->Ui.ProbeBudget);
+			Context->UpdateSubresource(GridParamsBuffer, 0, 0, &gGridParams, 0, 0);
+		}
 
 		static f32 ClearColor[4] = { 0, 0, 0, 0 };
 
 		Context->ClearDepthStencilView(BackbufferDSV, D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
 		Context->ClearRenderTargetView(BackbufferRTV, ClearColor);
-		Context->ClearRenderTargetView(FrontRTV, ClearColor);
-		Context->ClearRenderTargetView(BackRTV, ClearColor);
 		Context->RSSetViewports(1, &Viewport);
 		Context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
-		gModelParams.World = Mat4Scale(VOLUME_SCALE);//Mat4Rotate(Time, v3(0, 1, 0)) * Mat4Translate(v3(-0.5f, -0.5f, -0.5f));
-		gModelParams.View = Mat4LookAtLH(gCamera.Pos, gCamera.Pos + gCamera.Front, gCamera.Up);
-		gModelParams.Proj = Mat4PerspectiveLH(45.0f, (f32)SCR_WIDTH / (f32)SCR_HEIGHT, 0.1f, 1000.0f);
-		Context->UpdateSubresource(ModelParamsBuffer, 0, 0, &gModelParams, 0, 0);
+		UpdateConstants(Context, ModelParamsBuffer, &Model, &UploadedModelParams, sizeof(Model));
+
+		// Accumulation: while nothing moves the history is the mean of every
+		// jittered frame since the last change. A camera move reprojects it in
+		// temporal.ps and caps it at TemporalFrames so it can keep up,
+		// anything else that changes the image starts it over. Rebakes land in
+		// the bake keys a frame later, which restarts it then.
+		u64 BakeKeys[] = { gBakedKey, gScatterKey, gShadowKey, gDeepShadowKey };
+		m4 ViewProj = Model.Proj * Model.View;
+		b32 Moved = memcmp(&ViewProj, &PrevViewProj, sizeof(m4)) != 0;
+
+		// The params' part only needs hashing when their version moves, the
+		// volume's range only changes with the volume
+		if (ParamsVersion != ParamsKeyVersion || gVolumeHash != ParamsKeyVolume)
+		{
+			raymarch_params KeyParams = Params;
+
+			KeyParams.FrameIndex = 0;
+			ParamsKey = HashBytes(&KeyParams, sizeof(KeyParams), gVolumeHash);
+			ParamsKeyVersion = ParamsVersion;
+			ParamsKeyVolume = gVolumeHash;
+		}
+
+		u64 FrameKey = HashBytes(BakeKeys, sizeof(BakeKeys), ParamsKey);
+
+		if (!Input->Ui.Accumulate || FrameKey != AccumKey || (Moved && !Input->Ui.Temporal))
+		{
+			AccumFrames = 0;
+			AccumKey = FrameKey;
+		}
+		else if (Moved)
+		{
+			AccumFrames = _Min(AccumFrames, u32(Input->Ui.TemporalFrames));
+		}
+
+		// The jitter only advances on frames that march, so a converged
+		// still view re-uploads nothing
+		b32 March = AccumFrames < u32(Input->Ui.AccumMaxFrames) || Moved;
+
+		if (March)
+		{
+			FrameIndex = FrameCounter++;
+		}
+		Params.FrameIndex = FrameIndex;
+
+		// Everything the shaders would otherwise rederive per pixel or per
+		// probe, the inverses, the box and the march step
+		DeriveParams(&DerivedParams, Model.World, Model.View, Model.Proj, &gVolumeData, &Params);
+
+		UpdateConstants(Context, RaymarchParamsBuffer, &Params, &UploadedRaymarchParams, sizeof(Params));
+		UpdateConstants(Context, DerivedParamsBuffer, &DerivedParams, &UploadedDerivedParams, sizeof(DerivedParams));
 
 		//////////////////////////////////////////////////////////////////////
-		// First pass, generate ray textures and probe data
+		// First pass, probe data
 
-		Context->OMSetBlendState(nullptr, nullptr, 0xFFFFFFF);
+		// Probes compute pass, only when something the bake reads changed
+		u64 BakeKey = ProbeBakeKey(gVolumeHash, &Params, &gGridParams);
 
-		// Cull texture pass prep
-		Context->VSSetShader(ModelVS, 0, 0);
-		Context->PSSetShader(ModelPS, 0, 0);
-		Context->IASetIndexBuffer(CubeIndexBuffer, DXGI_FORMAT_R32_UINT, 0);
-		Context->VSSetShaderResources(0, 1, &CubeVertexBufferView);
-		Context->VSSetConstantBuffers(0, 1, &ModelParamsBuffer);
+		if (BakeKey != gBakedKey)
+		{
+			CachedProbes.resize(gProbeStorage);
 
-		// Front-face cull to get back positions
-        Context->OMSetRenderTargets(1, &BackRTV, nullptr);
-        Context->RSSetState(CullFront);
-        Context->DrawIndexed(36, 0, 0);
-
-        // Back-face cull to get front positions
-        Context->OMSetRenderTargets(1, &FrontRTV, nullptr);
-        Context->RSSetState(CullBack);
-        Context->DrawIndexed(36, 0, 0);
-
-		// Probes compute pass
-		Context->CSSetShader(ProbeCS, 0, 0);
-		Context->CSSetSamplers(0, 1, &LinearSampler);
-		Context->CSSetConstantBuffers(0, 1, &ModelParamsBuffer);
-		Context->CSSetConstantBuffers(1, 1, &RaymarchParamsBuffer);
-		Context->CSSetConstantBuffers(2, 1, &GridParamsBuffer);
-        Context->CSSetShaderResources(0, 1, &gVolumeSRV);
-		Context->CSSetUnorderedAccessViews(0, 1, &ProbesUAV, 0);
-		Context->Dispatch(GridParams.GridDims.x, GridParams.GridDims.y, GridParams.GridDims.z);
-		Context->CSSetUnorderedAccessViews(0, 8, NULL_UAV, 0);	
+			if (Input->Ui.UseBakeCache && LoadCachedProbes(&gBakeCache, BakeKey, &gGridParams, CachedProbes.data()))
+			{
+				Context->UpdateSubresource(gProbesBuffer, 0, 0, CachedProbes.data(), 0, 0);
+				StoreBake = FALSE;
+			}
+			else
+			{
+				Context->CSSetShader(ProbeCS, 0, 0);
+				Context->CSSetSamplers(0, 1, &LinearSampler);
+				Context->CSSetConstantBuffers(1, 1, &RaymarchParamsBuffer);
+				Context->CSSetConstantBuffers(2, 1, &GridParamsBuffer);
+				Context->CSSetConstantBuffers(3, 1, &DerivedParamsBuffer);
+				Context->CSSetShaderResources(0, 1, &gVolumeSRV);
+				Context->CSSetUnorderedAccessViews(0, 1, &gProbesUAV, 0);
+				Context->Dispatch(gGridParams.GridDims.x, gGridParams.GridDims.y, gGridParams.GridDims.z);
+				Context->CSSetUnorderedAccessViews(0, 8, NULL_UAV, 0);
+				StoreBake = Input->Ui.UseBakeCache;
+			}
+
+			gBakedKey = BakeKey;
+		}
+
+		// Wait for drags to finish so we don't write a file per frame
+		if (StoreBake && !Input->Ui.Interacting)
+		{
+			ReadbackProbes(Device, Context, CachedProbes);
+			StoreCachedProbes(&gBakeCache, gBakedKey, &gGridParams, CachedProbes.data());
+			StoreBake = FALSE;
+		}
+
+		// SH scatter probes are baked on the CPU and take a while, so like the
+		// cache store they wait for drags to finish. Diffusion is cheap enough
+		// to follow the drag.
+		if (Params.ScatterOrder != SCATTER_OFF)
+		{
+			ScatterBake.Order = Params.ScatterOrder;
+
+			u64 ScatterKey = HashBytes(&ScatterBake, sizeof(ScatterBake), BakeKey);
+
+			if (ScatterKey != gScatterKey &&
+				(Params.ScatterOrder == SCATTER_DIFFUSION || !Input->Ui.Interacting))
+			{
+				UpdateScatterProbes(Device, Context, &Params, &ScatterBake);
+				gScatterKey = ScatterKey;
+			}
+		}
+
+		// The shadow volume and deep shadow map read the same inputs as the
+		// probes minus the grid, and a full resolution rebuild is too slow
+		// to follow a drag
+		if (Params.LightingMode == LIGHTING_SHADOW_VOLUME ||
+			Params.LightingMode == LIGHTING_DEEP_SHADOW_MAP)
+		{
+			grid_params NoGrid = {};
+			u64 ShadowKey = ProbeBakeKey(gVolumeHash, &Params, &NoGrid);
+
+			if (Params.LightingMode == LIGHTING_SHADOW_VOLUME &&
+				ShadowKey != gShadowKey && !Input->Ui.Interacting)
+			{
+				UpdateShadowVolume(Device, &Params);
+				gShadowKey = ShadowKey;
+			}
+			else if (Params.LightingMode == LIGHTING_DEEP_SHADOW_MAP &&
+					 ShadowKey != gDeepShadowKey && !Input->Ui.Interacting)
+			{
+				UpdateDeepShadowMap(Device, &Params);
+				gDeepShadowKey = ShadowKey;
+			}
+		}
 
 		//
 		//////////////////////////////////////////////////////////////////////
@@ -754,59 +1188,336 @@ main()
 		//////////////////////////////////////////////////////////////////////
 		// Second pass, render volume, lamp, and probes
 
-		if (ShowProbes)
+		if (Input->Ui.ShowProbes)
 		{
 			Context->VSSetShader(ProbeDebugVS, 0, 0);
 			Context->PSSetShader(ProbeDebugPS, 0, 0);
 			Context->VSSetConstantBuffers(0, 1, &ModelParamsBuffer);
 			Context->VSSetConstantBuffers(1, 1, &GridParamsBuffer);
-			Context->VSSetShaderResources(1, 1, &ProbesSRV);
-			Context->DrawIndexedInstanced(36, GridParams.ProbeCount, 0, 0, 0);
+			Context->VSSetShaderResources(1, 1, &gProbesSRV);
+			Context->DrawIndexedInstanced(36, gGridParams.ProbeCount, 0, 0, 0);
 			Context->VSSetShaderResources(0, 8, NULL_SRV);
 			Context->PSSetShaderResources(0, 8, NULL_SRV);
 		}
 
-		// Lamp
-		gModelParams.World = Mat4Translate(gRaymarchParams.LightPos);
-		Context->UpdateSubresource(ModelParamsBuffer, 0, 0, &gModelParams, 0, 0);
+		// Lamps, directional lights have nowhere to draw one
 		Context->IASetIndexBuffer(SphereIndexBuffer, DXGI_FORMAT_R32_UINT, 0);
 		Context->VSSetShaderResources(0, 1, &SphereVertexBufferView);
 		Context->VSSetShader(LampVS, 0, 0);
 		Context->PSSetShader(LampPS, 0, 0);
 		Context->VSSetConstantBuffers(0, 1, &ModelParamsBuffer);
-		Context->DrawIndexed(UINT(SphereIndices.size()), 0, 0);
+		for (u32 L = 0; L < _Min(Params.LightCount, u32(MAX_LIGHTS)); L++)
+		{
+			if (Params.Lights[L].Type == LIGHT_POINT)
+			{
+				Model.World = Mat4Translate(Params.Lights[L].Position);
+				UpdateConstants(Context, ModelParamsBuffer, &Model, &UploadedModelParams, sizeof(Model));
+				Context->DrawIndexed(UINT(SphereIndices.size()), 0, 0);
+			}
+		}
 
-		// Raymarch volume
-		gModelParams.World = Mat4Scale(VOLUME_SCALE);//Mat4Rotate(Time, v3(0, 1, 0)) * Mat4Translate(v3(-0.5f, -0.5f, -0.5f));
-		Context->UpdateSubresource(ModelParamsBuffer, 0, 0, &gModelParams, 0, 0);
+		// Raymarch volume, then blend it into the history. Frame N goes in
+		// with weight 1 / (N + 1), so the history is the mean and the first
+		// frame after a restart replaces it. Once converged there's nothing
+		// left to march.
+		Model.World = Mat4Scale(VOLUME_SCALE);
+		UpdateConstants(Context, ModelParamsBuffer, &Model, &UploadedModelParams, sizeof(Model));
+
+		// The march and temporal passes only fill the top left corner of
+		// their targets at a reduced resolution, the composite upsamples it.
+		// Downsample is in the frame key, so a change always marches and
+		// leaves these in TemporalParamsBuffer, the rest of TemporalParams is
+		// only uploaded when it changes.
+		temporal_params TemporalParams = {};
+		D3D11_VIEWPORT MarchViewport = Viewport;
+		u32 Downsample = Params.Downsample;
+
+		TemporalParams.Width = (SCR_WIDTH + Downsample - 1) / Downsample;
+		TemporalParams.Height = (SCR_HEIGHT + Downsample - 1) / Downsample;
+		TemporalParams.Downsample = Downsample;
+		TemporalParams.UpsampleSigma = UPSAMPLE_SIGMA * _Max(_Max(VOLUME_SCALE.x, VOLUME_SCALE.y), VOLUME_SCALE.z);
+		MarchViewport.Width = f32(TemporalParams.Width);
+		MarchViewport.Height = f32(TemporalParams.Height);
+
+		if (March)
+		{
+			Context->RSSetViewports(1, &MarchViewport);
+			Context->OMSetRenderTargets(2, MarchRTV, nullptr);
+			Context->OMSetBlendState(nullptr, nullptr, 0xFFFFFFF);
+			Context->VSSetShader(FullscreenVS, 0, 0);
+			Context->PSSetShader(RaymarchPS, 0, 0);
+			Context->PSSetConstantBuffers(1, 1, &RaymarchParamsBuffer);
+			Context->PSSetConstantBuffers(2, 1, &GridParamsBuffer);
+			Context->PSSetConstantBuffers(3, 1, &DerivedParamsBuffer);
+			Context->PSSetShaderResources(0, 1, &gVolumeSRV);
+			Context->PSSetShaderResources(3, 1, &ColormapSRV);
+			Context->PSSetShaderResources(4, 1, &gProbesSRV);
+			Context->PSSetShaderResources(5, 1, &gScatterSRV);
+			Context->PSSetShaderResources(6, 1, &gShadowSRV);
+			Context->PSSetShaderResources(7, 1, &gDeepShadowSRV);
+			Context->PSSetSamplers(0, 1, &LinearSampler);
+			Context->Draw(3, 0);
+			Context->PSSetShaderResources(0, 8, NULL_SRV);
+
+			TemporalParams.PrevViewProj = PrevViewProj;
+			TemporalParams.Weight = 1.0f / f32(AccumFrames + 1);
+			TemporalParams.Reproject = Moved && AccumFrames > 0;
+			UpdateConstants(Context, TemporalParamsBuffer, &TemporalParams, &UploadedTemporalParams, sizeof(TemporalParams));
+
+			Context->OMSetRenderTargets(1, &HistoryRTV[HistoryIndex ^ 1], nullptr);
+			Context->PSSetShader(TemporalPS, 0, 0);
+			Context->PSSetConstantBuffers(0, 1, &TemporalParamsBuffer);
+			Context->PSSetShaderResources(0, 2, MarchSRV);
+			Context->PSSetShaderResources(2, 1, &HistorySRV[HistoryIndex]);
+			Context->Draw(3, 0);
+			Context->PSSetShaderResources(0, 8, NULL_SRV);
+			Context->RSSetViewports(1, &Viewport);
+
+			HistoryIndex ^= 1;
+			AccumFrames++;
+		}
+		PrevViewProj = ViewProj;
+
+		// Composite with the cube so the lamps still depth test against it
+		Context->OMSetRenderTargets(1, &BackbufferRTV, BackbufferDSV);
+		Context->OMSetBlendState(BlendState, nullptr, 0xFFFFFFF);
 		Context->VSSetShader(RaymarchVS, 0, 0);
-		Context->PSSetShader(RaymarchPS, 0, 0);
+		Context->PSSetShader(CompositePS, 0, 0);
 		Context->IASetIndexBuffer(CubeIndexBuffer, DXGI_FORMAT_R32_UINT, 0);
 		Context->VSSetShaderResources(0, 1, &CubeVertexBufferView);
 		Context->VSSetConstantBuffers(0, 1, &ModelParamsBuffer);
-		Context->PSSetConstantBuffers(0, 1, &ModelParamsBuffer);
-		Context->PSSetConstantBuffers(1, 1, &RaymarchParamsBuffer);
-		Context->PSSetConstantBuffers(2, 1, &GridParamsBuffer);
-		Context->PSSetShaderResources(0, 1, &gVolumeSRV);
-		Context->PSSetShaderResources(1, 1, &FrontSRV);
-		Context->PSSetShaderResources(2, 1, &BackSRV);
-		Context->PSSetShaderResources(3, 1, &ColormapSRV);
-		Context->PSSetShaderResources(4, 1, &ProbesSRV);
-		Context->PSSetSamplers(0, 1, &LinearSampler);
+		Context->PSSetConstantBuffers(0, 1, &TemporalParamsBuffer);
+		Context->PSSetConstantBuffers(1, 1, &DerivedParamsBuffer);
+		Context->PSSetShaderResources(0, 1, &HistorySRV[HistoryIndex]);
 		Context->DrawIndexed(36, 0, 0);
 		Context->PSSetShaderResources(0, 8, NULL_SRV);
 
 		//
 		//////////////////////////////////////////////////////////////////////
 
-		ImGui::Render();
-		ImGui_ImplDX11_RenderDrawData(ImGui::GetDrawData());
-		ImGui::EndFrame();
+		// The UI stage's draw lists, copied when it published them
+		ImDrawData Overlay;
+
+		Overlay.Valid = true;
+		Overlay.DisplayPos = ImVec2(Input->OverlayPos.x, Input->OverlayPos.y);
+		Overlay.DisplaySize = ImVec2(Input->OverlaySize.x, Input->OverlaySize.y);
+		Overlay.FramebufferScale = ImVec2(Input->OverlayScale.x, Input->OverlayScale.y);
+		for (ImDrawList *List : Input->Overlay)
+		{
+			Overlay.CmdLists.push_back(List);
+			Overlay.TotalVtxCount += List->VtxBuffer.Size;
+			Overlay.TotalIdxCount += List->IdxBuffer.Size;
+		}
+		Overlay.CmdListsCount = Overlay.CmdLists.Size;
+		ImGui_ImplDX11_RenderDrawData(&Overlay);
 
 		SwapChain->Present(0, 0);
 		Time += 0.05f;
+
+		Output->AccumFrames = AccumFrames;
+		Output->Grid = gGridParams;
+		Output->Fit = gProbeFit;
+		Output->CacheHits = gBakeCache.Hits;
+		Output->CacheMisses = gBakeCache.Misses;
+		Output->ScatterDims = gScatter.Dims;
+	};
+
+	//////////////////////////////////////////////////////////////////////////
+	// Main loop
+
+	frame_ui Ui = {};
+	b32 RefitProbeGrid = FALSE;
+	char const *ScatterOrderNames[] = { "Off", "L1", "L2", "Diffusion" };
+	char const *ResolutionNames[] = { "Full", "Half", "Quarter" };
+	s32 Resolution = 0;
+	s32 UpdatePerfCounter = 0;
+	f32 MsPerFrame = 0;
+	bool RecordPath = false;
+	camera_path RecordedPath;
+
+	Ui.Accumulate = true;
+	Ui.Temporal = true;
+	Ui.UseBakeCache = true;
+	Ui.AccumMaxFrames = 256;
+	Ui.TemporalFrames = 8;
+	Ui.ProbeLayout = LAYOUT_LINEAR;
+
+	StartFramePipeline(&Pipeline, &gJobs, RenderFrame);
+
+	while (!glfwWindowShouldClose(Window))
+	{
+		glfwPollEvents();
+		ProcessInput(Window);
+
+		f32 CurrentFrame = f32(glfwGetTime());
+		gDeltaTime = CurrentFrame - gLastFrame;
+		gLastFrame = CurrentFrame;
+
+		// Waits for the render stage to latch the last frame, this one is
+		// built while it renders that
+		frame_input *Input = BeginFrameInput(&Pipeline);
+		frame_output *Rendered = LatestFrameOutput(&Pipeline, nullptr);
+
+		ImGui_ImplDX11_NewFrame();
+		ImGui_ImplGlfw_NewFrame();
+		ImGui::NewFrame();
+
+		ImGui::Begin("Performance");
+			if (UpdatePerfCounter % 50 == 0)
+			{
+				MsPerFrame = gDeltaTime * 1000;
+				UpdatePerfCounter = 0;
+			}
+			ImGui::Text("Frametime: %f ms", MsPerFrame);
+			ImGui::Text("FPS: %f", 1 / gDeltaTime);
+			ImGui::Text("Render stage: %.2f ms (latch %.2f ms)", Rendered->RenderMs, Rendered->LatchMs);
+		ImGui::End();
+		UpdatePerfCounter += 1;
+
+		ImGui::Begin("Controls");
+			if (ImGui::Button("Open VDB file"))
+			{
+				std::string VDBFileName = GetVDBFilename(hWnd);
+
+				if (VDBFileName != "")
+				{
+					snprintf(Ui.VolumeFile, sizeof(Ui.VolumeFile), "%s", VDBFileName.c_str());
+					Ui.VolumeSerial++;
+				}
+			}
+			ImGui::SliderInt("Lights", (s32 *)&gRaymarchParams.LightCount, 1, MAX_LIGHTS, "%d", ImGuiSliderFlags_AlwaysClamp);
+			for (u32 L = 0; L < _Min(gRaymarchParams.LightCount, u32(MAX_LIGHTS)); L++)
+			{
+				light *Light = &gRaymarchParams.Lights[L];
+				char const *LightTypes[] = { "Point", "Directional" };
+
+				ImGui::PushID(L);
+				ImGui::Text("Light %u", L);
+				if (ImGui::Combo("Type", (s32 *)&Light->Type, LightTypes, 2) && Light->Type == LIGHT_DIRECTIONAL)
+				{
+					Light->Position = Normalize(Light->Position);
+				}
+				ImGui::DragFloat3(Light->Type == LIGHT_POINT ? "Position" : "Direction", Light->Position.Elements, 0.01f, -20, 20);
+				ImGui::ColorEdit3("Color", Light->Color.Elements);
+				ImGui::DragFloat("Intensity", &Light->Intensity, 0.01f, 0, 10);
+				ImGui::PopID();
+			}
+			ImGui::DragFloat("Absorption", &gRaymarchParams.Absorption, 0.01f, 0, 5);
+			ImGui::DragFloat("Density scale", &gRaymarchParams.DensityScale, 0.01f, 0, 100);
+			ImGui::DragFloat("Ambient", &gRaymarchParams.Ambient, 0.001f, 0, 1);
+			ImGui::Combo("Lighting", (s32 *)&gRaymarchParams.LightingMode, LightingModeNames, LIGHTING_MODE_COUNT);
+			ImGui::Combo("Probe filter", (s32 *)&gRaymarchParams.ProbeFilter, ProbeFilterNames, PROBE_FILTER_COUNT);
+			ImGui::Combo("Multiple scattering", (s32 *)&gRaymarchParams.ScatterOrder, ScatterOrderNames, 4);
+			ImGui::DragFloat("Phase g", &gRaymarchParams.PhaseG, 0.01f, -0.95f, 0.95f);
+			ImGui::DragFloat("Multiple scatter", &gRaymarchParams.MultiScatter, 0.01f, 0, 10);
+			if (gRaymarchParams.ScatterOrder == SCATTER_DIFFUSION)
+			{
+				ImGui::SliderInt("Diffusion sweeps", (s32 *)&gScatterBake.Iterations, 0, 256);
+			}
+			else
+			{
+				ImGui::SliderInt("Scatter rays", (s32 *)&gScatterBake.RaysPerProbe, 16, 256);
+			}
+			ImGui::DragFloat("Step (voxels)", &gRaymarchParams.StepScale, 0.05f, 0.25f, 16);
+			if (ImGui::Combo("Resolution", &Resolution, ResolutionNames, 3))
+			{
+				gRaymarchParams.Downsample = 1u << Resolution;
+			}
+			ImGui::Checkbox("Accumulate", &Ui.Accumulate);
+			ImGui::Checkbox("Temporal reprojection", &Ui.Temporal);
+			ImGui::SliderInt("Max frames", &Ui.AccumMaxFrames, 1, 4096);
+			ImGui::SliderInt("Frames while moving", &Ui.TemporalFrames, 1, 32);
+			ImGui::Text("Accumulated: %u frames", Rendered->AccumFrames);
+			if (ImGui::Checkbox("Record camera path", &RecordPath) && !RecordPath)
+			{
+				SaveCameraPath(&RecordedPath, "camera_path.txt");
+			}
+			if (RecordPath)
+			{
+				ImGui::Text("Recorded: %u frames", u32(RecordedPath.Keys.size()));
+			}
+			ImGui::Checkbox("Show probes", &Ui.ShowProbes);
+		ImGui::End();
+
+		ImGui::Begin("Probe grid");
+			RefitProbeGrid |= ImGui::Combo("Layout", &Ui.ProbeLayout, LayoutNames, LAYOUT_COUNT);
+			RefitProbeGrid |= ImGui::DragFloat("Voxels per probe", &gProbeBudget.VoxelsPerProbe, 0.05f, 0.5f, 16.0f);
+			RefitProbeGrid |= ImGui::DragFloat("Memory budget (MB)", &gProbeBudget.MemoryMB, 0.5f, 0.1f, 4096.0f);
+			RefitProbeGrid |= ImGui::DragFloat("Bake budget (ms)", &gProbeBudget.BakeMs, 1.0f, 1.0f, 60000.0f);
+			RefitProbeGrid |= ImGui::DragFloat("Occupancy threshold", &gProbeBudget.OccupancyThreshold, 0.001f, 0.0f, 1.0f);
+			ImGui::Text("Grid: %d x %d x %d (%u probes)", Rendered->Grid.GridDims.x, Rendered->Grid.GridDims.y,
+						Rendered->Grid.GridDims.z, Rendered->Grid.ProbeCount);
+			ImGui::Text("Occupancy: %.1f%%", Rendered->Fit.Occupancy * 100.0f);
+			ImGui::Text("Memory: %.2f MB, est. CPU bake: %.1f ms", Rendered->Fit.MemoryMB, Rendered->Fit.BakeMs);
+			ImGui::Checkbox("Bake cache", &Ui.UseBakeCache);
+			ImGui::Text("Cache: %u hits, %u misses", Rendered->CacheHits, Rendered->CacheMisses);
+			if (gRaymarchParams.ScatterOrder != SCATTER_OFF)
+			{
+				ImGui::Text("Scatter grid: %d x %d x %d", Rendered->ScatterDims.x, Rendered->ScatterDims.y, Rendered->ScatterDims.z);
+			}
+
+			// Only refit once the drag is released, a refit re-scans the volume
+			if (RefitProbeGrid && !ImGui::IsAnyItemActive())
+			{
+				RefitProbeGrid = FALSE;
+				Ui.RefitSerial++;
+			}
+		ImGui::End();
+
+		if (RecordPath)
+		{
+			RecordedPath.Keys.push_back({ gCamera.Pos, gCamera.Front, gCamera.Up });
+		}
+		else if (!RecordedPath.Keys.empty())
+		{
+			RecordedPath.Keys.clear();
+		}
+
+		gModelParams.World = Mat4Scale(VOLUME_SCALE);//Mat4Rotate(Time, v3(0, 1, 0)) * Mat4Translate(v3(-0.5f, -0.5f, -0.5f));
+		gModelParams.View = Mat4LookAtLH(gCamera.Pos, gCamera.Pos + gCamera.Front, gCamera.Up);
+		gModelParams.Proj = Mat4PerspectiveLH(45.0f, (f32)SCR_WIDTH / (f32)SCR_HEIGHT, 0.1f, 1000.0f);
+
+		ImGui::Render();
+		ImGui::EndFrame();
+
+		// The draw lists are ImGui's until the next NewFrame(), so they're
+		// copied into lists the slot keeps, which don't reallocate once
+		// they're big enough
+		ImDrawData *DrawData = ImGui::GetDrawData();
+
+		while (Input->Overlay.size() > u32(DrawData->CmdLists.Size))
+		{
+			IM_DELETE(Input->Overlay.back());
+			Input->Overlay.pop_back();
+		}
+		while (Input->Overlay.size() < u32(DrawData->CmdLists.Size))
+		{
+			Input->Overlay.push_back(IM_NEW(ImDrawList)(nullptr));
+		}
+		for (s32 I = 0; I < DrawData->CmdLists.Size; I++)
+		{
+			Input->Overlay[I]->CmdBuffer = DrawData->CmdLists[I]->CmdBuffer;
+			Input->Overlay[I]->IdxBuffer = DrawData->CmdLists[I]->IdxBuffer;
+			Input->Overlay[I]->VtxBuffer = DrawData->CmdLists[I]->VtxBuffer;
+			Input->Overlay[I]->Flags = DrawData->CmdLists[I]->Flags;
+		}
+		Input->OverlayPos = v2(DrawData->DisplayPos.x, DrawData->DisplayPos.y);
+		Input->OverlaySize = v2(DrawData->DisplaySize.x, DrawData->DisplaySize.y);
+		Input->OverlayScale = v2(DrawData->FramebufferScale.x, DrawData->FramebufferScale.y);
+
+		Ui.Interacting = ImGui::IsAnyItemActive();
+		Ui.ProbeBudget = gProbeBudget;
+		Ui.ScatterBake = gScatterBake;
+
+		PublishParamChannel(&Pipeline.Model, &gModelParams);
+		PublishParamChannel(&Pipeline.Params, &gRaymarchParams);
+		Input->Ui = Ui;
+		PublishFrameInput(&Pipeline);
 	}
 
+	StopFramePipeline(&Pipeline);
+	ShutdownJobSystem(&gJobs);
+
 	return (0);
 }
 
@@ -1061,9 +1772,20 @@ UpdateVolume(std::string Filename,
     u32                                 VolumeWidth,
                                         VolumeHeight,
                                         VolumeDepth;
+    std::vector<f32>                    Loaded;
+
 
+	// LoadVDB() wants a plain vector, the copy puts it on large pages
+	LoadVDB(Filename, Loaded, VolumeWidth, VolumeHeight, VolumeDepth, MinVal, MaxVal);
 
-	LoadVDB(Filename, gVolumeData, VolumeWidth, VolumeHeight, VolumeDepth, MinVal, MaxVal);
+	gVolumeData.Width = VolumeWidth;
+	gVolumeData.Height = VolumeHeight;
+	gVolumeData.Depth = VolumeDepth;
+	gVolumeData.Layout = LAYOUT_LINEAR;
+	FillVolumeData(&gVolumeData, Loaded.data());
+	Loaded = std::vector<f32>();
+	BuildVolumeOffsets(&gVolumeData);
+	gVolumeHash = HashVolume(&gVolumeData);
 
     VolumeDesc.Width = VolumeWidth;
     VolumeDesc.Height = VolumeHeight;
@@ -1072,7 +1794,7 @@ UpdateVolume(std::string Filename,
     VolumeDesc.MipLevels = 1;
     VolumeDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
 
-    VolumeSubData.pSysMem = gVolumeData.data();
+    VolumeSubData.pSysMem = gVolumeData.Data.data();
     VolumeSubData.SysMemPitch = VolumeDesc.Width * sizeof(f32);
     VolumeSubData.SysMemSlicePitch = VolumeDesc.Width * VolumeDesc.Height * sizeof(f32);
 
@@ -1095,6 +1817,329 @@ UpdateVolume(std::string Filename,
     Device->CreateTexture3D(&VolumeDesc, &VolumeSubData, &gVolume);
     Device->CreateShaderResourceView(gVolume, &VolumeSRVDesc, &gVolumeSRV);
 
-	gRaymarchParams.MinVal = MinVal;
-	gRaymarchParams.MaxVal = MaxVal;
+	gVolumeMinVal = MinVal;
+	gVolumeMaxVal = MaxVal;
+}
+
+// Refits the probe grid to the current volume and budget, and reallocates the
+// probe buffer if the storage size changed. The caller uploads gGridParams.
+void
+UpdateProbeGrid(ID3D11Device *Device,
+				raymarch_params *Params,
+				probe_budget *Budget)
+{
+	D3D11_BUFFER_DESC						ProbesBufferDesc = {};
+	D3D11_SHADER_RESOURCE_VIEW_DESC			ProbesSRVDesc = {};
+	D3D11_UNORDERED_ACCESS_VIEW_DESC		ProbesUAVDesc = {};
+	m4										World = Mat4Scale(VOLUME_SCALE);
+	u32										ProbeStorage;
+
+
+	FitProbeGrid(&gGridParams, &gVolumeData, Params, World, Budget, &gProbeFit);
+	ProbeStorage = ProbeStorageCount(&gGridParams);
+
+	// Either the buffer is new or the layout may have changed, so force a
+	// rebake (or a cache load)
+	gBakedKey = 0;
+
+	if (gProbesBuffer && ProbeStorage == gProbeStorage)
+	{
+		return;
+	}
+
+	if (gProbesBuffer)
+	{
+		gProbesBuffer->Release();
+		gProbesBuffer = nullptr;
+	}
+	if (gProbesSRV)
+	{
+		gProbesSRV->Release();
+		gProbesSRV = nullptr;
+	}
+	if (gProbesUAV)
+	{
+		gProbesUAV->Release();
+		gProbesUAV = nullptr;
+	}
+
+	ProbesBufferDesc.ByteWidth = ProbeStorage * sizeof(probe);
+	ProbesBufferDesc.StructureByteStride = sizeof(probe);
+	ProbesBufferDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS;
+	ProbesBufferDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+
+	ProbesSRVDesc.Format = DXGI_FORMAT_UNKNOWN;
+	ProbesSRVDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+	ProbesSRVDesc.Buffer.FirstElement = 0;
+	ProbesSRVDesc.Buffer.NumElements = ProbeStorage;
+
+	ProbesUAVDesc.Format = DXGI_FORMAT_UNKNOWN;
+	ProbesUAVDesc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+	ProbesUAVDesc.Buffer.FirstElement = 0;
+	ProbesUAVDesc.Buffer.NumElements = ProbeStorage;
+
+	Device->CreateBuffer(&ProbesBufferDesc, nullptr, &gProbesBuffer);
+	Device->CreateShaderResourceView(gProbesBuffer, &ProbesSRVDesc, &gProbesSRV);
+	Device->CreateUnorderedAccessView(gProbesBuffer, &ProbesUAVDesc, &gProbesUAV);
+
+	gProbeStorage = ProbeStorage;
+}
+
+// Copies the probe buffer back to the CPU, stalls until the GPU is done
+void
+ReadbackProbes(ID3D11Device *Device,
+			   ID3D11DeviceContext *Context,
+			   std::vector<probe> &Probes)
+{
+	ID3D11Buffer				*Staging;
+	D3D11_BUFFER_DESC			StagingDesc = {};
+	D3D11_MAPPED_SUBRESOURCE	Mapped;
+
+
+	StagingDesc.ByteWidth = gProbeStorage * sizeof(probe);
+	StagingDesc.Usage = D3D11_USAGE_STAGING;
+	StagingDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+
+	Device->CreateBuffer(&StagingDesc, nullptr, &Staging);
+	Context->CopyResource(Staging, gProbesBuffer);
+
+	Probes.resize(gProbeStorage);
+	if (SUCCEEDED(Context->Map(Staging, 0, D3D11_MAP_READ, 0, &Mapped)))
+	{
+		memcpy(Probes.data(), Mapped.pData, gProbeStorage * sizeof(probe));
+		Context->Unmap(Staging, 0);
+	}
+
+	Staging->Release();
+}
+
+// Bakes the multiple scattering probes for the current volume, grid and
+// lights, and uploads them to a new texture. Diffusion starts from the GPU
+// baked transmittance, so the probes have to be current.
+void
+UpdateScatterProbes(ID3D11Device *Device,
+					ID3D11DeviceContext *Context,
+					raymarch_params *Params,
+					scatter_bake_params *Bake)
+{
+	D3D11_TEXTURE3D_DESC				ScatterDesc = {};
+	D3D11_SHADER_RESOURCE_VIEW_DESC		ScatterSRVDesc = {};
+	D3D11_SUBRESOURCE_DATA				ScatterSubData = {};
+	m4									InvWorld = Mat4Inverse(Mat4Scale(VOLUME_SCALE));
+	std::vector<probe>					Probes;
+
+
+	// Both start from the transmittance the probes already hold
+	ReadbackProbes(Device, Context, Probes);
+
+	if (Bake->Order == SCATTER_DIFFUSION)
+	{
+		RelaxScatterProbes(&gScatter, Probes.data(), &gVolumeData, &gGridParams, Params, InvWorld,
+						   Bake->Iterations);
+	}
+	else
+	{
+		BakeScatterProbes(&gScatter, Probes.data(), &gVolumeData, &gGridParams, Params, InvWorld, Bake);
+	}
+
+	// Slots are stacked along z, see scatter.h
+	ScatterDesc.Width = gScatter.Dims.x;
+	ScatterDesc.Height = gScatter.Dims.y;
+	ScatterDesc.Depth = gScatter.Dims.z * gScatter.SlotCount;
+	ScatterDesc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+	ScatterDesc.MipLevels = 1;
+	ScatterDesc.Usage = D3D11_USAGE_IMMUTABLE;
+	ScatterDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+	ScatterSubData.pSysMem = gScatter.Texels.data();
+	ScatterSubData.SysMemPitch = ScatterDesc.Width * sizeof(v4);
+	ScatterSubData.SysMemSlicePitch = ScatterDesc.Width * ScatterDesc.Height * sizeof(v4);
+
+	ScatterSRVDesc.Format = ScatterDesc.Format;
+	ScatterSRVDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE3D;
+	ScatterSRVDesc.Texture3D.MipLevels = 1;
+	ScatterSRVDesc.Texture3D.MostDetailedMip = 0;
+
+	if (gScatterTexture)
+	{
+		gScatterTexture->Release();
+		gScatterTexture = nullptr;
+	}
+	if (gScatterSRV)
+	{
+		gScatterSRV->Release();
+		gScatterSRV = nullptr;
+	}
+
+	Device->CreateTexture3D(&ScatterDesc, &ScatterSubData, &gScatterTexture);
+	Device->CreateShaderResourceView(gScatterTexture, &ScatterSRVDesc, &gScatterSRV);
+}
+
+// Builds the shadow volume for the current volume and lights on the CPU, and
+// uploads it to a new texture
+void
+UpdateShadowVolume(ID3D11Device *Device,
+				   raymarch_params *Params)
+{
+	D3D11_TEXTURE3D_DESC				ShadowDesc = {};
+	D3D11_SHADER_RESOURCE_VIEW_DESC		ShadowSRVDesc = {};
+	D3D11_SUBRESOURCE_DATA				ShadowSubData = {};
+	m4									World = Mat4Scale(VOLUME_SCALE);
+
+
+	BuildShadowVolume(&gShadowVolume, &gVolumeData, Params, World);
+
+	ShadowDesc.Width = gShadowVolume.Width;
+	ShadowDesc.Height = gShadowVolume.Height;
+	ShadowDesc.Depth = gShadowVolume.Depth;
+	ShadowDesc.Format = DXGI_FORMAT_R16G16B16A16_FLOAT;
+	ShadowDesc.MipLevels = 1;
+	ShadowDesc.Usage = D3D11_USAGE_IMMUTABLE;
+	ShadowDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+	ShadowSubData.pSysMem = gShadowVolume.Texels.data();
+	ShadowSubData.SysMemPitch = ShadowDesc.Width * 4 * sizeof(u16);
+	ShadowSubData.SysMemSlicePitch = ShadowDesc.Width * ShadowDesc.Height * 4 * sizeof(u16);
+
+	ShadowSRVDesc.Format = ShadowDesc.Format;
+	ShadowSRVDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE3D;
+	ShadowSRVDesc.Texture3D.MipLevels = 1;
+	ShadowSRVDesc.Texture3D.MostDetailedMip = 0;
+
+	if (gShadowTexture)
+	{
+		gShadowTexture->Release();
+		gShadowTexture = nullptr;
+	}
+	if (gShadowSRV)
+	{
+		gShadowSRV->Release();
+		gShadowSRV = nullptr;
+	}
+
+	Device->CreateTexture3D(&ShadowDesc, &ShadowSubData, &gShadowTexture);
+	Device->CreateShaderResourceView(gShadowTexture, &ShadowSRVDesc, &gShadowSRV);
+}
+
+// Builds the deep shadow maps for the current volume and lights on the CPU,
+// and uploads them as one array with DEEP_SHADOW_SLICES slices per light
+void
+UpdateDeepShadowMap(ID3D11Device *Device,
+					raymarch_params *Params)
+{
+	D3D11_TEXTURE2D_DESC				DeepShadowDesc = {};
+	D3D11_SHADER_RESOURCE_VIEW_DESC		DeepShadowSRVDesc = {};
+	D3D11_SUBRESOURCE_DATA				DeepShadowSubData[MAX_LIGHTS * DEEP_SHADOW_SLICES] = {};
+	m4									World = Mat4Scale(VOLUME_SCALE);
+
+
+	// Rays that didn't fit in scratch are unshadowed, still worth showing
+	if (!BuildDeepShadowMap(&gDeepShadowMap, &gVolumeData, Params, World, DEEP_SHADOW_MAP_SIZE,
+							&gLightAlignedCache, gVolumeHash))
+	{
+		printf("Out of scratch memory building the deep shadow map\n");
+	}
+
+	DeepShadowDesc.Width = gDeepShadowMap.Size;
+	DeepShadowDesc.Height = gDeepShadowMap.Size;
+	DeepShadowDesc.ArraySize = MAX_LIGHTS * DEEP_SHADOW_SLICES;
+	DeepShadowDesc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+	DeepShadowDesc.MipLevels = 1;
+	DeepShadowDesc.SampleDesc.Count = 1;
+	DeepShadowDesc.Usage = D3D11_USAGE_IMMUTABLE;
+	DeepShadowDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+	for (u32 Slice = 0; Slice < MAX_LIGHTS * DEEP_SHADOW_SLICES; Slice++)
+	{
+		DeepShadowSubData[Slice].pSysMem = &gDeepShadowMap.Texels[u64(Slice) * gDeepShadowMap.Size * gDeepShadowMap.Size];
+		DeepShadowSubData[Slice].SysMemPitch = gDeepShadowMap.Size * sizeof(v4);
+	}
+
+	DeepShadowSRVDesc.Format = DeepShadowDesc.Format;
+	DeepShadowSRVDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+	DeepShadowSRVDesc.Texture2DArray.MipLevels = 1;
+	DeepShadowSRVDesc.Texture2DArray.MostDetailedMip = 0;
+	DeepShadowSRVDesc.Texture2DArray.FirstArraySlice = 0;
+	DeepShadowSRVDesc.Texture2DArray.ArraySize = DeepShadowDesc.ArraySize;
+
+	if (gDeepShadowTexture)
+	{
+		gDeepShadowTexture->Release();
+		gDeepShadowTexture = nullptr;
+	}
+	if (gDeepShadowSRV)
+	{
+		gDeepShadowSRV->Release();
+		gDeepShadowSRV = nullptr;
+	}
+
+	Device->CreateTexture2D(&DeepShadowDesc, DeepShadowSubData, &gDeepShadowTexture);
+	Device->CreateShaderResourceView(gDeepShadowTexture, &DeepShadowSRVDesc, &gDeepShadowSRV);
+}
+
+// Defaults shared by the viewer and the headless modes: a single white key
+// light
+void
+InitRaymarchParams(raymarch_params *Params)
+{
+	Params->Absorption = 1.0f;
+	Params->DensityScale = 1.0f;
+	Params->LightingMode = LIGHTING_PROBES;
+	Params->Ambient = 0.1f;
+	Params->LightCount = 1;
+	Params->ScatterOrder = SCATTER_OFF;
+	Params->PhaseG = 0.5f;
+	Params->MultiScatter = 1.0f;
+	Params->ProbeFilter = PROBE_FILTER_TRILINEAR;
+	Params->StepScale = 1.0f;
+	Params->Downsample = 1;
+	Params->Lights[0] = PointLight(v3(1, 1, 1), v3(1, 1, 1), 1.0f);
+	Params->Lights[1] = PointLight(v3(-3, 6, 7), v3(1, 0.8f, 0.6f), 0.5f);
+	Params->Lights[2] = DirectionalLight(v3(1, 1, 1), v3(0.6f, 0.7f, 1), 0.3f);
+	Params->Lights[3] = PointLight(v3(2.5f, -4, 2.5f), v3(1, 1, 1), 0.2f);
+}
+
+// CPU only volume load for the headless modes, procedural noise without a
+// file
+void
+LoadHeadlessVolume(std::string Filename,
+				   volume *Volume,
+				   raymarch_params *Params)
+{
+	if (Filename != "")
+	{
+		std::vector<f32> Loaded;
+
+		// LoadVDB() folds into the incoming min/max
+		Params->MinVal = 10000.0f;
+		Params->MaxVal = -10000.0f;
+		LoadVDB(Filename, Loaded, Volume->Width, Volume->Height, Volume->Depth, Params->MinVal, Params->MaxVal);
+		Volume->Layout = LAYOUT_LINEAR;
+		FillVolumeData(Volume, Loaded.data());
+		BuildVolumeOffsets(Volume);
+	}
+	else
+	{
+		GenerateNoiseVolume(Volume, VOLUME_WIDTH, VOLUME_HEIGHT, VOLUME_DEPTH, &Params->MinVal, &Params->MaxVal);
+	}
+}
+
+// Uploads Data only when it differs from the copy in Uploaded, which is what
+// the last call left in Buffer. Returns whether it uploaded.
+b32
+UpdateConstants(ID3D11DeviceContext *Context,
+				ID3D11Buffer *Buffer,
+				void const *Data,
+				void *Uploaded,
+				u32 Size)
+{
+	if (memcmp(Data, Uploaded, Size) == 0)
+	{
+		return (FALSE);
+	}
+
+	memcpy(Uploaded, Data, Size);
+	Context->UpdateSubresource(Buffer, 0, 0, Data, 0, 0);
+
+	return (TRUE);
 }
@@ -0,0 +1,17 @@
+struct ps_in
+{
+	float4		Position : SV_Position;
+};
+
+// One triangle covering the screen, draw with 3 vertices and no buffers
+ps_in
+main(uint VertexID : SV_VertexID)
+{
+	ps_in		Output;
+	float2		Tex = float2((VertexID << 1) & 2, VertexID & 2);
+
+
+	Output.Position = float4(Tex * float2(2, -2) + float2(-1, 1), 0, 1);
+
+	return (Output);
+}
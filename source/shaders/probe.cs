@@ -1,14 +1,22 @@
+// Transmittance towards each light, Lights[i] goes in component i
 struct probe
 {
 	float3		Position;
-	float		Transmittance;
+	float		_Pad0;
+	float4		Transmittance;
 };
 
-cbuffer model_params : register(b0)
+// Must match light_type in volume.h
+#define LIGHT_POINT			0
+#define LIGHT_DIRECTIONAL	1
+#define MAX_LIGHTS			4
+
+struct light
 {
-	float4x4		World,
-					View,
-					Proj;
+	float3		Position;		// direction towards the light for LIGHT_DIRECTIONAL
+	uint		Type;
+	float3		Color;
+	float		Intensity;
 };
 
 cbuffer raymarch_params : register(b1)
@@ -17,10 +25,16 @@ cbuffer raymarch_params : register(b1)
 	uint		ScreenHeight;
 	float		MinVal;
 	float		MaxVal;
-	float3		LightPos;
 	float 		Absorption;
 	float 		DensityScale;
+	uint		LightingMode;
 	float 		Ambient;
+	uint		LightCount;
+	uint		ScatterOrder;
+	float		PhaseG;
+	float		MultiScatter;
+	uint		ProbeFilter;
+	light		Lights[MAX_LIGHTS];
 };
 
 cbuffer grid_params : register(b2)
@@ -28,26 +42,42 @@ cbuffer grid_params : register(b2)
 	int3		GridDims;
 	uint		ProbeCount;
 	float3		GridMin;
+	uint		ProbeLayout;
 	float3		GridMax;
 	float3		GridExtents;
 	float3		GridExtentsRcp;
 	float3		CellSize;
 };
 
+// Must match derived_params in volume.h, only InvWorld is needed here
+cbuffer derived_params : register(b3)
+{
+	float4x4	InvWorld;
+};
+
 static const uint		MaxIterations = 64;
 
 Texture3D<float>				Volume : register(t0);
 SamplerState					LinearSampler : register(s0);
 RWStructuredBuffer<probe>		Probes : register(u0);
 
-float4x4 	inverse(float4x4 m);
-float		Lightmarch(float3 Pos);
+#define probe_index		uint
+#define grid_coord		uint3
+
+// Must match data_layout in volume.h
+#define LAYOUT_LINEAR	0
+#define LAYOUT_MORTON	1
+#define LAYOUT_TILED	2
+
+bool		LightDirection(light Light, float3 Pos, out float3 Dir);
+float4		LightmarchAll(float3 Pos);
+uint		MortonEncode3(uint3 Coord);
+probe_index	GridCoordToProbeIndex(grid_coord ProbeCoord);
 
 [numthreads(1, 1, 1)]
 void
 main(uint3 ThreadID : SV_DispatchThreadID)
 {
-	float		Transmittance;
 	float3		Pos;
 	uint		ProbeIndex;
 
@@ -56,10 +86,10 @@ main(uint3 ThreadID : SV_DispatchThreadID)
 	Pos.y = float(ThreadID.y) * CellSize.y + GridMin.y;
 	Pos.z = float(ThreadID.z) * CellSize.z + GridMin.z;
 
-	ProbeIndex = (ThreadID.z * GridDims.x * GridDims.y) + ThreadID.y * GridDims.x + ThreadID.x;
+	ProbeIndex = GridCoordToProbeIndex(ThreadID);
 	
 	Probes[ProbeIndex].Position = Pos;
-	Probes[ProbeIndex].Transmittance = Lightmarch(Pos);
+	Probes[ProbeIndex].Transmittance = LightmarchAll(Pos);
 }
 
 bool
@@ -89,73 +119,116 @@ IntersectBox(float3 Origin,
 	return (tNear < tFar);
 }
 
-float
-Lightmarch(float3 Pos)
+// LightDirection() in probes.h, false for a point light sitting right on
+// Pos (nothing in between, so full transmittance)
+bool
+LightDirection(light Light,
+			   float3 Pos,
+			   out float3 Dir)
 {
-	float3 LightDir = normalize(LightPos - Pos);
+	float3 ToLight = (Light.Type == LIGHT_POINT) ? Light.Position - Pos : Light.Position;
+
+	Dir = float3(0, 0, 1);
+	if (dot(ToLight, ToLight) < 1e-12)
+	{
+		return (false);
+	}
 
-	float tNear, tFar;
-	bool Hit = IntersectBox(Pos, LightDir, GridMin, GridMax, tNear, tFar);
-	float3 HitPoint = Pos + tFar * LightDir;
+	Dir = normalize(ToLight);
 
-	float dt = length(HitPoint - Pos) / float(MaxIterations);
+	return (true);
+}
 
-	float TotalDensity = 0;
-	float4x4 InvWorld = inverse(World);
+// Bakes every light in one thread. The marches all start at Pos, so the
+// first sample is shared between them.
+float4
+LightmarchAll(float3 Pos)
+{
+	float3 InvOrigin = mul(InvWorld, float4(Pos, 1)).xyz;
+	float Density0 = DensityScale * Volume.SampleLevel(LinearSampler, InvOrigin, 0);
+	float4 Transmittance = float4(0, 0, 0, 0);
 
-	for (uint i = 0; i < MaxIterations; i++)
+	for (uint l = 0; l < min(LightCount, MAX_LIGHTS); l++)
 	{
-		float3 InvPos = mul(InvWorld, float4(Pos, 1)).xyz;
-		float Density = DensityScale * Volume.SampleLevel(LinearSampler, InvPos, 0);
-		/* float NormalizedDensity = (Density - MinVal) / (MaxVal - MinVal); */
+		float3 LightDir;
+
+		if (!LightDirection(Lights[l], Pos, LightDir))
+		{
+			Transmittance[l] = 1;
+			continue;
+		}
+
+		float tNear, tFar;
+		bool Hit = IntersectBox(Pos, LightDir, GridMin, GridMax, tNear, tFar);
+		float3 HitPoint = Pos + tFar * LightDir;
+
+		// Stop at a point light inside the box
+		float MarchLength = length(HitPoint - Pos);
+		if (Lights[l].Type == LIGHT_POINT)
+		{
+			MarchLength = min(MarchLength, length(Lights[l].Position - Pos));
+		}
+
+		float dt = MarchLength / float(MaxIterations);
+		float3 InvStep = mul(InvWorld, float4(dt * LightDir, 0)).xyz;
+		float3 InvPos = InvOrigin + InvStep;
+
+		float TotalDensity = Density0 * dt;
+
+		for (uint i = 1; i < MaxIterations; i++)
+		{
+			float Density = DensityScale * Volume.SampleLevel(LinearSampler, InvPos, 0);
 
-		TotalDensity += Density * dt;
+			TotalDensity += Density * dt;
 
-		Pos += dt * LightDir;
+			InvPos += InvStep;
+		}
+
+		Transmittance[l] = exp(-TotalDensity * Absorption);
 	}
-	
-	float Transmittance = exp(-TotalDensity * Absorption);
 
 	return (Transmittance);
 }
 
-float4x4 inverse(float4x4 m)
+uint
+MortonPart1By2(uint X)
 {
-    float n11 = m[0][0], n12 = m[1][0], n13 = m[2][0], n14 = m[3][0];
-    float n21 = m[0][1], n22 = m[1][1], n23 = m[2][1], n24 = m[3][1];
-    float n31 = m[0][2], n32 = m[1][2], n33 = m[2][2], n34 = m[3][2];
-    float n41 = m[0][3], n42 = m[1][3], n43 = m[2][3], n44 = m[3][3];
-
-    float t11 = n23 * n34 * n42 - n24 * n33 * n42 + n24 * n32 * n43 - n22 * n34 * n43 - n23 * n32 * n44 + n22 * n33 * n44;
-    float t12 = n14 * n33 * n42 - n13 * n34 * n42 - n14 * n32 * n43 + n12 * n34 * n43 + n13 * n32 * n44 - n12 * n33 * n44;
-    float t13 = n13 * n24 * n42 - n14 * n23 * n42 + n14 * n22 * n43 - n12 * n24 * n43 - n13 * n22 * n44 + n12 * n23 * n44;
-    float t14 = n14 * n23 * n32 - n13 * n24 * n32 - n14 * n22 * n33 + n12 * n24 * n33 + n13 * n22 * n34 - n12 * n23 * n34;
-
-    float det = n11 * t11 + n21 * t12 + n31 * t13 + n41 * t14;
-    float idet = 1.0f / det;
-
-    float4x4 ret;
-
-    ret[0][0] = t11 * idet;
-    ret[0][1] = (n24 * n33 * n41 - n23 * n34 * n41 - n24 * n31 * n43 + n21 * n34 * n43 + n23 * n31 * n44 - n21 * n33 * n44) * idet;
-    ret[0][2] = (n22 * n34 * n41 - n24 * n32 * n41 + n24 * n31 * n42 - n21 * n34 * n42 - n22 * n31 * n44 + n21 * n32 * n44) * idet;
-    ret[0][3] = (n23 * n32 * n41 - n22 * n33 * n41 - n23 * n31 * n42 + n21 * n33 * n42 + n22 * n31 * n43 - n21 * n32 * n43) * idet;
-
-    ret[1][0] = t12 * idet;
-    ret[1][1] = (n13 * n34 * n41 - n14 * n33 * n41 + n14 * n31 * n43 - n11 * n34 * n43 - n13 * n31 * n44 + n11 * n33 * n44) * idet;
-    ret[1][2] = (n14 * n32 * n41 - n12 * n34 * n41 - n14 * n31 * n42 + n11 * n34 * n42 + n12 * n31 * n44 - n11 * n32 * n44) * idet;
-    ret[1][3] = (n12 * n33 * n41 - n13 * n32 * n41 + n13 * n31 * n42 - n11 * n33 * n42 - n12 * n31 * n43 + n11 * n32 * n43) * idet;
-
-    ret[2][0] = t13 * idet;
-    ret[2][1] = (n14 * n23 * n41 - n13 * n24 * n41 - n14 * n21 * n43 + n11 * n24 * n43 + n13 * n21 * n44 - n11 * n23 * n44) * idet;
-    ret[2][2] = (n12 * n24 * n41 - n14 * n22 * n41 + n14 * n21 * n42 - n11 * n24 * n42 - n12 * n21 * n44 + n11 * n22 * n44) * idet;
-    ret[2][3] = (n13 * n22 * n41 - n12 * n23 * n41 - n13 * n21 * n42 + n11 * n23 * n42 + n12 * n21 * n43 - n11 * n22 * n43) * idet;
-
-    ret[3][0] = t14 * idet;
-    ret[3][1] = (n13 * n24 * n31 - n14 * n23 * n31 + n14 * n21 * n33 - n11 * n24 * n33 - n13 * n21 * n34 + n11 * n23 * n34) * idet;
-    ret[3][2] = (n14 * n22 * n31 - n12 * n24 * n31 - n14 * n21 * n32 + n11 * n24 * n32 + n12 * n21 * n34 - n11 * n22 * n34) * idet;
-    ret[3][3] = (n12 * n23 * n31 - n13 * n22 * n31 + n13 * n21 * n32 - n11 * n23 * n32 - n12 * n21 * n33 + n11 * n22 * n33) * idet;
-
-    return ret;
+	X &= 0x000003ff;
+	X = (X ^ (X << 16)) & 0xff0000ff;
+	X = (X ^ (X <<  8)) & 0x0300f00f;
+	X = (X ^ (X <<  4)) & 0x030c30c3;
+	X = (X ^ (X <<  2)) & 0x09249249;
+
+	return (X);
 }
 
+uint
+MortonEncode3(uint3 Coord)
+{
+	return (MortonPart1By2(Coord.x) | (MortonPart1By2(Coord.y) << 1) | (MortonPart1By2(Coord.z) << 2));
+}
+
+probe_index
+GridCoordToProbeIndex(grid_coord ProbeCoord)
+{
+	probe_index		Idx;
+
+
+	if (ProbeLayout == LAYOUT_MORTON)
+	{
+		Idx = MortonEncode3(ProbeCoord);
+	}
+	else if (ProbeLayout == LAYOUT_TILED)
+	{
+		uint3 Bricks = (uint3(GridDims) + 3) >> 2;
+		uint3 Brick = ProbeCoord >> 2;
+
+		Idx = (((Brick.z * Bricks.y + Brick.y) * Bricks.x + Brick.x) << 6) | MortonEncode3(ProbeCoord & 3);
+	}
+	else
+	{
+		Idx = (ProbeCoord.z * GridDims.x * GridDims.y) + (ProbeCoord.y * GridDims.x) + ProbeCoord.x;
+	}
+
+	return (Idx);
+}
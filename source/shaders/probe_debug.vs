@@ -6,7 +6,8 @@ struct vertex
 struct probe
 {
 	float3		Pos;
-	float		Transmittance;
+	float		_Pad0;
+	float4		Transmittance;
 };
 
 struct ps_in
@@ -15,6 +16,14 @@ struct ps_in
 	float		Transmittance : COLOR;
 };
 
+#define probe_index		uint
+#define grid_coord		uint3
+
+// Must match data_layout in volume.h
+#define LAYOUT_LINEAR	0
+#define LAYOUT_MORTON	1
+#define LAYOUT_TILED	2
+
 StructuredBuffer<vertex>		Vertices : register(t0);
 StructuredBuffer<probe>			Probes : register(t1);
 
@@ -30,12 +39,16 @@ cbuffer grid_params : register(b1)
 	int3		GridDims;
 	uint		ProbeCount;
 	float3		GridMin;
+	uint		ProbeLayout;
 	float3		GridMax;
 	float3		GridExtents;
 	float3		GridExtentsRcp;
 	float3		CellSize;
 };
 
+uint		MortonEncode3(uint3 Coord);
+probe_index	GridCoordToProbeIndex(grid_coord ProbeCoord);
+
 ps_in
 main(uint VertexID : SV_VertexID,
 	 uint InstanceID : SV_InstanceID)
@@ -43,19 +56,68 @@ main(uint VertexID : SV_VertexID,
 	ps_in			Output;
 	vertex			Input;
 	probe			Probe;
+	grid_coord		Coord;
 	float3			Scale = 0.5f * CellSize;
 
 
+	// Instances walk the grid linearly, the buffer may be stored in a
+	// different order
+	Coord.z = InstanceID / (GridDims.x * GridDims.y);
+	Coord.y = (InstanceID / GridDims.x) % GridDims.y;
+	Coord.x = InstanceID % GridDims.x;
+
 	Input = Vertices[VertexID];
-	Probe = Probes[InstanceID];
+	Probe = Probes[GridCoordToProbeIndex(Coord)];
 
 	Input.Pos *= Scale;
 	Output.Pos = float4(Input.Pos - (Scale * float3(0.5f, 0.5f, 0.5f) - Probe.Pos), 1.0f);
 
 	Output.Pos = mul(View, Output.Pos);
 	Output.Pos = mul(Proj, Output.Pos);
-	Output.Transmittance = Probe.Transmittance;
+	Output.Transmittance = Probe.Transmittance.x;		// key light
 
 	return (Output);
 }
 
+uint
+MortonPart1By2(uint X)
+{
+	X &= 0x000003ff;
+	X = (X ^ (X << 16)) & 0xff0000ff;
+	X = (X ^ (X <<  8)) & 0x0300f00f;
+	X = (X ^ (X <<  4)) & 0x030c30c3;
+	X = (X ^ (X <<  2)) & 0x09249249;
+
+	return (X);
+}
+
+uint
+MortonEncode3(uint3 Coord)
+{
+	return (MortonPart1By2(Coord.x) | (MortonPart1By2(Coord.y) << 1) | (MortonPart1By2(Coord.z) << 2));
+}
+
+probe_index
+GridCoordToProbeIndex(grid_coord ProbeCoord)
+{
+	probe_index		Idx;
+
+
+	if (ProbeLayout == LAYOUT_MORTON)
+	{
+		Idx = MortonEncode3(ProbeCoord);
+	}
+	else if (ProbeLayout == LAYOUT_TILED)
+	{
+		uint3 Bricks = (uint3(GridDims) + 3) >> 2;
+		uint3 Brick = ProbeCoord >> 2;
+
+		Idx = (((Brick.z * Bricks.y + Brick.y) * Bricks.x + Brick.x) << 6) | MortonEncode3(ProbeCoord & 3);
+	}
+	else
+	{
+		Idx = (ProbeCoord.z * GridDims.x * GridDims.y) + (ProbeCoord.y * GridDims.x) + ProbeCoord.x;
+	}
+
+	return (Idx);
+}